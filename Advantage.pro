@@ -215,6 +215,9 @@ HEADERS += src/qt/bitcoingui.h \
     src/qt/editaddressdialog.h \
     src/qt/bitcoinaddressvalidator.h \
     src/alert.h \
+    src/blockcache.h \
+    src/blockfile.h \
+    src/blockfilter.h \
     src/allocators.h \
     src/addrman.h \
     src/base58.h \
@@ -241,7 +244,9 @@ HEADERS += src/qt/bitcoingui.h \
     src/pubkey.h \
     src/db.h \
     src/txdb.h \
+    src/coins.h \
     src/txmempool.h \
+    src/orphanpool.h \
     src/walletdb.h \
     src/script.h \
     src/scrypt.h \
@@ -344,12 +349,17 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/qt/editaddressdialog.cpp \
     src/qt/bitcoinaddressvalidator.cpp \
     src/alert.cpp \
+    src/blockcache.cpp \
+    src/blockfile.cpp \
+    src/blockfilter.cpp \
     src/allocators.cpp \
     src/base58.cpp \
     src/chainfunctions.cpp \
     src/version.cpp \
     src/sync.cpp \
+    src/coins.cpp \
     src/txmempool.cpp \
+    src/orphanpool.cpp \
     src/util.cpp \
     src/hash.cpp \
     src/netbase.cpp \
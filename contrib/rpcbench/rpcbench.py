@@ -0,0 +1,126 @@
+#!/usr/bin/python
+#
+# rpcbench.py:  Measure JSON-RPC throughput at increasing client concurrency.
+#
+# Copyright (c) 2018 The Advantage developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#
+
+import json
+import base64
+import sys
+import threading
+import time
+
+try:
+	import httplib
+except ImportError:
+	import http.client as httplib
+
+settings = {}
+
+class BitcoinRPC:
+	OBJID = 1
+
+	def __init__(self, host, port, username, password):
+		authpair = "%s:%s" % (username, password)
+		self.authhdr = "Basic %s" % (base64.b64encode(authpair.encode('utf-8')).decode('ascii'))
+		self.conn = httplib.HTTPConnection(host, port, timeout=30)
+	def rpc(self, method, params=None):
+		self.OBJID += 1
+		obj = { 'version' : '1.1',
+			'method' : method,
+			'params' : params or [],
+			'id' : self.OBJID }
+		self.conn.request('POST', '/', json.dumps(obj),
+			{ 'Authorization' : self.authhdr,
+			  'Content-type' : 'application/json' })
+		resp = self.conn.getresponse()
+		body = resp.read()
+		resp_obj = json.loads(body)
+		if resp_obj.get('error') is not None:
+			raise RuntimeError(resp_obj['error'])
+		return resp_obj['result']
+
+# Explorer-style mix of read-only queries; getblock/getrawtransaction
+# targets are drawn from the last 'depth' blocks.
+def make_workload(rpc, depth):
+	height = rpc.rpc('getblockcount')
+	calls = [ ('getblockcount', []), ('getbestblockhash', []),
+		  ('getinfo', []), ('getrawmempool', []) ]
+	for h in range(max(0, height - depth), height + 1):
+		blockhash = rpc.rpc('getblockhash', [h])
+		calls.append(('getblockhash', [h]))
+		calls.append(('getblock', [blockhash]))
+		block = rpc.rpc('getblock', [blockhash])
+		for txid in block['tx'][:2]:
+			calls.append(('getrawtransaction', [txid, 1]))
+	return calls
+
+def client(calls, offset, deadline, results):
+	rpc = BitcoinRPC(settings['host'], settings['port'],
+			 settings['rpcuser'], settings['rpcpassword'])
+	n = 0
+	errors = 0
+	i = offset
+	while time.time() < deadline:
+		method, params = calls[i % len(calls)]
+		try:
+			rpc.rpc(method, params)
+			n += 1
+		except Exception:
+			errors += 1
+			rpc = BitcoinRPC(settings['host'], settings['port'],
+					 settings['rpcuser'], settings['rpcpassword'])
+		i += 1
+	results.append((n, errors))
+
+def run(calls, nclients, seconds):
+	results = []
+	deadline = time.time() + seconds
+	threads = [ threading.Thread(target=client, args=(calls, i * 7, deadline, results))
+		    for i in range(nclients) ]
+	start = time.time()
+	for t in threads:
+		t.start()
+	for t in threads:
+		t.join()
+	elapsed = time.time() - start
+	total = sum(r[0] for r in results)
+	errors = sum(r[1] for r in results)
+	return total / elapsed, errors
+
+if __name__ == '__main__':
+	if len(sys.argv) != 2:
+		print("Usage: rpcbench.py CONFIG-FILE")
+		sys.exit(1)
+
+	f = open(sys.argv[1])
+	for line in f:
+		# skip comment lines
+		if line.startswith('#'):
+			continue
+		m = line.strip().split('=', 1)
+		if len(m) != 2:
+			continue
+		settings[m[0].strip()] = m[1].strip()
+	f.close()
+
+	settings.setdefault('host', '127.0.0.1')
+	settings['port'] = int(settings.get('port', 53211))
+	settings['seconds'] = int(settings.get('seconds', 10))
+	settings['depth'] = int(settings.get('depth', 100))
+	clients = [int(c) for c in settings.get('clients', '1,2,4,8,16,32,64').split(',')]
+	if 'rpcuser' not in settings or 'rpcpassword' not in settings:
+		print("Missing username and/or password in cfg file")
+		sys.exit(1)
+
+	rpc = BitcoinRPC(settings['host'], settings['port'],
+			 settings['rpcuser'], settings['rpcpassword'])
+	calls = make_workload(rpc, settings['depth'])
+	print("workload: %d distinct calls, %ds per step" % (len(calls), settings['seconds']))
+	print("%8s %12s %8s" % ("clients", "requests/s", "errors"))
+	for n in clients:
+		rate, errors = run(calls, n, settings['seconds'])
+		print("%8d %12.1f %8d" % (n, rate, errors))
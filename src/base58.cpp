@@ -8,10 +8,12 @@
 #include "hash.h"
 #include "uint256.h"
 #include "chainfunctions.h"
+#include "sync.h"
 
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
+#include <map>
 #include <vector>
 #include <string>
 #include <boost/variant/apply_visitor.hpp>
@@ -20,12 +22,32 @@
 /* All alphanumeric characters except for "0", "I", "O", and "l" */
 static const char* pszBase58 = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
 
+/* Digit value of every input byte, -1 for bytes outside the alphabet */
+static const int8_t mapBase58[256] = {
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1, 0, 1, 2, 3, 4, 5, 6,  7, 8,-1,-1,-1,-1,-1,-1,
+    -1, 9,10,11,12,13,14,15, 16,-1,17,18,19,20,21,-1,
+    22,23,24,25,26,27,28,29, 30,31,32,-1,-1,-1,-1,-1,
+    -1,33,34,35,36,37,38,39, 40,41,42,43,-1,44,45,46,
+    47,48,49,50,51,52,53,54, 55,56,57,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+};
+
+/* Upper bound of the encodings the stack buffers below are sized for; the
+ * largest thing we encode is a stealth address of a few hundred bytes */
+static const size_t BASE58_STACK_SIZE = 512;
+
 bool DecodeBase58(const char* psz, std::vector<unsigned char>& vchRet) {
-    CAutoBN_CTX pctx;
     vchRet.clear();
-    CBigNum bn58 = 58;
-    CBigNum bn = 0;
-    CBigNum bnChar;
     // Skip leading spaces.
     while (*psz && isspace(*psz))
         psz++;
@@ -35,56 +57,34 @@ bool DecodeBase58(const char* psz, std::vector<unsigned char>& vchRet) {
         zeroes++;
         psz++;
     }
-    // Convert big endian string to bignum
-    for (const char* p = psz; *p; p++)
-    {
-        const char* p1 = strchr(pszBase58, *p);
-        if (p1 == NULL)
-        {
-            while (isspace(*p))
-                p++;
-            if (*p != '\0')
-                return false;
-            break;
-        }
-        bnChar.setulong(p1 - pszBase58);
-        if (!BN_mul(&bn, &bn, &bn58, pctx))
-            throw bignum_error("DecodeBase58 : BN_mul failed");
-        bn += bnChar;
-    }
-
-     // Get bignum as little endian data
-    std::vector<unsigned char> vchTmp = bn.getvch();
-
-    // Trim off sign byte if present
-    if (vchTmp.size() >= 2 && vchTmp.end()[-1] == 0 && vchTmp.end()[-2] >= 0x80)
-        vchTmp.erase(vchTmp.end()-1);
-
-    // Restore leading zeros
-    int nLeadingZeros = 0;
-    for (const char* p = psz; *p == pszBase58[0]; p++)
-        nLeadingZeros++;
-    vchRet.assign(nLeadingZeros + vchTmp.size(), 0);
-
-    // Convert little endian data to big endian
-    reverse_copy(vchTmp.begin(), vchTmp.end(), vchRet.end() - vchTmp.size());
-    return true;
     // Allocate enough space in big-endian base256 representation.
-    std::vector<unsigned char> b256(strlen(psz) * 733 / 1000 + 1); // log(58) / log(256), rounded up.
+    size_t size = strlen(psz) * 733 / 1000 + 1; // log(58) / log(256), rounded up.
+    unsigned char b256Stack[BASE58_STACK_SIZE];
+    std::vector<unsigned char> b256Heap;
+    unsigned char* b256 = b256Stack;
+    if (size > BASE58_STACK_SIZE) {
+        b256Heap.resize(size);
+        b256 = &b256Heap[0];
+    }
+    memset(b256, 0, size);
+    // Number of trailing bytes of b256 in use; the rest are still zero.
+    size_t length = 0;
     // Process the characters.
     while (*psz && !isspace(*psz)) {
         // Decode base58 character
-        const char *ch = strchr(pszBase58, *psz);
-        if (ch == NULL)
+        int carry = mapBase58[(unsigned char)*psz];
+        if (carry == -1)
             return false;
         // Apply "b256 = b256 * 58 + ch".
-        int carry = ch - pszBase58;
-        for (std::vector<unsigned char>::reverse_iterator it = b256.rbegin(); it != b256.rend(); it++) {
+        size_t i = 0;
+        for (unsigned char* it = b256 + size; (carry != 0 || i < length) && it != b256; i++) {
+            --it;
             carry += 58 * (*it);
             *it = carry % 256;
             carry /= 256;
         }
         assert(carry == 0);
+        length = i;
         psz++;
     }
     // Skip trailing spaces.
@@ -93,14 +93,13 @@ bool DecodeBase58(const char* psz, std::vector<unsigned char>& vchRet) {
     if (*psz != 0)
         return false;
     // Skip leading zeroes in b256.
-    std::vector<unsigned char>::iterator it = b256.begin();
-    while (it != b256.end() && *it == 0)
+    const unsigned char* it = b256 + (size - length);
+    while (it != b256 + size && *it == 0)
         it++;
     // Copy result into output vector.
-    vchRet.reserve(zeroes + (b256.end() - it));
+    vchRet.reserve(zeroes + (b256 + size - it));
     vchRet.assign(zeroes, 0x00);
-    while (it != b256.end())
-      vchRet.push_back(*(it++));
+    vchRet.insert(vchRet.end(), it, (const unsigned char*)b256 + size);
     return true;
 }
 
@@ -112,33 +111,48 @@ std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
         zeroes++;
     }
     // Allocate enough space in big-endian base58 representation.
-    std::vector<unsigned char> b58((pend - pbegin) * 138 / 100 + 1); // log(256) / log(58), rounded up.
+    size_t size = (pend - pbegin) * 138 / 100 + 1; // log(256) / log(58), rounded up.
+    unsigned char b58Stack[BASE58_STACK_SIZE];
+    std::vector<unsigned char> b58Heap;
+    unsigned char* b58 = b58Stack;
+    if (size > BASE58_STACK_SIZE) {
+        b58Heap.resize(size);
+        b58 = &b58Heap[0];
+    }
+    memset(b58, 0, size);
+    // Number of trailing digits of b58 in use; the rest are still zero.
+    size_t length = 0;
     // Process the bytes.
     while (pbegin != pend) {
         int carry = *pbegin;
         // Apply "b58 = b58 * 256 + ch".
-        for (std::vector<unsigned char>::reverse_iterator it = b58.rbegin(); it != b58.rend(); it++) {
+        size_t i = 0;
+        for (unsigned char* it = b58 + size; (carry != 0 || i < length) && it != b58; i++) {
+            --it;
             carry += 256 * (*it);
             *it = carry % 58;
             carry /= 58;
         }
         assert(carry == 0);
+        length = i;
         pbegin++;
     }
     // Skip leading zeroes in base58 result.
-    std::vector<unsigned char>::iterator it = b58.begin();
-    while (it != b58.end() && *it == 0)
+    const unsigned char* it = b58 + (size - length);
+    while (it != b58 + size && *it == 0)
         it++;
     // Translate the result into a string.
     std::string str;
-    str.reserve(zeroes + (b58.end() - it));
+    str.reserve(zeroes + (b58 + size - it));
     str.assign(zeroes, '1');
-    while (it != b58.end())
+    while (it != b58 + size)
         str += pszBase58[*(it++)];
     return str;
 }
 
 std::string EncodeBase58(const std::vector<unsigned char>& vch) {
+    if (vch.empty())
+        return std::string();
     return EncodeBase58(&vch[0], &vch[0] + vch.size());
 }
 
@@ -148,7 +162,9 @@ bool DecodeBase58(const std::string& str, std::vector<unsigned char>& vchRet) {
 
 std::string EncodeBase58Check(const std::vector<unsigned char>& vchIn) {
     // add 4-byte hash check to the end
-    std::vector<unsigned char> vch(vchIn);
+    std::vector<unsigned char> vch;
+    vch.reserve(vchIn.size() + 4);
+    vch.assign(vchIn.begin(), vchIn.end());
     uint256 hash = Hash(vch.begin(), vch.end());
     vch.insert(vch.end(), (unsigned char*)&hash, (unsigned char*)&hash + 4);
     return EncodeBase58(vch);
@@ -213,7 +229,9 @@ bool CBase58Data::SetString(const std::string& str) {
 }
 
 std::string CBase58Data::ToString() const {
-    std::vector<unsigned char> vch = vchVersion;
+    std::vector<unsigned char> vch;
+    vch.reserve(vchVersion.size() + vchData.size());
+    vch.assign(vchVersion.begin(), vchVersion.end());
     vch.insert(vch.end(), vchData.begin(), vchData.end());
     return EncodeBase58Check(vch);
 }
@@ -265,6 +283,62 @@ bool CAdvantagecoinAddress::Set(const CTxDestination &dest) {
     return boost::apply_visitor(CAdvantagecoinAddressVisitor(this), dest);
 }
 
+/* Recently rendered addresses, keyed by version and payload. Lookups
+ * promote entries out of the older generation; when the current one is full
+ * the older one is dropped, which keeps the set bounded while the addresses
+ * a wallet keeps showing stay in it. */
+static const size_t ADDRESS_CACHE_GENERATION = 4096;
+static CCriticalSection cs_mapAddressCache;
+static std::map<std::vector<unsigned char>, std::string> mapAddressCache[2];
+static uint64_t nAddressCacheHits = 0;
+static uint64_t nAddressCacheMisses = 0;
+
+std::string CAdvantagecoinAddress::ToString() const {
+    std::vector<unsigned char> vchKey;
+    vchKey.reserve(vchVersion.size() + vchData.size());
+    vchKey.assign(vchVersion.begin(), vchVersion.end());
+    vchKey.insert(vchKey.end(), vchData.begin(), vchData.end());
+
+    {
+        LOCK(cs_mapAddressCache);
+        std::map<std::vector<unsigned char>, std::string>::iterator mi = mapAddressCache[0].find(vchKey);
+        if (mi != mapAddressCache[0].end()) {
+            nAddressCacheHits++;
+            return mi->second;
+        }
+        mi = mapAddressCache[1].find(vchKey);
+        if (mi != mapAddressCache[1].end()) {
+            nAddressCacheHits++;
+            std::string str = mi->second;
+            mapAddressCache[1].erase(mi);
+            if (mapAddressCache[0].size() >= ADDRESS_CACHE_GENERATION) {
+                mapAddressCache[0].swap(mapAddressCache[1]);
+                mapAddressCache[0].clear();
+            }
+            mapAddressCache[0].insert(std::make_pair(vchKey, str));
+            return str;
+        }
+        nAddressCacheMisses++;
+    }
+
+    std::string str = EncodeBase58Check(vchKey);
+
+    LOCK(cs_mapAddressCache);
+    if (mapAddressCache[0].size() >= ADDRESS_CACHE_GENERATION) {
+        mapAddressCache[0].swap(mapAddressCache[1]);
+        mapAddressCache[0].clear();
+    }
+    mapAddressCache[0].insert(std::make_pair(vchKey, str));
+    return str;
+}
+
+void CAdvantagecoinAddress::GetCacheStats(size_t& nEntries, uint64_t& nHits, uint64_t& nMisses) {
+    LOCK(cs_mapAddressCache);
+    nEntries = mapAddressCache[0].size() + mapAddressCache[1].size();
+    nHits = nAddressCacheHits;
+    nMisses = nAddressCacheMisses;
+}
+
 bool CAdvantagecoinAddress::IsValid() const {
     bool fCorrectSize = vchData.size() == 20;
     bool fKnownVersion = vchVersion == Params().Base58Prefix(CChainParams::PUBKEY_ADDRESS) ||
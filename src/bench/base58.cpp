@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "base58.h"
+#include "key.h"
+
+#include <vector>
+
+using namespace std;
+
+// A 32 byte key, as for private key export
+static void Base58Encode(benchmark::State& state)
+{
+    vector<unsigned char> vch(32, 0x5a);
+    while (state.KeepRunning())
+        EncodeBase58(vch);
+}
+
+static void Base58Decode(benchmark::State& state)
+{
+    string str = EncodeBase58(vector<unsigned char>(32, 0x5a));
+    vector<unsigned char> vch;
+    while (state.KeepRunning())
+        DecodeBase58(str, vch);
+}
+
+// Addresses with their checksum, as shown and parsed everywhere; the
+// first one is encoded each time, the second one served by the cache
+static void Base58CheckEncodeAddressUncached(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID = key.GetPubKey().GetID();
+    while (state.KeepRunning())
+        CAdvantagecoinAddress(keyID).CBase58Data::ToString();
+}
+
+static void Base58CheckEncodeAddress(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID = key.GetPubKey().GetID();
+    while (state.KeepRunning())
+        CAdvantagecoinAddress(keyID).ToString();
+}
+
+static void Base58CheckDecodeAddress(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    string strAddress = CAdvantagecoinAddress(key.GetPubKey().GetID()).ToString();
+    while (state.KeepRunning())
+        CAdvantagecoinAddress(strAddress).IsValid();
+}
+
+BENCHMARK(Base58Encode, 200000);
+BENCHMARK(Base58Decode, 200000);
+BENCHMARK(Base58CheckEncodeAddressUncached, 100000);
+BENCHMARK(Base58CheckEncodeAddress, 100000);
+BENCHMARK(Base58CheckDecodeAddress, 100000);
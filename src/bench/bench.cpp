@@ -0,0 +1,135 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "json/json_spirit_writer_template.h"
+#include "mainfunctions.h"
+#include "util.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+using namespace json_spirit;
+
+namespace benchmark {
+
+bool State::KeepRunning()
+{
+    if (nCount == 0)
+        nStart = GetTimeMicros();
+    if (nCount < nIterations)
+    {
+        nCount++;
+        return true;
+    }
+    nElapsed = GetTimeMicros() - nStart;
+    return false;
+}
+
+BenchRunner::BenchmarkMap& BenchRunner::benchmarks()
+{
+    static BenchmarkMap benchmarks;
+    return benchmarks;
+}
+
+BenchRunner::BenchRunner(const string& strName, BenchFunction func, uint64_t nIterations)
+{
+    Bench bench;
+    bench.func = func;
+    bench.nIterations = nIterations;
+    benchmarks().insert(make_pair(strName, bench));
+}
+
+void BenchRunner::RunAll(const string& strFilter, int nRuns, int nWarmup, double dScale, bool fJSON)
+{
+    Array results;
+    if (!fJSON)
+        printf("%-28s %10s %6s %14s %14s %14s\n", "# benchmark", "iterations", "runs", "min (ns)", "median (ns)", "max (ns)");
+
+    BOOST_FOREACH(const BenchmarkMap::value_type& item, benchmarks())
+    {
+        if (item.first.find(strFilter) == string::npos)
+            continue;
+
+        uint64_t nIterations = max((uint64_t)1, (uint64_t)(item.second.nIterations * dScale));
+        for (int i = 0; i < nWarmup; i++)
+        {
+            State state(nIterations);
+            item.second.func(state);
+        }
+
+        // Nanoseconds per iteration of each run
+        vector<double> vTimes;
+        for (int i = 0; i < nRuns; i++)
+        {
+            State state(nIterations);
+            item.second.func(state);
+            vTimes.push_back(state.GetElapsed() * 1000.0 / nIterations);
+        }
+        sort(vTimes.begin(), vTimes.end());
+        double dMin = vTimes.front(), dMax = vTimes.back();
+        double dMedian = vTimes.size() % 2 ? vTimes[vTimes.size() / 2] : (vTimes[vTimes.size() / 2 - 1] + vTimes[vTimes.size() / 2]) / 2;
+
+        if (fJSON)
+        {
+            Object result;
+            result.push_back(Pair("name", item.first));
+            result.push_back(Pair("iterations", (boost::int64_t)nIterations));
+            result.push_back(Pair("runs", nRuns));
+            result.push_back(Pair("warmup", nWarmup));
+            result.push_back(Pair("min_ns", dMin));
+            result.push_back(Pair("median_ns", dMedian));
+            result.push_back(Pair("max_ns", dMax));
+            results.push_back(result);
+        }
+        else
+        {
+            printf("%-28s %10u %6d %14.1f %14.1f %14.1f\n", item.first.c_str(), (unsigned int)nIterations, nRuns, dMin, dMedian, dMax);
+            fflush(stdout);
+        }
+    }
+
+    if (fJSON)
+        printf("%s\n", write_string(Value(results), true).c_str());
+}
+
+CBlockIndex* BenchChain()
+{
+    const int nBlocks = 5000;
+    static CBlockIndex* pindexTip = NULL;
+    if (pindexTip)
+        return pindexTip;
+
+    LOCK(cs_main);
+    unsigned int nTime = GetTime() - nBlocks;
+    for (int nHeight = 0; nHeight < nBlocks; nHeight++)
+    {
+        uint256 hash = GetRandHash();
+        CBlockIndex* pindex = new CBlockIndex();
+        pindex->phashBlock = &mapBlockIndex.insert(make_pair(hash, pindex)).first->first;
+        pindex->pprev = pindexTip;
+        pindex->nHeight = nHeight;
+        pindex->nTime = nTime + nHeight;
+        pindex->nBits = 0x1e0fffff;
+        pindex->nNonce = GetRand(1 << 30);
+        pindex->nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        if (pindexTip)
+            pindexTip->pnext = pindex;
+        else
+            pindexGenesisBlock = pindex;
+        pindexTip = pindex;
+    }
+
+    pindexBest = pindexTip;
+    hashBestChain = pindexTip->GetBlockHash();
+    nBestHeight = pindexTip->nHeight;
+    return pindexTip;
+}
+
+} // namespace benchmark
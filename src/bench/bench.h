@@ -0,0 +1,82 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCREDIT_BENCH_BENCH_H
+#define BITCREDIT_BENCH_BENCH_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+class CBlockIndex;
+
+namespace benchmark {
+
+/**
+ * Handed to a benchmark, which does its setup and then loops while
+ * KeepRunning() is true. Only the loop is timed, so setup may be costly:
+ *
+ *     static void Base58Encode(benchmark::State& state)
+ *     {
+ *         std::vector<unsigned char> vch(32, 0x42);
+ *         while (state.KeepRunning())
+ *             EncodeBase58(vch);
+ *     }
+ *     BENCHMARK(Base58Encode, 100000);
+ */
+class State
+{
+private:
+    uint64_t nIterations;
+    uint64_t nCount;
+    int64_t nStart;
+    int64_t nElapsed;
+
+public:
+    State(uint64_t nIterationsIn) : nIterations(nIterationsIn), nCount(0), nStart(0), nElapsed(0) {}
+
+    bool KeepRunning();
+
+    uint64_t GetIterations() const { return nIterations; }
+    // Microseconds the loop took
+    int64_t GetElapsed() const { return nElapsed; }
+};
+
+typedef void (*BenchFunction)(State&);
+
+/** Registers a benchmark at static initialization, and runs them all */
+class BenchRunner
+{
+private:
+    struct Bench
+    {
+        BenchFunction func;
+        uint64_t nIterations;
+    };
+    typedef std::map<std::string, Bench> BenchmarkMap;
+    static BenchmarkMap& benchmarks();
+
+public:
+    BenchRunner(const std::string& strName, BenchFunction func, uint64_t nIterations);
+
+    /**
+     * Run the benchmarks whose name contains strFilter: nWarmup untimed runs,
+     * then nRuns timed ones of the registered iterations scaled by dScale.
+     * Prints min/median/max time per iteration as a table or as JSON.
+     */
+    static void RunAll(const std::string& strFilter, int nRuns, int nWarmup, double dScale, bool fJSON);
+};
+
+/**
+ * Synthetic best chain of 5000 blocks a second apart, with stake modifiers,
+ * for the code that walks the block index; deep enough for masternode
+ * scores, which look back 4095 blocks. Built on the first call.
+ */
+CBlockIndex* BenchChain();
+
+} // namespace benchmark
+
+#define BENCHMARK(n, iterations) static benchmark::BenchRunner bench_##n(#n, n, iterations);
+
+#endif
@@ -0,0 +1,49 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "chainfunctions.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-help"))
+    {
+        printf("Usage: bench_advantage [options]\n\n"
+               "  -filter=<str>    Only run the benchmarks whose name contains <str>\n"
+               "  -runs=<n>        Timed runs of each benchmark (default: 5)\n"
+               "  -warmup=<n>      Untimed runs before them (default: 1)\n"
+               "  -scale=<x>       Multiply the iterations of each run by <x> (default: 1.0)\n"
+               "  -json            Print the results as JSON\n"
+               "  -datadir=<dir>   Directory for the databases and debug.log (default: a new temporary one)\n");
+        return 0;
+    }
+
+    SelectParams(CChainParams::MAIN);
+    StartParallelWorkers();
+
+    // The database benchmarks write under the data directory, so keep them
+    // away from a real one
+    boost::filesystem::path pathTemp;
+    if (!mapArgs.count("-datadir"))
+    {
+        pathTemp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("bench_advantage_%%%%-%%%%");
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+    }
+
+    benchmark::BenchRunner::RunAll(GetArg("-filter", ""), std::max(1, (int)GetArg("-runs", 5)), std::max(0, (int)GetArg("-warmup", 1)),
+        atof(GetArg("-scale", "1.0").c_str()), GetBoolArg("-json", false));
+
+    StopParallelWorkers();
+    FlushDebugLog();
+    if (!pathTemp.empty())
+        boost::filesystem::remove_all(pathTemp);
+    return 0;
+}
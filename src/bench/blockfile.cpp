@@ -0,0 +1,120 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "blockcache.h"
+#include "blockfile.h"
+#include "mainfunctions.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+// Blocks written to the block files, and transactions in each
+static const int BLOCKFILE_BENCH_BLOCKS = 2000;
+static const int BLOCKFILE_BENCH_TRANSACTIONS = 20;
+
+// Where the synthetic blocks and their transactions were written
+struct CBlockFileBenchPos
+{
+    unsigned int nFile;
+    unsigned int nBlockPos;
+    vector<CDiskTxPos> vTxPos;
+};
+
+static const vector<CBlockFileBenchPos>& BenchBlockFiles()
+{
+    static vector<CBlockFileBenchPos> vPos;
+    if (!vPos.empty())
+        return vPos;
+
+    for (int n = 0; n < BLOCKFILE_BENCH_BLOCKS; n++)
+    {
+        CBlock block;
+        block.nTime = 1500000000 + n;
+        for (int i = 0; i < BLOCKFILE_BENCH_TRANSACTIONS; i++)
+        {
+            CTransaction tx;
+            tx.nTime = block.nTime;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+            tx.vin[0].scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+            tx.vout.resize(2);
+            for (int j = 0; j < 2; j++)
+            {
+                tx.vout[j].nValue = (i + j + 1) * CREDIT;
+                tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+            }
+            // A coinstake second, so reading the block checks no proof of work
+            if (i == 1)
+                tx.vout[0].SetEmpty();
+            block.vtx.push_back(tx);
+        }
+
+        CBlockFileBenchPos pos;
+        if (!block.WriteToDisk(pos.nFile, pos.nBlockPos))
+            throw runtime_error("BenchBlockFiles : WriteToDisk failed");
+        // As ConnectBlock indexes them
+        unsigned int nTxPos = pos.nBlockPos + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) - (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(block.vtx.size());
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        {
+            pos.vTxPos.push_back(CDiskTxPos(pos.nFile, pos.nBlockPos, nTxPos));
+            nTxPos += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        }
+        vPos.push_back(pos);
+    }
+    CommitBlockFile();
+    return vPos;
+}
+
+// An explorer looking up random transactions (getrawtransaction), with
+// the block cache out of the way so every lookup reads the file
+static void BlockFileReadTransaction(benchmark::State& state)
+{
+    const vector<CBlockFileBenchPos>& vPos = BenchBlockFiles();
+    blockcache.SetMaxUsage(0);
+    CTransaction tx;
+    while (state.KeepRunning())
+    {
+        const CBlockFileBenchPos& pos = vPos[GetRand(vPos.size())];
+        if (!tx.ReadFromDisk(pos.vTxPos[GetRand(pos.vTxPos.size())]))
+            throw runtime_error("BlockFileReadTransaction : ReadFromDisk failed");
+    }
+    blockcache.SetMaxUsage(DEFAULT_BLOCK_CACHE << 20);
+}
+
+// and the header of the block holding each, for its hash and depth
+static void BlockFileReadHeader(benchmark::State& state)
+{
+    const vector<CBlockFileBenchPos>& vPos = BenchBlockFiles();
+    blockcache.SetMaxUsage(0);
+    CBlock block;
+    while (state.KeepRunning())
+    {
+        const CBlockFileBenchPos& pos = vPos[GetRand(vPos.size())];
+        if (!block.ReadFromDisk(pos.nFile, pos.nBlockPos, false))
+            throw runtime_error("BlockFileReadHeader : ReadFromDisk failed");
+    }
+    blockcache.SetMaxUsage(DEFAULT_BLOCK_CACHE << 20);
+}
+
+// getblock
+static void BlockFileReadBlock(benchmark::State& state)
+{
+    const vector<CBlockFileBenchPos>& vPos = BenchBlockFiles();
+    blockcache.SetMaxUsage(0);
+    CBlock block;
+    while (state.KeepRunning())
+    {
+        const CBlockFileBenchPos& pos = vPos[GetRand(vPos.size())];
+        if (!block.ReadFromDisk(pos.nFile, pos.nBlockPos))
+            throw runtime_error("BlockFileReadBlock : ReadFromDisk failed");
+    }
+    blockcache.SetMaxUsage(DEFAULT_BLOCK_CACHE << 20);
+}
+
+BENCHMARK(BlockFileReadTransaction, 20000);
+BENCHMARK(BlockFileReadHeader, 20000);
+BENCHMARK(BlockFileReadBlock, 5000);
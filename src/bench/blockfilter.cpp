@@ -0,0 +1,115 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "blockfilter.h"
+#include "mainfunctions.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+// Blocks of the synthetic chain, of which one in 100 pays the wallet
+static const int BLOCKFILTER_BENCH_BLOCKS = 2000;
+
+static BlockFilterElement RandomElement()
+{
+    uint256 hash = GetRandHash();
+    CScript script = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(hash.begin(), hash.begin() + 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return BlockFilterElement(script.begin(), script.end());
+}
+
+// Serialized blocks of 50 transactions, as read from disk, with their
+// filters and the scripts of a wallet of 50 keys
+struct CBenchRescanChain
+{
+    vector<CDataStream> vBlocks;
+    vector<CBlockFilter> vFilters;
+    BlockFilterElements wallet;
+};
+
+static const CBenchRescanChain& BenchRescanChain()
+{
+    static CBenchRescanChain chain;
+    if (!chain.vBlocks.empty())
+        return chain;
+
+    for (int i = 0; i < 50; i++)
+        chain.wallet.insert(RandomElement());
+    for (int n = 0; n < BLOCKFILTER_BENCH_BLOCKS; n++)
+    {
+        CBlock block;
+        block.vtx.resize(50);
+        BOOST_FOREACH(CTransaction& tx, block.vtx)
+        {
+            tx.vin.resize(1);
+            tx.vin[0].prevout.hash = GetRandHash();
+            tx.vin[0].scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+            tx.vout.resize(2);
+            for (int i = 0; i < 2; i++)
+            {
+                BlockFilterElement element = RandomElement();
+                tx.vout[i].scriptPubKey = CScript(element.begin(), element.end());
+            }
+        }
+        if (n % 100 == 0)
+        {
+            const BlockFilterElement& element = *chain.wallet.begin();
+            block.vtx[n % 50].vout[0].scriptPubKey = CScript(element.begin(), element.end());
+        }
+
+        chain.vBlocks.push_back(CDataStream(SER_DISK, CLIENT_VERSION));
+        chain.vBlocks.back() << block;
+        BlockFilterElements elements;
+        GetBlockFilterElements(block, vector<CScript>(), elements);
+        chain.vFilters.push_back(CBlockFilter(block.GetHash(), elements));
+    }
+    return chain;
+}
+
+static int ScanBlock(const CBenchRescanChain& chain, int n)
+{
+    CDataStream ss(chain.vBlocks[n]);
+    CBlock block;
+    ss >> block;
+    int nFound = 0;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        BOOST_FOREACH(const CTxOut& txout, tx.vout)
+            if (chain.wallet.count(BlockFilterElement(txout.scriptPubKey.begin(), txout.scriptPubKey.end())))
+                nFound++;
+    return nFound;
+}
+
+// A rescan reading every block
+static void RescanReadAll(benchmark::State& state)
+{
+    const CBenchRescanChain& chain = BenchRescanChain();
+    while (state.KeepRunning())
+    {
+        int nFound = 0;
+        for (int n = 0; n < BLOCKFILTER_BENCH_BLOCKS; n++)
+            nFound += ScanBlock(chain, n);
+        if (nFound != BLOCKFILTER_BENCH_BLOCKS / 100)
+            throw runtime_error("RescanReadAll : wrong number of payments found");
+    }
+}
+
+// The same rescan reading only the blocks whose filter matches the wallet
+static void RescanFiltered(benchmark::State& state)
+{
+    const CBenchRescanChain& chain = BenchRescanChain();
+    while (state.KeepRunning())
+    {
+        int nFound = 0;
+        for (int n = 0; n < BLOCKFILTER_BENCH_BLOCKS; n++)
+            if (chain.vFilters[n].MatchAny(chain.wallet))
+                nFound += ScanBlock(chain, n);
+        if (nFound != BLOCKFILTER_BENCH_BLOCKS / 100)
+            throw runtime_error("RescanFiltered : wrong number of payments found");
+    }
+}
+
+BENCHMARK(RescanReadAll, 10);
+BENCHMARK(RescanFiltered, 10);
@@ -0,0 +1,80 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "mainfunctions.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+// Transactions in the synthetic large block
+static const int CHECKBLOCK_BENCH_TRANSACTIONS = 50000;
+
+static const CBlock& BenchLargeBlock()
+{
+    static CBlock block;
+    if (!block.vtx.empty())
+        return block;
+
+    block.nTime = 1500000100;
+    block.nBits = 0x1d00ffff;
+    CTransaction txCoinBase;
+    txCoinBase.nTime = 1500000000;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vin[0].scriptSig = CScript() << 1 << 2;
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].nValue = CREDIT;
+    txCoinBase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(txCoinBase);
+    for (int i = 1; i < CHECKBLOCK_BENCH_TRANSACTIONS; i++)
+    {
+        CTransaction tx;
+        tx.nTime = 1500000000;
+        tx.vin.resize(1 + i % 3);
+        for (unsigned int j = 0; j < tx.vin.size(); j++)
+        {
+            tx.vin[j].prevout = COutPoint(GetRandHash(), j);
+            tx.vin[j].scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+        }
+        tx.vout.resize(2);
+        for (int j = 0; j < 2; j++)
+        {
+            tx.vout[j].nValue = (i + j + 1) * CREDIT;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+    // As received from a peer
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        tx.MakeImmutable();
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+// The context-free checks of a large block, before any coin is looked up
+static void CheckBlockLarge(benchmark::State& state)
+{
+    const CBlock& block = BenchLargeBlock();
+    while (state.KeepRunning())
+    {
+        if (!block.CheckBlock(false, true, false))
+            throw runtime_error("CheckBlockLarge : CheckBlock failed");
+    }
+}
+
+// The merkle tree of transactions not hashed yet, as the miner builds it
+static void BuildMerkleTreeLarge(benchmark::State& state)
+{
+    // Copies are not immutable: their hashes are not cached
+    CBlock block;
+    block.vtx = BenchLargeBlock().vtx;
+    while (state.KeepRunning())
+        block.BuildMerkleTree();
+}
+
+BENCHMARK(CheckBlockLarge, 20);
+BENCHMARK(BuildMerkleTreeLarge, 20);
@@ -0,0 +1,177 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "blockcache.h"
+#include "blockfile.h"
+#include "coins.h"
+#include "kernel.h"
+#include "mainfunctions.h"
+#include "txdb.h"
+
+#include <limits>
+#include <stdexcept>
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+// Blocks of the chain the coins benchmarks replay, and transactions in each
+static const int COINS_BENCH_BLOCKS = 1000;
+static const int COINS_BENCH_TRANSACTIONS = 50;
+
+// A branch of its own, written to the block files and the tx index. Each
+// transaction spends an output of one in the block before and keeps its
+// last output unspent, for the kernel benchmarks to stake.
+struct CCoinsBenchChain
+{
+    CBlockIndex* pindexTip;
+    vector<COutPoint> vStakeOut;
+};
+
+static const CCoinsBenchChain& BenchCoinsChain()
+{
+    static CCoinsBenchChain chain;
+    if (chain.pindexTip)
+        return chain;
+
+    LOCK(cs_main);
+    CTxDB txdb("cr+");
+    txdb.TxnBegin();
+    CBlockIndex* pindexPrev = NULL;
+    vector<uint256> vPrevTx(COINS_BENCH_TRANSACTIONS);
+    unsigned int nTime = GetTime() - COINS_BENCH_BLOCKS * 64;
+    for (int nHeight = 0; nHeight < COINS_BENCH_BLOCKS; nHeight++)
+    {
+        CBlock block;
+        block.hashPrevBlock = pindexPrev ? pindexPrev->GetBlockHash() : 0;
+        block.nTime = nTime + nHeight * 64;
+        block.nBits = 0x1e0fffff;
+        for (int i = 0; i < COINS_BENCH_TRANSACTIONS; i++)
+        {
+            CTransaction tx;
+            tx.nTime = block.nTime;
+            tx.vin.resize(1);
+            if (i == 0)
+            {
+                tx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+                tx.vout.resize(1);
+                tx.vout[0].SetEmpty();
+                block.vtx.push_back(tx);
+                continue;
+            }
+
+            // A coinstake second, so reading the block checks no proof of
+            // work; its outputs come after the empty one
+            unsigned int nFirst = (i == 1 ? 1 : 0);
+            tx.vin[0].prevout = pindexPrev ? COutPoint(vPrevTx[i], nFirst) : COutPoint(GetRandHash(), 0);
+            tx.vin[0].scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+            tx.vout.resize(nFirst + 2);
+            for (unsigned int j = nFirst; j < tx.vout.size(); j++)
+            {
+                tx.vout[j].nValue = (i + j + 1) * CREDIT;
+                tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+            }
+            if (i == 1)
+                tx.vout[0].SetEmpty();
+            block.vtx.push_back(tx);
+        }
+        block.hashMerkleRoot = block.BuildMerkleTree();
+
+        unsigned int nFile, nBlockPos;
+        if (!block.WriteToDisk(nFile, nBlockPos))
+            throw runtime_error("BenchCoinsChain : WriteToDisk failed");
+        // As ConnectBlock indexes them
+        unsigned int nTxPos = nBlockPos + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) - (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(block.vtx.size());
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+        {
+            const CTransaction& tx = block.vtx[i];
+            uint256 hashTx = tx.GetHash();
+            txdb.UpdateTxIndex(hashTx, CTxIndex(CDiskTxPos(nFile, nBlockPos, nTxPos)));
+            nTxPos += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+            vPrevTx[i] = hashTx;
+            // The set leaves the contents of the first block out, as it does
+            // those of the genesis block
+            if (i > 0 && pindexPrev)
+                chain.vStakeOut.push_back(COutPoint(hashTx, tx.vout.size() - 1));
+        }
+
+        CBlockIndex* pindex = new CBlockIndex(nFile, nBlockPos, block);
+        pindex->phashBlock = &mapBlockIndex.insert(make_pair(block.GetHash(), pindex)).first->first;
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = nHeight;
+        pindex->nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        if (pindexPrev)
+            pindexPrev->pnext = pindex;
+        pindexPrev = pindex;
+    }
+    CommitBlockFile();
+    if (!txdb.TxnCommit())
+        throw runtime_error("BenchCoinsChain : TxnCommit failed");
+
+    chain.pindexTip = pindexPrev;
+    return chain;
+}
+
+// Rebuilding the unspent output set from the block files, as after a
+// reindex or a lost coins database: one iteration replays the whole chain
+// and writes the set out
+static void CoinsReplayChain(benchmark::State& state)
+{
+    const CCoinsBenchChain& chain = BenchCoinsChain();
+    blockcache.SetMaxUsage(0);
+    CTxDB txdb("r");
+    while (state.KeepRunning())
+    {
+        CCoinsCache coins(txdb.GetCoinsCacheSize());
+        if (!coins.SyncToTip(txdb, chain.pindexTip) || !coins.Flush())
+            throw runtime_error("CoinsReplayChain : replay failed");
+    }
+    blockcache.SetMaxUsage(DEFAULT_BLOCK_CACHE << 20);
+}
+
+// The staker checking the kernel of random outputs, which it finds in the
+// unspent output set when that is at the tip ...
+static void CoinsStakeKernelSet(benchmark::State& state)
+{
+    const CCoinsBenchChain& chain = BenchCoinsChain();
+    CTxDB txdb("r");
+    CCoinsCache coins(txdb.GetCoinsCacheSize());
+    if (!coins.SyncToTip(txdb, chain.pindexTip))
+        throw runtime_error("CoinsStakeKernelSet : SyncToTip failed");
+
+    CCoinsCache* pcoinsSaved = pcoinsTip;
+    pcoinsTip = &coins;
+    CCoin coin;
+    if (!GetStakeCoin(chain.pindexTip, chain.vStakeOut.back(), coin))
+        throw runtime_error("CoinsStakeKernelSet : GetStakeCoin failed");
+
+    unsigned int nTime = chain.pindexTip->nTime + nStakeMinAge;
+    int64_t nBlockTime;
+    while (state.KeepRunning())
+        CheckKernel(chain.pindexTip, chain.pindexTip->nBits, nTime, chain.vStakeOut[GetRand(chain.vStakeOut.size())], &nBlockTime);
+    pcoinsTip = pcoinsSaved;
+}
+
+// ... and in the tx index and block files when it is not
+static void CoinsStakeKernelTxIndex(benchmark::State& state)
+{
+    const CCoinsBenchChain& chain = BenchCoinsChain();
+    CCoinsCache* pcoinsSaved = pcoinsTip;
+    pcoinsTip = NULL;
+    CCoin coin;
+    if (!GetStakeCoin(chain.pindexTip, chain.vStakeOut.back(), coin))
+        throw runtime_error("CoinsStakeKernelTxIndex : GetStakeCoin failed");
+
+    unsigned int nTime = chain.pindexTip->nTime + nStakeMinAge;
+    int64_t nBlockTime;
+    while (state.KeepRunning())
+        CheckKernel(chain.pindexTip, chain.pindexTip->nBits, nTime, chain.vStakeOut[GetRand(chain.vStakeOut.size())], &nBlockTime);
+    pcoinsTip = pcoinsSaved;
+}
+
+BENCHMARK(CoinsReplayChain, 1);
+BENCHMARK(CoinsStakeKernelSet, 20000);
+BENCHMARK(CoinsStakeKernelTxIndex, 20000);
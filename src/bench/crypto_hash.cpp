@@ -0,0 +1,66 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "hash.h"
+#include "util.h"
+
+#include <vector>
+
+using namespace std;
+
+// Proof-of-work hash of a block header
+static void SkeinHeader(benchmark::State& state)
+{
+    vector<unsigned char> vch(80, 0x5a);
+    uint256 hash;
+    while (state.KeepRunning())
+    {
+        hash = HashSkein(vch.begin(), vch.end());
+        vch[76] = hash.Get64(0);
+    }
+}
+
+// Transaction and block hashes, OpenSSL's SHA-256 as Hash() uses
+static void SHA256DHeader(benchmark::State& state)
+{
+    vector<unsigned char> vch(80, 0x5a);
+    uint256 hash;
+    while (state.KeepRunning())
+    {
+        hash = Hash(vch.begin(), vch.end());
+        vch[76] = hash.Get64(0);
+    }
+}
+
+// A merkle tree node
+static void SHA256D64(benchmark::State& state)
+{
+    uint256 hash[2];
+    while (state.KeepRunning())
+        hash[0] = Hash(BEGIN(hash[0]), END(hash[1]));
+}
+
+// The built-in SHA-256 of CHash256 on a large transaction
+static void CHash256_1MB(benchmark::State& state)
+{
+    vector<unsigned char> vch(1000000, 0x5a);
+    unsigned char hash[CHash256::OUTPUT_SIZE];
+    while (state.KeepRunning())
+        CHash256().Write(&vch[0], vch.size()).Finalize(hash);
+}
+
+static void SHA256D1MB(benchmark::State& state)
+{
+    vector<unsigned char> vch(1000000, 0x5a);
+    while (state.KeepRunning())
+        Hash(vch.begin(), vch.end());
+}
+
+BENCHMARK(SkeinHeader, 200000);
+BENCHMARK(SHA256DHeader, 200000);
+BENCHMARK(SHA256D64, 200000);
+BENCHMARK(CHash256_1MB, 50);
+BENCHMARK(SHA256D1MB, 50);
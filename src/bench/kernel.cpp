@@ -0,0 +1,27 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "kernel.h"
+#include "mainfunctions.h"
+
+// One output tried at successive timestamps, as the staker searches
+static void StakeKernelHash(benchmark::State& state)
+{
+    CBlockIndex* pindexPrev = benchmark::BenchChain();
+
+    CTransaction txPrev;
+    txPrev.nTime = pindexPrev->nTime - nStakeMinAge - 1000;
+    txPrev.vout.resize(1);
+    txPrev.vout[0].nValue = 1000 * CREDIT;
+    COutPoint prevout(txPrev.GetHash(), 0);
+
+    uint256 hashProofOfStake, targetProofOfStake;
+    unsigned int nTimeTx = pindexPrev->nTime;
+    while (state.KeepRunning())
+        CheckStakeKernelHash(pindexPrev, pindexPrev->nBits, txPrev.nTime, txPrev, prevout, nTimeTx++, hashProofOfStake, targetProofOfStake);
+}
+
+BENCHMARK(StakeKernelHash, 100000);
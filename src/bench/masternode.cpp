@@ -0,0 +1,140 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "darksend.h"
+#include "key.h"
+#include "masternodeman.h"
+#include "util.h"
+
+using namespace std;
+
+// Masternodes the ranking benchmarks pick from
+static const int MASTERNODE_BENCH_COUNT = 500;
+
+// A list of enabled masternodes with random collaterals and keys
+static void SetupMasternodes()
+{
+    benchmark::BenchChain();
+    if (mnodeman.size() == MASTERNODE_BENCH_COUNT)
+        return;
+
+    for (int i = 0; i < MASTERNODE_BENCH_COUNT; i++)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        CTxIn vin(COutPoint(GetRandHash(), i % 4));
+        CService addr(strprintf("10.%d.%d.1", i >> 8, i & 255), 9999);
+        CMasternode mn(addr, vin, key.GetPubKey(), vector<unsigned char>(), GetAdjustedTime(), key.GetPubKey(), PROTOCOL_VERSION, CScript(), 0);
+        mn.unitTest = true; // the collateral is not in the unspent set
+        mn.lastTimeSeen = GetAdjustedTime();
+        mnodeman.Add(mn);
+    }
+}
+
+// Rank of one masternode, as asked for each masternode ping and vote
+static void MasternodeRank(benchmark::State& state)
+{
+    SetupMasternodes();
+    CTxIn vin = mnodeman.GetFullMasternodeVector()[MASTERNODE_BENCH_COUNT / 2].vin;
+
+    while (state.KeepRunning())
+        mnodeman.GetMasternodeRank(vin, nBestHeight, 0);
+}
+
+// Every masternode ranked, as for masternode list and payments
+static void MasternodeRanks(benchmark::State& state)
+{
+    SetupMasternodes();
+
+    while (state.KeepRunning())
+        mnodeman.GetMasternodeRanks(nBestHeight, 0);
+}
+
+// Signed announcements of MASTERNODE_BENCH_COUNT masternodes, as a list
+// sync hands them out
+static const vector<CMasternodeListEntry>& BenchListEntries()
+{
+    static vector<CMasternodeListEntry> vEntries;
+    if (!vEntries.empty())
+        return vEntries;
+
+    int64_t nNow = GetAdjustedTime();
+    for (int i = 0; i < MASTERNODE_BENCH_COUNT; i++)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        CMasternodeListEntry entry;
+        entry.vin = CTxIn(COutPoint(GetRandHash(), i % 4));
+        entry.addr = CService(strprintf("8.8.%d.%d", i >> 8, i & 255), 9999);
+        entry.pubkey = entry.pubkey2 = key.GetPubKey();
+        entry.sigTime = entry.lastTimeSeen = nNow - i;
+        entry.protocolVersion = PROTOCOL_VERSION;
+        entry.isOldNode = false;
+        string strError;
+        darkSendSigner.SignMessage(entry.GetSignatureMessage(), strError, entry.sig, key);
+        vEntries.push_back(entry);
+    }
+    return vEntries;
+}
+
+// A fresh node checking a whole list one signature at a time, as it does
+// for the dsee+ messages of a dseg answer
+static void MasternodeListVerifyEach(benchmark::State& state)
+{
+    const vector<CMasternodeListEntry>& vEntries = BenchListEntries();
+    while (state.KeepRunning())
+        BOOST_FOREACH(const CMasternodeListEntry& entry, vEntries)
+            entry.VerifySignature();
+}
+
+// The same list out of mnlist batches, checked on all cores
+static void MasternodeListVerifyBatch(benchmark::State& state)
+{
+    const vector<CMasternodeListEntry>& vEntries = BenchListEntries();
+    vector<char> vValid;
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < vEntries.size(); i += MASTERNODES_LIST_BATCH_SIZE)
+        {
+            vector<CMasternodeListEntry> vBatch(vEntries.begin() + i, vEntries.begin() + min((size_t)i + MASTERNODES_LIST_BATCH_SIZE, vEntries.size()));
+            CMasternodeMan::VerifyListEntries(vBatch, vValid);
+        }
+    }
+}
+
+// What the answer to an mnget costs the seed: the entries a node restarted
+// from an older list lacks
+static void MasternodeListDiff(benchmark::State& state)
+{
+    const vector<CMasternodeListEntry>& vEntries = BenchListEntries();
+    static CMasternodeMan seed;
+    if (seed.size() == 0)
+    {
+        BOOST_FOREACH(const CMasternodeListEntry& entry, vEntries)
+        {
+            CMasternode mn(entry.addr, entry.vin, entry.pubkey, entry.sig, entry.sigTime, entry.pubkey2, entry.protocolVersion, CScript(), 0);
+            mn.unitTest = true;
+            mn.lastTimeSeen = entry.lastTimeSeen;
+            seed.Add(mn);
+        }
+    }
+    vector<pair<COutPoint, int64_t> > vInv;
+    seed.GetListInventory(vInv);
+    vInv.resize(vInv.size() * 9 / 10);
+
+    vector<CMasternodeListEntry> vDiff;
+    while (state.KeepRunning())
+    {
+        if (seed.GetListDigest() != uint256(0))
+            seed.GetListDiff(vInv, vDiff);
+    }
+}
+
+BENCHMARK(MasternodeRank, 10);
+BENCHMARK(MasternodeRanks, 10);
+BENCHMARK(MasternodeListVerifyEach, 5);
+BENCHMARK(MasternodeListVerifyBatch, 5);
+BENCHMARK(MasternodeListDiff, 100);
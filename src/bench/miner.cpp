@@ -0,0 +1,82 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "mainfunctions.h"
+#include "miner.h"
+#include "txmempool.h"
+#include "wallet.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+// A pool of nTx independent transactions whose inputs were confirmed a
+// hundred blocks ago, the way AcceptToMemoryPool would have left them
+static void FillBenchMempool(int nTx)
+{
+    CBlockIndex* pindexTip = benchmark::BenchChain();
+    mempool.clear();
+    for (int i = 0; i < nTx; i++)
+    {
+        CTransaction tx;
+        tx.nTime = pindexTip->nTime - 60;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.hash = Hash(BEGIN(i), END(i));
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * CREDIT;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+        CMempoolInputs inputs;
+        inputs.vPrevOut.resize(1);
+        inputs.vPrevOut[0].txout.nValue = 1 * CREDIT + (1 + i % 100) * CENT;
+        inputs.vPrevOut[0].txout.scriptPubKey = CScript() << OP_TRUE;
+        inputs.vPrevOut[0].nHeight = pindexTip->nHeight - 100;
+        inputs.vPrevOut[0].fCoinBase = false;
+        inputs.nValueIn = inputs.vPrevOut[0].txout.nValue;
+        inputs.nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        inputs.nSigOps = GetLegacySigOpCount(tx);
+
+        mempool.addUnchecked(tx.GetHash(), tx, inputs);
+    }
+}
+
+// A block template, as the staker and getblocktemplate build it, out of a
+// pool of nTx transactions
+static void CreateNewBlockPool(benchmark::State& state, int nTx)
+{
+    FillBenchMempool(nTx);
+    CReserveKey reservekey(NULL);
+    while (state.KeepRunning())
+    {
+        int64_t nFees = 0;
+        CBlock* pblock = CreateNewBlock(reservekey, true, &nFees);
+        if (!pblock)
+            throw runtime_error("CreateNewBlockPool : CreateNewBlock failed");
+        delete pblock;
+    }
+    mempool.clear();
+}
+
+static void CreateNewBlock10k(benchmark::State& state)
+{
+    CreateNewBlockPool(state, 10000);
+}
+
+static void CreateNewBlock50k(benchmark::State& state)
+{
+    CreateNewBlockPool(state, 50000);
+}
+
+static void CreateNewBlock100k(benchmark::State& state)
+{
+    CreateNewBlockPool(state, 100000);
+}
+
+BENCHMARK(CreateNewBlock10k, 10);
+BENCHMARK(CreateNewBlock50k, 5);
+BENCHMARK(CreateNewBlock100k, 2);
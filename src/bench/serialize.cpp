@@ -0,0 +1,93 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "mainfunctions.h"
+
+using namespace std;
+
+// A block of about 1 MB: 4000 transactions of two signed inputs and two outputs
+static void LargeBlock(CBlock& block)
+{
+    block.vtx.resize(4000);
+    for (unsigned int n = 0; n < block.vtx.size(); n++)
+    {
+        CTransaction& tx = block.vtx[n];
+        tx.nTime = n;
+        tx.vin.resize(2);
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+        {
+            tx.vin[i].prevout = COutPoint(GetRandHash(), i);
+            tx.vin[i].scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+        }
+        tx.vout.resize(2);
+        for (unsigned int i = 0; i < tx.vout.size(); i++)
+        {
+            tx.vout[i].nValue = (i + 1) * CREDIT;
+            tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+    }
+    block.vchBlockSig.resize(72, 0x30);
+}
+
+static void SerializeLargeBlock(benchmark::State& state)
+{
+    CBlock block;
+    LargeBlock(block);
+
+    while (state.KeepRunning())
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << block;
+    }
+}
+
+static void DeserializeLargeBlock(benchmark::State& state)
+{
+    CBlock block;
+    LargeBlock(block);
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << block;
+
+    while (state.KeepRunning())
+    {
+        CDataStream ss(ssBlock);
+        CBlock blockRead;
+        ss >> blockRead;
+    }
+}
+
+// What a balance query pays for hashing: each transaction hashed once per output
+static void HashBlockTransactions(const CBlock& block)
+{
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        for (unsigned int i = 0; i < tx.vout.size(); i++)
+            tx.GetHash();
+}
+
+static void TxGetHashUncached(benchmark::State& state)
+{
+    CBlock block;
+    LargeBlock(block);
+
+    while (state.KeepRunning())
+        HashBlockTransactions(block);
+}
+
+static void TxGetHashCached(benchmark::State& state)
+{
+    CBlock block;
+    LargeBlock(block);
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        tx.MakeImmutable();
+
+    while (state.KeepRunning())
+        HashBlockTransactions(block);
+}
+
+BENCHMARK(SerializeLargeBlock, 50);
+BENCHMARK(DeserializeLargeBlock, 50);
+BENCHMARK(TxGetHashUncached, 20);
+BENCHMARK(TxGetHashCached, 20);
@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "base58.h"
+#include "init.h"
+#include "smessage.h"
+#include "wallet.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+// Address of a key in pwalletMain, to send the messages to
+static string SetupSecureMsgAddress()
+{
+    static string strAddress;
+    if (!strAddress.empty())
+        return strAddress;
+
+    if (!pwalletMain)
+    {
+        pwalletMain = new CWallet();
+        pwalletMain->SetMinVersion(FEATURE_LATEST); // compressed keys, as messages need
+    }
+    LOCK(pwalletMain->cs_wallet);
+    strAddress = CAdvantagecoinAddress(pwalletMain->GenerateNewKey().GetID()).ToString();
+    fSecMsgEnabled = true; // SecureMsgSetHash stops when it is not
+    return strAddress;
+}
+
+static string SecureMsgBenchText()
+{
+    string strMessage;
+    for (int i = 0; strMessage.size() < 1000; i++)
+        strMessage += strprintf("Secure message benchmark line %d. ", i);
+    return strMessage;
+}
+
+// ECDH, AES and HMAC of an anonymous message of 1000 characters
+static void SmsgEncrypt(benchmark::State& state)
+{
+    string strAddress = SetupSecureMsgAddress();
+    string strMessage = SecureMsgBenchText();
+
+    while (state.KeepRunning())
+    {
+        SecureMessage smsg;
+        if (SecureMsgEncrypt(smsg, "anon", strAddress, strMessage) != 0)
+            throw runtime_error("SmsgEncrypt : encrypt failed");
+    }
+}
+
+static void SmsgDecrypt(benchmark::State& state)
+{
+    string strAddress = SetupSecureMsgAddress();
+    SecureMessage smsg;
+    if (SecureMsgEncrypt(smsg, "anon", strAddress, SecureMsgBenchText()) != 0)
+        throw runtime_error("SmsgDecrypt : encrypt failed");
+
+    MessageData msg;
+    while (state.KeepRunning())
+        if (SecureMsgDecrypt(false, strAddress, smsg, msg) != 0)
+            throw runtime_error("SmsgDecrypt : decrypt failed");
+}
+
+// The proof of work a message needs before it is relayed, with the encryption
+// of a new message each time as a small part of it; its time varies a lot
+// with the nonce found, so take the median of several runs
+static void SmsgSetHash(benchmark::State& state)
+{
+    string strAddress = SetupSecureMsgAddress();
+    string strMessage = SecureMsgBenchText();
+
+    while (state.KeepRunning())
+    {
+        SecureMessage smsg;
+        SecureMsgEncrypt(smsg, "anon", strAddress, strMessage);
+        if (SecureMsgSetHash(&smsg.hash[0], smsg.pPayload, smsg.nPayload) != 0)
+            throw runtime_error("SmsgSetHash : no proof of work found");
+    }
+}
+
+// Checking the proof of work of a received message
+static void SmsgValidate(benchmark::State& state)
+{
+    string strAddress = SetupSecureMsgAddress();
+    SecureMessage smsg;
+    SecureMsgEncrypt(smsg, "anon", strAddress, SecureMsgBenchText());
+    SecureMsgSetHash(&smsg.hash[0], smsg.pPayload, smsg.nPayload);
+
+    while (state.KeepRunning())
+        if (SecureMsgValidate(&smsg.hash[0], smsg.pPayload, smsg.nPayload) != 0)
+            throw runtime_error("SmsgValidate : invalid message");
+}
+
+BENCHMARK(SmsgEncrypt, 500);
+BENCHMARK(SmsgDecrypt, 500);
+BENCHMARK(SmsgSetHash, 5);
+BENCHMARK(SmsgValidate, 10000);
@@ -0,0 +1,37 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "instantx.h"
+#include "spork.h"
+
+#include <vector>
+
+using namespace std;
+
+// The spork check alone, as done for every InstantX depth query
+static void SporkIsActive(benchmark::State& state)
+{
+    int nActive = 0;
+    while (state.KeepRunning())
+        nActive += IsSporkActive(SPORK_2_INSTANTX);
+}
+
+// The InstantX part of GetDepthInMainChain, for every transaction of a
+// 5000 transaction wallet
+static void SporkDepthInstantX(benchmark::State& state)
+{
+    vector<uint256> vHashes;
+    for (int i = 0; i < 5000; i++)
+        vHashes.push_back(GetRandHash());
+
+    int nSignatures = 0;
+    while (state.KeepRunning())
+        for (unsigned int i = 0; i < vHashes.size(); i++)
+            nSignatures += IsSporkActive(SPORK_2_INSTANTX) ? GetTransactionLockSignatures(vHashes[i]) : -3;
+}
+
+BENCHMARK(SporkIsActive, 1000000);
+BENCHMARK(SporkDepthInstantX, 100);
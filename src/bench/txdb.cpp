@@ -0,0 +1,93 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "coins.h"
+#include "mainfunctions.h"
+#include "txdb.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+// Entries in the tx index, and coins, the read benchmarks look up
+static const int TXDB_BENCH_ENTRIES = 20000;
+
+static uint256 TxDBBenchHash(int n)
+{
+    return Hash(BEGIN(n), END(n));
+}
+
+// Transaction index entries of a block of 1000 transactions, in one batch
+static void TxDBWriteTxIndex(benchmark::State& state)
+{
+    CTxDB txdb("cr+");
+    int n = 0;
+    while (state.KeepRunning())
+    {
+        txdb.TxnBegin();
+        for (int i = 0; i < 1000; i++, n++)
+            txdb.UpdateTxIndex(TxDBBenchHash(n % TXDB_BENCH_ENTRIES), CTxIndex(CDiskTxPos(1, n, n)));
+        if (!txdb.TxnCommit())
+            throw runtime_error("TxDBWriteTxIndex : TxnCommit failed");
+    }
+    txdb.Close();
+}
+
+static void TxDBReadTxIndex(benchmark::State& state)
+{
+    CTxDB txdb("cr+");
+    txdb.TxnBegin();
+    for (int n = 0; n < TXDB_BENCH_ENTRIES; n++)
+        txdb.UpdateTxIndex(TxDBBenchHash(n), CTxIndex(CDiskTxPos(1, n, n)));
+    txdb.TxnCommit();
+
+    CTxIndex txindex;
+    while (state.KeepRunning())
+        if (!txdb.ReadTxIndex(TxDBBenchHash(GetRand(TXDB_BENCH_ENTRIES)), txindex))
+            throw runtime_error("TxDBReadTxIndex : ReadTxIndex failed");
+    txdb.Close();
+}
+
+// Unspent outputs as they are flushed from the coins cache
+static void TxDBWriteCoins(benchmark::State& state)
+{
+    CTxDB txdb("cr+");
+    CCoin coin;
+    coin.txout.nValue = CREDIT;
+    coin.txout.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x01) << OP_EQUALVERIFY << OP_CHECKSIG;
+    int n = 0;
+    while (state.KeepRunning())
+    {
+        txdb.TxnBegin();
+        for (int i = 0; i < 1000; i++, n++)
+            txdb.WriteCoin(COutPoint(TxDBBenchHash(n % TXDB_BENCH_ENTRIES), 0), coin);
+        if (!txdb.TxnCommit())
+            throw runtime_error("TxDBWriteCoins : TxnCommit failed");
+    }
+    txdb.Close();
+}
+
+static void TxDBReadCoin(benchmark::State& state)
+{
+    CTxDB txdb("cr+");
+    CCoin coin;
+    coin.txout.nValue = CREDIT;
+    coin.txout.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x01) << OP_EQUALVERIFY << OP_CHECKSIG;
+    txdb.TxnBegin();
+    for (int n = 0; n < TXDB_BENCH_ENTRIES; n++)
+        txdb.WriteCoin(COutPoint(TxDBBenchHash(n), 0), coin);
+    txdb.TxnCommit();
+
+    while (state.KeepRunning())
+        if (!txdb.ReadCoin(COutPoint(TxDBBenchHash(GetRand(TXDB_BENCH_ENTRIES)), 0), coin))
+            throw runtime_error("TxDBReadCoin : ReadCoin failed");
+    txdb.Close();
+}
+
+BENCHMARK(TxDBWriteTxIndex, 20);
+BENCHMARK(TxDBReadTxIndex, 20000);
+BENCHMARK(TxDBWriteCoins, 20);
+BENCHMARK(TxDBReadCoin, 20000);
@@ -0,0 +1,153 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "key.h"
+#include "keystore.h"
+#include "mainfunctions.h"
+#include "script.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+// A transaction spending nInputs pay-to-pubkey-hash outputs of txFrom with key
+static void SpendingTransaction(const CKey& key, int nInputs, CTransaction& txFrom, CTransaction& txTo)
+{
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    txFrom.vout.resize(nInputs);
+    for (int i = 0; i < nInputs; i++)
+    {
+        txFrom.vout[i].nValue = CREDIT;
+        txFrom.vout[i].scriptPubKey = scriptPubKey;
+    }
+
+    txTo.vin.resize(nInputs);
+    for (int i = 0; i < nInputs; i++)
+        txTo.vin[i].prevout = COutPoint(txFrom.GetHash(), i);
+    txTo.vout.resize(1);
+    txTo.vout[0].nValue = nInputs * CREDIT;
+    txTo.vout[0].scriptPubKey = scriptPubKey;
+}
+
+// Hash of one input of a small transaction
+static void SignatureHashSmall(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CTransaction txFrom, txTo;
+    SpendingTransaction(key, 2, txFrom, txTo);
+
+    while (state.KeepRunning())
+        SignatureHash(txFrom.vout[0].scriptPubKey, txTo, 0, SIGHASH_ALL);
+}
+
+// Hashes of all inputs of a consolidation of 1000 outputs, sharing midstates
+static void SignatureHashLarge(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CTransaction txFrom, txTo;
+    SpendingTransaction(key, 1000, txFrom, txTo);
+
+    while (state.KeepRunning())
+    {
+        CSignatureHasher sighasher(txTo);
+        for (unsigned int i = 0; i < txTo.vin.size(); i++)
+            sighasher.SignatureHash(txFrom.vout[i].scriptPubKey, i, SIGHASH_ALL);
+    }
+}
+
+// The same hashes one input at a time, reserializing the transaction for each
+static void SignatureHashLargeEach(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CTransaction txFrom, txTo;
+    SpendingTransaction(key, 1000, txFrom, txTo);
+
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < txTo.vin.size(); i++)
+            SignatureHash(txFrom.vout[i].scriptPubKey, txTo, i, SIGHASH_ALL);
+    }
+}
+
+// Script and ECDSA check of a signed pay-to-pubkey-hash input
+static void VerifyP2PKH(benchmark::State& state, unsigned int flags)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CTransaction txFrom, txTo;
+    SpendingTransaction(key, 1, txFrom, txTo);
+    if (!SignSignature(keystore, txFrom, txTo, 0))
+        throw runtime_error("VerifyP2PKH : SignSignature failed");
+
+    while (state.KeepRunning())
+        VerifySignature(txFrom, txTo, 0, flags, 0);
+}
+
+// Bypassing the signature cache, as for a transaction seen the first time
+static void VerifySignatureP2PKH(benchmark::State& state)
+{
+    VerifyP2PKH(state, SCRIPT_VERIFY_NOCACHE);
+}
+
+// The same once the signature cache holds it, as for a block of transactions
+// that were in the memory pool
+static void VerifySignatureCached(benchmark::State& state)
+{
+    VerifyP2PKH(state, SCRIPT_VERIFY_NONE);
+}
+
+// The interpreter alone: a pay-to-script-hash hash lock, with no signature
+static void VerifyScriptHashLock(benchmark::State& state)
+{
+    valtype vchPreimage(32, 0x42);
+    uint256 hash;
+    SHA256(&vchPreimage[0], vchPreimage.size(), (unsigned char*)&hash);
+    CScript redeem = CScript() << OP_SHA256 << hash << OP_EQUAL;
+    CScript scriptPubKey = GetScriptForDestination(redeem.GetID());
+    CScript scriptSig = CScript() << vchPreimage << valtype(redeem.begin(), redeem.end());
+
+    CTransaction txTo;
+    txTo.vin.resize(1);
+    txTo.vout.resize(1);
+    while (state.KeepRunning())
+        if (!VerifyScript(scriptSig, scriptPubKey, txTo, 0, SCRIPT_VERIFY_NONE, 0))
+            throw runtime_error("VerifyScriptHashLock : script failed");
+}
+
+// Stack shuffling of pubkey-sized elements, as in the scripts of
+// masternode and multisig spends
+static void VerifyScriptStackOps(benchmark::State& state)
+{
+    CScript scriptSig;
+    for (int i = 0; i < 10; i++)
+        scriptSig << valtype(33, i);
+    // 10 operations a round, within the limit of 201
+    CScript scriptPubKey;
+    for (int i = 0; i < 19; i++)
+        scriptPubKey << OP_2DUP << OP_TOALTSTACK << OP_TOALTSTACK << OP_3 << OP_ROLL << OP_TUCK
+                     << OP_2DROP << OP_FROMALTSTACK << OP_FROMALTSTACK << OP_2SWAP << OP_DROP;
+    scriptPubKey << OP_DEPTH << OP_10 << OP_NUMEQUAL;
+
+    CTransaction txTo;
+    txTo.vin.resize(1);
+    txTo.vout.resize(1);
+    while (state.KeepRunning())
+        if (!VerifyScript(scriptSig, scriptPubKey, txTo, 0, SCRIPT_VERIFY_NONE, 0))
+            throw runtime_error("VerifyScriptStackOps : script failed");
+}
+
+BENCHMARK(SignatureHashSmall, 100000);
+BENCHMARK(SignatureHashLarge, 20);
+BENCHMARK(SignatureHashLargeEach, 5);
+BENCHMARK(VerifySignatureP2PKH, 2000);
+BENCHMARK(VerifySignatureCached, 100000);
+BENCHMARK(VerifyScriptHashLock, 200000);
+BENCHMARK(VerifyScriptStackOps, 20000);
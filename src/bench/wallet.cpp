@@ -0,0 +1,155 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "wallet.h"
+#include "walletdb.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+// Transactions paying the synthetic wallet, one per block
+static const int WALLET_BENCH_TRANSACTIONS = 2000;
+
+// A wallet of WALLET_BENCH_TRANSACTIONS confirmed transactions, each paying
+// one of its keys and someone else. Each transaction is alone in its block,
+// so it is the merkle root of the block and needs no merkle branch.
+static CWallet* BenchWallet()
+{
+    static CWallet* pwallet = NULL;
+    if (pwallet)
+        return pwallet;
+
+    CBlockIndex* pindex = benchmark::BenchChain();
+    pwallet = new CWallet();
+    pwallet->SetMinVersion(FEATURE_LATEST);
+    LOCK2(cs_main, pwallet->cs_wallet);
+
+    vector<CPubKey> vKeys;
+    for (int i = 0; i < 100; i++)
+        vKeys.push_back(pwallet->GenerateNewKey());
+
+    for (int n = 0; n < WALLET_BENCH_TRANSACTIONS && pindex->pprev; n++, pindex = pindex->pprev)
+    {
+        CTransaction tx;
+        tx.nTime = pindex->nTime;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.resize(2);
+        tx.vout[0].nValue = (n + 1) * CREDIT;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(vKeys[n % vKeys.size()].GetID());
+        tx.vout[1].nValue = CREDIT;
+        tx.vout[1].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x01) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+        CWalletTx wtx(pwallet, tx);
+        wtx.hashBlock = pindex->GetBlockHash();
+        wtx.nIndex = 0;
+        pindex->hashMerkleRoot = tx.GetHash();
+        pwallet->AddToWallet(wtx, true);
+    }
+    return pwallet;
+}
+
+// The coins coin selection picks from, for each send and stake attempt
+static void WalletAvailableCoins(benchmark::State& state)
+{
+    CWallet* pwallet = BenchWallet();
+    vector<COutput> vCoins;
+    while (state.KeepRunning())
+        pwallet->AvailableCoins(vCoins);
+}
+
+static CTransaction WalletBenchTx(int n)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(Hash(BEGIN(n), END(n)), 0);
+    tx.vin[0].scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = CREDIT;
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x01) << OP_EQUALVERIFY << OP_CHECKSIG;
+    tx.vout[1].nValue = 2 * CREDIT;
+    tx.vout[1].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x02) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return tx;
+}
+
+// Startup of a long-used wallet: 100000 transactions and 100 keys on disk
+static void WalletLoad(benchmark::State& state)
+{
+    static const string strFile = "bench_wallet_load.dat";
+    {
+        CDBBatch batch(strFile);
+        CWalletDB walletdb(strFile, "cr+");
+        for (int i = 0; i < 100000; i++)
+        {
+            CWalletTx wtx(NULL, WalletBenchTx(i));
+            wtx.nOrderPos = i;
+            walletdb.WriteTx(wtx.GetHash(), wtx);
+        }
+        for (int i = 0; i < 100; i++)
+        {
+            CKey key;
+            key.MakeNewKey(true);
+            walletdb.WriteKey(key.GetPubKey(), key.GetPrivKey(), CKeyMetadata(GetTime()));
+        }
+        walletdb.WriteOrderPosNext(100000);
+    }
+
+    while (state.KeepRunning())
+    {
+        CWallet wallet(strFile);
+        bool fFirstRun;
+        if (wallet.LoadWallet(fFirstRun) != DB_LOAD_OK)
+            throw runtime_error("WalletLoad : LoadWallet failed");
+    }
+}
+
+// The spent coins CommitTransaction rewrites for a send of 1000 inputs, one
+// WriteTx each through its own CWalletDB as CWalletTx::WriteToDisk does
+static void WalletWriteSpentCoins(benchmark::State& state, const string& strFile, bool fBatch)
+{
+    vector<CWalletTx> vwtx;
+    for (int i = 0; i < 1000; i++)
+        vwtx.push_back(CWalletTx(NULL, WalletBenchTx(i)));
+    {
+        CWalletDB walletdb(strFile, "cr+");
+    }
+
+    while (state.KeepRunning())
+    {
+        CDBBatch batch(fBatch ? strFile : "");
+        for (unsigned int i = 0; i < vwtx.size(); i++)
+            CWalletDB(strFile).WriteTx(vwtx[i].GetHash(), vwtx[i]);
+    }
+}
+
+static void WalletWriteTx(benchmark::State& state)
+{
+    WalletWriteSpentCoins(state, "bench_wallet_write.dat", false);
+}
+
+static void WalletWriteTxBatch(benchmark::State& state)
+{
+    WalletWriteSpentCoins(state, "bench_wallet_batch.dat", true);
+}
+
+// A -keypool=10000 refill of an empty pool
+static void WalletTopUpKeyPool(benchmark::State& state)
+{
+    int n = 0;
+    while (state.KeepRunning())
+    {
+        CWallet wallet(strprintf("bench_wallet_keypool_%d.dat", n++));
+        if (!wallet.TopUpKeyPool(10000))
+            throw runtime_error("WalletTopUpKeyPool : TopUpKeyPool failed");
+    }
+}
+
+BENCHMARK(WalletAvailableCoins, 100);
+BENCHMARK(WalletLoad, 1);
+BENCHMARK(WalletWriteTx, 1);
+BENCHMARK(WalletWriteTxBatch, 1);
+BENCHMARK(WalletTopUpKeyPool, 1);
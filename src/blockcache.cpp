@@ -0,0 +1,227 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+CBlockCache blockcache(DEFAULT_BLOCK_CACHE << 20);
+
+// The list node, the position and hash index nodes and the shared_ptr
+// control block of an entry, besides the entry itself
+static const size_t ENTRY_NODES = 16 * sizeof(void*) + sizeof(CDiskTxPos) + sizeof(uint256);
+
+size_t TransactionUsage(const CTransaction& tx)
+{
+    size_t nUsage = sizeof(CTransaction) + tx.vin.capacity() * sizeof(CTxIn) + tx.vout.capacity() * sizeof(CTxOut);
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        nUsage += txin.scriptSig.allocated_memory();
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        nUsage += txout.scriptPubKey.allocated_memory();
+    return nUsage;
+}
+
+size_t BlockUsage(const CBlock& block)
+{
+    size_t nUsage = sizeof(CBlock) + block.vchBlockSig.capacity() + (block.vtx.capacity() - block.vtx.size()) * sizeof(CTransaction);
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        nUsage += TransactionUsage(tx);
+    return nUsage;
+}
+
+CBlockCache::CBlockCache(size_t nMaxUsageIn) : nUsage(0), nMaxUsage(nMaxUsageIn), nHeaders(0), nTransactions(0),
+                                               nHits(0), nMisses(0), nEvicted(0), nInvalidated(0), nEpoch(0)
+{
+}
+
+void CBlockCache::Insert(CEntry entry)
+{
+    CPosMap::iterator mi = mapPos.find(entry.pos);
+    if (mi != mapPos.end())
+        Erase(mi->second);
+    entry.nUsage += sizeof(CEntry) + ENTRY_NODES;
+    if (entry.nUsage > nMaxUsage)
+        return;
+
+    CEntryList::iterator it = listEntries.insert(listEntries.begin(), entry);
+    mapPos.insert(make_pair(entry.pos, it));
+    if (entry.ptx && entry.hashBlock != 0)
+        mapTxHash[entry.ptx->GetHash()] = it;
+    if (entry.ptx)
+        nTransactions++;
+    else if (entry.pblock->vtx.empty())
+        nHeaders++;
+    nUsage += entry.nUsage;
+    Trim();
+}
+
+void CBlockCache::Erase(CEntryList::iterator it)
+{
+    if (it->ptx && it->hashBlock != 0)
+    {
+        map<uint256, CEntryList::iterator>::iterator mi = mapTxHash.find(it->ptx->GetHash());
+        if (mi != mapTxHash.end() && mi->second == it)
+            mapTxHash.erase(mi);
+    }
+    if (it->ptx)
+        nTransactions--;
+    else if (it->pblock->vtx.empty())
+        nHeaders--;
+    nUsage -= it->nUsage;
+    mapPos.erase(it->pos);
+    listEntries.erase(it);
+}
+
+void CBlockCache::Trim()
+{
+    while (nUsage > nMaxUsage && !listEntries.empty())
+    {
+        Erase(--listEntries.end());
+        nEvicted++;
+    }
+}
+
+void CBlockCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    Trim();
+}
+
+bool CBlockCache::GetBlock(unsigned int nFile, unsigned int nBlockPos, bool fHeaderOnly, CBlockRef& pblockRet)
+{
+    LOCK(cs);
+    CPosMap::iterator mi = mapPos.find(CDiskTxPos(nFile, nBlockPos, 0));
+    if (mi == mapPos.end() || (!fHeaderOnly && mi->second->pblock->vtx.empty()))
+    {
+        nMisses++;
+        return false;
+    }
+    nHits++;
+    listEntries.splice(listEntries.begin(), listEntries, mi->second);
+    pblockRet = mi->second->pblock;
+    return true;
+}
+
+void CBlockCache::AddBlock(unsigned int nFile, unsigned int nBlockPos, const CBlockRef& pblock)
+{
+    CEntry entry;
+    entry.pos = CDiskTxPos(nFile, nBlockPos, 0);
+    entry.pblock = pblock;
+    entry.nUsage = BlockUsage(*pblock);
+
+    LOCK(cs);
+    // A header does not replace the full block
+    CPosMap::iterator mi = mapPos.find(entry.pos);
+    if (mi != mapPos.end() && pblock->vtx.empty() && !mi->second->pblock->vtx.empty())
+        return;
+    Insert(entry);
+}
+
+bool CBlockCache::GetTransaction(const CDiskTxPos& pos, CTransactionRef& ptxRet)
+{
+    LOCK(cs);
+    CPosMap::iterator mi = mapPos.find(pos);
+    if (mi == mapPos.end())
+    {
+        nMisses++;
+        return false;
+    }
+    nHits++;
+    listEntries.splice(listEntries.begin(), listEntries, mi->second);
+    ptxRet = mi->second->ptx;
+    return true;
+}
+
+bool CBlockCache::GetTransaction(const uint256& hash, CTransactionRef& ptxRet, uint256& hashBlockRet)
+{
+    LOCK(cs);
+    map<uint256, CEntryList::iterator>::iterator mi = mapTxHash.find(hash);
+    if (mi == mapTxHash.end())
+    {
+        nMisses++;
+        return false;
+    }
+    nHits++;
+    listEntries.splice(listEntries.begin(), listEntries, mi->second);
+    ptxRet = mi->second->ptx;
+    hashBlockRet = mi->second->hashBlock;
+    return true;
+}
+
+void CBlockCache::AddTransaction(const CDiskTxPos& pos, const CTransactionRef& ptx, const uint256& hashBlock, uint64_t nEpochIn)
+{
+    CEntry entry;
+    entry.pos = pos;
+    entry.ptx = ptx;
+    entry.nUsage = TransactionUsage(*ptx);
+
+    LOCK(cs);
+    if (nEpochIn == nEpoch)
+        entry.hashBlock = hashBlock;
+    Insert(entry);
+}
+
+uint64_t CBlockCache::GetEpoch() const
+{
+    LOCK(cs);
+    return nEpoch;
+}
+
+void CBlockCache::EraseBlock(unsigned int nFile, unsigned int nBlockPos)
+{
+    LOCK(cs);
+    nEpoch++;
+    // The block sorts before its transactions, which all follow it in the file
+    CPosMap::iterator mi = mapPos.lower_bound(CDiskTxPos(nFile, nBlockPos, 0));
+    while (mi != mapPos.end() && mi->first.nFile == nFile && mi->first.nBlockPos == nBlockPos)
+    {
+        CEntryList::iterator it = mi->second;
+        mi++;
+        Erase(it);
+        nInvalidated++;
+    }
+}
+
+void CBlockCache::Clear()
+{
+    LOCK(cs);
+    listEntries.clear();
+    mapPos.clear();
+    mapTxHash.clear();
+    nUsage = 0;
+    nHeaders = 0;
+    nTransactions = 0;
+}
+
+void CBlockCache::GetStats(CBlockCacheStats& stats) const
+{
+    LOCK(cs);
+    stats.nBlocks = listEntries.size() - nHeaders - nTransactions;
+    stats.nHeaders = nHeaders;
+    stats.nTransactions = nTransactions;
+    stats.nUsage = nUsage;
+    stats.nMaxUsage = nMaxUsage;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nEvicted = nEvicted;
+    stats.nInvalidated = nInvalidated;
+}
+
+bool ReadBlockFromDisk(const CBlockIndex* pindex, CBlockRef& pblockRet)
+{
+    if (!blockcache.GetBlock(pindex->nFile, pindex->nBlockPos, false, pblockRet))
+    {
+        CBlock* pblock = new CBlock();
+        pblockRet.reset(pblock);
+        if (!pblock->ReadFromFile(pindex->nFile, pindex->nBlockPos, true))
+            return false;
+        blockcache.AddBlock(pindex->nFile, pindex->nBlockPos, pblockRet);
+    }
+    if (pblockRet->GetHash() != pindex->GetBlockHash())
+        return error("ReadBlockFromDisk() : GetHash() doesn't match index");
+    return true;
+}
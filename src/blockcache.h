@@ -0,0 +1,119 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCREDIT_BLOCKCACHE_H
+#define BITCREDIT_BLOCKCACHE_H
+
+#include "mainfunctions.h"
+#include "sync.h"
+
+#include <list>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+
+/** Default for -blockcache, in megabytes */
+static const int64_t DEFAULT_BLOCK_CACHE = 32;
+
+/** A block shared between readers; it must not be modified */
+typedef boost::shared_ptr<const CBlock> CBlockRef;
+
+struct CBlockCacheStats
+{
+    uint64_t nBlocks;       // full blocks
+    uint64_t nHeaders;      // blocks read for their header only
+    uint64_t nTransactions;
+    uint64_t nUsage;
+    uint64_t nMaxUsage;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvicted;
+    uint64_t nInvalidated;
+};
+
+/**
+ * Recently read blocks and transactions from the block files, least
+ * recently used first out once the memory they take passes a budget
+ * (-blockcache).
+ *
+ * Entries are found by their position in the block files, which never
+ * changes once written, and transactions also by their hash once
+ * GetTransaction has resolved the block holding them. The objects are
+ * shared and immutable: readers either keep the reference or copy it.
+ * A block leaving the main chain is dropped with its transactions, so a
+ * lookup by hash never answers with a block that is no longer in it.
+ */
+class CBlockCache
+{
+private:
+    struct CEntry
+    {
+        CDiskTxPos pos;    // nTxPos is 0 for a block: a transaction never starts a file
+        CBlockRef pblock;  // a block, or a header without transactions
+        CTransactionRef ptx;
+        uint256 hashBlock; // for a transaction found by hash, the block holding it
+        size_t nUsage;
+    };
+    typedef std::list<CEntry> CEntryList; // most recently used first
+    typedef std::map<CDiskTxPos, CEntryList::iterator> CPosMap;
+
+    mutable CCriticalSection cs;
+    CEntryList listEntries;
+    CPosMap mapPos;
+    std::map<uint256, CEntryList::iterator> mapTxHash;
+    size_t nUsage;
+    size_t nMaxUsage;
+    uint64_t nHeaders;
+    uint64_t nTransactions;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvicted;
+    uint64_t nInvalidated;
+    uint64_t nEpoch; // blocks left the main chain
+
+    void Insert(CEntry entry);
+    void Erase(CEntryList::iterator it);
+    void Trim();
+
+public:
+    CBlockCache(size_t nMaxUsageIn);
+
+    /** Change the memory budget; 0 disables the cache */
+    void SetMaxUsage(size_t nMaxUsageIn);
+
+    /** The block at a position; a cached header only answers fHeaderOnly lookups */
+    bool GetBlock(unsigned int nFile, unsigned int nBlockPos, bool fHeaderOnly, CBlockRef& pblockRet);
+    void AddBlock(unsigned int nFile, unsigned int nBlockPos, const CBlockRef& pblock);
+
+    /** The transaction at a position */
+    bool GetTransaction(const CDiskTxPos& pos, CTransactionRef& ptxRet);
+    /** A transaction of the main chain by hash, and the hash of its block */
+    bool GetTransaction(const uint256& hash, CTransactionRef& ptxRet, uint256& hashBlockRet);
+    /**
+     * Cache the transaction at pos. With hashBlock, it can be found by hash
+     * too, unless a block left the main chain since GetEpoch() returned
+     * nEpoch: the tx index it was looked up in may not hold any more.
+     */
+    void AddTransaction(const CDiskTxPos& pos, const CTransactionRef& ptx, const uint256& hashBlock = 0, uint64_t nEpoch = 0);
+    uint64_t GetEpoch() const;
+
+    /** Forget a block that left the main chain and the transactions read
+     *  from it; call it once the tx index no longer points into it */
+    void EraseBlock(unsigned int nFile, unsigned int nBlockPos);
+    void Clear();
+
+    void GetStats(CBlockCacheStats& stats) const;
+};
+
+/** Estimated memory a deserialized transaction or block takes */
+size_t TransactionUsage(const CTransaction& tx);
+size_t BlockUsage(const CBlock& block);
+
+extern CBlockCache blockcache;
+
+/** Read a block shared through the block cache, adding it there for the
+ *  next reader: for the blocks peers and RPC clients ask for repeatedly */
+bool ReadBlockFromDisk(const CBlockIndex* pindex, CBlockRef& pblockRet);
+
+#endif
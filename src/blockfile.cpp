@@ -0,0 +1,246 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfile.h"
+
+#include "serialize.h"
+#include "sync.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <list>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+
+using namespace std;
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+namespace {
+
+/** A read-only descriptor, closed when the pool and its last reader drop it */
+class CBlockFileHandle
+{
+public:
+    int fd;
+
+    CBlockFileHandle(int fdIn) : fd(fdIn) {}
+    ~CBlockFileHandle() { close(fd); }
+};
+typedef boost::shared_ptr<CBlockFileHandle> CBlockFileHandleRef;
+
+CCriticalSection cs_blockfiles;
+// Least recently used last
+list<pair<unsigned int, CBlockFileHandleRef> > listHandles;
+map<unsigned int, list<pair<unsigned int, CBlockFileHandleRef> >::iterator> mapHandles;
+
+CCriticalSection cs_blockfilewriter;
+int fdWriter = -1;
+unsigned int nWriterFile = 1;
+unsigned int nWriterSize = 0;
+
+CBlockFileStats stats = CBlockFileStats();
+
+}
+
+boost::filesystem::path BlockFilePath(unsigned int nFile)
+{
+    return GetDataDir() / strprintf("blk%04u.dat", nFile);
+}
+
+static CBlockFileHandleRef GetReadHandle(unsigned int nFile)
+{
+    LOCK(cs_blockfiles);
+    map<unsigned int, list<pair<unsigned int, CBlockFileHandleRef> >::iterator>::iterator mi = mapHandles.find(nFile);
+    if (mi != mapHandles.end())
+    {
+        listHandles.splice(listHandles.begin(), listHandles, mi->second);
+        return mi->second->second;
+    }
+
+    int fd = open(BlockFilePath(nFile).string().c_str(), O_RDONLY | O_BINARY);
+    if (fd == -1)
+        return CBlockFileHandleRef();
+    stats.nOpens++;
+    listHandles.push_front(make_pair(nFile, CBlockFileHandleRef(new CBlockFileHandle(fd))));
+    mapHandles[nFile] = listHandles.begin();
+    if (listHandles.size() > MAX_BLOCK_FILE_DESCRIPTORS)
+    {
+        // Readers still holding it close it when they are done
+        mapHandles.erase(listHandles.back().first);
+        listHandles.pop_back();
+    }
+    return listHandles.front().second;
+}
+
+// Positioned read; -1 on error
+static int64_t ReadAt(int fd, char* pch, size_t nSize, uint64_t nPos)
+{
+#ifdef WIN32
+    // ReadFile at an offset moves the file pointer, which no reader relies on
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = (DWORD)nPos;
+    overlapped.OffsetHigh = (DWORD)(nPos >> 32);
+    DWORD nRead = 0;
+    if (!ReadFile((HANDLE)_get_osfhandle(fd), pch, nSize, &nRead, &overlapped))
+        return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    return nRead;
+#else
+    ssize_t nRead;
+    do {
+        nRead = pread(fd, pch, nSize, nPos);
+    } while (nRead == -1 && errno == EINTR);
+    return nRead;
+#endif
+}
+
+bool ReadBlockFile(unsigned int nFile, unsigned int nPos, unsigned int nSize, CDataStream& ss)
+{
+    if ((nFile < 1) || (nFile == (unsigned int) -1))
+        return false;
+    CBlockFileHandleRef handle = GetReadHandle(nFile);
+    if (!handle)
+        return error("ReadBlockFile() : open blk%04u.dat failed", nFile);
+
+    size_t nStart = ss.size();
+    ss.resize(nStart + nSize);
+    size_t nDone = 0;
+    uint64_t nCalls = 0;
+    while (nDone < nSize)
+    {
+        int64_t nRead = ReadAt(handle->fd, &ss[nStart + nDone], nSize - nDone, (uint64_t)nPos + nDone);
+        nCalls++;
+        if (nRead < 0)
+        {
+            ss.resize(nStart);
+            return error("ReadBlockFile() : read blk%04u.dat at %u failed", nFile, nPos);
+        }
+        if (nRead == 0)
+            break;
+        nDone += nRead;
+    }
+    ss.resize(nStart + nDone);
+
+    LOCK(cs_blockfiles);
+    stats.nReads += nCalls;
+    stats.nReadBytes += nDone;
+    return true;
+}
+
+static bool SyncBlockFile(int fd)
+{
+#ifdef WIN32
+    return FlushFileBuffers((HANDLE)_get_osfhandle(fd));
+#elif defined(__linux__)
+    // The file size changes with every append, which fdatasync also writes
+    return fdatasync(fd) == 0;
+#else
+    return fsync(fd) == 0;
+#endif
+}
+
+static void CloseWriter()
+{
+    if (fdWriter == -1)
+        return;
+    SyncBlockFile(fdWriter);
+    close(fdWriter);
+    fdWriter = -1;
+}
+
+bool AppendBlockFile(const CDataStream& ss, unsigned int& nFileRet, unsigned int& nPosRet)
+{
+    LOCK(cs_blockfilewriter);
+    // FAT32 file size max 4GB, fseek and ftell max 2GB, so we must stay under 2GB
+    while (fdWriter == -1 || nWriterSize >= (unsigned int)(0x7F000000 - MAX_SIZE))
+    {
+        if (fdWriter != -1)
+        {
+            CloseWriter();
+            nWriterFile++;
+        }
+        fdWriter = open(BlockFilePath(nWriterFile).string().c_str(), O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0644);
+        if (fdWriter == -1)
+            return error("AppendBlockFile() : open blk%04u.dat failed", nWriterFile);
+        struct stat st;
+        if (fstat(fdWriter, &st) != 0)
+        {
+            CloseWriter();
+            return error("AppendBlockFile() : fstat blk%04u.dat failed", nWriterFile);
+        }
+        nWriterSize = st.st_size;
+    }
+
+    size_t nDone = 0;
+    while (nDone < ss.size())
+    {
+        int nWritten = write(fdWriter, &ss[nDone], ss.size() - nDone);
+        if (nWritten < 0 && errno == EINTR)
+            continue;
+        if (nWritten <= 0)
+        {
+            // Start over from the file's actual size on the next append
+            CloseWriter();
+            return error("AppendBlockFile() : write blk%04u.dat failed", nWriterFile);
+        }
+        nDone += nWritten;
+    }
+    nFileRet = nWriterFile;
+    nPosRet = nWriterSize;
+    nWriterSize += ss.size();
+
+    {
+        LOCK(cs_blockfiles);
+        stats.nAppends++;
+        stats.nAppendBytes += ss.size();
+    }
+    return true;
+}
+
+bool CommitBlockFile()
+{
+    LOCK(cs_blockfilewriter);
+    if (fdWriter == -1)
+        return true;
+    int64_t nStart = GetTimeMillis();
+    if (!SyncBlockFile(fdWriter))
+        return error("CommitBlockFile() : sync blk%04u.dat failed", nWriterFile);
+
+    {
+        LOCK(cs_blockfiles);
+        stats.nSyncs++;
+        stats.nSyncTimeMs += GetTimeMillis() - nStart;
+    }
+    return true;
+}
+
+void CloseBlockFiles()
+{
+    {
+        LOCK(cs_blockfilewriter);
+        CloseWriter();
+    }
+    LOCK(cs_blockfiles);
+    mapHandles.clear();
+    listHandles.clear();
+}
+
+void GetBlockFileStats(CBlockFileStats& statsRet)
+{
+    LOCK(cs_blockfiles);
+    statsRet = stats;
+    statsRet.nOpenFiles = listHandles.size();
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCREDIT_BLOCKFILE_H
+#define BITCREDIT_BLOCKFILE_H
+
+#include <stdint.h>
+
+#include <boost/filesystem/path.hpp>
+
+class CDataStream;
+
+/** Read-only descriptors of blk*.dat files kept open for readers */
+static const unsigned int MAX_BLOCK_FILE_DESCRIPTORS = 8;
+/** Bytes read at once for a block or transaction whose size is not known yet */
+static const unsigned int BLOCK_FILE_READ_AHEAD = 8192;
+
+struct CBlockFileStats
+{
+    uint64_t nOpenFiles;  // read-only descriptors in the pool
+    uint64_t nOpens;
+    uint64_t nReads;      // read system calls
+    uint64_t nReadBytes;
+    uint64_t nAppends;
+    uint64_t nAppendBytes;
+    uint64_t nSyncs;
+    int64_t nSyncTimeMs;
+};
+
+boost::filesystem::path BlockFilePath(unsigned int nFile);
+
+/**
+ * Append up to nSize bytes read at nPos of blk<nFile>.dat to ss; fewer at
+ * the end of the file. Reads go through a pool of read-only descriptors
+ * kept open, least recently used first closed, and are positioned (pread),
+ * so concurrent readers neither lock nor seek and a read is one system
+ * call instead of an open, a seek, a stdio refill every 4 KB and a close.
+ */
+bool ReadBlockFile(unsigned int nFile, unsigned int nPos, unsigned int nSize, CDataStream& ss);
+
+/**
+ * Append ss to the current block file, moving on to the next one when it
+ * is full, and return where it starts. One descriptor stays open for all
+ * the appends; they only reach the disk at the next CommitBlockFile().
+ */
+bool AppendBlockFile(const CDataStream& ss, unsigned int& nFileRet, unsigned int& nPosRet);
+
+/** Make the appends so far durable (fdatasync) */
+bool CommitBlockFile();
+
+/** Commit the appends and close all the descriptors, at shutdown */
+void CloseBlockFiles();
+
+void GetBlockFileStats(CBlockFileStats& stats);
+
+#endif
@@ -0,0 +1,285 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "hash.h"
+#include "mainfunctions.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+bool fBlockFilterIndex = false;
+
+namespace {
+
+/** Appends bits to a byte vector, most significant first */
+class CBitWriter
+{
+private:
+    vector<unsigned char>& vch;
+    unsigned char nBuffer;
+    int nBits;
+
+public:
+    CBitWriter(vector<unsigned char>& vchIn) : vch(vchIn), nBuffer(0), nBits(0) {}
+
+    void Write(uint64_t nData, int nCount)
+    {
+        while (nCount > 0)
+        {
+            int nTake = min(8 - nBits, nCount);
+            nBuffer |= (unsigned char)(((nData >> (nCount - nTake)) & ((1 << nTake) - 1)) << (8 - nBits - nTake));
+            nBits += nTake;
+            nCount -= nTake;
+            if (nBits == 8)
+                Flush();
+        }
+    }
+
+    void Flush()
+    {
+        if (nBits == 0)
+            return;
+        vch.push_back(nBuffer);
+        nBuffer = 0;
+        nBits = 0;
+    }
+};
+
+/** Reads the bits CBitWriter wrote; reading past the end gives zeros */
+class CBitReader
+{
+private:
+    const vector<unsigned char>& vch;
+    size_t nPos;
+    int nBits; // left in vch[nPos]
+
+public:
+    CBitReader(const vector<unsigned char>& vchIn) : vch(vchIn), nPos(0), nBits(8) {}
+
+    uint64_t Read(int nCount)
+    {
+        uint64_t nData = 0;
+        while (nCount > 0)
+        {
+            if (nPos >= vch.size())
+                return nData << nCount;
+            int nTake = min(nBits, nCount);
+            nData = (nData << nTake) | ((vch[nPos] >> (nBits - nTake)) & ((1 << nTake) - 1));
+            nBits -= nTake;
+            nCount -= nTake;
+            if (nBits == 0)
+            {
+                nPos++;
+                nBits = 8;
+            }
+        }
+        return nData;
+    }
+};
+
+void GolombRiceEncode(CBitWriter& writer, uint64_t n)
+{
+    // Quotient in unary, then the remainder in P bits
+    for (uint64_t q = n >> BLOCK_FILTER_P; q > 0; q--)
+        writer.Write(1, 1);
+    writer.Write(0, 1);
+    writer.Write(n, BLOCK_FILTER_P);
+}
+
+uint64_t GolombRiceDecode(CBitReader& reader)
+{
+    uint64_t q = 0;
+    while (reader.Read(1) == 1)
+        q++;
+    return (q << BLOCK_FILTER_P) + reader.Read(BLOCK_FILTER_P);
+}
+
+// (x * n) >> 64 without a 128-bit type
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    uint64_t ac = x_hi * n_hi;
+    uint64_t ad = x_hi * n_lo;
+    uint64_t bc = x_lo * n_hi;
+    uint64_t bd = x_lo * n_lo;
+    uint64_t mid = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    return ac + (bc >> 32) + (ad >> 32) + (mid >> 32);
+}
+
+} // anon namespace
+
+uint64_t CBlockFilter::HashToRange(const BlockFilterElement& element) const
+{
+    uint64_t nHash = SipHash(hashBlock.Get64(0), hashBlock.Get64(1), element.empty() ? NULL : &element[0], element.size());
+    return MapIntoRange(nHash, nElements * BLOCK_FILTER_M);
+}
+
+CBlockFilter::CBlockFilter(const uint256& hashBlockIn, const BlockFilterElements& elements) :
+    hashBlock(hashBlockIn), nElements(elements.size())
+{
+    vector<uint64_t> vHashes;
+    vHashes.reserve(elements.size());
+    BOOST_FOREACH(const BlockFilterElement& element, elements)
+        vHashes.push_back(HashToRange(element));
+    sort(vHashes.begin(), vHashes.end());
+
+    CBitWriter writer(vEncoded);
+    uint64_t nLast = 0;
+    BOOST_FOREACH(uint64_t nHash, vHashes)
+    {
+        GolombRiceEncode(writer, nHash - nLast);
+        nLast = nHash;
+    }
+    writer.Flush();
+}
+
+bool CBlockFilter::Match(const BlockFilterElement& element) const
+{
+    BlockFilterElements elements;
+    elements.insert(element);
+    return MatchAny(elements);
+}
+
+bool CBlockFilter::MatchAny(const BlockFilterElements& elements) const
+{
+    if (nElements == 0 || elements.empty())
+        return false;
+
+    vector<uint64_t> vQueries;
+    vQueries.reserve(elements.size());
+    BOOST_FOREACH(const BlockFilterElement& element, elements)
+        vQueries.push_back(HashToRange(element));
+    sort(vQueries.begin(), vQueries.end());
+
+    // Walk the set and the queries together, both being sorted
+    CBitReader reader(vEncoded);
+    uint64_t nValue = 0;
+    vector<uint64_t>::const_iterator it = vQueries.begin();
+    for (uint64_t i = 0; i < nElements; i++)
+    {
+        nValue += GolombRiceDecode(reader);
+        while (*it < nValue)
+            if (++it == vQueries.end())
+                return false;
+        if (*it == nValue)
+            return true;
+    }
+    return false;
+}
+
+BlockFilterElement BlockFilterStealthElement()
+{
+    return BlockFilterElement(1, OP_RETURN);
+}
+
+static void AddScriptElements(const CScript& script, BlockFilterElements& elements)
+{
+    if (script.empty())
+        return;
+    if (script[0] == OP_RETURN)
+    {
+        elements.insert(BlockFilterStealthElement());
+        return;
+    }
+    elements.insert(BlockFilterElement(script.begin(), script.end()));
+
+    // A wallet owning every key of a bare multisig output cannot know the
+    // script it will be paid with, so the keys go in one by one
+    txnouttype whichType;
+    vector<vector<unsigned char> > vSolutions;
+    if (script[script.size() - 1] == OP_CHECKMULTISIG && Solver(script, whichType, vSolutions) && whichType == TX_MULTISIG)
+        for (unsigned int i = 1; i + 1 < vSolutions.size(); i++)
+            elements.insert(vSolutions[i]);
+}
+
+void GetBlockFilterElements(const CBlock& block, const vector<CScript>& vSpent, BlockFilterElements& elements)
+{
+    elements.clear();
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        BOOST_FOREACH(const CTxOut& txout, tx.vout)
+            AddScriptElements(txout.scriptPubKey, elements);
+    BOOST_FOREACH(const CScript& script, vSpent)
+        AddScriptElements(script, elements);
+}
+
+bool BuildBlockFilter(CTxDB& txdb, const CBlock& block, CBlockFilter& filter)
+{
+    vector<CScript> vSpent;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            CTransaction txPrev;
+            if (!txdb.ReadDiskTx(txin.prevout, txPrev) || txin.prevout.n >= txPrev.vout.size())
+                return error("BuildBlockFilter() : %s spends unknown output %s", tx.GetHash().ToString(), txin.prevout.ToString());
+            vSpent.push_back(txPrev.vout[txin.prevout.n].scriptPubKey);
+        }
+    }
+
+    BlockFilterElements elements;
+    GetBlockFilterElements(block, vSpent, elements);
+    filter = CBlockFilter(block.GetHash(), elements);
+    return true;
+}
+
+bool GetBlockFilter(const CBlockIndex* pindex, CBlockFilter& filter)
+{
+    if (!fBlockFilterIndex)
+        return false;
+    CTxDB txdb("r");
+    return txdb.ReadBlockFilter(pindex->GetBlockHash(), filter);
+}
+
+void ThreadBlockFilterBackfill()
+{
+    RenameThread("Advantage-bfilter");
+
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = pindexGenesisBlock;
+    }
+
+    int64_t nStart = GetTimeMillis();
+    unsigned int nBuilt = 0;
+    CTxDB txdb("r+");
+    while (pindex)
+    {
+        boost::this_thread::interruption_point();
+
+        // Blocks connected since startup already have theirs
+        if (!txdb.HaveBlockFilter(pindex->GetBlockHash()))
+        {
+            CBlock block;
+            CBlockFilter filter;
+            if (!block.ReadFromDisk(pindex, true) || !BuildBlockFilter(txdb, block, filter))
+            {
+                LogPrintf("ThreadBlockFilterBackfill() : stopped at block %d\n", pindex->nHeight);
+                return;
+            }
+            txdb.WriteBlockFilter(filter);
+            if (++nBuilt % 10000 == 0)
+                LogPrintf("Built block filters up to block %d\n", pindex->nHeight);
+        }
+
+        // A block disconnected meanwhile has no next block; the ones that
+        // replace it get their filters as they are connected
+        LOCK(cs_main);
+        pindex = pindex->pnext;
+    }
+
+    if (nBuilt)
+        LogPrintf("Built %u block filters in %dms\n", nBuilt, GetTimeMillis() - nStart);
+}
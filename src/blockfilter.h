@@ -0,0 +1,85 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCREDIT_BLOCKFILTER_H
+#define BITCREDIT_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CScript;
+class CTxDB;
+
+/** Bits of each Golomb-Rice remainder, and the inverse false positive rate */
+static const int BLOCK_FILTER_P = 19;
+static const uint64_t BLOCK_FILTER_M = 784931;
+
+/** Whether block filters are kept (-blockfilterindex) */
+extern bool fBlockFilterIndex;
+
+typedef std::vector<unsigned char> BlockFilterElement;
+typedef std::set<BlockFilterElement> BlockFilterElements;
+
+/**
+ * Compact probabilistic set of the output scripts a block creates and the
+ * ones it spends, as a Golomb-coded set keyed by the block hash: elements
+ * are hashed into [0, N * M), sorted, and the differences between them
+ * stored Golomb-Rice coded. A query for a script in the set always
+ * matches; one for a script not in it matches about once in M blocks.
+ *
+ * Blocks with an OP_RETURN output also hold the element for a lone
+ * OP_RETURN, so wallets with stealth addresses can find the blocks that
+ * may pay them. Bare multisig scripts also add each of their public keys,
+ * which is how a wallet finds the ones all of its keys can spend.
+ */
+class CBlockFilter
+{
+private:
+    uint256 hashBlock;
+    uint64_t nElements;
+    std::vector<unsigned char> vEncoded;
+
+    uint64_t HashToRange(const BlockFilterElement& element) const;
+
+public:
+    CBlockFilter() : nElements(0) {}
+    CBlockFilter(const uint256& hashBlockIn, const BlockFilterElements& elements);
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(hashBlock);
+        READWRITE(VARINT(nElements));
+        READWRITE(vEncoded);
+    )
+
+    const uint256& GetBlockHash() const { return hashBlock; }
+    uint64_t GetElementCount() const { return nElements; }
+    size_t GetEncodedSize() const { return vEncoded.size(); }
+
+    bool Match(const BlockFilterElement& element) const;
+    bool MatchAny(const BlockFilterElements& elements) const;
+};
+
+/** The element of a block with an OP_RETURN output */
+BlockFilterElement BlockFilterStealthElement();
+
+/** The elements of a block: the scripts of its outputs, and vSpent, the scripts of the outputs its inputs spend,
+ *  with the keys of the bare multisig ones among them */
+void GetBlockFilterElements(const CBlock& block, const std::vector<CScript>& vSpent, BlockFilterElements& elements);
+
+/** Build the filter of a connected block, reading the outputs it spends from the tx index */
+bool BuildBlockFilter(CTxDB& txdb, const CBlock& block, CBlockFilter& filter);
+
+/** Read the filter of a block; false if it has none yet */
+bool GetBlockFilter(const CBlockIndex* pindex, CBlockFilter& filter);
+
+/** Build the filters missing for the best chain, at startup when -blockfilterindex is first enabled */
+void ThreadBlockFilterBackfill();
+
+#endif
@@ -0,0 +1,193 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCREDIT_BOUNDEDMAP_H
+#define BITCREDIT_BOUNDEDMAP_H
+
+#include "serialize.h"
+#include "util.h"
+#include "version.h"
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <string>
+
+/** Memory an element is estimated to take, from its serialized size */
+template <typename T> struct serialized_usage
+{
+    size_t operator()(const T& x) const { return std::max(sizeof(T), (size_t)::GetSerializeSize(x, SER_NETWORK, PROTOCOL_VERSION)); }
+};
+
+/** Size and memory use of a cache, as getmemoryinfo reports it */
+struct CCacheInfo
+{
+    std::string strName;
+    size_t nEntries;
+    size_t nMaxEntries; // 0: no limit
+    int64_t nMaxAge;    // seconds, 0: no limit
+    size_t nUsage;      // bytes, estimated
+    uint64_t nEvicted;
+};
+
+/**
+ * STL-like map container bounded in size and in entry age. Entries are
+ * queued by the time they were inserted or last touched; inserting expires
+ * the ones older than the age limit and evicts the oldest ones over the
+ * size limit, so the cost of keeping the map bounded is spread over inserts
+ * instead of paid in periodic full scans.
+ *
+ * Memory use is accounted per entry when it is inserted; callers that grow
+ * an entry in place afterwards call resized() on it.
+ */
+template <typename K, typename V, typename Usage = serialized_usage<V> > class boundedmap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef typename std::map<K, V>::iterator iterator;
+    typedef typename std::map<K, V>::const_iterator const_iterator;
+    typedef typename std::map<K, V>::size_type size_type;
+
+protected:
+    struct queue_entry
+    {
+        int64_t nTime; // inserted or last touched
+        iterator it;
+        size_t nUsage;
+    };
+    typedef std::list<queue_entry> queue_type;
+
+    std::map<K, V> map;
+    queue_type queue; // oldest first
+    std::map<K, typename queue_type::iterator> mapQueuePos;
+    size_type nMaxSize;
+    int64_t nMaxAge;
+    size_t nUsage;
+    uint64_t nEvicted;
+
+    size_t EntryUsage(const V& v) const
+    {
+        // a tree node carries three pointers and a color, a list node two pointers
+        static const size_t nTreeNode = 4 * sizeof(void*);
+        static const size_t nListNode = 2 * sizeof(void*);
+        return 2 * nTreeNode + nListNode + 2 * sizeof(K) + sizeof(queue_entry) +
+               sizeof(typename queue_type::iterator) + Usage()(v);
+    }
+    void erase_queued(typename queue_type::iterator itQueue)
+    {
+        nUsage -= itQueue->nUsage;
+        mapQueuePos.erase(itQueue->it->first);
+        map.erase(itQueue->it);
+        queue.erase(itQueue);
+    }
+
+public:
+    boundedmap(size_type nMaxSizeIn = 0, int64_t nMaxAgeIn = 0) : nMaxSize(nMaxSizeIn), nMaxAge(nMaxAgeIn), nUsage(0), nEvicted(0) {}
+    iterator begin() { return map.begin(); }
+    iterator end() { return map.end(); }
+    const_iterator begin() const { return map.begin(); }
+    const_iterator end() const { return map.end(); }
+    size_type size() const { return map.size(); }
+    bool empty() const { return map.empty(); }
+    iterator find(const key_type& k) { return map.find(k); }
+    const_iterator find(const key_type& k) const { return map.find(k); }
+    size_type count(const key_type& k) const { return map.count(k); }
+
+    std::pair<iterator, bool> insert(const value_type& x)
+    {
+        expire();
+        std::pair<iterator, bool> ret = map.insert(x);
+        if (ret.second)
+        {
+            if (nMaxSize && map.size() > nMaxSize)
+            {
+                erase_queued(queue.begin());
+                nEvicted++;
+            }
+            queue_entry entry;
+            entry.nTime = GetTime();
+            entry.it = ret.first;
+            entry.nUsage = EntryUsage(x.second);
+            nUsage += entry.nUsage;
+            mapQueuePos[x.first] = queue.insert(queue.end(), entry);
+        }
+        return ret;
+    }
+    mapped_type& operator[](const key_type& k)
+    {
+        iterator it = map.find(k);
+        if (it != map.end())
+            return it->second;
+        return insert(value_type(k, mapped_type())).first->second;
+    }
+    void erase(iterator it)
+    {
+        erase_queued(mapQueuePos[it->first]);
+    }
+    void erase(const key_type& k)
+    {
+        iterator it = map.find(k);
+        if (it != map.end())
+            erase(it);
+    }
+    void clear()
+    {
+        map.clear();
+        queue.clear();
+        mapQueuePos.clear();
+        nUsage = 0;
+    }
+
+    /** Move an entry to the back of the queue, as if it had just been inserted */
+    void touch(iterator it)
+    {
+        typename queue_type::iterator itQueue = mapQueuePos[it->first];
+        itQueue->nTime = GetTime();
+        queue.splice(queue.end(), queue, itQueue);
+    }
+    /** Account for an entry whose value grew or shrank in place */
+    void resized(iterator it)
+    {
+        typename queue_type::iterator itQueue = mapQueuePos[it->first];
+        nUsage -= itQueue->nUsage;
+        itQueue->nUsage = EntryUsage(it->second);
+        nUsage += itQueue->nUsage;
+    }
+    /** The entry next in line for eviction */
+    iterator oldest() { return queue.empty() ? map.end() : queue.front().it; }
+
+    /** Drop the entries older than the age limit */
+    void expire()
+    {
+        if (!nMaxAge)
+            return;
+        int64_t nOldest = GetTime() - nMaxAge;
+        while (!queue.empty() && queue.front().nTime < nOldest)
+        {
+            erase_queued(queue.begin());
+            nEvicted++;
+        }
+    }
+
+    size_type max_size() const { return nMaxSize; }
+    int64_t max_age() const { return nMaxAge; }
+    /** Estimated memory held by the entries, the map and its index */
+    size_t DynamicUsage() const { return nUsage; }
+
+    CCacheInfo GetInfo(const std::string& strName) const
+    {
+        CCacheInfo info;
+        info.strName = strName;
+        info.nEntries = map.size();
+        info.nMaxEntries = nMaxSize;
+        info.nMaxAge = nMaxAge;
+        info.nUsage = nUsage;
+        info.nEvicted = nEvicted;
+        return info;
+    }
+};
+
+#endif
@@ -0,0 +1,520 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2013 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "chainfunctions.h"
+#include "mainfunctions.h"
+#include "txdb.h"
+#include "ui_interface.h"
+#include "util.h"
+
+using namespace std;
+
+CCoinsCache* pcoinsTip = NULL;
+
+// Write pending changes at least this often (seconds), so an unclean
+// shutdown leaves only a few blocks to replay
+static const int64_t COINS_FLUSH_INTERVAL = 10 * 60;
+
+CCoin::CCoin(const CTransaction& tx, unsigned int n, int nHeightIn, unsigned int nBlockTimeIn)
+{
+    txout = tx.vout[n];
+    nHeight = nHeightIn;
+    nTime = tx.nTime;
+    nBlockTime = nBlockTimeIn;
+    nFlags = (tx.IsCoinBase() ? COIN_COINBASE : 0) | (tx.IsCoinStake() ? COIN_COINSTAKE : 0);
+}
+
+CCoinsCache::CCoinsCache(size_t nMaxUsageIn)
+{
+    hashBlock = 0;
+    nUsage = nStakeUsage = 0;
+    nMaxUsage = nMaxUsageIn;
+    nLastFlush = GetTime();
+    nHits = nMisses = nFlushes = 0;
+    nFlushTimeMs = 0;
+}
+
+size_t CCoinsCache::EntryUsage(const CEntry& entry)
+{
+    // Map node (three pointers and a colour) plus the script's heap buffer,
+    // none for scripts short enough to be stored inline
+    return sizeof(CEntryMap::value_type) + 4 * sizeof(void*) + entry.coin.txout.scriptPubKey.allocated_memory();
+}
+
+void CCoinsCache::AddUsage(const CEntry& entry)
+{
+    size_t n = EntryUsage(entry);
+    nUsage += n;
+    if (entry.fStake)
+        nStakeUsage += n;
+}
+
+void CCoinsCache::RemoveUsage(const CEntry& entry)
+{
+    size_t n = EntryUsage(entry);
+    nUsage -= n;
+    if (entry.fStake)
+        nStakeUsage -= n;
+}
+
+CCoinsCache::CEntryMap::iterator CCoinsCache::Fetch(const COutPoint& outpoint)
+{
+    CEntryMap::iterator it = mapCoins.find(outpoint);
+    if (it != mapCoins.end())
+    {
+        nHits++;
+        return it;
+    }
+    nMisses++;
+
+    CEntry entry;
+    if (!CTxDB("r").ReadCoin(outpoint, entry.coin))
+        return mapCoins.end();
+    it = mapCoins.insert(make_pair(outpoint, entry)).first;
+    AddUsage(it->second);
+    return it;
+}
+
+void CCoinsCache::AddCoin(const COutPoint& outpoint, const CCoin& coin)
+{
+    pair<CEntryMap::iterator, bool> ret = mapCoins.insert(make_pair(outpoint, CEntry()));
+    CEntry& entry = ret.first->second;
+    if (ret.second)
+        entry.fFresh = true; // txids are unique, so the database cannot hold it
+    else
+        RemoveUsage(entry);
+    entry.coin = coin;
+    entry.fSpent = false;
+    entry.fDirty = true;
+    AddUsage(entry);
+}
+
+void CCoinsCache::SpendCoin(const COutPoint& outpoint)
+{
+    CEntryMap::iterator it = mapCoins.find(outpoint);
+    if (it == mapCoins.end())
+    {
+        CEntry entry;
+        entry.fSpent = true;
+        entry.fDirty = true;
+        it = mapCoins.insert(make_pair(outpoint, entry)).first;
+        AddUsage(it->second);
+        return;
+    }
+
+    RemoveUsage(it->second);
+    if (it->second.fFresh)
+    {
+        // Created and spent between two flushes; the database never hears of it
+        mapCoins.erase(it);
+        return;
+    }
+    it->second.coin = CCoin();
+    it->second.fSpent = true;
+    it->second.fDirty = true;
+    it->second.fStake = false;
+    AddUsage(it->second);
+}
+
+bool CCoinsCache::ConnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block is never connected to the chain state, so its
+    // coinbase cannot be spent
+    if (!pindex->pprev)
+    {
+        hashBlock = pindex->GetBlockHash();
+        return true;
+    }
+
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        uint256 hash = tx.GetHash();
+        if (!tx.IsCoinBase())
+        {
+            BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                SpendCoin(txin.prevout);
+        }
+        // Empty outputs (coinstake and proof-of-stake coinbase) are kept
+        // too: they stay spendable like any other
+        for (unsigned int n = 0; n < tx.vout.size(); n++)
+            AddCoin(COutPoint(hash, n), CCoin(tx, n, pindex->nHeight, pindex->nTime));
+    }
+    hashBlock = pindex->GetBlockHash();
+    return true;
+}
+
+// Read an output spent by a block that is being taken back. The transaction
+// index keeps the position of every transaction of the chain, spent or not.
+static bool ReadSpentCoin(CTxDB& txdb, const COutPoint& outpoint, CCoin& coin)
+{
+    CTransaction txPrev;
+    CTxIndex txindex;
+    if (!txdb.ReadDiskTx(outpoint.hash, txPrev, txindex) || outpoint.n >= txPrev.vout.size())
+        return error("ReadSpentCoin() : cannot read prev tx %s", outpoint.hash.ToString());
+
+    CBlock blockPrev;
+    if (!blockPrev.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+        return error("ReadSpentCoin() : cannot read block of prev tx %s", outpoint.hash.ToString());
+    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(blockPrev.GetHash());
+    if (mi == mapBlockIndex.end())
+        return error("ReadSpentCoin() : block of prev tx %s not indexed", outpoint.hash.ToString());
+
+    coin = CCoin(txPrev, outpoint.n, mi->second->nHeight, mi->second->nTime);
+    return true;
+}
+
+// Runs on a set left ahead of the transaction index by an unclean shutdown,
+// so the outputs to restore are looked up there. Transactions of blocks
+// leaving the chain in the same step are skipped: whatever they created is
+// going away too.
+bool CCoinsCache::DisconnectBlock(CTxDB& txdb, const CBlock& block, const set<uint256>& setDisconnectedTx)
+{
+    BOOST_REVERSE_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        uint256 hash = tx.GetHash();
+        for (unsigned int n = 0; n < tx.vout.size(); n++)
+            SpendCoin(COutPoint(hash, n));
+
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            if (setDisconnectedTx.count(txin.prevout.hash))
+                continue;
+
+            CCoin coin;
+            if (!ReadSpentCoin(txdb, txin.prevout, coin))
+                return false;
+            AddCoin(txin.prevout, coin);
+        }
+    }
+    return true;
+}
+
+bool CCoinsCache::GetCoin(const COutPoint& outpoint, CCoin& coin, const CBlockIndex* pindexAt, bool fStake)
+{
+    LOCK(cs);
+    if (!pindexAt || hashBlock != pindexAt->GetBlockHash())
+        return false;
+    CEntryMap::iterator it = Fetch(outpoint);
+    if (it == mapCoins.end() || it->second.fSpent)
+        return false;
+    // Pinned until spent, while they fit in their share of the budget
+    if (fStake && !it->second.fStake && nStakeUsage + EntryUsage(it->second) <= nMaxUsage / COINS_STAKE_SHARE)
+    {
+        RemoveUsage(it->second);
+        it->second.fStake = true;
+        AddUsage(it->second);
+    }
+    coin = it->second.coin;
+    return true;
+}
+
+uint256 CCoinsCache::GetBestBlock() const
+{
+    LOCK(cs);
+    return hashBlock;
+}
+
+bool CCoinsCache::ApplyChanges(const CCoinsChanges& mapChanges, const CBlockIndex* pindexFrom, const CBlockIndex* pindexTo)
+{
+    LOCK(cs);
+    if (hashBlock != (pindexFrom ? pindexFrom->GetBlockHash() : 0))
+        return error("CCoinsCache::ApplyChanges() : set moved on under the view");
+
+    for (CCoinsChanges::const_iterator it = mapChanges.begin(); it != mapChanges.end(); ++it)
+    {
+        if (it->second.IsNull())
+            SpendCoin(it->first);
+        else
+            AddCoin(it->first, it->second);
+    }
+    hashBlock = pindexTo ? pindexTo->GetBlockHash() : 0;
+    return true;
+}
+
+bool CCoinsCache::SyncToTip(CTxDB& txdb, CBlockIndex* pindexTip)
+{
+    LOCK(cs);
+    if (!pindexTip || hashBlock == pindexTip->GetBlockHash())
+        return true;
+
+    CBlockIndex* pindexCoins = NULL;
+    if (hashBlock != 0)
+    {
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi == mapBlockIndex.end())
+            return error("CCoinsCache::SyncToTip() : unknown block %s", hashBlock.ToString());
+        pindexCoins = mi->second;
+    }
+
+    // Find the fork
+    CBlockIndex* pfork = pindexCoins;
+    CBlockIndex* plonger = pindexTip;
+    while (pfork && pfork != plonger)
+    {
+        while (plonger->nHeight > pfork->nHeight)
+            if (!(plonger = plonger->pprev))
+                return error("CCoinsCache::SyncToTip() : plonger->pprev is null");
+        if (pfork == plonger)
+            break;
+        pfork = pfork->pprev;
+    }
+
+    // Disconnect the branch the set is on
+    vector<CBlock> vDisconnect;
+    set<uint256> setDisconnectedTx;
+    for (CBlockIndex* pindex = pindexCoins; pindex != pfork; pindex = pindex->pprev)
+    {
+        vDisconnect.push_back(CBlock());
+        if (!vDisconnect.back().ReadFromDisk(pindex))
+            return error("CCoinsCache::SyncToTip() : ReadFromDisk for disconnect failed");
+        BOOST_FOREACH(const CTransaction& tx, vDisconnect.back().vtx)
+            setDisconnectedTx.insert(tx.GetHash());
+    }
+    BOOST_FOREACH(const CBlock& block, vDisconnect)
+        if (!DisconnectBlock(txdb, block, setDisconnectedTx))
+            return false;
+    if (pfork)
+        hashBlock = pfork->GetBlockHash();
+
+    // Connect the best chain
+    vector<CBlockIndex*> vConnect;
+    for (CBlockIndex* pindex = pindexTip; pindex != pfork; pindex = pindex->pprev)
+        vConnect.push_back(pindex);
+    if (vConnect.size() > 1)
+        LogPrintf("CCoinsCache::SyncToTip() : disconnecting %u and connecting %u blocks\n", vDisconnect.size(), vConnect.size());
+    int64_t nStart = GetTimeMillis();
+    unsigned int nConnected = 0;
+    BOOST_REVERSE_FOREACH(CBlockIndex* pindex, vConnect)
+    {
+        boost::this_thread::interruption_point();
+        CBlock block;
+        if (!block.ReadFromDisk(pindex))
+            return error("CCoinsCache::SyncToTip() : ReadFromDisk for connect failed");
+        ConnectBlock(block, pindex);
+
+        // A replay of the whole chain takes a while; say how far it got
+        if (++nConnected % COINS_REPLAY_PROGRESS == 0)
+        {
+            LogPrintf("CCoinsCache::SyncToTip() : connected %u of %u blocks in %dms\n", nConnected, vConnect.size(), GetTimeMillis() - nStart);
+            uiInterface.InitMessage(strprintf(_("Building the unspent output set, block %i"), pindex->nHeight));
+        }
+
+        // Long catch-ups stay within budget
+        if (nUsage > nMaxUsage && !FlushUnlocked())
+            return false;
+    }
+    return true;
+}
+
+bool CCoinsCache::Load(CTxDB& txdb)
+{
+    LOCK(cs);
+    mapCoins.clear();
+    nUsage = nStakeUsage = 0;
+
+    uint256 hashStored = 0;
+    if (!txdb.ReadBestCoinsBlock(hashStored))
+    {
+        // New database: the set grows from the genesis block up
+        if (pindexBest == NULL)
+        {
+            hashBlock = 0;
+            return true;
+        }
+        LogPrintf("Building the unspent output set, this may take a while...\n");
+    }
+    else
+    {
+        int nVersion = 0;
+        txdb.ReadCoinsVersion(nVersion);
+        hashBlock = hashStored;
+        if (nVersion < COINS_VERSION)
+            LogPrintf("Unspent output set version %d is older than %d, rebuilding\n", nVersion, COINS_VERSION);
+        else if (SyncToTip(txdb, pindexBest))
+            return FlushUnlocked();
+        else
+            LogPrintf("Unspent output set cannot follow the chain, rebuilding\n");
+        mapCoins.clear();
+        nUsage = nStakeUsage = 0;
+    }
+    uiInterface.InitMessage(_("Building the unspent output set..."));
+
+    // The transaction index no longer records spends, so the set is
+    // rebuilt by replaying the best chain from the block files
+    int64_t nStart = GetTimeMillis();
+    if (!txdb.EraseCoins())
+        return false;
+    hashBlock = 0;
+    if (!SyncToTip(txdb, pindexBest) || !FlushUnlocked())
+        return error("CCoinsCache::Load() : replaying the best chain failed");
+    LogPrintf("Built the unspent output set to height %d in %dms\n", pindexBest->nHeight, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CCoinsCache::FlushUnlocked()
+{
+    int64_t nStart = GetTimeMillis();
+    unsigned int nWritten = 0, nErased = 0;
+    CTxDB txdb("r+");
+    if (!txdb.TxnBegin())
+        return error("CCoinsCache::Flush() : TxnBegin failed");
+    for (CEntryMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ++it)
+    {
+        if (!it->second.fDirty)
+            continue;
+        if (it->second.fSpent)
+        {
+            txdb.EraseCoin(it->first);
+            nErased++;
+        }
+        else
+        {
+            txdb.WriteCoin(it->first, it->second.coin);
+            nWritten++;
+        }
+    }
+    if (hashBlock != 0)
+    {
+        txdb.WriteBestCoinsBlock(hashBlock);
+        txdb.WriteCoinsVersion(COINS_VERSION);
+    }
+    if (!txdb.TxnCommit(true))
+        return error("CCoinsCache::Flush() : TxnCommit failed");
+
+    // Keep what was read or written as a read cache unless memory is tight;
+    // stake candidates are kept either way, and being held to their share of
+    // the budget they leave the cache well under it
+    bool fTight = nUsage > nMaxUsage / 2;
+    for (CEntryMap::iterator it = mapCoins.begin(); it != mapCoins.end(); )
+    {
+        if (it->second.fSpent || (fTight && !it->second.fStake))
+        {
+            RemoveUsage(it->second);
+            mapCoins.erase(it++);
+            continue;
+        }
+        it->second.fDirty = it->second.fFresh = false;
+        ++it;
+    }
+
+    int64_t nElapsed = GetTimeMillis() - nStart;
+    nLastFlush = GetTime();
+    nFlushes++;
+    nFlushTimeMs += nElapsed;
+    LogPrint("coindb", "Flushed unspent output set at %s: %u written, %u erased in %dms\n",
+        hashBlock.ToString(), nWritten, nErased, nElapsed);
+    return true;
+}
+
+bool CCoinsCache::Flush()
+{
+    LOCK(cs);
+    return FlushUnlocked();
+}
+
+bool CCoinsCache::FlushIfNeeded()
+{
+    LOCK(cs);
+    if (nUsage > nMaxUsage || GetTime() - nLastFlush > COINS_FLUSH_INTERVAL)
+        return FlushUnlocked();
+    return true;
+}
+
+void CCoinsCache::GetStats(CCoinsStats& stats) const
+{
+    LOCK(cs);
+    stats.hashBlock = hashBlock;
+    stats.nEntries = mapCoins.size();
+    stats.nDirty = 0;
+    stats.nStake = 0;
+    for (CEntryMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it)
+    {
+        if (it->second.fDirty)
+            stats.nDirty++;
+        if (it->second.fStake)
+            stats.nStake++;
+    }
+    stats.nStakeUsage = nStakeUsage;
+    stats.nUsage = nUsage;
+    stats.nMaxUsage = nMaxUsage;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nFlushes = nFlushes;
+    stats.nFlushTimeMs = nFlushTimeMs;
+}
+
+CCoinsView::CCoinsView(CCoinsCache* pbaseIn)
+{
+    pbase = pbaseIn;
+    pindexBase = NULL;
+    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(pbase->GetBestBlock());
+    if (mi != mapBlockIndex.end())
+        pindexBase = mi->second;
+    pindexView = pindexBase;
+}
+
+bool CCoinsView::GetCoin(const COutPoint& outpoint, CCoin& coin) const
+{
+    CCoinsChanges::const_iterator it = mapChanges.find(outpoint);
+    if (it != mapChanges.end())
+    {
+        if (it->second.IsNull())
+            return false;
+        coin = it->second;
+        return true;
+    }
+    return pbase->GetCoin(outpoint, coin, pindexBase);
+}
+
+void CCoinsView::ConnectTransaction(const CTransaction& tx, const CBlockIndex* pindex)
+{
+    uint256 hash = tx.GetHash();
+    if (!tx.IsCoinBase())
+    {
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            mapChanges[txin.prevout] = CCoin();
+    }
+    for (unsigned int n = 0; n < tx.vout.size(); n++)
+        mapChanges[COutPoint(hash, n)] = CCoin(tx, n, pindex->nHeight, pindex->nTime);
+}
+
+// Called before the block's own transactions leave the transaction index,
+// so inputs spending an earlier transaction of the same block still resolve
+bool CCoinsView::DisconnectBlock(CTxDB& txdb, const CBlock& block)
+{
+    if (!pindexView || pindexView->GetBlockHash() != block.GetHash())
+        return error("CCoinsView::DisconnectBlock() : block is not the tip of the view");
+
+    BOOST_REVERSE_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        uint256 hash = tx.GetHash();
+        for (unsigned int n = 0; n < tx.vout.size(); n++)
+            mapChanges[COutPoint(hash, n)] = CCoin();
+
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            CCoin coin;
+            if (!ReadSpentCoin(txdb, txin.prevout, coin))
+                return false;
+            mapChanges[txin.prevout] = coin;
+        }
+    }
+    pindexView = pindexView->pprev;
+    return true;
+}
+
+bool CCoinsView::Flush()
+{
+    if (!pbase->ApplyChanges(mapChanges, pindexBase, pindexView))
+        return false;
+    mapChanges.clear();
+    pindexBase = pindexView;
+    return true;
+}
@@ -0,0 +1,215 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2013 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCREDIT_COINS_H
+#define BITCREDIT_COINS_H
+
+#include "core.h"
+#include "sync.h"
+
+#include <map>
+#include <set>
+
+class CBlock;
+class CBlockIndex;
+class CTransaction;
+class CTxDB;
+
+/** Share of the unspent output cache budget that stake candidates may keep pinned */
+static const unsigned int COINS_STAKE_SHARE = 4;
+
+/** Version of the stored set; a set written by an older one is rebuilt on load */
+static const int COINS_VERSION = 1;
+
+/** Blocks between the progress reports of a long replay */
+static const unsigned int COINS_REPLAY_PROGRESS = 10000;
+
+/** An unspent transaction output of the best chain, with what validation needs to know about it */
+class CCoin
+{
+public:
+    enum
+    {
+        COIN_COINBASE  = (1 << 0),
+        COIN_COINSTAKE = (1 << 1),
+    };
+
+    CTxOut txout;
+    int nHeight;             // height of the block holding the transaction
+    unsigned int nTime;      // transaction timestamp
+    unsigned int nBlockTime; // timestamp of the block holding the transaction
+    unsigned char nFlags;
+
+    CCoin()
+    {
+        SetNull();
+    }
+
+    CCoin(const CTransaction& tx, unsigned int n, int nHeightIn, unsigned int nBlockTimeIn);
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(txout);
+        READWRITE(nHeight);
+        READWRITE(nTime);
+        READWRITE(nBlockTime);
+        READWRITE(nFlags);
+    )
+
+    void SetNull()
+    {
+        txout.SetNull();
+        nHeight = -1;
+        nTime = nBlockTime = 0;
+        nFlags = 0;
+    }
+
+    bool IsNull() const { return txout.IsNull(); }
+    bool IsCoinBase() const { return (nFlags & COIN_COINBASE) != 0; }
+    bool IsCoinStake() const { return (nFlags & COIN_COINSTAKE) != 0; }
+};
+
+/** Outputs added (a coin) or spent (a null coin) on top of a set */
+typedef std::map<COutPoint, CCoin> CCoinsChanges;
+
+/** Runtime statistics of the unspent output cache */
+struct CCoinsStats
+{
+    uint256 hashBlock;
+    uint64_t nEntries;
+    uint64_t nDirty;
+    uint64_t nStake;
+    uint64_t nStakeUsage;
+    uint64_t nUsage;
+    uint64_t nMaxUsage;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nFlushes;
+    int64_t nFlushTimeMs;
+};
+
+/**
+ * The unspent output set of the best chain, stored in txleveldb under
+ * "utxo" keys with a write-back cache in front of it.
+ *
+ * This is what inputs are validated against: FetchInputs resolves them
+ * here (through a CCoinsView) and an output that is not in the set is
+ * either spent or was never created. The transaction index only keeps
+ * where each transaction is stored. Changes are only written out when the
+ * cache outgrows its budget (-dbcache) or at shutdown, together with the
+ * block they reflect, and replayed from the block files on the next start
+ * if that block is not the best one any more.
+ */
+class CCoinsCache
+{
+private:
+    struct CEntry
+    {
+        CCoin coin;
+        bool fSpent; // erased, erase not yet written
+        bool fDirty; // differs from the database
+        bool fFresh; // the database has never seen this output
+        bool fStake; // looked up for staking, kept in memory across flushes while within the stake budget
+
+        CEntry() : fSpent(false), fDirty(false), fFresh(false), fStake(false) {}
+    };
+    typedef std::map<COutPoint, CEntry> CEntryMap;
+
+    mutable CCriticalSection cs;
+    CEntryMap mapCoins;
+    uint256 hashBlock;
+    size_t nUsage;
+    size_t nStakeUsage; // part of nUsage held by fStake entries
+    size_t nMaxUsage;
+    int64_t nLastFlush;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nFlushes;
+    int64_t nFlushTimeMs;
+
+    static size_t EntryUsage(const CEntry& entry);
+    void AddUsage(const CEntry& entry);
+    void RemoveUsage(const CEntry& entry);
+    CEntryMap::iterator Fetch(const COutPoint& outpoint);
+    void AddCoin(const COutPoint& outpoint, const CCoin& coin);
+    void SpendCoin(const COutPoint& outpoint);
+    bool ConnectBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool DisconnectBlock(CTxDB& txdb, const CBlock& block, const std::set<uint256>& setDisconnectedTx);
+    bool FlushUnlocked();
+
+public:
+    CCoinsCache(size_t nMaxUsageIn);
+
+    /**
+     * Look an output up; false if it is spent, unknown, or the set does not
+     * currently reflect pindexAt (kernel and coin age lookups then fall back
+     * to the tx index).
+     * Outputs looked up with fStake stay in memory until they are spent, so
+     * the kernel search and stake weight of a wallet do not hit the disk;
+     * they hold a 1/COINS_STAKE_SHARE of the budget at most, and the ones
+     * past it are cached like any other output.
+     */
+    bool GetCoin(const COutPoint& outpoint, CCoin& coin, const CBlockIndex* pindexAt, bool fStake = false);
+
+    /** Block the set currently reflects */
+    uint256 GetBestBlock() const;
+
+    /** Take over the changes of a view built on pindexFrom, which leave the set at pindexTo */
+    bool ApplyChanges(const CCoinsChanges& mapChanges, const CBlockIndex* pindexFrom, const CBlockIndex* pindexTo);
+
+    /** Replay the blocks between the set and pindexTip, which have been validated before */
+    bool SyncToTip(CTxDB& txdb, CBlockIndex* pindexTip);
+
+    /** Read the best block of the stored set and catch up with the chain, rebuilding if needed */
+    bool Load(CTxDB& txdb);
+
+    /** Write all pending changes out */
+    bool Flush();
+
+    /** Flush if the cache is over budget or has not been written for a while */
+    bool FlushIfNeeded();
+
+    void GetStats(CCoinsStats& stats) const;
+};
+
+/**
+ * Changes to the unspent output set staged on top of a CCoinsCache while a
+ * block, a reorganisation or a pool transaction is being validated. The set
+ * only sees them on Flush, which the chain code calls once the transaction
+ * index commit for the same blocks went through; a failed validation just
+ * drops the view.
+ */
+class CCoinsView
+{
+private:
+    CCoinsCache* pbase;
+    const CBlockIndex* pindexBase; // block pbase reflects
+    const CBlockIndex* pindexView; // block the view reflects
+    CCoinsChanges mapChanges;
+
+public:
+    /** A view of the set as it is, at the block it currently reflects */
+    explicit CCoinsView(CCoinsCache* pbaseIn);
+
+    /** Look an unspent output up, in the staged changes first */
+    bool GetCoin(const COutPoint& outpoint, CCoin& coin) const;
+
+    /** Spend the inputs of tx and add its outputs, confirmed in pindex */
+    void ConnectTransaction(const CTransaction& tx, const CBlockIndex* pindex);
+
+    /** Take back the last block: its outputs go and the ones it spent are read back from the tx index */
+    bool DisconnectBlock(CTxDB& txdb, const CBlock& block);
+
+    /** Block the view reflects, NULL before the genesis block */
+    const CBlockIndex* GetBestBlock() const { return pindexView; }
+    void SetBestBlock(const CBlockIndex* pindex) { pindexView = pindex; }
+
+    /** Hand the staged changes to the set */
+    bool Flush();
+};
+
+/** The unspent output set of the best chain */
+extern CCoinsCache* pcoinsTip;
+
+#endif // BITCREDIT_COINS_H
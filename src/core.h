@@ -12,9 +12,15 @@
 
 #include <stdio.h>
 
+#include <boost/shared_ptr.hpp>
+
 class CScript;
 class CTransaction;
 
+/** A transaction shared between its holders (mempool, relay, block assembly);
+ *  the pointee has been made immutable and must not be modified */
+typedef boost::shared_ptr<const CTransaction> CTransactionRef;
+
 /** An outpoint - a combination of a transaction hash and an index n into its vout */
 class COutPoint
 {
@@ -52,11 +58,11 @@ public:
 class CInPoint
 {
 public:
-    CTransaction* ptx;
+    const CTransaction* ptx;
     unsigned int n;
 
     CInPoint() { SetNull(); }
-    CInPoint(CTransaction* ptxIn, unsigned int nIn) { ptx = ptxIn; n = nIn; }
+    CInPoint(const CTransaction* ptxIn, unsigned int nIn) { ptx = ptxIn; n = nIn; }
     void SetNull() { ptx = NULL; n = (unsigned int) -1; }
     bool IsNull() const { return (ptx == NULL && n == (unsigned int) -1); }
 };
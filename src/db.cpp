@@ -234,7 +234,7 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 
 
 CDB::CDB(const std::string& strFilename, const char* pszMode) :
-    pdb(NULL), activeTxn(NULL)
+    pdb(NULL), activeTxn(NULL), batchTxn(NULL)
 {
     int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
@@ -293,6 +293,12 @@ CDB::CDB(const std::string& strFilename, const char* pszMode) :
 
             bitdb.mapDb[strFile] = pdb;
         }
+
+        // Join this thread's write batch on the file
+        std::map<std::pair<boost::thread::id, std::string>, CDBBatch*>::iterator mi =
+            bitdb.mapBatch.find(make_pair(boost::this_thread::get_id(), strFile));
+        if (mi != bitdb.mapBatch.end())
+            activeTxn = batchTxn = (*mi).second->GetTxn();
     }
 }
 
@@ -300,22 +306,78 @@ void CDB::Close()
 {
     if (!pdb)
         return;
-    if (activeTxn)
+    if (activeTxn && activeTxn != batchTxn)
         activeTxn->abort();
     activeTxn = NULL;
     pdb = NULL;
 
     // Flush database activity from memory pool to disk log
-    unsigned int nMinutes = 0;
-    if (fReadOnly)
-        nMinutes = 1;
+    // (a batch does that once, when it commits)
+    if (!batchTxn)
+    {
+        unsigned int nMinutes = 0;
+        if (fReadOnly)
+            nMinutes = 1;
+
+        bitdb.dbenv.txn_checkpoint(nMinutes ? GetArg("-dblogsize", 100)*1024 : 0, nMinutes, 0);
+    }
+    batchTxn = NULL;
+
+    {
+        LOCK(bitdb.cs_db);
+        --bitdb.mapFileUseCount[strFile];
+    }
+}
+
+CDBBatch::CDBBatch(const std::string& strFileIn) : strFile(strFileIn), fActive(false), ptxn(NULL)
+{
+    if (strFile.empty())
+        return;
+    LOCK(bitdb.cs_db);
+    std::pair<boost::thread::id, std::string> key = make_pair(boost::this_thread::get_id(), strFile);
+    if (bitdb.mapBatch.count(key))
+        return; // nested in a batch of this thread
+    bitdb.mapBatch[key] = this;
+    fActive = true;
+}
 
-    bitdb.dbenv.txn_checkpoint(nMinutes ? GetArg("-dblogsize", 100)*1024 : 0, nMinutes, 0);
+DbTxn* CDBBatch::GetTxn()
+{
+    AssertLockHeld(bitdb.cs_db);
+    if (!ptxn)
+    {
+        ptxn = bitdb.TxnBegin();
+        // Keep ThreadFlushWalletDB from closing the file under the open transaction
+        if (ptxn)
+            ++bitdb.mapFileUseCount[strFile];
+    }
+    return ptxn;
+}
 
+bool CDBBatch::Commit()
+{
+    if (!fActive)
+        return true;
+    DbTxn* ptxnCommit;
+    {
+        LOCK(bitdb.cs_db);
+        bitdb.mapBatch.erase(make_pair(boost::this_thread::get_id(), strFile));
+        fActive = false;
+        ptxnCommit = ptxn;
+        ptxn = NULL;
+    }
+    if (!ptxnCommit)
+        return true; // nothing was written
+
+    int ret = ptxnCommit->commit(0);
+    bitdb.dbenv.txn_checkpoint(0, 0, 0);
     {
         LOCK(bitdb.cs_db);
         --bitdb.mapFileUseCount[strFile];
     }
+    if (ret != 0)
+        return error("CDBBatch::Commit() : commit of %s failed, error %d", strFile, ret);
+    return true;
 }
 
 void CDBEnv::CloseDb(const string& strFile)
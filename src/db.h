@@ -15,10 +15,12 @@
 #include <vector>
 
 #include <boost/filesystem/path.hpp>
+#include <boost/thread/thread.hpp>
 #include <db_cxx.h>
 
 class CAddrMan;
 class CBlockLocator;
+class CDBBatch;
 class CDiskBlockIndex;
 class CDiskTxPos;
 class COutPoint;
@@ -44,6 +46,8 @@ public:
     DbEnv dbenv;
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
+    // Open write batches by thread and file (see CDBBatch)
+    std::map<std::pair<boost::thread::id, std::string>, CDBBatch*> mapBatch;
 
     CDBEnv();
     ~CDBEnv();
@@ -76,10 +80,10 @@ public:
     void CloseDb(const std::string& strFile);
     bool RemoveDb(const std::string& strFile);
 
-    DbTxn *TxnBegin(int flags=DB_TXN_WRITE_NOSYNC)
+    DbTxn *TxnBegin(int flags=DB_TXN_WRITE_NOSYNC, DbTxn* ptxnParent=NULL)
     {
         DbTxn* ptxn = NULL;
-        int ret = dbenv.txn_begin(NULL, &ptxn, flags);
+        int ret = dbenv.txn_begin(ptxnParent, &ptxn, flags);
         if (!ptxn || ret != 0)
             return NULL;
         return ptxn;
@@ -96,6 +100,7 @@ protected:
     Db* pdb;
     std::string strFile;
     DbTxn *activeTxn;
+    DbTxn *batchTxn; // write batch of this thread the handle joined, if any
     bool fReadOnly;
 
     explicit CDB(const std::string& strFilename, const char* pszMode="r+");
@@ -266,11 +271,12 @@ protected:
     }
 
 public:
+    // Inside a write batch these nest in the batch's transaction
     bool TxnBegin()
     {
-        if (!pdb || activeTxn)
+        if (!pdb || activeTxn != batchTxn)
             return false;
-        DbTxn* ptxn = bitdb.TxnBegin();
+        DbTxn* ptxn = bitdb.TxnBegin(DB_TXN_WRITE_NOSYNC, batchTxn);
         if (!ptxn)
             return false;
         activeTxn = ptxn;
@@ -279,19 +285,19 @@ public:
 
     bool TxnCommit()
     {
-        if (!pdb || !activeTxn)
+        if (!pdb || activeTxn == batchTxn)
             return false;
         int ret = activeTxn->commit(0);
-        activeTxn = NULL;
+        activeTxn = batchTxn;
         return (ret == 0);
     }
 
     bool TxnAbort()
     {
-        if (!pdb || !activeTxn)
+        if (!pdb || activeTxn == batchTxn)
             return false;
         int ret = activeTxn->abort();
-        activeTxn = NULL;
+        activeTxn = batchTxn;
         return (ret == 0);
     }
 
@@ -309,4 +315,36 @@ public:
     bool static Rewrite(const std::string& strFile, const char* pszSkip = NULL);
 };
 
+
+/**
+ * Groups the writes of one logical operation (a block during a rescan, a
+ * sendmany, a keypool refill) to strFile into a single database transaction,
+ * committed and checkpointed once instead of once per record.
+ *
+ * Every CDB the constructing thread opens on strFile while the batch is
+ * alive joins it, so existing code writes through the batch unchanged.
+ * Open the batch before any handle used inside its scope and hold the
+ * lock guarding the file's users (cs_wallet for wallet.dat) for its whole
+ * lifetime: other threads block on the pages it has written until it commits.
+ * Batches nest; only the outermost one commits.
+ */
+class CDBBatch
+{
+private:
+    std::string strFile;
+    bool fActive; // outermost batch of this thread on strFile
+    DbTxn* ptxn;  // begun when the first handle joins
+
+    CDBBatch(const CDBBatch&);
+    void operator=(const CDBBatch&);
+
+public:
+    explicit CDBBatch(const std::string& strFileIn);
+    ~CDBBatch() { Commit(); }
+
+    /** The transaction for a joining handle (call with bitdb.cs_db held) */
+    DbTxn* GetTxn();
+    bool Commit();
+};
+
 #endif // BITCREDIT_DB_H
@@ -54,3 +54,48 @@ void BIP32Hash(const unsigned char chainCode[32], unsigned int nChild, unsigned
     HMAC_SHA512_Update(&ctx, num, 4);
     HMAC_SHA512_Final(output, &ctx);
 }
+
+#define ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND do { \
+    v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+    v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+} while (0)
+
+uint64_t SipHash(uint64_t k0, uint64_t k1, const unsigned char* data, size_t size)
+{
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+    size_t nBlocks = size / 8;
+    for (size_t i = 0; i < nBlocks; i++, data += 8)
+    {
+        uint64_t m = 0;
+        for (int j = 7; j >= 0; j--)
+            m = (m << 8) | data[j];
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    // The last block holds the remaining bytes and the length in its top byte
+    uint64_t m = ((uint64_t)size) << 56;
+    for (int j = (int)(size % 8) - 1; j >= 0; j--)
+        m |= ((uint64_t)data[j]) << (8 * j);
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+
+    v2 ^= 0xFF;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
@@ -7,11 +7,16 @@
 #include "init.h"
 
 #include "addrman.h"
+#include "blockcache.h"
+#include "blockfile.h"
+#include "blockfilter.h"
 #include "mainfunctions.h"
 #include "chainfunctions.h"
+#include "coins.h"
 #include "txdb.h"
 #include "rpcserver.h"
 #include "net.h"
+#include "orphanpool.h"
 #include "key.h"
 #include "pubkey.h"
 #include "util.h"
@@ -131,6 +136,14 @@ void Shutdown()
         if (pwalletMain)
             pwalletMain->SetBestChain(CBlockLocator(pindexBest));
 #endif
+        // The unspent output set refers to the blocks, so they go first
+        CloseBlockFiles();
+        if (pcoinsTip)
+        {
+            pcoinsTip->Flush();
+            // Waits for a compaction still running on it
+            CTxDB().Close();
+        }
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -144,7 +157,9 @@ void Shutdown()
 #endif
     globalVerifyHandle.reset();
     ECC_Stop();
+    StopParallelWorkers();
     LogPrintf("Shutdown : done\n");
+    StopLogWriter();
 }
 
 //
@@ -193,7 +208,10 @@ std::string HelpMessage()
     strUsage += "  -pid=<file>            " + _("Specify pid file (default: Advantaged.pid)") + "\n";
     strUsage += "  -datadir=<dir>         " + _("Specify data directory") + "\n";
     strUsage += "  -wallet=<dir>          " + _("Specify wallet file (within data directory)") + "\n";
-    strUsage += "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 10)") + "\n";
+    strUsage += "  -dbcache=<n>           " + _("Set database cache size in megabytes, used for both the LevelDB block cache and the unspent output cache (default: 10, 2 with -dbprofile=lowmem)") + "\n";
+    strUsage += "  -blockcache=<n>        " + _("Set the size in megabytes of the cache of recently read blocks and transactions, 0 to disable (default: 32)") + "\n";
+    strUsage += "  -dbprofile=<profile>   " + _("LevelDB tuning: auto, default, ibd (large write buffers, no sync) or lowmem (default: auto, ibd for a new database until it has caught up)") + "\n";
+    strUsage += "  -dbsync                " + _("Wait for the disk on database commits that move the best chain, unless the profile is ibd (default: 0)") + "\n";
     strUsage += "  -dbwalletcache=<n>     " + _("Set wallet database cache size in megabytes (default: 1)") + "\n";
     strUsage += "  -dblogsize=<n>         " + _("Set database disk log size in megabytes (default: 100)") + "\n";
     strUsage += "  -timeout=<n>           " + _("Specify connection timeout in milliseconds (default: 5000)") + "\n";
@@ -244,6 +262,7 @@ std::string HelpMessage()
         strUsage += ".\n";
     }
     strUsage += "  -logtimestamps         " + _("Prepend debug output with timestamp") + "\n";
+    strUsage += "  -logasync              " + _("Write debug.log from a background thread (default: 1)") + "\n";
     strUsage += "  -shrinkdebugfile       " + _("Shrink debug.log file on client startup (default: 1 when no -debug)") + "\n";
     strUsage += "  -printtoconsole        " + _("Send trace/debug info to console instead of debug.log file") + "\n";
     strUsage += "  -regtest               " + _("Enter regression test mode, which uses a special chain in which blocks can be "
@@ -265,11 +284,15 @@ std::string HelpMessage()
     strUsage += "  -createwalletbackups=<n> " + _("Number of automatic wallet backups (default: 10)") + "\n";
     strUsage += "  -keypool=<n>           " + _("Set key pool size to <n> (default: 100) (litemode: 10)") + "\n";
     strUsage += "  -rescan                " + _("Rescan the block chain for missing wallet transactions") + "\n";
+    strUsage += "  -blockfilterindex      " + _("Keep compact filters of the scripts each block creates and spends, to skip blocks in wallet rescans (default: 0)") + "\n";
     strUsage += "  -salvagewallet         " + _("Attempt to recover private keys from a corrupt wallet.dat") + "\n";
     strUsage += "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 500, 0 = all)") + "\n";
     strUsage += "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n";
     strUsage += "  -maxorphanblocks=<n>   " + strprintf(_("Keep at most <n> unconnectable blocks in memory (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCKS) + "\n";
+    strUsage += "  -maxorphanblockssize=<n> " + strprintf(_("Keep at most <n> megabytes of unconnectable blocks in memory (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCKS_SIZE) + "\n";
+    strUsage += "  -maxorphantx=<n>       " + strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS) + "\n";
+    strUsage += "  -maxorphantxsize=<n>   " + strprintf(_("Keep at most <n> megabytes of unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TX_SIZE) + "\n";
 
     strUsage += "\n" + _("Block creation options:") + "\n";
     strUsage += "  -blockminsize=<n>      "   + _("Set minimum block size in bytes (default: 0)") + "\n";
@@ -376,6 +399,10 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     nNodeLifespan = GetArg("-addrlifespan", 7);
     fUseFastIndex = GetBoolArg("-fastindex", true);
+    fBlockFilterIndex = GetBoolArg("-blockfilterindex", false);
+    blockcache.SetMaxUsage((size_t)std::max(GetArg("-blockcache", DEFAULT_BLOCK_CACHE), (int64_t)0) << 20);
+    orphantxpool.SetLimits((size_t)std::max(GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS), (int64_t)0),
+                           (size_t)std::max(GetArg("-maxorphantxsize", DEFAULT_MAX_ORPHAN_TX_SIZE), (int64_t)0) << 20);
     nMinerSleep = GetArg("-minersleep", 500);
 
     nDerivationMethodIndex = 0;
@@ -442,6 +469,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     const vector<string>& categories = mapMultiArgs["-debug"];
     if (GetBoolArg("-nodebug", false) || find(categories.begin(), categories.end(), string("0")) != categories.end())
         fDebug = false;
+    InitLogCategories();
 
     if(fDebug)
     {
@@ -529,6 +557,8 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     if (GetBoolArg("-shrinkdebugfile", !fDebug))
         ShrinkDebugFile();
+    StartLogWriter();
+    StartParallelWorkers();
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("Advantage version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
@@ -929,9 +959,15 @@ bool AppInit2(boost::thread_group& threadGroup)
             nStart = GetTimeMillis();
             pwalletMain->ScanForWalletTransactions(pindexRescan, true);
             LogPrintf(" rescan      %15dms\n", GetTimeMillis() - nStart);
-            pwalletMain->SetBestChain(CBlockLocator(pindexBest));
-            nWalletDBUpdated++;
+            // An interrupted rescan starts over from the same block next time
+            if (!ShutdownRequested())
+            {
+                pwalletMain->SetBestChain(CBlockLocator(pindexBest));
+                nWalletDBUpdated++;
+            }
         }
+
+        threadGroup.create_thread(boost::bind(&ThreadWalletPostLoad, pwalletMain));
     } // (!fDisableWallet)
 #else // ENABLE_WALLET
     LogPrintf("No wallet compiled in!\n");
@@ -946,6 +982,9 @@ bool AppInit2(boost::thread_group& threadGroup)
     }
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
+    if (fBlockFilterIndex)
+        threadGroup.create_thread(&ThreadBlockFilterBackfill);
+
     // ********************************************************* Step 10: load peers
 
     uiInterface.InitMessage(_("Loading addresses..."));
@@ -976,7 +1015,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     uiInterface.InitMessage(_("Loading masternode cache..."));
 
     CMasternodeDB mndb;
-    CMasternodeDB::ReadResult readResult = mndb.Read(mnodeman);
+    CMasternodeDB::ReadResult readResult = mndb.Read(mnodeman, &masternodePayments);
     if (readResult == CMasternodeDB::FileError)
         LogPrintf("Missing masternode cache file - mncache.dat, will try to recreate\n");
     else if (readResult != CMasternodeDB::Ok)
@@ -1088,6 +1127,9 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     threadGroup.create_thread(boost::bind(&ThreadCheckDarkSendPool));
 
+    // Scheduled spork activations take effect within a second, in lite mode too
+    threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "sporks", &CheckSporkSchedule, 1000));
+
 
 
     RandAddSeedPerfmon();
@@ -17,13 +17,23 @@
 using namespace std;
 using namespace boost;
 
-std::map<uint256, CTransaction> mapTxLockReq;
-std::map<uint256, CTransaction> mapTxLockReqRejected;
-std::map<uint256, CConsensusVote> mapTxLockVote;
-std::map<uint256, CTransactionLock> mapTxLocks;
-std::map<COutPoint, uint256> mapLockedInputs;
-std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
+boundedmap<uint256, CTransaction> mapTxLockReq(INSTANTX_MAX_LOCKS, INSTANTX_CACHE_SECONDS);
+boundedmap<uint256, CTransaction> mapTxLockReqRejected(INSTANTX_MAX_LOCKS, INSTANTX_CACHE_SECONDS);
+boundedmap<uint256, CConsensusVote> mapTxLockVote(INSTANTX_MAX_LOCKS * INSTANTX_SIGNATURES_TOTAL, INSTANTX_CACHE_SECONDS);
+// held to INSTANTX_MAX_LOCKS by MakeRoomForTransactionLock, which knows which locks can go
+boundedmap<uint256, CTransactionLock, CTransactionLockUsage> mapTxLocks;
+static uint64_t nTxLocksEvicted = 0;
+// inputs of complete locks; no limit of its own, an entry goes with its lock
+boundedmap<COutPoint, uint256> mapLockedInputs;
+boundedmap<uint256, int64_t> mapUnknownVotes(INSTANTX_MAX_LOCKS, INSTANTX_CACHE_SECONDS); //track votes with no tx for DOS
 int nCompleteTXLocks;
+CCriticalSection cs_instantx;
+CInstantXQuorum instantxQuorum;
+
+static void LockTransactionInputs(const CTransaction& tx);
+
+// serialized hashes of votes whose signature checked out
+static mruset<uint256> setVoteSignaturesValid(10000);
 
 //txlock - Locks transaction
 //
@@ -47,8 +57,11 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
         CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if(mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())){
-            return;
+        {
+            LOCK(cs_instantx);
+            if(mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())){
+                return;
+            }
         }
 
         if(!IsIXTXValid(tx)){
@@ -66,9 +79,6 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
 
         bool fMissingInputs = false;
         CValidationState state;
-        CBlockIndex* pindex;
-        CBlock block;
-        CTxDB txdb("r");
 
         bool fAccepted = false;
         {
@@ -81,7 +91,10 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
 
             DoConsensusVote(tx, nBlockHeight);
 
-            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            {
+                LOCK(cs_instantx);
+                mapTxLockReq.insert(make_pair(tx.GetHash(), tx)).first->second.MakeImmutable();
+            }
 
             LogPrintf("ProcessMessageInstantX::txlreq - Transaction Lock Request: %s %s : accepted %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
@@ -91,7 +104,10 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
             return;
 
         } else {
-            mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            {
+                LOCK(cs_instantx);
+                mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            }
 
             // can we get the conflicting transaction as proof?
 
@@ -100,24 +116,15 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
                 tx.GetHash().ToString().c_str()
             );
 
-            BOOST_FOREACH(const CTxIn& in, tx.vin){
-                if(!mapLockedInputs.count(in.prevout)){
-                    mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
-                }
-            }
-
             // resolve conflicts
-            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
-            if (i != mapTxLocks.end()){
-                //we only care if we have a complete tx lock
-                if((*i).second.CountSignatures() >= INSTANTX_SIGNATURES_REQUIRED){
-                    if(!CheckForConflictingLocks(tx)){
-                        LogPrintf("ProcessMessageInstantX::txlreq - Found Existing Complete IX Lock\n");
-
-                        //reprocess the last 15 blocks
-                        block.DisconnectBlock(txdb, pindex);
-                        tx.DisconnectInputs(txdb);
+            //we only care if we have a complete tx lock
+            if(GetTransactionLockSignatures(tx.GetHash()) >= INSTANTX_SIGNATURES_REQUIRED){
+                if(!CheckForConflictingLocks(tx)){
+                    {
+                        LOCK(cs_instantx);
+                        LockTransactionInputs(tx);
                     }
+                    LogPrintf("ProcessMessageInstantX::txlreq - Found Existing Complete IX Lock\n");
                 }
             }
 
@@ -132,33 +139,43 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if(mapTxLockVote.count(ctx.GetHash())){
-            return;
+        {
+            LOCK(cs_instantx);
+            if(mapTxLockVote.count(ctx.GetHash())){
+                return;
+            }
         }
 
-        mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
-
+        // Only votes that check out are remembered: junk must not push
+        // valid votes out of the cache
         if(ProcessConsensusVote(pfrom, ctx)){
-            //Spam/Dos protection
-            /*
-                Masternodes will sometimes propagate votes before the transaction is known to the client.
-                This tracks those messages and allows it at the same rate of the rest of the network, if
-                a peer violates it, it will simply be ignored
-            */
-            if(!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)){
-                if(!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)){
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime()+(60*10);
-                }
+            {
+                LOCK(cs_instantx);
+                mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
+
+                //Spam/Dos protection
+                /*
+                    Masternodes will sometimes propagate votes before the transaction is known to the client.
+                    This tracks those messages and allows it at the same rate of the rest of the network, if
+                    a peer violates it, it will simply be ignored
+                */
+                if(!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)){
+                    const uint256& hashMasternode = ctx.vinMasternode.prevout.hash;
+                    boundedmap<uint256, int64_t>::iterator it = mapUnknownVotes.find(hashMasternode);
+                    if(it == mapUnknownVotes.end()){
+                        it = mapUnknownVotes.insert(make_pair(hashMasternode, GetTime()+(60*10))).first;
+                    }
 
-                if(mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] - GetAverageVoteTime() > 60*10){
-                        LogPrintf("ProcessMessageInstantX::txlreq - masternode is spamming transaction votes: %s %s\n",
-                            ctx.vinMasternode.ToString().c_str(),
-                            ctx.txHash.ToString().c_str()
-                        );
-                        return;
-                } else {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime()+(60*10);
+                    if(it->second > GetTime() &&
+                        it->second - GetAverageVoteTime() > 60*10){
+                            LogPrintf("ProcessMessageInstantX::txlreq - masternode is spamming transaction votes: %s %s\n",
+                                ctx.vinMasternode.ToString().c_str(),
+                                ctx.txHash.ToString().c_str()
+                            );
+                            return;
+                    } else {
+                        it->second = GetTime()+(60*10);
+                    }
                 }
             }
 
@@ -215,6 +232,75 @@ bool IsIXTXValid(const CTransaction& txCollateral){
     return true;
 }
 
+// Drop a lock along with its request, the inputs it locked and its votes
+static void EraseTransactionLock(boundedmap<uint256, CTransactionLock, CTransactionLockUsage>::iterator it)
+{
+    const uint256& txHash = it->second.txHash;
+    BOOST_FOREACH(const COutPoint& prevout, it->second.vecLockedInputs){
+        boundedmap<COutPoint, uint256>::iterator itInput = mapLockedInputs.find(prevout);
+        if(itInput != mapLockedInputs.end() && itInput->second == txHash)
+            mapLockedInputs.erase(itInput);
+    }
+
+    mapTxLockReq.erase(txHash);
+    mapTxLockReqRejected.erase(txHash);
+
+    BOOST_FOREACH(CConsensusVote& v, it->second.vecConsensusVotes)
+        mapTxLockVote.erase(v.GetHash());
+
+    mapTxLocks.erase(it);
+}
+
+// Record the inputs of a complete lock in mapLockedInputs. The lock owns the
+// entries it adds and drops them when it goes, so they are never evicted
+// while it lives. Called with cs_instantx held.
+static void LockTransactionInputs(const CTransaction& tx)
+{
+    uint256 txHash = tx.GetHash();
+    boundedmap<uint256, CTransactionLock, CTransactionLockUsage>::iterator it = mapTxLocks.find(txHash);
+    if(it == mapTxLocks.end()) return;
+
+    BOOST_FOREACH(const CTxIn& in, tx.vin){
+        if(!mapLockedInputs.count(in.prevout)){
+            mapLockedInputs.insert(make_pair(in.prevout, txHash));
+            it->second.vecLockedInputs.push_back(in.prevout);
+        }
+    }
+    mapTxLocks.resized(it);
+}
+
+// Make room in mapTxLocks for one more lock. Expired locks and the ones that
+// timed out before completing go first, then the oldest incomplete one; a
+// complete lock stays until it expires, so nothing is freed if all of them
+// are. Called with cs_instantx held.
+static bool MakeRoomForTransactionLock()
+{
+    if(mapTxLocks.size() < INSTANTX_MAX_LOCKS) return true;
+
+    int64_t nNow = GetTime();
+    boundedmap<uint256, CTransactionLock, CTransactionLockUsage>::iterator it = mapTxLocks.begin(), itOldest = mapTxLocks.end();
+    while(it != mapTxLocks.end()){
+        boundedmap<uint256, CTransactionLock, CTransactionLockUsage>::iterator itCur = it++;
+        CTransactionLock& lock = itCur->second;
+        bool fComplete = lock.CountSignatures() >= INSTANTX_SIGNATURES_REQUIRED;
+        if(nNow > lock.nExpiration || (!fComplete && nNow > lock.nTimeout)){
+            LogPrint("instantx", "MakeRoomForTransactionLock - Removing %s transaction lock %s\n", fComplete ? "expired" : "timed out", lock.txHash.ToString().c_str());
+            EraseTransactionLock(itCur);
+            nTxLocksEvicted++;
+        } else if(!fComplete && (itOldest == mapTxLocks.end() || lock.nTimeout < itOldest->second.nTimeout)){
+            itOldest = itCur;
+        }
+    }
+
+    if(mapTxLocks.size() < INSTANTX_MAX_LOCKS) return true;
+    if(itOldest == mapTxLocks.end()) return false;
+
+    LogPrint("instantx", "MakeRoomForTransactionLock - Removing incomplete transaction lock %s\n", itOldest->second.txHash.ToString().c_str());
+    EraseTransactionLock(itOldest);
+    nTxLocksEvicted++;
+    return true;
+}
+
 int64_t CreateNewLock(CTransaction tx)
 {
 
@@ -235,17 +321,22 @@ int64_t CreateNewLock(CTransaction tx)
     */
     int nBlockHeight = (pindexBest->nHeight - nTxAge)+4;
 
+    LOCK(cs_instantx);
     if (!mapTxLocks.count(tx.GetHash())){
+        if(!MakeRoomForTransactionLock()){
+            LogPrintf("CreateNewLock - Too many complete transaction locks, ignoring %s\n", tx.GetHash().ToString().c_str());
+            return 0;
+        }
         LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
 
         CTransactionLock newLock;
         newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime()+(20*60); //locks expire after 20 minutes (20 confirmations)
+        newLock.nExpiration = GetTime()+INSTANTX_LOCK_SECONDS; //locks expire after 20 minutes (20 confirmations)
         newLock.nTimeout = GetTime()+(60*5);
         newLock.txHash = tx.GetHash();
         mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
     } else {
-        mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
+        mapTxLocks[tx.GetHash()].SetBlockHeight(nBlockHeight);
         LogPrint("instantx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
     }
 
@@ -257,7 +348,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 {
     if(!fMasterNode) return;
 
-    int n = mnodeman.GetMasternodeRank(activeMasternode.vin, nBlockHeight, MIN_INSTANTX_PROTO_VERSION);
+    int n = instantxQuorum.GetRank(activeMasternode.vin, nBlockHeight);
 
     if(n == -1)
     {
@@ -289,7 +380,10 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
         return;
     }
 
-    mapTxLockVote[ctx.GetHash()] = ctx;
+    {
+        LOCK(cs_instantx);
+        mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
+    }
 
     CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
 
@@ -300,7 +394,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 //received a consensus vote
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 {
-    int n = mnodeman.GetMasternodeRank(ctx.vinMasternode, ctx.nBlockHeight, MIN_INSTANTX_PROTO_VERSION);
+    int n = instantxQuorum.GetRank(ctx.vinMasternode, ctx.nBlockHeight);
 
     CMasternode* pmn = mnodeman.Find(ctx.vinMasternode);
     if(pmn != NULL)
@@ -329,74 +423,86 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         return false;
     }
 
-    if (!mapTxLocks.count(ctx.txHash)){
-        LogPrintf("InstantX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
+    //compile consessus vote
+    int nSignatures;
+    {
+        LOCK(cs_instantx);
+        boundedmap<uint256, CTransactionLock, CTransactionLockUsage>::iterator i = mapTxLocks.find(ctx.txHash);
+        if (i == mapTxLocks.end()){
+            if(!MakeRoomForTransactionLock()){
+                LogPrintf("InstantX::ProcessConsensusVote - Too many complete transaction locks, ignoring %s\n", ctx.txHash.ToString().c_str());
+                return false;
+            }
+            LogPrintf("InstantX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
+
+            CTransactionLock newLock;
+            newLock.nBlockHeight = 0;
+            newLock.nExpiration = GetTime()+INSTANTX_LOCK_SECONDS;
+            newLock.nTimeout = GetTime()+(60*5);
+            newLock.txHash = ctx.txHash;
+            i = mapTxLocks.insert(make_pair(ctx.txHash, newLock)).first;
+        } else {
+            LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
+        }
 
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime()+(20*60);
-        newLock.nTimeout = GetTime()+(60*5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
-    } else {
-        LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
+        if(!(*i).second.AddSignature(ctx)){
+            LogPrint("instantx", "InstantX::ProcessConsensusVote - Masternode %s already voted on %s\n", ctx.vinMasternode.prevout.ToString().c_str(), ctx.txHash.ToString().c_str());
+            return false;
+        }
+        mapTxLocks.resized(i);
+        nSignatures = (*i).second.CountSignatures();
     }
 
-    CBlockIndex* pindex;
-    CBlock block;
-    CTxDB txdb("r");
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
-    if (i != mapTxLocks.end()){
-        (*i).second.AddSignature(ctx);
-
 #ifdef ENABLE_WALLET
-        if(pwalletMain){
-            //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
-            if(pwalletMain->mapRequestCount.count(ctx.txHash))
-                pwalletMain->mapRequestCount[ctx.txHash]++;
-        }
+    if(pwalletMain){
+        //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
+        if(pwalletMain->mapRequestCount.count(ctx.txHash))
+            pwalletMain->mapRequestCount[ctx.txHash]++;
+    }
 #endif
 
-        LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", (*i).second.CountSignatures(), ctx.GetHash().ToString().c_str());
+    LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", nSignatures, ctx.GetHash().ToString().c_str());
+
+    if(nSignatures >= INSTANTX_SIGNATURES_REQUIRED){
+        LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", ctx.txHash.ToString().c_str());
 
-        if((*i).second.CountSignatures() >= INSTANTX_SIGNATURES_REQUIRED){
-            LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
+        CTransaction tx;
+        bool fRejected = false;
+        bool fConflict;
+        {
+            LOCK(cs_instantx);
+            boundedmap<uint256, CTransaction>::iterator itReq = mapTxLockReq.find(ctx.txHash);
+            if(itReq != mapTxLockReq.end()){
+                tx = itReq->second;
+            } else if((itReq = mapTxLockReqRejected.find(ctx.txHash)) != mapTxLockReqRejected.end()){
+                tx = itReq->second;
+                fRejected = true;
+            }
+            // a transaction not seen yet has no inputs to check or lock
+            fConflict = CheckForConflictingLocks(tx);
+            if(!fConflict)
+                LockTransactionInputs(tx);
+        }
 
-            CTransaction& tx = mapTxLockReq[ctx.txHash];
-            if(!CheckForConflictingLocks(tx)){
+        if(!fConflict){
 
 #ifdef ENABLE_WALLET
-                if(pwalletMain){
-                    if(pwalletMain->UpdatedTransaction((*i).second.txHash)){
-                        nCompleteTXLocks++;
-                    }
+            if(pwalletMain){
+                if(pwalletMain->UpdatedTransaction(ctx.txHash)){
+                    nCompleteTXLocks++;
                 }
+            }
 #endif
 
-                if(mapTxLockReq.count(ctx.txHash)){
-                    BOOST_FOREACH(const CTxIn& in, tx.vin){
-                        if(!mapLockedInputs.count(in.prevout)){
-                            mapLockedInputs.insert(make_pair(in.prevout, ctx.txHash));
-                        }
-                    }
-                }
-
-                // resolve conflicts
+            // resolve conflicts
 
-                //if this tx lock was rejected, we need to remove the conflicting blocks
-                if(mapTxLockReqRejected.count((*i).second.txHash)){
-                    //reprocess the last 15 blocks
-                    block.DisconnectBlock(txdb, pindex);
-                    tx.DisconnectInputs(txdb);
-                }
-            }
+            //if this tx lock was rejected, the conflicting blocks stay in the
+            //chain; nothing here can reprocess them
+            if(fRejected)
+                LogPrintf("InstantX::ProcessConsensusVote - Rejected transaction %s completed its lock, conflicting blocks are kept\n", ctx.txHash.ToString().c_str());
         }
-        return true;
     }
-
-
-    return false;
+    return true;
 }
 
 bool CheckForConflictingLocks(CTransaction& tx)
@@ -408,14 +514,18 @@ bool CheckForConflictingLocks(CTransaction& tx)
         Blocks could have been rejected during this time, which is OK. After they cancel out, the client will
         rescan the blocks and find they're acceptable and then take the chain with the most work.
     */
+    LOCK(cs_instantx);
+    uint256 txHash = tx.GetHash();
     BOOST_FOREACH(const CTxIn& in, tx.vin){
-        if(mapLockedInputs.count(in.prevout)){
-            if(mapLockedInputs[in.prevout] != tx.GetHash()){
-                LogPrintf("InstantX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if(mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if(mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
-                return true;
-            }
+        boundedmap<COutPoint, uint256>::iterator itInput = mapLockedInputs.find(in.prevout);
+        if(itInput != mapLockedInputs.end() && itInput->second != txHash){
+            uint256 txHashOther = itInput->second;
+            LogPrintf("InstantX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", txHash.ToString().c_str(), txHashOther.ToString().c_str());
+            boundedmap<uint256, CTransactionLock, CTransactionLockUsage>::iterator it = mapTxLocks.find(txHash);
+            if(it != mapTxLocks.end()) it->second.nExpiration = GetTime();
+            it = mapTxLocks.find(txHashOther);
+            if(it != mapTxLocks.end()) it->second.nExpiration = GetTime();
+            return true;
         }
     }
 
@@ -424,7 +534,8 @@ bool CheckForConflictingLocks(CTransaction& tx)
 
 int64_t GetAverageVoteTime()
 {
-    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
+    LOCK(cs_instantx);
+    boundedmap<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
     int64_t total = 0;
     int64_t count = 0;
 
@@ -434,6 +545,7 @@ int64_t GetAverageVoteTime()
         it++;
     }
 
+    if(count == 0) return 0;
     return total / count;
 }
 
@@ -441,29 +553,16 @@ void CleanTransactionLocksList()
 {
     if(pindexBest == NULL) return;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
-
-    while(it != mapTxLocks.end()) {
-        if(GetTime() > it->second.nExpiration){ //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+    LOCK(cs_instantx);
 
-            if(mapTxLockReq.count(it->second.txHash)){
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
-
-                BOOST_FOREACH(const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
-
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
-
-                BOOST_FOREACH(CConsensusVote& v, it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
-
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
-        }
+    // Locks are created with the same lifetime, so the oldest ones expire
+    // first; the ones cut short by a conflict already count as gone and are
+    // dropped when their turn comes
+    int64_t nNow = GetTime();
+    boundedmap<uint256, CTransactionLock, CTransactionLockUsage>::iterator it;
+    while((it = mapTxLocks.oldest()) != mapTxLocks.end() && nNow > it->second.nExpiration) {
+        LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+        EraseTransactionLock(it);
     }
 
 }
@@ -476,6 +575,14 @@ uint256 CConsensusVote::GetHash() const
 
 bool CConsensusVote::SignatureValid()
 {
+    // Votes are checked when they arrive and again when a lock is examined
+    uint256 hash = SerializeHash(*this);
+    {
+        LOCK(cs_instantx);
+        if(setVoteSignaturesValid.count(hash))
+            return true;
+    }
+
     std::string errorMessage;
     std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
     //LogPrintf("verify strMessage %s \n", strMessage.c_str());
@@ -493,6 +600,8 @@ bool CConsensusVote::SignatureValid()
         return false;
     }
 
+    LOCK(cs_instantx);
+    setVoteSignaturesValid.insert(hash);
     return true;
 }
 
@@ -529,9 +638,9 @@ bool CConsensusVote::Sign()
 bool CTransactionLock::SignaturesValid()
 {
 
-    BOOST_FOREACH(CConsensusVote vote, vecConsensusVotes)
+    BOOST_FOREACH(CConsensusVote& vote, vecConsensusVotes)
     {
-        int n = mnodeman.GetMasternodeRank(vote.vinMasternode, vote.nBlockHeight, MIN_INSTANTX_PROTO_VERSION);
+        int n = instantxQuorum.GetRank(vote.vinMasternode, vote.nBlockHeight);
 
         if(n == -1)
         {
@@ -554,9 +663,25 @@ bool CTransactionLock::SignaturesValid()
     return true;
 }
 
-void CTransactionLock::AddSignature(CConsensusVote& cv)
+bool CTransactionLock::AddSignature(CConsensusVote& cv)
 {
+    if(!setVoters.insert(cv.vinMasternode.prevout).second)
+        return false;
     vecConsensusVotes.push_back(cv);
+    if(cv.nBlockHeight == nBlockHeight)
+        nSignatures++;
+    return true;
+}
+
+void CTransactionLock::SetBlockHeight(int nBlockHeightIn)
+{
+    nBlockHeight = nBlockHeightIn;
+    nSignatures = 0;
+    BOOST_FOREACH(const CConsensusVote& v, vecConsensusVotes){
+        if(v.nBlockHeight == nBlockHeight){
+            nSignatures++;
+        }
+    }
 }
 
 int CTransactionLock::CountSignatures()
@@ -568,11 +693,84 @@ int CTransactionLock::CountSignatures()
 
     if(nBlockHeight == 0) return -1;
 
-    int n = 0;
-    BOOST_FOREACH(CConsensusVote v, vecConsensusVotes){
-        if(v.nBlockHeight == nBlockHeight){
-            n++;
+    return nSignatures;
+}
+
+void GetInstantXCacheInfo(std::vector<CCacheInfo>& vInfo)
+{
+    LOCK(cs_instantx);
+    vInfo.push_back(mapTxLockReq.GetInfo("txlockrequests"));
+    vInfo.push_back(mapTxLockReqRejected.GetInfo("txlockrejected"));
+    vInfo.push_back(mapTxLockVote.GetInfo("txlockvotes"));
+    CCacheInfo infoLocks = mapTxLocks.GetInfo("txlocks");
+    infoLocks.nMaxEntries = INSTANTX_MAX_LOCKS;
+    infoLocks.nEvicted = nTxLocksEvicted;
+    vInfo.push_back(infoLocks);
+    vInfo.push_back(mapLockedInputs.GetInfo("lockedinputs"));
+    vInfo.push_back(mapUnknownVotes.GetInfo("unknownvotes"));
+}
+
+int GetTransactionLockSignatures(const uint256& txHash)
+{
+    LOCK(cs_instantx);
+    boundedmap<uint256, CTransactionLock, CTransactionLockUsage>::iterator i = mapTxLocks.find(txHash);
+    if (i != mapTxLocks.end() && GetTime() <= (*i).second.nExpiration){
+        return (*i).second.CountSignatures();
+    }
+
+    return -1;
+}
+
+bool IsTransactionLockTimedOut(const uint256& txHash)
+{
+    LOCK(cs_instantx);
+    boundedmap<uint256, CTransactionLock, CTransactionLockUsage>::iterator i = mapTxLocks.find(txHash);
+    if (i != mapTxLocks.end()){
+        return GetTime() > (*i).second.nTimeout;
+    }
+
+    return false;
+}
+
+int CInstantXQuorum::GetRank(const CTxIn& vin, int nBlockHeight)
+{
+    {
+        LOCK(cs);
+
+        // A new block, or masternodes added, removed, enabled or disabled,
+        // can reorder the ranking
+        uint64_t nGeneration = mnodeman.GetStateGeneration();
+        if(nTipHeight != nBestHeight || nMasternodeGeneration != nGeneration){
+            mapQuorums.clear();
+            nTipHeight = nBestHeight;
+            nMasternodeGeneration = nGeneration;
+        }
+
+        std::map<int, std::map<COutPoint, int> >::iterator mi = mapQuorums.find(nBlockHeight);
+        if(mi == mapQuorums.end()){
+            std::vector<CTxIn> vecQuorum = mnodeman.GetMasternodeQuorum(nBlockHeight, INSTANTX_SIGNATURES_TOTAL, MIN_INSTANTX_PROTO_VERSION);
+            if(vecQuorum.empty()) return -1; // unknown block
+
+            // votes can name any height, keep the number of rankings bounded
+            if(mapQuorums.size() >= 64) mapQuorums.erase(mapQuorums.begin());
+
+            mi = mapQuorums.insert(make_pair(nBlockHeight, std::map<COutPoint, int>())).first;
+            for(unsigned int i = 0; i < vecQuorum.size(); i++)
+                mi->second[vecQuorum[i].prevout] = i + 1;
         }
+
+        std::map<COutPoint, int>::iterator ri = mi->second.find(vin.prevout);
+        if(ri != mi->second.end()) return ri->second;
     }
-    return n;
-}
\ No newline at end of file
+
+    // outside the quorum; tell unknown masternodes apart so they get asked for
+    if(mnodeman.Find(vin) == NULL) return -1;
+    return INSTANTX_SIGNATURES_TOTAL + 1;
+}
+
+void CInstantXQuorum::Clear()
+{
+    LOCK(cs);
+    mapQuorums.clear();
+    nTipHeight = -1;
+}
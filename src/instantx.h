@@ -15,21 +15,34 @@
 #include "script.h"
 #include "base58.h"
 #include "mainfunctions.h"
+#include "boundedmap.h"
+#include "mruset.h"
 
 using namespace std;
 using namespace boost;
 
+// Locks expire INSTANTX_LOCK_SECONDS after they were created; the requests and
+// votes they reference are kept for INSTANTX_CACHE_SECONDS so they go after the
+// locks, the locked inputs go with them
+#define INSTANTX_LOCK_SECONDS                  (20*60)
+#define INSTANTX_CACHE_SECONDS                 (60*60)
+#define INSTANTX_MAX_LOCKS                     10000
+
 class CConsensusVote;
 class CTransaction;
 class CTransactionLock;
+struct CTransactionLockUsage;
 
-extern map<uint256, CTransaction> mapTxLockReq;
-extern map<uint256, CTransaction> mapTxLockReqRejected;
-extern map<uint256, CConsensusVote> mapTxLockVote;
-extern map<uint256, CTransactionLock> mapTxLocks;
-extern std::map<COutPoint, uint256> mapLockedInputs;
+extern boundedmap<uint256, CTransaction> mapTxLockReq;
+extern boundedmap<uint256, CTransaction> mapTxLockReqRejected;
+extern boundedmap<uint256, CConsensusVote> mapTxLockVote;
+extern boundedmap<uint256, CTransactionLock, CTransactionLockUsage> mapTxLocks;
+extern boundedmap<COutPoint, uint256> mapLockedInputs;
 extern int nCompleteTXLocks;
 
+// protects mapTxLocks and the vote signature cache; never held while taking another lock
+extern CCriticalSection cs_instantx;
+
 
 int64_t CreateNewLock(CTransaction tx);
 
@@ -46,9 +59,18 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight);
 //process consensus vote message
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx);
 
-// keep transaction locks in memory for an hour
+// drop the transaction locks that expired
 void CleanTransactionLocksList();
 
+// sizes of the InstantX caches, for getmemoryinfo
+void GetInstantXCacheInfo(std::vector<CCacheInfo>& vInfo);
+
+// number of valid lock votes for a transaction, -1 if it has no lock
+int GetTransactionLockSignatures(const uint256& txHash);
+
+// true if the lock on this transaction did not complete in time
+bool IsTransactionLockTimedOut(const uint256& txHash);
+
 int64_t GetAverageVoteTime();
 
 class CConsensusVote
@@ -75,16 +97,28 @@ public:
 
 class CTransactionLock
 {
+private:
+    // votes for nBlockHeight, kept up to date by AddSignature and SetBlockHeight
+    int nSignatures;
+    // masternodes that voted; each one counts once, however often its vote is relayed
+    std::set<COutPoint> setVoters;
+
 public:
     int nBlockHeight;
     uint256 txHash;
     std::vector<CConsensusVote> vecConsensusVotes;
+    // inputs this lock holds in mapLockedInputs
+    std::vector<COutPoint> vecLockedInputs;
     int nExpiration;
     int nTimeout;
 
+    CTransactionLock() : nSignatures(0), nBlockHeight(0), nExpiration(0), nTimeout(0) {}
+
     bool SignaturesValid();
     int CountSignatures();
-    void AddSignature(CConsensusVote& cv);
+    // false if the masternode has voted on this lock already
+    bool AddSignature(CConsensusVote& cv);
+    void SetBlockHeight(int nBlockHeightIn);
 
     uint256 GetHash()
     {
@@ -92,5 +126,42 @@ public:
     }
 };
 
+struct CTransactionLockUsage
+{
+    size_t operator()(const CTransactionLock& lock) const
+    {
+        size_t nUsage = sizeof(CTransactionLock) + lock.vecLockedInputs.size() * sizeof(COutPoint);
+        BOOST_FOREACH(const CConsensusVote& vote, lock.vecConsensusVotes)
+            nUsage += sizeof(CConsensusVote) + vote.vchMasterNodeSignature.size() + sizeof(COutPoint) + 4 * sizeof(void*);
+        return nUsage;
+    }
+};
+
+/** The masternodes allowed to vote on locks for a block height: the top
+ *  INSTANTX_SIGNATURES_TOTAL of the masternode ranking. Ranking the whole
+ *  list is only done once per height, chain tip and masternode list change
+ *  instead of once per vote.
+ */
+class CInstantXQuorum
+{
+private:
+    mutable CCriticalSection cs;
+    // lock block height -> masternode outpoint -> rank
+    std::map<int, std::map<COutPoint, int> > mapQuorums;
+    // tip and masternode list state the cached quorums were computed for
+    int nTipHeight;
+    uint64_t nMasternodeGeneration;
+
+public:
+    CInstantXQuorum() : nTipHeight(-1), nMasternodeGeneration(0) {}
+
+    /** Rank of a masternode for nBlockHeight: -1 if the masternode or the block
+     *  is unknown, above INSTANTX_SIGNATURES_TOTAL if it is not in the quorum */
+    int GetRank(const CTxIn& vin, int nBlockHeight);
+
+    void Clear();
+};
+
+extern CInstantXQuorum instantxQuorum;
 
 #endif
@@ -5,6 +5,7 @@
 
 #include <boost/assign/list_of.hpp>
 
+#include "coins.h"
 #include "kernel.h"
 #include "txdb.h"
 
@@ -190,9 +191,12 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     return true;
 }
 
-bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+// The kernel only depends on the timestamp and value of the staked output,
+// so it can be checked from an unspent output set entry as well as from the
+// full previous transaction
+static bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, int64_t nValueIn, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
-    if (nTimeTx < txPrev.nTime)  // Transaction timestamp violation
+    if (nTimeTx < nTimeTxPrev)  // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
     if (nTimeBlockFrom + nStakeMinAge > nTimeTx) // Min age requirement
@@ -203,7 +207,6 @@ bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, unsigned
     bnTarget.SetCompact(nBits);
 
     // Weighted target
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
     CBigNum bnWeight = CBigNum(nValueIn);
     bnTarget *= bnWeight;
 
@@ -216,7 +219,7 @@ bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, unsigned
     // Calculate hash
     CDataStream ss(SER_GETHASH, 0);
 
-    ss << nStakeModifier << nTimeBlockFrom << txPrev.nTime << prevout.hash << prevout.n << nTimeTx;
+    ss << nStakeModifier << nTimeBlockFrom << nTimeTxPrev << prevout.hash << prevout.n << nTimeTx;
     hashProofOfStake = HashSkein(ss.begin(), ss.end());
 
     if (fPrintProofOfStake)
@@ -227,7 +230,7 @@ bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, unsigned
             DateTimeStrFormat(nTimeBlockFrom));
         LogPrintf("CheckStakeKernelHash() : check modifier=0x%016x nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
 
@@ -244,13 +247,18 @@ bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, unsigned
             DateTimeStrFormat(nTimeBlockFrom));
         LogPrintf("CheckStakeKernelHash() : pass modifier=0x%016x nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
 
     return true;
 }
 
+bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+{
+    return CheckStakeKernelHash(pindexPrev, nBits, nTimeBlockFrom, txPrev.nTime, txPrev.vout[prevout.n].nValue, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, uint256& targetProofOfStake)
 {
@@ -260,6 +268,20 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx.vin[0];
 
+    // An unspent kernel of the best chain needs neither the previous
+    // transaction nor its block header from disk
+    CCoin coin;
+    if (pcoinsTip && pcoinsTip->GetCoin(txin.prevout, coin, pindexBest))
+    {
+        if (!VerifyScript(txin.scriptSig, coin.txout.scriptPubKey, tx, 0, SCRIPT_VERIFY_NONE, 0))
+            return tx.DoS(100, error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString()));
+
+        if (!CheckStakeKernelHash(pindexPrev, nBits, coin.nBlockTime, coin.nTime, coin.txout.nValue, txin.prevout, tx.nTime, hashProofOfStake, targetProofOfStake, fDebug))
+            return tx.DoS(1, error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s", tx.GetHash().ToString(), hashProofOfStake.ToString())); // may occur during initial download or if behind on block chain sync
+
+        return true;
+    }
+
     // First try finding the previous transaction in database
     CTxDB txdb("r");
     CTransaction txPrev;
@@ -288,9 +310,10 @@ bool CheckCoinStakeTimestamp(int nHeight, int64_t nTimeBlock, int64_t nTimeTx)
         return (nTimeBlock == nTimeTx) && ((nTimeTx & STAKE_TIMESTAMP_MASK) == 0);
 }
 
-bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, int64_t* pBlockTime)
+bool GetStakeCoin(const CBlockIndex* pindexPrev, const COutPoint& prevout, CCoin& coin)
 {
-    uint256 hashProofOfStake, targetProofOfStake;
+    if (pcoinsTip && pcoinsTip->GetCoin(prevout, coin, pindexPrev, true))
+        return true;
 
     CTxDB txdb("r");
     CTransaction txPrev;
@@ -303,11 +326,32 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, con
     if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
         return false;
 
-    if (block.GetBlockTime() + nStakeMinAge > nTime)
+    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
+    if (mi == mapBlockIndex.end())
+        return false;
+
+    coin = CCoin(txPrev, prevout.n, mi->second->nHeight, block.GetBlockTime());
+    return true;
+}
+
+bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, const CCoin& coin)
+{
+    uint256 hashProofOfStake, targetProofOfStake;
+
+    if (coin.nBlockTime + nStakeMinAge > nTime)
         return false; // only count coins meeting min age requirement
 
+    return CheckStakeKernelHash(pindexPrev, nBits, coin.nBlockTime, coin.nTime, coin.txout.nValue, prevout, nTime, hashProofOfStake, targetProofOfStake, false);
+}
+
+bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, int64_t* pBlockTime)
+{
+    CCoin coin;
+    if (!GetStakeCoin(pindexPrev, prevout, coin))
+        return false;
+
     if (pBlockTime)
-        *pBlockTime = block.GetBlockTime();
+        *pBlockTime = coin.nBlockTime;
 
-    return CheckStakeKernelHash(pindexPrev, nBits, block.GetBlockTime(), txPrev, prevout, nTime, hashProofOfStake, targetProofOfStake);
+    return CheckKernel(pindexPrev, nBits, nTime, prevout, coin);
 }
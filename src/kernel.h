@@ -7,6 +7,8 @@
 
 #include "mainfunctions.h"
 
+class CCoin;
+
 // To decrease granularity of timestamp
 // Supposed to be 2^n-1
 static const int STAKE_TIMESTAMP_MASK = 15;
@@ -40,4 +42,13 @@ int64_t GetWeight(int64_t nIntervalBeginning, int64_t nIntervalEnd);
 // Convenient for searching a kernel
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, int64_t* pBlockTime = NULL);
 
+// The same from an output already looked up with GetStakeCoin(), for
+// searching the timestamps of one output without looking it up again
+bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, const CCoin& coin);
+
+// Look up what the kernel hash of an output depends on, from the unspent
+// output set (pinning it there for the next search while the stake share
+// of the cache allows) or else from the tx index
+bool GetStakeCoin(const CBlockIndex* pindexPrev, const COutPoint& prevout, CCoin& coin);
+
 #endif // PPCREDIT_KERNEL_H
@@ -56,6 +56,14 @@ bool CBasicKeyStore::GetCScript(const CScriptID &hash, CScript& redeemScriptOut)
     return false;
 }
 
+void CBasicKeyStore::GetCScripts(std::vector<CScript> &vRedeemScripts) const
+{
+    LOCK(cs_KeyStore);
+    vRedeemScripts.clear();
+    for (ScriptMap::const_iterator mi = mapScripts.begin(); mi != mapScripts.end(); ++mi)
+        vRedeemScripts.push_back(mi->second);
+}
+
 bool CBasicKeyStore::AddWatchOnly(const CScript &dest)
 {
     LOCK(cs_KeyStore);
@@ -82,3 +90,8 @@ bool CBasicKeyStore::HaveWatchOnly() const
     return (!setWatchOnly.empty());
 }
 
+void CBasicKeyStore::GetWatchOnly(WatchOnlySet &setWatchOnlyOut) const
+{
+    LOCK(cs_KeyStore);
+    setWatchOnlyOut = setWatchOnly;
+}
@@ -9,12 +9,17 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockcache.h"
+#include "blockfile.h"
+#include "blockfilter.h"
 #include "chainfunctions.h"
+#include "coins.h"
 #include "checkpoints.h"
 #include "db.h"
 #include "init.h"
 #include "kernel.h"
 #include "net.h"
+#include "orphanpool.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -61,6 +66,8 @@ uint256 nBestInvalidTrust = 0;
 
 uint256 hashBestChain = 0;
 CBlockIndex* pindexBest = NULL;
+static CCriticalSection cs_chainTip;
+static CChainTip chainTip;
 int64_t nTimeBestReceived = 0;
 bool fImporting = false;
 bool fReindex = false;
@@ -72,13 +79,16 @@ struct COrphanBlock {
     uint256 hashPrev;
     std::pair<COutPoint, unsigned int> stake;
     vector<unsigned char> vchBlock;
+    NodeId fromPeer;
+    size_t nPos; // in vOrphanBlocks
 };
 map<uint256, COrphanBlock*> mapOrphanBlocks;
 multimap<uint256, COrphanBlock*> mapOrphanBlocksByPrev;
 set<pair<COutPoint, unsigned int> > setStakeSeenOrphan;
-
-map<uint256, CTransaction> mapOrphanTransactions;
-map<uint256, set<uint256> > mapOrphanTransactionsByPrev;
+vector<COrphanBlock*> vOrphanBlocks; // to pick one at random
+map<NodeId, size_t> mapOrphanBlockBytesByPeer;
+size_t nOrphanBlockBytes = 0;
+uint64_t nOrphanBlocksEvicted = 0;
 
 // Constant stuff for coinbase transactions we create:
 CScript CREDITBASE_FLAGS;
@@ -99,6 +109,8 @@ namespace {
 struct CMainSignals {
     // Notifies listeners of updated transaction data (passing hash, transaction, and optionally the block it is found in.
     boost::signals2::signal<void (const CTransaction &, const CBlock *, bool)> SyncTransaction;
+    // Notifies listeners of all transactions of a connected or disconnected block at once.
+    boost::signals2::signal<void (const CBlock &, bool)> SyncBlock;
     // Notifies listeners of an erased transaction (currently disabled, requires transaction replacement).
     boost::signals2::signal<void (const uint256 &)> EraseTransaction;
     // Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible).
@@ -114,6 +126,7 @@ struct CMainSignals {
 
 void RegisterWallet(CWalletInterface* pwalletIn) {
     g_signals.SyncTransaction.connect(boost::bind(&CWalletInterface::SyncTransaction, pwalletIn, _1, _2, _3));
+    g_signals.SyncBlock.connect(boost::bind(&CWalletInterface::SyncBlock, pwalletIn, _1, _2));
     g_signals.EraseTransaction.connect(boost::bind(&CWalletInterface::EraseFromWallet, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CWalletInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.SetBestChain.connect(boost::bind(&CWalletInterface::SetBestChain, pwalletIn, _1));
@@ -127,6 +140,7 @@ void UnregisterWallet(CWalletInterface* pwalletIn) {
     g_signals.SetBestChain.disconnect(boost::bind(&CWalletInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CWalletInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.EraseTransaction.disconnect(boost::bind(&CWalletInterface::EraseFromWallet, pwalletIn, _1));
+    g_signals.SyncBlock.disconnect(boost::bind(&CWalletInterface::SyncBlock, pwalletIn, _1, _2));
     g_signals.SyncTransaction.disconnect(boost::bind(&CWalletInterface::SyncTransaction, pwalletIn, _1, _2, _3));
 }
 
@@ -136,6 +150,7 @@ void UnregisterAllWallets() {
     g_signals.SetBestChain.disconnect_all_slots();
     g_signals.UpdatedTransaction.disconnect_all_slots();
     g_signals.EraseTransaction.disconnect_all_slots();
+    g_signals.SyncBlock.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
 }
 
@@ -143,6 +158,10 @@ void SyncWithWallets(const CTransaction &tx, const CBlock *pblock, bool fConnect
     g_signals.SyncTransaction(tx, pblock, fConnect);
 }
 
+void SyncBlockWithWallets(const CBlock &block, bool fConnect) {
+    g_signals.SyncBlock(block, fConnect);
+}
+
 void ResendWalletTransactions(bool fForce) {
     g_signals.Broadcast(fForce);
 }
@@ -199,6 +218,7 @@ void InitializeNode(NodeId nodeid, const CNode *pnode) {
 void FinalizeNode(NodeId nodeid) {
     LOCK(cs_main);
     mapNodeState.erase(nodeid);
+    orphantxpool.EraseForPeer(nodeid);
 }
 
 }
@@ -234,6 +254,7 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals)
 bool AbortNode(const std::string &strMessage, const std::string &userMessage) {
     strMiscWarning = strMessage;
     LogPrintf("*** %s\n", strMessage);
+    FlushDebugLog();
     uiInterface.ThreadSafeMessageBox(
         userMessage.empty() ? _("Error: A fatal internal error occured, see debug.log for details") : userMessage,
         "", CClientUIInterface::MSG_ERROR);
@@ -243,78 +264,64 @@ bool AbortNode(const std::string &strMessage, const std::string &userMessage) {
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// mapOrphanTransactions
+// CTransaction and CTxIndex
 //
 
-bool AddOrphanTx(const CTransaction& tx)
+bool CTransaction::ReadFromDisk(CDiskTxPos pos, FILE** pfileRet)
 {
-    uint256 hash = tx.GetHash();
-    if (mapOrphanTransactions.count(hash))
-        return false;
-
-    // Ignore big transactions, to avoid a
-    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
-    // large transaction with a missing parent then we assume
-    // it will rebroadcast it later, after the parent transaction(s)
-    // have been mined or received.
-    // 10,000 orphans, each of which is at most 5,000 bytes big is
-    // at most 500 megabytes of orphans:
-
-    size_t nSize = tx.GetSerializeSize(SER_NETWORK, CTransaction::CURRENT_VERSION);
+    CTransactionRef ptx;
+    if (!pfileRet && blockcache.GetTransaction(pos, ptx))
+    {
+        *this = *ptx;
+        return true;
+    }
 
-    if (nSize > 5000)
+    if (!pfileRet)
     {
-        LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", nSize, hash.ToString());
-        return false;
+        // The size is not stored, so read ahead and read again with a
+        // larger window if the transaction did not fit
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        for (unsigned int nWindow = BLOCK_FILE_READ_AHEAD; ; nWindow *= 4)
+        {
+            ss.clear();
+            if (!ReadBlockFile(pos.nFile, pos.nTxPos, nWindow, ss))
+                return error("CTransaction::ReadFromDisk() : ReadBlockFile failed");
+            bool fEnd = ss.size() < nWindow || nWindow >= MAX_BLOCK_SIZE;
+            try {
+                ss >> *this;
+                break;
+            }
+            catch (std::exception &e) {
+                if (fEnd)
+                    return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+            }
+        }
+        blockcache.AddTransaction(pos, MakeTransactionRef(*this));
+        return true;
     }
 
-    mapOrphanTransactions[hash] = tx;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
-        mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
+    CAutoFile filein = CAutoFile(OpenBlockFile(pos.nFile, 0, "rb+"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("CTransaction::ReadFromDisk() : OpenBlockFile failed");
 
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u)\n", hash.ToString(),
-        mapOrphanTransactions.size());
-    return true;
-}
+    // Read transaction
+    if (fseek(filein.Get(), pos.nTxPos, SEEK_SET) != 0)
+        return error("CTransaction::ReadFromDisk() : fseek failed");
 
-void static EraseOrphanTx(uint256 hash)
-{
-    map<uint256, CTransaction>::iterator it = mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end())
-        return;
-    BOOST_FOREACH(const CTxIn& txin, it->second.vin)
-    {
-        map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
-            continue;
-        itPrev->second.erase(hash);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
+    try {
+        filein >> *this;
+    }
+    catch (std::exception &e) {
+        return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
     }
-    mapOrphanTransactions.erase(it);
-}
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
-{
-    unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
-    {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, CTransaction>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
-        ++nEvicted;
-    }
-    return nEvicted;
+    // Return file pointer
+    if (fseek(filein.Get(), pos.nTxPos, SEEK_SET) != 0)
+        return error("CTransaction::ReadFromDisk() : second fseek failed");
+    *pfileRet = filein.release();
+    return true;
 }
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// CTransaction and CTxIndex
-//
-
 bool CTransaction::ReadFromDisk(CTxDB& txdb, const uint256& hash, CTxIndex& txindexRet)
 {
     SetNull();
@@ -476,7 +483,7 @@ bool IsFinalTx(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
 // 2. P2SH scripts with a crazy number of expensive
 //    CHECKSIG/CHECKMULTISIG operations
 //
-bool AreInputsStandard(const CTransaction& tx, const MapPrevTx& mapInputs)
+bool AreInputsStandard(const CTransaction& tx, const MapPrevOut& mapInputs)
 {
     if (tx.IsCoinBase())
         return true; // Coinbases don't use vin normally
@@ -553,7 +560,7 @@ unsigned int GetLegacySigOpCount(const CTransaction& tx)
     return nSigOps;
 }
 
-unsigned int GetP2SHSigOpCount(const CTransaction& tx, const MapPrevTx& inputs)
+unsigned int GetP2SHSigOpCount(const CTransaction& tx, const MapPrevOut& inputs)
 {
     if (tx.IsCoinBase())
         return 0;
@@ -728,6 +735,25 @@ int64_t GetMinFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree,
 }
 
 
+// Resolve the inputs of a transaction entering the pool into the cached form
+// CreateNewBlock works from, so block assembly never has to go back to disk
+static void GetMempoolInputs(const CTransaction& tx, const MapPrevOut& mapInputs,
+                             unsigned int nSize, unsigned int nSigOps, CMempoolInputs& inputs)
+{
+    inputs.vPrevOut.resize(tx.vin.size());
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        const CCoin& coin = mapInputs.find(tx.vin[i].prevout)->second;
+        CMempoolPrevOut& prev = inputs.vPrevOut[i];
+        prev.txout = coin.txout;
+        prev.nHeight = coin.nHeight; // MEMPOOL_HEIGHT for parents still in the pool
+        prev.fCoinBase = coin.IsCoinBase() || coin.IsCoinStake();
+    }
+    inputs.nValueIn = tx.GetValueIn(mapInputs);
+    inputs.nTxSize = nSize;
+    inputs.nSigOps = nSigOps;
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
 {
@@ -759,9 +785,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
 
     // ----------- instantX transaction scanning -----------
 
-    BOOST_FOREACH(const CTxIn& in, tx.vin){
-        if(mapLockedInputs.count(in.prevout)){
-            if(mapLockedInputs[in.prevout] != tx.GetHash()){
+    {
+        LOCK(cs_instantx);
+        BOOST_FOREACH(const CTxIn& in, tx.vin){
+            boundedmap<COutPoint, uint256>::iterator it = mapLockedInputs.find(in.prevout);
+            if(it != mapLockedInputs.end() && it->second != hash){
                 return tx.DoS(0, error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason));
             }
         }
@@ -781,6 +809,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
     }
     }
 
+    CMempoolInputs inputs;
     {
         CTxDB txdb("r");
 
@@ -798,10 +827,10 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
                 return false;
             }
         }
-        MapPrevTx mapInputs;
-        map<uint256, CTxIndex> mapUnused;
+        CCoinsView view(pcoinsTip);
+        MapPrevOut mapInputs;
         bool fInvalid = false;
-        if (!tx.FetchInputs(txdb, mapUnused, false, false, mapInputs, fInvalid))
+        if (!tx.FetchInputs(view, true, mapInputs, fInvalid))
         {
             if (fInvalid)
                 return error("AcceptToMemoryPool : FetchInputs found invalid tx %s", hash.ToString());
@@ -870,7 +899,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!tx.ConnectInputs(txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false, STANDARD_SCRIPT_VERIFY_FLAGS))
+        if (!tx.ConnectInputs(mapInputs, view.GetBestBlock(), false, STANDARD_SCRIPT_VERIFY_FLAGS))
         {
             return error("AcceptToMemoryPool : ConnectInputs failed %s", hash.ToString());
         }
@@ -884,14 +913,16 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!tx.ConnectInputs(txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false, MANDATORY_SCRIPT_VERIFY_FLAGS))
+        if (!tx.ConnectInputs(mapInputs, view.GetBestBlock(), false, MANDATORY_SCRIPT_VERIFY_FLAGS))
         {
             return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
+
+        GetMempoolInputs(tx, mapInputs, nSize, nSigOps, inputs);
     }
 
     // Store transaction in memory
-    pool.addUnchecked(hash, tx);
+    pool.addUnchecked(hash, tx, inputs);
     setValidatedTx.insert(hash);
 
     SyncWithWallets(tx, NULL);
@@ -931,9 +962,11 @@ bool AcceptableInputs(CTxMemPool& pool, const CTransaction &txo, bool fLimitFree
 
     // ----------- instantX transaction scanning -----------
 
-    BOOST_FOREACH(const CTxIn& in, tx.vin){
-        if(mapLockedInputs.count(in.prevout)){
-            if(mapLockedInputs[in.prevout] != tx.GetHash()){
+    {
+        LOCK(cs_instantx);
+        BOOST_FOREACH(const CTxIn& in, tx.vin){
+            boundedmap<COutPoint, uint256>::iterator it = mapLockedInputs.find(in.prevout);
+            if(it != mapLockedInputs.end() && it->second != hash){
                 return tx.DoS(0, error("AcceptableInputs : conflicts with existing transaction lock: %s", reason));
             }
         }
@@ -960,10 +993,10 @@ bool AcceptableInputs(CTxMemPool& pool, const CTransaction &txo, bool fLimitFree
         if (txdb.ContainsTx(hash))
             return false;
 
-        MapPrevTx mapInputs;
-        map<uint256, CTxIndex> mapUnused;
+        CCoinsView view(pcoinsTip);
+        MapPrevOut mapInputs;
         bool fInvalid = false;
-        if (!tx.FetchInputs(txdb, mapUnused, false, false, mapInputs, fInvalid))
+        if (!tx.FetchInputs(view, true, mapInputs, fInvalid))
         {
             if (fInvalid)
                 return error("AcceptableInputs : FetchInputs found invalid tx %s", hash.ToString());
@@ -1031,7 +1064,7 @@ bool AcceptableInputs(CTxMemPool& pool, const CTransaction &txo, bool fLimitFree
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!tx.ConnectInputs(txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, true, false, STANDARD_SCRIPT_VERIFY_FLAGS, false))
+        if (!tx.ConnectInputs(mapInputs, view.GetBestBlock(), true, STANDARD_SCRIPT_VERIFY_FLAGS, false))
         {
             return error("AcceptableInputs : ConnectInputs failed %s", hash.ToString());
         }
@@ -1077,26 +1110,14 @@ int CMerkleTx::GetTransactionLockSignatures() const
     if(!IsSporkActive(SPORK_2_INSTANTX)) return -3;
     if(!fEnableInstantX) return -1;
 
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()){
-        return (*i).second.CountSignatures();
-    }
-
-    return -1;
+    return ::GetTransactionLockSignatures(GetHash());
 }
 
 bool CMerkleTx::IsTransactionLockTimedOut() const
 {
     if(!fEnableInstantX) return -1;
 
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()){
-        return GetTime() > (*i).second.nTimeout;
-    }
-
-    return false;
+    return ::IsTransactionLockTimedOut(GetHash());
 }
 
 int CMerkleTx::GetDepthInMainChain(CBlockIndex* &pindexRet, bool enableIX) const
@@ -1185,10 +1206,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
     if(nResult < 0) nResult = 0;
 
     if (nResult < 6){
-        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-        if (i != mapTxLocks.end()){
-            sigs = (*i).second.CountSignatures();
-        }
+        sigs = GetTransactionLockSignatures(nTXHash);
         if(sigs >= INSTANTX_SIGNATURES_REQUIRED){
             return nInstantXDepth+nResult;
         }
@@ -1199,12 +1217,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
 
 int GetIXConfirmations(uint256 nTXHash)
 {
-    int sigs = 0;
-
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-    if (i != mapTxLocks.end()){
-        sigs = (*i).second.CountSignatures();
-    }
+    int sigs = GetTransactionLockSignatures(nTXHash);
     if(sigs >= INSTANTX_SIGNATURES_REQUIRED){
         return nInstantXDepth;
     }
@@ -1231,23 +1244,33 @@ int CTxIndex::GetDepthInMainChain() const
 // Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock)
 {
+    // The mempool has its own lock and LevelDB reads see the last committed
+    // batch, so only the block index walk below needs cs_main.
+    if (mempool.lookup(hash, tx))
+        return true;
+    CTransactionRef ptx;
+    if (blockcache.GetTransaction(hash, ptx, hashBlock))
     {
-        LOCK(cs_main);
-        {
-            if (mempool.lookup(hash, tx))
-            {
-                return true;
-            }
-        }
+        tx = *ptx;
+        return true;
+    }
+    {
+        uint64_t nEpoch = blockcache.GetEpoch();
         CTxDB txdb("r");
         CTxIndex txindex;
         if (tx.ReadFromDisk(txdb, hash, txindex))
         {
             CBlock block;
             if (block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+            {
                 hashBlock = block.GetHash();
+                blockcache.AddTransaction(txindex.pos, MakeTransactionRef(tx), hashBlock, nEpoch);
+            }
             return true;
         }
+    }
+    {
+        LOCK(cs_main);
         // look for transaction in disconnected blocks to find orphaned CoinBase and CoinStake transactions
         BOOST_FOREACH(PAIRTYPE(const uint256, CBlockIndex*)& item, mapBlockIndex)
         {
@@ -1270,6 +1293,21 @@ bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock)
     return false;
 }
 
+void UpdateChainTip(const CBlockIndex* pindexNew)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_chainTip);
+    chainTip.nHeight = pindexNew->nHeight;
+    chainTip.hashBlock = pindexNew->GetBlockHash();
+    chainTip.pindex = pindexNew;
+}
+
+CChainTip GetChainTip()
+{
+    LOCK(cs_chainTip);
+    return chainTip;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CBlock and CBlockIndex
@@ -1293,6 +1331,105 @@ CBlockIndex* FindBlockByHeight(int nHeight)
     return pblockindex;
 }
 
+bool CBlock::WriteToDisk(unsigned int& nFileRet, unsigned int& nBlockPosRet)
+{
+    // Index header and block, appended with a single write
+    unsigned int nSize = ::GetSerializeSize(*this, SER_DISK, CLIENT_VERSION);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss.reserve(MESSAGE_START_SIZE + sizeof(nSize) + nSize);
+    ss << FLATDATA(Params().MessageStart()) << nSize << *this;
+
+    unsigned int nPos;
+    if (!AppendBlockFile(ss, nFileRet, nPos))
+        return error("CBlock::WriteToDisk() : AppendBlockFile failed");
+    nBlockPosRet = nPos + MESSAGE_START_SIZE + sizeof(nSize);
+
+    // Commit to disk before returning
+    if (!IsInitialBlockDownload() || (nBestHeight+1) % 500 == 0)
+        CommitBlockFile();
+
+    return true;
+}
+
+bool CBlock::ReadFromFile(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions)
+{
+    SetNull();
+
+    // The block follows its size in the file, so it is read in one call if
+    // it fits the read ahead, in two otherwise. A header is 80 bytes
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    if (!fReadTransactions)
+    {
+        if (!ReadBlockFile(nFile, nBlockPos, 80, ss))
+            return error("CBlock::ReadFromDisk() : ReadBlockFile failed");
+        ss.nType |= SER_BLOCKHEADERONLY;
+    }
+    else
+    {
+        unsigned int nSize;
+        if (nBlockPos < sizeof(nSize) || !ReadBlockFile(nFile, nBlockPos - sizeof(nSize), BLOCK_FILE_READ_AHEAD, ss))
+            return error("CBlock::ReadFromDisk() : ReadBlockFile failed");
+        try {
+            ss >> nSize;
+        }
+        catch (std::exception &e) {
+            return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+        }
+        if (nSize > MAX_BLOCK_SIZE)
+            return error("CBlock::ReadFromDisk() : bad block size %u", nSize);
+        if (ss.size() < nSize && !ReadBlockFile(nFile, nBlockPos + ss.size(), nSize - ss.size(), ss))
+            return error("CBlock::ReadFromDisk() : ReadBlockFile failed");
+    }
+
+    // Read block
+    try {
+        ss >> *this;
+    }
+    catch (std::exception &e) {
+        return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+    }
+    BOOST_FOREACH(const CTransaction& tx, vtx)
+        tx.MakeImmutable();
+
+    // Check the header
+    if (fReadTransactions && IsProofOfWork() && !CheckProofOfWork(GetPoWHash(), nBits))
+        return error("CBlock::ReadFromDisk() : errors in block header");
+
+    return true;
+}
+
+bool CBlock::ReadFromDisk(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions)
+{
+    CBlockRef pblock;
+    if (blockcache.GetBlock(nFile, nBlockPos, !fReadTransactions, pblock))
+    {
+        SetNull();
+        nVersion = pblock->nVersion;
+        hashPrevBlock = pblock->hashPrevBlock;
+        hashMerkleRoot = pblock->hashMerkleRoot;
+        nTime = pblock->nTime;
+        nBits = pblock->nBits;
+        nNonce = pblock->nNonce;
+        if (fReadTransactions)
+        {
+            vtx.resize(pblock->vtx.size());
+            for (unsigned int i = 0; i < vtx.size(); i++)
+                vtx[i].AssignImmutable(pblock->vtx[i]);
+            vchBlockSig = pblock->vchBlockSig;
+        }
+        return true;
+    }
+
+    if (!ReadFromFile(nFile, nBlockPos, fReadTransactions))
+        return false;
+    if (!fReadTransactions)
+    {
+        CBlock* pheader = new CBlock(*this);
+        blockcache.AddBlock(nFile, nBlockPos, CBlockRef(pheader));
+    }
+    return true;
+}
+
 bool CBlock::ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions)
 {
     if (!fReadTransactions)
@@ -1331,30 +1468,68 @@ uint256 WantedByOrphan(const COrphanBlock* pblockOrphan)
     return pblockOrphan->hashPrev;
 }
 
-// Remove a random orphan block (which does not have any dependent orphans).
-void static PruneOrphanBlocks()
+// Forget an orphan block, once connected or evicted; its own orphans stay
+void static EraseOrphanBlock(COrphanBlock* pblockOrphan)
 {
-    if (mapOrphanBlocksByPrev.size() <= (size_t)std::max((int64_t)0, GetArg("-maxorphanblocks", DEFAULT_MAX_ORPHAN_BLOCKS)))
-        return;
+    for (multimap<uint256, COrphanBlock*>::iterator mi = mapOrphanBlocksByPrev.lower_bound(pblockOrphan->hashPrev);
+         mi != mapOrphanBlocksByPrev.end() && mi->first == pblockOrphan->hashPrev; ++mi)
+    {
+        if (mi->second == pblockOrphan)
+        {
+            mapOrphanBlocksByPrev.erase(mi);
+            break;
+        }
+    }
+    mapOrphanBlocks.erase(pblockOrphan->hashBlock);
+    setStakeSeenOrphan.erase(pblockOrphan->stake);
 
-    // Pick a random orphan block.
-    int pos = insecure_rand() % mapOrphanBlocksByPrev.size();
-    std::multimap<uint256, COrphanBlock*>::iterator it = mapOrphanBlocksByPrev.begin();
-    while (pos--) it++;
+    // Fill its slot with the last one
+    vOrphanBlocks[pblockOrphan->nPos] = vOrphanBlocks.back();
+    vOrphanBlocks[pblockOrphan->nPos]->nPos = pblockOrphan->nPos;
+    vOrphanBlocks.pop_back();
 
-    // As long as this block has other orphans depending on it, move to one of those successors.
-    do {
-        std::multimap<uint256, COrphanBlock*>::iterator it2 = mapOrphanBlocksByPrev.find(it->second->hashBlock);
-        if (it2 == mapOrphanBlocksByPrev.end())
-            break;
-        it = it2;
-    } while(1);
+    map<NodeId, size_t>::iterator it = mapOrphanBlockBytesByPeer.find(pblockOrphan->fromPeer);
+    if (it != mapOrphanBlockBytesByPeer.end() && (it->second -= pblockOrphan->vchBlock.size()) == 0)
+        mapOrphanBlockBytesByPeer.erase(it);
+    nOrphanBlockBytes -= pblockOrphan->vchBlock.size();
+    delete pblockOrphan;
+}
+
+// Make room for an orphan block of nSize bytes, removing random orphan
+// blocks (which do not have any dependent orphans).
+void static PruneOrphanBlocks(size_t nSize)
+{
+    size_t nMaxBlocks = (size_t)std::max((int64_t)0, GetArg("-maxorphanblocks", DEFAULT_MAX_ORPHAN_BLOCKS));
+    size_t nMaxBytes = (size_t)std::max((int64_t)0, GetArg("-maxorphanblockssize", DEFAULT_MAX_ORPHAN_BLOCKS_SIZE)) << 20;
+    while (!vOrphanBlocks.empty() && (vOrphanBlocks.size() >= nMaxBlocks || nOrphanBlockBytes + nSize > nMaxBytes))
+    {
+        // Pick a random orphan block.
+        COrphanBlock* pblockOrphan = vOrphanBlocks[insecure_rand() % vOrphanBlocks.size()];
 
-    setStakeSeenOrphan.erase(it->second->stake);
-    uint256 hash = it->second->hashBlock;
-    delete it->second;
-    mapOrphanBlocksByPrev.erase(it);
-    mapOrphanBlocks.erase(hash);
+        // As long as this block has other orphans depending on it, move to one of those successors.
+        do {
+            std::multimap<uint256, COrphanBlock*>::iterator it2 = mapOrphanBlocksByPrev.find(pblockOrphan->hashBlock);
+            if (it2 == mapOrphanBlocksByPrev.end())
+                break;
+            pblockOrphan = it2->second;
+        } while(1);
+
+        EraseOrphanBlock(pblockOrphan);
+        nOrphanBlocksEvicted++;
+    }
+}
+
+CCacheInfo GetOrphanBlocksInfo()
+{
+    AssertLockHeld(cs_main);
+    CCacheInfo info;
+    info.strName = "orphanblocks";
+    info.nEntries = vOrphanBlocks.size();
+    info.nMaxEntries = (size_t)std::max((int64_t)0, GetArg("-maxorphanblocks", DEFAULT_MAX_ORPHAN_BLOCKS));
+    info.nMaxAge = 0;
+    info.nUsage = nOrphanBlockBytes + vOrphanBlocks.size() * (sizeof(COrphanBlock) + 16 * sizeof(void*));
+    info.nEvicted = nOrphanBlocksEvicted;
+    return info;
 }
 
 static CBigNum GetProofOfStakeLimit(int nHeight)
@@ -1546,44 +1721,7 @@ bool IsConfirmedInNPrevBlocks(const CTxIndex& txindex, const CBlockIndex* pindex
     return false;
 }
 
-bool CTransaction::DisconnectInputs(CTxDB& txdb)
-{
-    // Relinquish previous transactions' spent pointers
-    if (!IsCoinBase())
-    {
-        BOOST_FOREACH(const CTxIn& txin, vin)
-        {
-            COutPoint prevout = txin.prevout;
-
-            // Get prev txindex from disk
-            CTxIndex txindex;
-            if (!txdb.ReadTxIndex(prevout.hash, txindex))
-                return error("DisconnectInputs() : ReadTxIndex failed");
-
-            if (prevout.n >= txindex.vSpent.size())
-                return error("DisconnectInputs() : prevout.n out of range");
-
-            // Mark outpoint as not spent
-            txindex.vSpent[prevout.n].SetNull();
-
-            // Write back
-            if (!txdb.UpdateTxIndex(prevout.hash, txindex))
-                return error("DisconnectInputs() : UpdateTxIndex failed");
-        }
-    }
-
-    // Remove transaction from index
-    // This can fail if a duplicate of this transaction was in a chain that got
-    // reorganized away. This is only possible if this transaction was completely
-    // spent, so erasing it would be a no-op anyway.
-    txdb.EraseTxIndex(*this);
-
-    return true;
-}
-
-
-bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTestPool,
-                               bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid)
+bool CTransaction::FetchInputs(const CCoinsView& view, bool fMempool, MapPrevOut& inputsRet, bool& fInvalid) const
 {
     // FetchInputs can return false either because we just haven't seen some inputs
     // (in which case the transaction should be stored as an orphan)
@@ -1596,77 +1734,54 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
 
     for (unsigned int i = 0; i < vin.size(); i++)
     {
-        COutPoint prevout = vin[i].prevout;
-        if (inputsRet.count(prevout.hash))
+        const COutPoint& prevout = vin[i].prevout;
+        if (inputsRet.count(prevout))
             continue; // Got it already
 
-        // Read txindex
-        CTxIndex& txindex = inputsRet[prevout.hash].first;
-        bool fFound = true;
-        if ((fBlock || fMiner) && mapTestPool.count(prevout.hash))
+        // Unspent outputs of the chain; spent ones are not there
+        CCoin coin;
+        if (view.GetCoin(prevout, coin))
         {
-            // Get txindex from current proposed changes
-            txindex = mapTestPool.find(prevout.hash)->second;
-        }
-        else
-        {
-            // Read txindex from txdb
-            fFound = txdb.ReadTxIndex(prevout.hash, txindex);
+            inputsRet[prevout] = coin;
+            continue;
         }
-        if (!fFound && (fBlock || fMiner))
-            return fMiner ? false : error("FetchInputs() : %s prev tx %s index entry not found", GetHash().ToString(),  prevout.hash.ToString());
 
-        // Read txPrev
-        CTransaction& txPrev = inputsRet[prevout.hash].second;
-        if (!fFound || txindex.pos == CDiskTxPos(1,1,1))
+        // Outputs of single transactions in memory
+        CTransactionRef ptxPrev;
+        if (fMempool)
+            ptxPrev = mempool.get(prevout.hash);
+        if (!ptxPrev)
         {
-            // Get prev tx from single transactions in memory
-            if (!mempool.lookup(prevout.hash, txPrev))
-                return error("FetchInputs() : %s mempool Tx prev not found %s", GetHash().ToString(),  prevout.hash.ToString());
-            if (!fFound)
-                txindex.vSpent.resize(txPrev.vout.size());
+            // Not in the set: spent, unknown, or an output the transaction
+            // never had, which only the last makes the spender invalid
+            CTransaction txPrev;
+            if (!CTxDB("r").ReadDiskTx(prevout.hash, txPrev) || prevout.n < txPrev.vout.size())
+                return error("FetchInputs() : %s prevout %s spent or not found", GetHash().ToString(), prevout.ToString());
+            ptxPrev = MakeTransactionRef(txPrev);
         }
-        else
-        {
-            // Get prev tx from disk
-            if (!txPrev.ReadFromDisk(txindex.pos))
-                return error("FetchInputs() : %s ReadFromDisk prev tx %s failed", GetHash().ToString(),  prevout.hash.ToString());
-        }
-    }
-
-    // Make sure all prevout.n indexes are valid:
-    for (unsigned int i = 0; i < vin.size(); i++)
-    {
-        const COutPoint prevout = vin[i].prevout;
-        assert(inputsRet.count(prevout.hash) != 0);
-        const CTxIndex& txindex = inputsRet[prevout.hash].first;
-        const CTransaction& txPrev = inputsRet[prevout.hash].second;
-        if (prevout.n >= txPrev.vout.size() || prevout.n >= txindex.vSpent.size())
+        if (prevout.n >= ptxPrev->vout.size())
         {
             // Revisit this if/when transaction replacement is implemented and allows
             // adding inputs:
             fInvalid = true;
-            return DoS(100, error("FetchInputs() : %s prevout.n out of range %d %u %u prev tx %s\n%s", GetHash().ToString(), prevout.n, txPrev.vout.size(), txindex.vSpent.size(), prevout.hash.ToString(), txPrev.ToString()));
+            return DoS(100, error("FetchInputs() : %s prevout.n out of range %d %u prev tx %s\n%s", GetHash().ToString(), prevout.n, ptxPrev->vout.size(), prevout.hash.ToString(), ptxPrev->ToString()));
         }
+        inputsRet[prevout] = CCoin(*ptxPrev, prevout.n, MEMPOOL_HEIGHT, 0);
     }
 
     return true;
 }
 
-const CTxOut& CTransaction::GetOutputFor(const CTxIn& input, const MapPrevTx& inputs) const
+const CTxOut& CTransaction::GetOutputFor(const CTxIn& input, const MapPrevOut& inputs) const
 {
-    MapPrevTx::const_iterator mi = inputs.find(input.prevout.hash);
+    MapPrevOut::const_iterator mi = inputs.find(input.prevout);
     if (mi == inputs.end())
-        throw std::runtime_error("CTransaction::GetOutputFor() : prevout.hash not found");
-
-    const CTransaction& txPrev = (mi->second).second;
-    if (input.prevout.n >= txPrev.vout.size())
-        throw std::runtime_error("CTransaction::GetOutputFor() : prevout.n out of range");
+        throw std::runtime_error("CTransaction::GetOutputFor() : prevout not found");
 
-    return txPrev.vout[input.prevout.n];
+    return mi->second.txout;
 }
 
-int64_t CTransaction::GetValueIn(const MapPrevTx& inputs) const
+int64_t CTransaction::GetValueIn(const MapPrevOut& inputs) const
 {
     if (IsCoinBase())
         return 0;
@@ -1680,101 +1795,76 @@ int64_t CTransaction::GetValueIn(const MapPrevTx& inputs) const
 
 }
 
-bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-    const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags, bool fValidateSig)
+bool CTransaction::ConnectInputs(const MapPrevOut& inputs, const CBlockIndex* pindexBlock, bool fBlock,
+    unsigned int flags, bool fValidateSig) const
 {
-    // Take over previous transactions' spent pointers
+    // Check the outputs this transaction spends; the caller's view marks them spent
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
-    // fMiner is true when called from the internal bitcoin miner
-    // ... both are false when called from CTransaction::AcceptToMemoryPool
+    // ... false when called from CTransaction::AcceptToMemoryPool
     if (!IsCoinBase())
     {
         int64_t nValueIn = 0;
         int64_t nFees = 0;
         for (unsigned int i = 0; i < vin.size(); i++)
         {
-            COutPoint prevout = vin[i].prevout;
-            assert(inputs.count(prevout.hash) > 0);
-            CTxIndex& txindex = inputs[prevout.hash].first;
-            CTransaction& txPrev = inputs[prevout.hash].second;
-
-            if (prevout.n >= txPrev.vout.size() || prevout.n >= txindex.vSpent.size())
-                return DoS(100, error("ConnectInputs() : %s prevout.n out of range %d %u %u prev tx %s\n%s", GetHash().ToString(), prevout.n, txPrev.vout.size(), txindex.vSpent.size(), prevout.hash.ToString(), txPrev.ToString()));
+            MapPrevOut::const_iterator mi = inputs.find(vin[i].prevout);
+            assert(mi != inputs.end());
+            const CCoin& coin = mi->second;
 
             // If prev is coinbase or coinstake, check that it's matured
-            if (txPrev.IsCoinBase() || txPrev.IsCoinStake())
+            if (coin.IsCoinBase() || coin.IsCoinStake())
             {
-                int nSpendDepth;
-                if (IsConfirmedInNPrevBlocks(txindex, pindexBlock, nCoinbaseMaturity, nSpendDepth)){
-                    return error("ConnectInputs() : tried to spend %s at depth %d", txPrev.IsCoinBase() ? "coinbase" : "coinstake", nSpendDepth);
-                }
+                int nSpendDepth = pindexBlock->nHeight - coin.nHeight;
+                if (nSpendDepth < nCoinbaseMaturity)
+                    return error("ConnectInputs() : tried to spend %s at depth %d", coin.IsCoinBase() ? "coinbase" : "coinstake", nSpendDepth);
             }
             // ppcoin: check transaction timestamp
-            if (txPrev.nTime > nTime)
+            if (coin.nTime > nTime)
                 return DoS(100, error("ConnectInputs() : transaction timestamp earlier than input transaction"));
 
             // Check for negative or overflow input values
-            nValueIn += txPrev.vout[prevout.n].nValue;
-            if (!MoneyRange(txPrev.vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.txout.nValue;
+            if (!MoneyRange(coin.txout.nValue) || !MoneyRange(nValueIn))
                 return DoS(100, error("ConnectInputs() : txin values out of range"));
 
         }
         // The first loop above does all the inexpensive checks.
         // Only if ALL inputs pass do we perform expensive ECDSA signature checks.
         // Helps prevent CPU exhaustion attacks.
-        for (unsigned int i = 0; i < vin.size(); i++)
+        // Double spends cannot get this far: FetchInputs only finds unspent outputs.
+        CSignatureHasher sighasher(*this);
+        for (unsigned int i = 0; i < vin.size() && fValidateSig; i++)
         {
-            COutPoint prevout = vin[i].prevout;
-            assert(inputs.count(prevout.hash) > 0);
-            CTxIndex& txindex = inputs[prevout.hash].first;
-            CTransaction& txPrev = inputs[prevout.hash].second;
-
-            // Check for conflicts (double-spend)
-            // This doesn't trigger the DoS code on purpose; if it did, it would make it easier
-            // for an attacker to attempt to split the network.
-            if (!txindex.vSpent[prevout.n].IsNull())
-                return fMiner ? false : error("ConnectInputs() : %s prev tx already used at %s", GetHash().ToString(), txindex.vSpent[prevout.n].ToString());
-
-            if(fValidateSig)
+            const CScript& scriptPubKey = inputs.find(vin[i].prevout)->second.txout.scriptPubKey;
+
+            // Skip ECDSA signature verification when connecting blocks (fBlock=true)
+            // before the last blockchain checkpoint. This is safe because block merkle hashes are
+            // still computed and checked, and any change will be caught at the next checkpoint.
+            if (!(fBlock && !IsInitialBlockDownload()))
             {
-                // Skip ECDSA signature verification when connecting blocks (fBlock=true)
-                // before the last blockchain checkpoint. This is safe because block merkle hashes are
-                // still computed and checked, and any change will be caught at the next checkpoint.
-                if (!(fBlock && !IsInitialBlockDownload()))
+                // Verify signature
+                if (!VerifyScript(vin[i].scriptSig, scriptPubKey, *this, i, flags, 0, &sighasher))
                 {
-                    // Verify signature
-                    if (!VerifySignature(txPrev, *this, i, flags, 0))
-                    {
-                        if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
-                            // Check whether the failure was caused by a
-                            // non-mandatory script verification check, such as
-                            // non-null dummy arguments;
-                            // if so, don't trigger DoS protection to
-                            // avoid splitting the network between upgraded and
-                            // non-upgraded nodes.
-                            if (VerifySignature(txPrev, *this, i, flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, 0))
-                                return error("ConnectInputs() : %s non-mandatory VerifySignature failed", GetHash().ToString());
-                        }
-                        // Failures of other flags indicate a transaction that is
-                        // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
-                        // such nodes as they are not following the protocol. That
-                        // said during an upgrade careful thought should be taken
-                        // as to the correct behavior - we may want to continue
-                        // peering with non-upgraded nodes even after a soft-fork
-                        // super-majority vote has passed.
-                        return DoS(100,error("ConnectInputs() : %s VerifySignature failed", GetHash().ToString()));
+                    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
+                        // Check whether the failure was caused by a
+                        // non-mandatory script verification check, such as
+                        // non-null dummy arguments;
+                        // if so, don't trigger DoS protection to
+                        // avoid splitting the network between upgraded and
+                        // non-upgraded nodes.
+                        if (VerifyScript(vin[i].scriptSig, scriptPubKey, *this, i, flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, 0, &sighasher))
+                            return error("ConnectInputs() : %s non-mandatory VerifySignature failed", GetHash().ToString());
                     }
+                    // Failures of other flags indicate a transaction that is
+                    // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
+                    // such nodes as they are not following the protocol. That
+                    // said during an upgrade careful thought should be taken
+                    // as to the correct behavior - we may want to continue
+                    // peering with non-upgraded nodes even after a soft-fork
+                    // super-majority vote has passed.
+                    return DoS(100,error("ConnectInputs() : %s VerifySignature failed", GetHash().ToString()));
                 }
             }
-
-            // Mark outpoints as spent
-            txindex.vSpent[prevout.n] = posThisTx;
-
-            // Write back
-            if (fBlock || fMiner)
-            {
-                mapTestPool[prevout.hash] = txindex;
-            }
         }
 
         if (!IsCoinStake())
@@ -1796,12 +1886,19 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256, CTx
     return true;
 }
 
-bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
+bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex, CCoinsView& view)
 {
-    // Disconnect in reverse order
+    // Take the outputs of the block back and return the ones it spent,
+    // while its transactions can still be read through the index
+    if (!view.DisconnectBlock(txdb, *this))
+        return error("DisconnectBlock() : cannot restore the outputs spent by %s", GetHash().ToString());
+
+    // Remove transactions from index, in reverse order
+    // This can fail if a duplicate of a transaction was in a chain that got
+    // reorganized away. This is only possible if that transaction was completely
+    // spent, so erasing it would be a no-op anyway.
     for (int i = vtx.size()-1; i >= 0; i--)
-        if (!vtx[i].DisconnectInputs(txdb))
-            return false;
+        txdb.EraseTxIndex(vtx[i]);
 
     // Update block index on disk without changing it in memory.
     // The memory index structure will be changed after the db commits.
@@ -1814,8 +1911,7 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
     }
 
     // ppcoin: clean up wallet after disconnecting coinstake
-    BOOST_FOREACH(CTransaction& tx, vtx)
-        SyncWithWallets(tx, this, false);
+    SyncBlockWithWallets(*this, false);
 
     return true;
 }
@@ -1854,6 +1950,20 @@ bool static BuildAddrIndex(const CScript &script, std::vector<uint160>& addrIds)
     }
 }
 
+// The address index files a transaction under the outputs of the
+// transactions it spends from, which are read back through the tx index
+static bool ReadAddrIndexParents(CTxDB& txdb, const CTransaction& tx, map<uint256, CTransaction>& mapParents)
+{
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        if (mapParents.count(txin.prevout.hash))
+            continue;
+        if (!txdb.ReadDiskTx(txin.prevout.hash, mapParents[txin.prevout.hash]))
+            return false;
+    }
+    return true;
+}
+
 bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint256> &vtxhash) {
     uint160 addrid = 0;
     const CKeyID *pkeyid = boost::get<CKeyID>(&dest);
@@ -1888,16 +1998,13 @@ void CBlock::RebuildAddressIndex(CTxDB& txdb)
         // inputs
         if(!tx.IsCoinBase())
         {
-            MapPrevTx mapInputs;
-            map<uint256, CTxIndex> mapQueuedChangesT;
-            bool fInvalid;
-            if (!tx.FetchInputs(txdb, mapQueuedChangesT, true, false, mapInputs, fInvalid))
+            map<uint256, CTransaction> mapParents;
+            if (!ReadAddrIndexParents(txdb, tx, mapParents))
                 return;
 
-            MapPrevTx::const_iterator mi;
-            for(MapPrevTx::const_iterator mi = mapInputs.begin(); mi != mapInputs.end(); ++mi)
+            for(map<uint256, CTransaction>::const_iterator mi = mapParents.begin(); mi != mapParents.end(); ++mi)
             {
-                BOOST_FOREACH(const CTxOut &atxout, (*mi).second.second.vout)
+                BOOST_FOREACH(const CTxOut &atxout, (*mi).second.vout)
                 {
                     std::vector<uint160> addrIds;
                     if(BuildAddrIndex(atxout.scriptPubKey, addrIds))
@@ -1926,30 +2033,34 @@ void CBlock::RebuildAddressIndex(CTxDB& txdb)
     }
 }
 
-bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
+bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, CCoinsView& view, bool fJustCheck)
 {
     // Check it again in case a previous version let a bad block in, but skip BlockSig checking
     if (!CheckBlock(!fJustCheck, !fJustCheck, false))
         return false;
 
+    // Inputs resolve against the unspent outputs as of the parent
+    if (view.GetBestBlock() != pindex->pprev)
+        return error("ConnectBlock() : unspent output set is not at the parent of %s", pindex->GetBlockHash().ToString());
+
     unsigned int flags = SCRIPT_VERIFY_NOCACHE;
 
     //// issue here: it doesn't know the version
     unsigned int nTxPos;
     if (fJustCheck)
-        // FetchInputs treats CDiskTxPos(1,1,1) as a special "refer to memorypool" indicator
-        // Since we're just checking the block and not actually connecting it, it might not (and probably shouldn't) be on the disk to get the transaction from
+        // Since we're just checking the block and not actually connecting it, it might not (and probably shouldn't) be on the disk
         nTxPos = 1;
     else
         nTxPos = pindex->nBlockPos + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) - (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(vtx.size());
 
-    map<uint256, CTxIndex> mapQueuedChanges;
+    vector<pair<uint256, CTxIndex> > vQueuedIndex;
     int64_t nFees = 0;
     int64_t nValueIn = 0;
     int64_t nValueOut = 0;
     int64_t nStakeReward = 1;
     unsigned int nSigOps = 0;
     int nInputs = 0;
+    vector<CScript> vSpent; // for the block filter
 
     BOOST_FOREACH(CTransaction& tx, vtx)
     {
@@ -1964,13 +2075,13 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
         if (!fJustCheck)
             nTxPos += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
 
-        MapPrevTx mapInputs;
+        MapPrevOut mapInputs;
         if (tx.IsCoinBase())
             nValueOut += tx.GetValueOut();
         else
         {
             bool fInvalid;
-            if (!tx.FetchInputs(txdb, mapQueuedChanges, true, false, mapInputs, fInvalid))
+            if (!tx.FetchInputs(view, false, mapInputs, fInvalid))
                 return false;
 
             // Add in sigops done by pay-to-script-hash inputs;
@@ -1990,12 +2101,21 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                 nStakeReward = nTxValueOut - nTxValueIn;
 
 
-            if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, flags))
+            if (!tx.ConnectInputs(mapInputs, pindex, true, flags))
                 return false;
+
+            if (fBlockFilterIndex && !fJustCheck)
+            {
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                    vSpent.push_back(mapInputs[txin.prevout].txout.scriptPubKey);
+            }
         }
 
-        mapQueuedChanges[hashTx] = CTxIndex(posThisTx, tx.vout.size());
+        // Later transactions of the block may spend these outputs
+        view.ConnectTransaction(tx, pindex);
+        vQueuedIndex.push_back(make_pair(hashTx, CTxIndex(posThisTx)));
     }
+    view.SetBestBlock(pindex);
 
     if (IsProofOfWork())
     {
@@ -2032,13 +2152,21 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     if (fJustCheck)
         return true;
 
-    // Write queued txindex changes
-    for (map<uint256, CTxIndex>::iterator mi = mapQueuedChanges.begin(); mi != mapQueuedChanges.end(); ++mi)
+    // Write the positions of the block's transactions
+    for (vector<pair<uint256, CTxIndex> >::iterator mi = vQueuedIndex.begin(); mi != vQueuedIndex.end(); ++mi)
     {
         if (!txdb.UpdateTxIndex((*mi).first, (*mi).second))
             return error("ConnectBlock() : UpdateTxIndex failed");
     }
 
+    if (fBlockFilterIndex)
+    {
+        BlockFilterElements elements;
+        GetBlockFilterElements(*this, vSpent, elements);
+        if (!txdb.WriteBlockFilter(CBlockFilter(pindex->GetBlockHash(), elements)))
+            return error("ConnectBlock() : WriteBlockFilter failed");
+    }
+
     if(GetBoolArg("-addrindex", false))
     {
         // Write Address Index
@@ -2048,16 +2176,13 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
             // inputs
             if(!tx.IsCoinBase())
             {
-                MapPrevTx mapInputs;
-                map<uint256, CTxIndex> mapQueuedChangesT;
-                bool fInvalid;
-                if (!tx.FetchInputs(txdb, mapQueuedChangesT, true, false, mapInputs, fInvalid))
+                map<uint256, CTransaction> mapParents;
+                if (!ReadAddrIndexParents(txdb, tx, mapParents))
                     return false;
 
-                MapPrevTx::const_iterator mi;
-                for(MapPrevTx::const_iterator mi = mapInputs.begin(); mi != mapInputs.end(); ++mi)
+                for(map<uint256, CTransaction>::const_iterator mi = mapParents.begin(); mi != mapParents.end(); ++mi)
                 {
-                    BOOST_FOREACH(const CTxOut &atxout, (*mi).second.second.vout)
+                    BOOST_FOREACH(const CTxOut &atxout, (*mi).second.vout)
                     {
                         std::vector<uint160> addrIds;
                         if(BuildAddrIndex(atxout.scriptPubKey, addrIds))
@@ -2099,8 +2224,10 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     }
 
     // Watch for transactions paying to me
-    BOOST_FOREACH(CTransaction& tx, vtx)
-        SyncWithWallets(tx, this);
+    SyncBlockWithWallets(*this);
+
+    // The orphans this block includes or double spends will never be accepted
+    orphantxpool.EraseForBlock(*this);
 
     return true;
 }
@@ -2138,13 +2265,15 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
     LogPrintf("REORGANIZE: Connect %u blocks; %s..%s\n", vConnect.size(), pfork->GetBlockHash().ToString(), pindexNew->GetBlockHash().ToString());
 
     // Disconnect shorter branch
+    CCoinsView view(pcoinsTip);
     list<CTransaction> vResurrect;
+    vector<CTransaction> vUnconfirmed;
     BOOST_FOREACH(CBlockIndex* pindex, vDisconnect)
     {
         CBlock block;
         if (!block.ReadFromDisk(pindex))
             return error("Reorganize() : ReadFromDisk for disconnect failed");
-        if (!block.DisconnectBlock(txdb, pindex))
+        if (!block.DisconnectBlock(txdb, pindex, view))
             return error("Reorganize() : DisconnectBlock %s failed", pindex->GetBlockHash().ToString());
 
         // Queue memory transactions to resurrect.
@@ -2153,17 +2282,19 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
         BOOST_REVERSE_FOREACH(const CTransaction& tx, block.vtx)
             if (!(tx.IsCoinBase() || tx.IsCoinStake()) && pindex->nHeight > Checkpoints::GetTotalBlocksEstimate())
                 vResurrect.push_front(tx);
+        vUnconfirmed.insert(vUnconfirmed.end(), block.vtx.begin(), block.vtx.end());
     }
 
     // Connect longer branch
     vector<CTransaction> vDelete;
+    vector<int> vDeleteHeight;
     for (unsigned int i = 0; i < vConnect.size(); i++)
     {
         CBlockIndex* pindex = vConnect[i];
         CBlock block;
         if (!block.ReadFromDisk(pindex))
             return error("Reorganize() : ReadFromDisk for connect failed");
-        if (!block.ConnectBlock(txdb, pindex))
+        if (!block.ConnectBlock(txdb, pindex, view))
         {
             // Invalid block
             return error("Reorganize() : ConnectBlock %s failed", pindex->GetBlockHash().ToString());
@@ -2171,31 +2302,46 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
 
         // Queue memory transactions to delete
         BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        {
             vDelete.push_back(tx);
+            vDeleteHeight.push_back(pindex->nHeight);
+        }
     }
     if (!txdb.WriteHashBestChain(pindexNew->GetBlockHash()))
         return error("Reorganize() : WriteHashBestChain failed");
 
     // Make sure it's successfully written to disk before changing memory structure
-    if (!txdb.TxnCommit())
+    if (!txdb.TxnCommit(true))
         return error("Reorganize() : TxnCommit failed");
+    if (!view.Flush())
+        return AbortNode("Reorganize() : unspent output set out of step with the tx index");
 
     // Disconnect shorter branch
     BOOST_FOREACH(CBlockIndex* pindex, vDisconnect)
+    {
         if (pindex->pprev)
             pindex->pprev->pnext = NULL;
+        blockcache.EraseBlock(pindex->nFile, pindex->nBlockPos);
+    }
 
     // Connect longer branch
     BOOST_FOREACH(CBlockIndex* pindex, vConnect)
         if (pindex->pprev)
             pindex->pprev->pnext = pindex;
 
+    // Pool transactions spending outputs of the disconnected branch no longer
+    // have confirmed inputs; CreateNewBlock skips them until a parent returns
+    BOOST_FOREACH(const CTransaction& tx, vUnconfirmed)
+        mempool.UpdateInputHeights(tx, MEMPOOL_HEIGHT);
+
     // Resurrect memory transactions that were in the disconnected branch
     BOOST_FOREACH(CTransaction& tx, vResurrect)
         AcceptToMemoryPool(mempool, tx, false, NULL);
 
     // Delete redundant memory transactions that are in the connected branch
-    BOOST_FOREACH(CTransaction& tx, vDelete) {
+    for (unsigned int i = 0; i < vDelete.size(); i++) {
+        CTransaction& tx = vDelete[i];
+        mempool.UpdateInputHeights(tx, vDeleteHeight[i]);
         mempool.remove(tx);
         mempool.removeConflicts(tx);
     }
@@ -2212,21 +2358,28 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, CBlockIndex *pindexNew)
     uint256 hash = GetHash();
 
     // Adding to current best branch
-    if (!ConnectBlock(txdb, pindexNew) || !txdb.WriteHashBestChain(hash))
+    CCoinsView view(pcoinsTip);
+    if (!ConnectBlock(txdb, pindexNew, view) || !txdb.WriteHashBestChain(hash))
     {
         txdb.TxnAbort();
         InvalidChainFound(pindexNew);
         return false;
     }
-    if (!txdb.TxnCommit())
+    if (!txdb.TxnCommit(true))
         return error("SetBestChain() : TxnCommit failed");
+    if (!view.Flush())
+        return AbortNode("SetBestChain() : unspent output set out of step with the tx index");
 
     // Add to current best branch
     pindexNew->pprev->pnext = pindexNew;
 
     // Delete redundant memory transactions
     BOOST_FOREACH(CTransaction& tx, vtx)
+    {
+        mempool.UpdateInputHeights(tx, pindexNew->nHeight);
         mempool.remove(tx);
+        mempool.removeConflicts(tx);
+    }
 
     return true;
 }
@@ -2241,9 +2394,15 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     if (pindexGenesisBlock == NULL && hash == Params().HashGenesisBlock())
     {
         txdb.WriteHashBestChain(hash);
-        if (!txdb.TxnCommit())
+        if (!txdb.TxnCommit(true))
             return error("SetBestChain() : TxnCommit failed");
         pindexGenesisBlock = pindexNew;
+
+        // Nothing of the genesis block is spendable; the set just starts there
+        CCoinsView view(pcoinsTip);
+        view.SetBestBlock(pindexNew);
+        if (!view.Flush())
+            return error("SetBestChain() : unspent output set not empty at the genesis block");
     }
     else if (hashPrevBlock == hashBestChain)
     {
@@ -2312,6 +2471,25 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     nBestChainTrust = pindexNew->nChainTrust;
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
+    UpdateChainTip(pindexBest);
+
+    // The unspent output set moved with the chain; write it out when due
+    if (!pcoinsTip->FlushIfNeeded())
+        return AbortNode("SetBestChain() : writing the unspent output set failed");
+
+    // Initial download leaves many overlapping tables behind; merge them
+    // once the node has caught up
+    static bool fCompactAfterDownload = false;
+    if (fIsInitialDownload)
+        fCompactAfterDownload = true;
+    else if (fCompactAfterDownload)
+    {
+        fCompactAfterDownload = false;
+        txdb.EndInitialDownload();
+    }
+
+    CheckSporkSchedule();
+    uiInterface.NotifyBlockTip(nBestHeight);
 
     uint256 nBestBlockTrust = pindexBest->nHeight != 0 ? (pindexBest->nChainTrust - pindexBest->pprev->nChainTrust) : pindexBest->nChainTrust;
 
@@ -2367,25 +2545,43 @@ bool CTransaction::GetCoinAge(CTxDB& txdb, const CBlockIndex* pindexPrev, uint64
 
     BOOST_FOREACH(const CTxIn& txin, vin)
     {
-        // First try finding the previous transaction in database
-        CTransaction txPrev;
-        CTxIndex txindex;
-        if (!txPrev.ReadFromDisk(txdb, txin.prevout, txindex))
-            continue;  // previous transaction not in main chain
-        if (nTime < txPrev.nTime)
-            return false;  // Transaction timestamp violation
+        // Unspent outputs of the chain we build on resolve without disk reads
+        int64_t nValueIn;
+        unsigned int nTimePrev;
+        CCoin coin;
+        if (pcoinsTip && pcoinsTip->GetCoin(txin.prevout, coin, pindexPrev))
+        {
+            if (nTime < coin.nTime)
+                return false;  // Transaction timestamp violation
+            if (coin.nBlockTime + nStakeMinAge > nTime)
+                continue; // only count coins meeting min age requirement
+            nValueIn = coin.txout.nValue;
+            nTimePrev = coin.nTime;
+        }
+        else
+        {
+            // First try finding the previous transaction in database
+            CTransaction txPrev;
+            CTxIndex txindex;
+            if (!txPrev.ReadFromDisk(txdb, txin.prevout, txindex))
+                continue;  // previous transaction not in main chain
+            if (nTime < txPrev.nTime)
+                return false;  // Transaction timestamp violation
 
-        // Read block header
-        CBlock block;
-        if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
-            return false; // unable to read block of previous transaction
-        if (block.GetBlockTime() + nStakeMinAge > nTime)
-            continue; // only count coins meeting min age requirement
+            // Read block header
+            CBlock block;
+            if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+                return false; // unable to read block of previous transaction
+            if (block.GetBlockTime() + nStakeMinAge > nTime)
+                continue; // only count coins meeting min age requirement
+
+            nValueIn = txPrev.vout[txin.prevout.n].nValue;
+            nTimePrev = txPrev.nTime;
+        }
 
-        int64_t nValueIn = txPrev.vout[txin.prevout.n].nValue;
-        bnCentSecond += CBigNum(nValueIn) * (nTime-txPrev.nTime) / CENT;
+        bnCentSecond += CBigNum(nValueIn) * (nTime-nTimePrev) / CENT;
 
-        LogPrint("coinage", "coin age nValueIn=%d nTimeDiff=%d bnCentSecond=%s\n", nValueIn, nTime - txPrev.nTime, bnCentSecond.ToString());
+        LogPrint("coinage", "coin age nValueIn=%d nTimeDiff=%d bnCentSecond=%s\n", nValueIn, nTime - nTimePrev, bnCentSecond.ToString());
     }
 
     CBigNum bnCoinDay = bnCentSecond * CENT / CREDIT / (24 * 60 * 60);
@@ -2462,13 +2658,126 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
     return true;
 }
 
+static bool HashBlockTransaction(const vector<CTransaction>& vtx, vector<uint256>& vHash, vector<unsigned int>& vSize, size_t i)
+{
+    vHash[i] = vtx[i].GetHash();
+    vSize[i] = ::GetSerializeSize(vtx[i], SER_NETWORK, PROTOCOL_VERSION);
+    return true;
+}
+
+static bool GetBlockTransactionHash(const vector<CTransaction>& vtx, vector<uint256>& vHash, size_t i)
+{
+    vHash[i] = vtx[i].GetHash();
+    return true;
+}
+
+// Why a transaction of a block fails CheckBlock, in the order checked
+enum
+{
+    CHECK_TX_OK = 0,
+    CHECK_TX_INVALID,
+    CHECK_TX_TIME,
+};
+
+static bool CheckBlockTransaction(const CBlock& block, vector<char>& vResult, vector<unsigned int>& vSigOps, size_t i)
+{
+    const CTransaction& tx = block.vtx[i];
+    if (!tx.CheckTransaction())
+        vResult[i] = CHECK_TX_INVALID;
+    // ppcoin: check transaction timestamp
+    else if (block.GetBlockTime() < (int64_t)tx.nTime)
+        vResult[i] = CHECK_TX_TIME;
+    vSigOps[i] = GetLegacySigOpCount(tx);
+    return vResult[i] == CHECK_TX_OK;
+}
+
+// Leaves hashed together on one thread when building the merkle tree of a
+// large block: the levels below them are split between threads and only
+// the top of the tree is left to hash on the calling thread
+static const unsigned int MERKLE_CHUNK_LEVELS = 10;
+
+static void HashMerkleNodes(vector<uint256>& vTree, const vector<size_t>& vLevelStart, const vector<size_t>& vLevelSize,
+                            unsigned int nLevel, size_t nBegin, size_t nEnd)
+{
+    size_t j = vLevelStart[nLevel - 1], nSize = vLevelSize[nLevel - 1];
+    for (size_t i = nBegin; i < nEnd; i++)
+    {
+        size_t i2 = std::min(2 * i + 1, nSize - 1);
+        vTree[vLevelStart[nLevel] + i] = Hash(BEGIN(vTree[j + 2 * i]), END(vTree[j + 2 * i]),
+                                              BEGIN(vTree[j + i2]),    END(vTree[j + i2]));
+    }
+}
+
+static bool HashMerkleChunk(vector<uint256>& vTree, const vector<size_t>& vLevelStart, const vector<size_t>& vLevelSize,
+                            unsigned int nLevels, size_t nChunk)
+{
+    for (unsigned int nLevel = 1; nLevel < nLevels; nLevel++)
+    {
+        size_t nBegin = nChunk << (MERKLE_CHUNK_LEVELS - nLevel);
+        size_t nEnd = std::min((nChunk + 1) << (MERKLE_CHUNK_LEVELS - nLevel), vLevelSize[nLevel]);
+        HashMerkleNodes(vTree, vLevelStart, vLevelSize, nLevel, nBegin, nEnd);
+    }
+    return true;
+}
+
+uint256 CBlock::BuildMerkleTree() const
+{
+    vector<uint256> vTxHashes(vtx.size());
+    ParallelFor(vtx.size(), MIN_PARALLEL_CHECK_TRANSACTIONS, boost::bind(&GetBlockTransactionHash, boost::cref(vtx), boost::ref(vTxHashes), _1));
+    return BuildMerkleTree(vTxHashes);
+}
+
+uint256 CBlock::BuildMerkleTree(const vector<uint256>& vTxHashes) const
+{
+    // The levels of the tree one after the other, the leaves first
+    vector<size_t> vLevelStart, vLevelSize;
+    size_t nTotal = 0;
+    for (size_t nSize = vTxHashes.size(); ; nSize = (nSize + 1) / 2)
+    {
+        vLevelStart.push_back(nTotal);
+        vLevelSize.push_back(nSize);
+        nTotal += nSize;
+        if (nSize <= 1)
+            break;
+    }
+    vMerkleTree.assign(vTxHashes.begin(), vTxHashes.end());
+    vMerkleTree.resize(nTotal);
+
+    // A chunk of leaves and the nodes above them up to MERKLE_CHUNK_LEVELS
+    // only depend on each other, so chunks are hashed independently
+    unsigned int nLevel = 1;
+    if (vTxHashes.size() >= MIN_PARALLEL_CHECK_TRANSACTIONS && vLevelSize.size() > MERKLE_CHUNK_LEVELS)
+    {
+        size_t nChunks = ((vTxHashes.size() - 1) >> MERKLE_CHUNK_LEVELS) + 1;
+        ParallelFor(nChunks, 2, boost::bind(&HashMerkleChunk, boost::ref(vMerkleTree), boost::cref(vLevelStart), boost::cref(vLevelSize),
+                                            MERKLE_CHUNK_LEVELS + 1, _1));
+        nLevel = MERKLE_CHUNK_LEVELS + 1;
+    }
+    for (; nLevel < vLevelSize.size(); nLevel++)
+        HashMerkleNodes(vMerkleTree, vLevelStart, vLevelSize, nLevel, 0, vLevelSize[nLevel]);
+
+    return (vMerkleTree.empty() ? 0 : vMerkleTree.back());
+}
+
 bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) const
 {
     // These are checks that are independent of context
     // that can be verified before saving an orphan block.
 
+    // The transactions are hashed and measured, and later checked, on
+    // several threads for a large block; the results are then looked at
+    // in order, so the first failure is reported as when done one by one
+    vector<uint256> vTxHashes(vtx.size());
+    vector<unsigned int> vTxSizes(vtx.size());
+    if (!vtx.empty() && vtx.size() <= MAX_BLOCK_SIZE)
+        ParallelFor(vtx.size(), MIN_PARALLEL_CHECK_TRANSACTIONS, boost::bind(&HashBlockTransaction, boost::cref(vtx), boost::ref(vTxHashes), boost::ref(vTxSizes), _1));
+    uint64_t nBlockSize = ::GetSerializeSize(*this, SER_NETWORK | SER_BLOCKHEADERONLY, PROTOCOL_VERSION) + GetSizeOfCompactSize(vtx.size()) +
+                          ::GetSerializeSize(vchBlockSig, SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_FOREACH(unsigned int nTxSize, vTxSizes)
+        nBlockSize += nTxSize;
+
     // Size limits
-    if (vtx.empty() || vtx.size() > MAX_BLOCK_SIZE || ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_SIZE)
+    if (vtx.empty() || vtx.size() > MAX_BLOCK_SIZE || nBlockSize > MAX_BLOCK_SIZE)
         return DoS(100, error("CheckBlock() : size limits failed"));
 
     // Check proof of work matches claimed amount
@@ -2508,15 +2817,15 @@ bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) c
 // ----------- instantX transaction scanning -----------
 
     if(IsSporkActive(SPORK_3_INSTANTX_BLOCK_FILTERING)){
+        LOCK(cs_instantx);
         BOOST_FOREACH(const CTransaction& tx, vtx){
             if (!tx.IsCoinBase()){
                 //only reject blocks when it's based on complete consensus
                 BOOST_FOREACH(const CTxIn& in, tx.vin){
-                    if(mapLockedInputs.count(in.prevout)){
-                        if(mapLockedInputs[in.prevout] != tx.GetHash()){
-                            if(fDebug) { LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", mapLockedInputs[in.prevout].ToString().c_str(), tx.GetHash().ToString().c_str()); }
-                            return DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"));
-                        }
+                    boundedmap<COutPoint, uint256>::iterator it = mapLockedInputs.find(in.prevout);
+                    if(it != mapLockedInputs.end() && it->second != tx.GetHash()){
+                        if(fDebug) { LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", it->second.ToString().c_str(), tx.GetHash().ToString().c_str()); }
+                        return DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"));
                     }
                 }
             }
@@ -2596,36 +2905,34 @@ bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) c
 
 
     // Check transactions
-    BOOST_FOREACH(const CTransaction& tx, vtx)
+    vector<char> vResult(vtx.size(), CHECK_TX_OK);
+    vector<unsigned int> vSigOps(vtx.size(), 0);
+    ParallelFor(vtx.size(), MIN_PARALLEL_CHECK_TRANSACTIONS, boost::bind(&CheckBlockTransaction, boost::cref(*this), boost::ref(vResult), boost::ref(vSigOps), _1));
+    for (unsigned int i = 0; i < vtx.size(); i++)
     {
-        if (!tx.CheckTransaction())
-            return DoS(tx.nDoS, error("CheckBlock() : CheckTransaction failed"));
-
-        // ppcoin: check transaction timestamp
-        if (GetBlockTime() < (int64_t)tx.nTime)
+        if (vResult[i] == CHECK_TX_INVALID)
+            return DoS(vtx[i].nDoS, error("CheckBlock() : CheckTransaction failed"));
+        if (vResult[i] == CHECK_TX_TIME)
             return DoS(50, error("CheckBlock() : block timestamp earlier than transaction timestamp"));
     }
 
     // Check for duplicate txids. This is caught by ConnectInputs(),
     // but catching it earlier avoids a potential DoS attack:
-    set<uint256> uniqueTx;
-    BOOST_FOREACH(const CTransaction& tx, vtx)
-    {
-        uniqueTx.insert(tx.GetHash());
-    }
-    if (uniqueTx.size() != vtx.size())
+    vector<uint256> vSortedHashes(vTxHashes);
+    sort(vSortedHashes.begin(), vSortedHashes.end());
+    if (adjacent_find(vSortedHashes.begin(), vSortedHashes.end()) != vSortedHashes.end())
         return DoS(100, error("CheckBlock() : duplicate transaction"));
 
     unsigned int nSigOps = 0;
-    BOOST_FOREACH(const CTransaction& tx, vtx)
+    BOOST_FOREACH(unsigned int nTxSigOps, vSigOps)
     {
-        nSigOps += GetLegacySigOpCount(tx);
+        nSigOps += nTxSigOps;
     }
     if (nSigOps > MAX_BLOCK_SIGOPS)
         return DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"));
 
     // Check merkle root
-    if (fCheckMerkleRoot && hashMerkleRoot != BuildMerkleTree())
+    if (fCheckMerkleRoot && hashMerkleRoot != BuildMerkleTree(vTxHashes))
         return DoS(100, error("CheckBlock() : hashMerkleRoot mismatch"));
 
 
@@ -2838,18 +3145,36 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
                 if (setStakeSeenOrphan.count(pblock->GetProofOfStake()) && !mapOrphanBlocksByPrev.count(hash))
                     return error("ProcessBlock() : duplicate proof-of-stake (%s, %d) for orphan block %s", pblock->GetProofOfStake().first.ToString(), pblock->GetProofOfStake().second, hash.ToString());
             }
-            PruneOrphanBlocks();
             COrphanBlock* pblock2 = new COrphanBlock();
             {
                 CDataStream ss(SER_DISK, CLIENT_VERSION);
                 ss << *pblock;
                 pblock2->vchBlock = std::vector<unsigned char>(ss.begin(), ss.end());
             }
+
+            // A peer cannot push out the orphans of the others
+            size_t nSize = pblock2->vchBlock.size();
+            size_t nMaxPeerBytes = ((size_t)std::max((int64_t)0, GetArg("-maxorphanblockssize", DEFAULT_MAX_ORPHAN_BLOCKS_SIZE)) << 20) / ORPHAN_PEER_SHARE;
+            map<NodeId, size_t>::iterator itPeer = mapOrphanBlockBytesByPeer.find(pfrom->GetId());
+            if (itPeer != mapOrphanBlockBytesByPeer.end() && itPeer->second + nSize > nMaxPeerBytes)
+            {
+                delete pblock2;
+                LogPrintf("ProcessBlock: ignoring orphan block %s, peer=%d holds %u bytes of orphans already\n", hash.ToString(), pfrom->GetId(), itPeer->second);
+                PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(pblock->hashPrevBlock));
+                return true;
+            }
+
+            PruneOrphanBlocks(nSize);
             pblock2->hashBlock = hash;
             pblock2->hashPrev = pblock->hashPrevBlock;
             pblock2->stake = pblock->GetProofOfStake();
+            pblock2->fromPeer = pfrom->GetId();
+            pblock2->nPos = vOrphanBlocks.size();
             mapOrphanBlocks.insert(make_pair(hash, pblock2));
             mapOrphanBlocksByPrev.insert(make_pair(pblock2->hashPrev, pblock2));
+            vOrphanBlocks.push_back(pblock2);
+            mapOrphanBlockBytesByPeer[pblock2->fromPeer] += nSize;
+            nOrphanBlockBytes += nSize;
             if (pblock->IsProofOfStake())
                 setStakeSeenOrphan.insert(pblock->GetProofOfStake());
 
@@ -2873,23 +3198,24 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
     for (unsigned int i = 0; i < vWorkQueue.size(); i++)
     {
         uint256 hashPrev = vWorkQueue[i];
+        vector<COrphanBlock*> vChildren;
         for (multimap<uint256, COrphanBlock*>::iterator mi = mapOrphanBlocksByPrev.lower_bound(hashPrev);
-             mi != mapOrphanBlocksByPrev.upper_bound(hashPrev);
+             mi != mapOrphanBlocksByPrev.end() && mi->first == hashPrev;
              ++mi)
+            vChildren.push_back(mi->second);
+        BOOST_FOREACH(COrphanBlock* pblockOrphan, vChildren)
         {
             CBlock block;
             {
-                CDataStream ss(mi->second->vchBlock, SER_DISK, CLIENT_VERSION);
+                CDataStream ss(pblockOrphan->vchBlock, SER_DISK, CLIENT_VERSION);
                 ss >> block;
             }
+            uint256 hashOrphan = pblockOrphan->hashBlock;
+            EraseOrphanBlock(pblockOrphan);
             block.BuildMerkleTree();
             if (block.AcceptBlock())
-                vWorkQueue.push_back(mi->second->hashBlock);
-            mapOrphanBlocks.erase(mi->second->hashBlock);
-            setStakeSeenOrphan.erase(block.GetProofOfStake());
-            delete mi->second;
+                vWorkQueue.push_back(hashOrphan);
         }
-        mapOrphanBlocksByPrev.erase(hashPrev);
     }
 
     if(!IsInitialBlockDownload()){
@@ -3032,12 +3358,6 @@ bool CheckDiskSpace(uint64_t nAdditionalBytes)
     return true;
 }
 
-static filesystem::path BlockFilePath(unsigned int nFile)
-{
-    string strBlockFn = strprintf("blk%04u.dat", nFile);
-    return GetDataDir() / strBlockFn;
-}
-
 FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode)
 {
     if ((nFile < 1) || (nFile == (unsigned int) -1))
@@ -3056,29 +3376,6 @@ FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszM
     return file;
 }
 
-static unsigned int nCurrentBlockFile = 1;
-
-FILE* AppendBlockFile(unsigned int& nFileRet)
-{
-    nFileRet = 0;
-    while (true)
-    {
-        FILE* file = OpenBlockFile(nCurrentBlockFile, 0, "ab");
-        if (!file)
-            return NULL;
-        if (fseek(file, 0, SEEK_END) != 0)
-            return NULL;
-        // FAT32 file size max 4GB, fseek and ftell max 2GB, so we must stay under 2GB
-        if (ftell(file) < (long)(0x7F000000 - MAX_SIZE))
-        {
-            nFileRet = nCurrentBlockFile;
-            return file;
-        }
-        fclose(file);
-        nCurrentBlockFile++;
-    }
-}
-
 bool LoadBlockIndex(bool fAllowNew)
 {
     LOCK(cs_main);
@@ -3095,6 +3392,17 @@ bool LoadBlockIndex(bool fAllowNew)
     if (!txdb.LoadBlockIndex())
         return false;
 
+    //
+    // The unspent output set was brought up to the best chain along with the
+    // block index; a new database starts with an empty one
+    //
+    if (!pcoinsTip)
+    {
+        pcoinsTip = new CCoinsCache(txdb.GetCoinsCacheSize());
+        if (!pcoinsTip->Load(txdb))
+            return error("LoadBlockIndex() : loading the unspent output set failed");
+    }
+
     //
     // Init with genesis block
     //
@@ -3381,7 +3689,7 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
         bool txInMap = false;
         txInMap = mempool.exists(inv.hash);
         return txInMap ||
-               mapOrphanTransactions.count(inv.hash) ||
+               orphantxpool.HaveTx(inv.hash) ||
                txdb.ContainsTx(inv.hash);
         }
 
@@ -3389,14 +3697,23 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
         return mapBlockIndex.count(inv.hash) ||
                mapOrphanBlocks.count(inv.hash);
     case MSG_TXLOCK_REQUEST:
-        return mapTxLockReq.count(inv.hash) ||
-               mapTxLockReqRejected.count(inv.hash);
+        {
+            LOCK(cs_instantx);
+            return mapTxLockReq.count(inv.hash) ||
+                   mapTxLockReqRejected.count(inv.hash);
+        }
     case MSG_TXLOCK_VOTE:
-        return mapTxLockVote.count(inv.hash);
+        {
+            LOCK(cs_instantx);
+            return mapTxLockVote.count(inv.hash);
+        }
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_MASTERNODE_WINNER:
-        return mapSeenMasternodeVotes.count(inv.hash);
+        {
+            LOCK(cs_masternodepayments);
+            return mapSeenMasternodeVotes.count(inv.hash);
+        }
     }
     // Don't know what it is, just say we already got one
     return true;
@@ -3427,9 +3744,10 @@ void static ProcessGetData(CNode* pfrom)
                 map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end())
                 {
-                    CBlock block;
-                    block.ReadFromDisk((*mi).second);
-                    pfrom->PushMessage("block", block);
+                    // Several peers usually ask for the same new block
+                    CBlockRef pblock;
+                    if (ReadBlockFromDisk((*mi).second, pblock))
+                        pfrom->PushMessage("block", *pblock);
 
                     // Trigger them to send a getblocks request for the next batch of inventory
                     if (inv.hash == pfrom->hashContinue)
@@ -3460,32 +3778,42 @@ void static ProcessGetData(CNode* pfrom)
                 }*/
                 if (!pushed && inv.type == MSG_TX) {
 
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
+                    CTransactionRef ptx = mempool.get(inv.hash);
+                    if (ptx) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << tx;
+                        ss << *ptx;
                         pfrom->PushMessage("tx", ss);
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if(mapTxLockVote.count(inv.hash)){
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
-                        pfrom->PushMessage("txlvote", ss);
-                        pushed = true;
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    {
+                        LOCK(cs_instantx);
+                        boundedmap<uint256, CConsensusVote>::iterator it = mapTxLockVote.find(inv.hash);
+                        if(it != mapTxLockVote.end()){
+                            ss.reserve(1000);
+                            ss << it->second;
+                            pushed = true;
+                        }
                     }
+                    if(pushed)
+                        pfrom->PushMessage("txlvote", ss);
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if(mapTxLockReq.count(inv.hash)){
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
-                        pfrom->PushMessage("txlreq", ss);
-                        pushed = true;
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    {
+                        LOCK(cs_instantx);
+                        boundedmap<uint256, CTransaction>::iterator it = mapTxLockReq.find(inv.hash);
+                        if(it != mapTxLockReq.end()){
+                            ss.reserve(1000);
+                            ss << it->second;
+                            pushed = true;
+                        }
                     }
+                    if(pushed)
+                        pfrom->PushMessage("txlreq", ss);
                 }
                 if (!pushed && inv.type == MSG_SPORK) {
                     if(mapSporks.count(inv.hash)){
@@ -3497,10 +3825,12 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
                 if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
-                    if(mapSeenMasternodeVotes.count(inv.hash)){
+                    LOCK(cs_masternodepayments);
+                    boundedmap<uint256, CMasternodePaymentWinner>::iterator mi = mapSeenMasternodeVotes.find(inv.hash);
+                    if(mi != mapSeenMasternodeVotes.end()){
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mapSeenMasternodeVotes[inv.hash];
+                        ss << mi->second;
                         pfrom->PushMessage("mnw", ss);
                         pushed = true;
                     }
@@ -3895,7 +4225,6 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     else if (strCommand == "tx"|| strCommand == "dstx")
     {
         vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
         CTransaction tx;
 
         //masternode signed transaction
@@ -3973,15 +4302,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             // Recursively process any orphan transactions that depended on this one
             for (unsigned int i = 0; i < vWorkQueue.size(); i++)
             {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (set<uint256>::iterator mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
+                vector<uint256> vChildren;
+                orphantxpool.GetChildren(vWorkQueue[i], vChildren);
+                BOOST_FOREACH(const uint256& orphanTxHash, vChildren)
                 {
-                    const uint256& orphanTxHash = *mi;
-                    CTransaction& orphanTx = mapOrphanTransactions[orphanTxHash];
+                    CTransaction orphanTx;
+                    if (!orphantxpool.GetTx(orphanTxHash, orphanTx))
+                        continue;
                     bool fMissingInputs2 = false;
 
                     if (AcceptToMemoryPool(mempool, orphanTx, true, &fMissingInputs2))
@@ -3989,29 +4316,22 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                         LogPrint("mempool", "   accepted orphan tx %s\n", orphanTxHash.ToString());
                         RelayTransaction(orphanTx, orphanTxHash);
                         vWorkQueue.push_back(orphanTxHash);
-                        vEraseQueue.push_back(orphanTxHash);
+                        orphantxpool.EraseTx(orphanTxHash);
                     }
                     else if (!fMissingInputs2)
                     {
                         // Has inputs but not accepted to mempool
                         // Probably non-standard or insufficient fee/priority
-                        vEraseQueue.push_back(orphanTxHash);
+                        orphantxpool.EraseTx(orphanTxHash);
                         LogPrint("mempool", "   removed orphan tx %s\n", orphanTxHash.ToString());
                     }
                 }
             }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
         }
         else if (fMissingInputs)
         {
-            AddOrphanTx(tx);
-
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nEvicted = LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS);
-            if (nEvicted > 0)
-                LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
+            // The pool bounds itself, per peer and overall
+            orphantxpool.AddTx(tx, pfrom->GetId());
         }
         if(strCommand == "dstx"){
             inv = CInv(MSG_DSTX, tx.GetHash());
@@ -4025,6 +4345,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     {
         CBlock block;
         vRecv >> block;
+        // Transactions are hashed again and again while the block is checked
+        // and connected; they will not change from here on
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+            tx.MakeImmutable();
         uint256 hashBlock = block.GetHash();
 
         LogPrint("net", "received block %s\n", hashBlock.ToString());
@@ -8,6 +8,7 @@
 
 #include "core.h"
 #include "bignum.h"
+#include "coins.h"
 #include "sync.h"
 #include "txmempool.h"
 #include "net.h"
@@ -16,6 +17,8 @@
 
 #include <list>
 
+#include <boost/atomic.hpp>
+
 class CValidationState;
 
 #define START_MASTERNODE_PAYMENTS_TESTNET 1532132263
@@ -54,10 +57,12 @@ static const unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE/50;
 static const unsigned int MAX_P2SH_SIGOPS = 15;
 /** The maximum number of sigops we're willing to relay/mine in a single tx */
 static const unsigned int MAX_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
-/** The maximum number of orphan transactions kept in memory */
-static const unsigned int MAX_ORPHAN_TRANSACTIONS = MAX_BLOCK_SIZE/100;
 /** Default for -maxorphanblocks, maximum number of orphan blocks kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 750;
+/** Default for -maxorphanblockssize, in megabytes */
+static const int64_t DEFAULT_MAX_ORPHAN_BLOCKS_SIZE = 64;
+/** Blocks with fewer transactions are hashed and checked on one thread */
+static const unsigned int MIN_PARALLEL_CHECK_TRANSACTIONS = 256;
 /** This is the static minimum fee associated with each transaction in Satoshis (1 Coin = 100,000,000 Satoshis) */
 static const int64_t MIN_TX_FEE = 1000000; /**
 /** Fees smaller than this (in satoshi) are considered zero fee (for relaying) */
@@ -100,6 +105,7 @@ extern bool fImporting;
 extern bool fReindex;
 struct COrphanBlock;
 extern std::map<uint256, COrphanBlock*> mapOrphanBlocks;
+struct CCacheInfo;
 extern bool fHaveGUI;
 
 // Settings
@@ -126,6 +132,8 @@ void UnregisterWallet(CWalletInterface* pwalletIn);
 void UnregisterAllWallets();
 /** Push an updated transaction to all registered wallets */
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL, bool fConnect = true);
+/** Push the transactions of a connected or disconnected block to all registered wallets */
+void SyncBlockWithWallets(const CBlock& block, bool fConnect = true);
 /** Ask wallets to resend their transactions */
 void ResendWalletTransactions(bool fForce = false);
 
@@ -139,7 +147,6 @@ void PushGetBlocks(CNode* pnode, CBlockIndex* pindexBegin, uint256 hashEnd);
 bool ProcessBlock(CNode* pfrom, CBlock* pblock);
 bool CheckDiskSpace(uint64_t nAdditionalBytes=0);
 FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode="rb");
-FILE* AppendBlockFile(unsigned int& nFileRet);
 bool LoadBlockIndex(bool fAllowNew=true);
 void PrintBlockTree();
 CBlockIndex* FindBlockByHeight(int nHeight);
@@ -156,6 +163,8 @@ bool IsConfirmedInNPrevBlocks(const CTxIndex& txindex, const CBlockIndex* pindex
 std::string GetWarnings(std::string strFor);
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock);
 uint256 WantedByOrphan(const COrphanBlock* pblockOrphan);
+/** Size and memory use of the orphan blocks; call with cs_main held */
+CCacheInfo GetOrphanBlocksInfo();
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
 void ThreadStakeMiner(CWallet *pwallet);
 
@@ -184,6 +193,23 @@ struct CNodeStateStats {
     int nMisbehavior;
 };
 
+/** Copy of the active chain tip that readers can take without holding cs_main.
+ *  Block index entries are never freed while the node runs, so pindex may be
+ *  dereferenced for its immutable fields (hash, height, nBits, pprev, ...). */
+struct CChainTip
+{
+    int nHeight;
+    uint256 hashBlock;
+    const CBlockIndex* pindex;
+
+    CChainTip() : nHeight(-1), hashBlock(0), pindex(NULL) {}
+};
+
+/** Publish a new active chain tip (called with cs_main held) */
+void UpdateChainTip(const CBlockIndex* pindexNew);
+/** Get the most recently published chain tip */
+CChainTip GetChainTip();
+
 
 /** Position on disk for a particular transaction. */
 class CDiskTxPos
@@ -221,6 +247,15 @@ public:
         return !(a == b);
     }
 
+    friend bool operator<(const CDiskTxPos& a, const CDiskTxPos& b)
+    {
+        if (a.nFile != b.nFile)
+            return a.nFile < b.nFile;
+        if (a.nBlockPos != b.nBlockPos)
+            return a.nBlockPos < b.nBlockPos;
+        return a.nTxPos < b.nTxPos;
+    }
+
 
     std::string ToString() const
     {
@@ -241,7 +276,8 @@ enum GetMinFee_mode
     GMF_SEND,
 };
 
-typedef std::map<uint256, std::pair<CTxIndex, CTransaction> > MapPrevTx;
+/** The outputs a transaction spends, by outpoint */
+typedef std::map<COutPoint, CCoin> MapPrevOut;
 
 int64_t GetMinFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree, enum GetMinFee_mode mode);
 
@@ -264,14 +300,40 @@ public:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
 
+private:
+    // Hash of a transaction that has been declared immutable (see MakeImmutable);
+    // hashCached is written before fImmutable is released and only read after
+    // fImmutable is acquired, so another thread never sees a half-written hash
+    mutable uint256 hashCached;
+    mutable boost::atomic<bool> fImmutable;
+
+public:
     CTransaction()
     {
         SetNull();
     }
 
     CTransaction(int nVersion, unsigned int nTime, const std::vector<CTxIn>& vin, const std::vector<CTxOut>& vout, unsigned int nLockTime)
-        : nVersion(nVersion), nTime(nTime), vin(vin), vout(vout), nLockTime(nLockTime), nDoS(0)
+        : nVersion(nVersion), nTime(nTime), vin(vin), vout(vout), nLockTime(nLockTime), nDoS(0), fImmutable(false)
+    {
+    }
+
+    // A copy is a new builder: it does not inherit the source's cached hash
+    CTransaction(const CTransaction& tx)
+        : nVersion(tx.nVersion), nTime(tx.nTime), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime), nDoS(tx.nDoS), fImmutable(false)
+    {
+    }
+
+    CTransaction& operator=(const CTransaction& tx)
     {
+        fImmutable.store(false, boost::memory_order_relaxed);
+        nVersion = tx.nVersion;
+        nTime = tx.nTime;
+        vin = tx.vin;
+        vout = tx.vout;
+        nLockTime = tx.nLockTime;
+        nDoS = tx.nDoS;
+        return *this;
     }
 
     IMPLEMENT_SERIALIZE
@@ -282,6 +344,8 @@ public:
         READWRITE(vin);
         READWRITE(vout);
         READWRITE(nLockTime);
+        if (fRead)
+            fImmutable.store(false, boost::memory_order_relaxed);
     )
 
     void SetNull()
@@ -292,6 +356,37 @@ public:
         vout.clear();
         nLockTime = 0;
         nDoS = 0;  // Denial-of-service prevention
+        fImmutable.store(false, boost::memory_order_relaxed);
+    }
+
+    /** Promise that this transaction will not change any more and cache its
+     *  hash. Call it before the object is shared; the fields must not be
+     *  modified afterwards (copy the transaction to build a new one). */
+    void MakeImmutable() const
+    {
+        if (fImmutable.load(boost::memory_order_acquire))
+            return;
+        hashCached = SerializeHash(*this);
+        fImmutable.store(true, boost::memory_order_release);
+    }
+
+    /** Code that changes the fields of an existing transaction in place
+     *  asserts !IsImmutable() first: the cached hash would go stale */
+    bool IsImmutable() const
+    {
+        return fImmutable.load(boost::memory_order_acquire);
+    }
+
+    /** Copy a transaction that will not be modified either, keeping its
+     *  cached hash if it is immutable */
+    void AssignImmutable(const CTransaction& tx)
+    {
+        *this = tx;
+        if (tx.IsImmutable())
+        {
+            hashCached = tx.hashCached;
+            fImmutable.store(true, boost::memory_order_release);
+        }
     }
 
     bool IsNull() const
@@ -301,6 +396,8 @@ public:
 
     uint256 GetHash() const
     {
+        if (fImmutable.load(boost::memory_order_acquire))
+            return hashCached;
         return SerializeHash(*this);
     }
 
@@ -337,38 +434,15 @@ public:
         Note that lightweight clients may not know anything besides the hash of previous transactions,
         so may not be able to calculate this.
 
-        @param[in] mapInputs    Map of previous transactions that have outputs we're spending
+        @param[in] mapInputs    Map of the outputs we're spending
         @return Sum of value of all inputs (scriptSigs)
         @see CTransaction::FetchInputs
      */
-    int64_t GetValueIn(const MapPrevTx& mapInputs) const;
+    int64_t GetValueIn(const MapPrevOut& mapInputs) const;
 
-    bool ReadFromDisk(CDiskTxPos pos, FILE** pfileRet=NULL)
-    {
-        CAutoFile filein = CAutoFile(OpenBlockFile(pos.nFile, 0, pfileRet ? "rb+" : "rb"), SER_DISK, CLIENT_VERSION);
-        if (filein.IsNull())
-            return error("CTransaction::ReadFromDisk() : OpenBlockFile failed");
-
-        // Read transaction
-        if (fseek(filein.Get(), pos.nTxPos, SEEK_SET) != 0)
-            return error("CTransaction::ReadFromDisk() : fseek failed");
-
-        try {
-            filein >> *this;
-        }
-        catch (std::exception &e) {
-            return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
-        }
-
-        // Return file pointer
-        if (pfileRet)
-        {
-            if (fseek(filein.Get(), pos.nTxPos, SEEK_SET) != 0)
-                return error("CTransaction::ReadFromDisk() : second fseek failed");
-            *pfileRet = filein.release();
-        }
-        return true;
-    }
+    /** Read the transaction at pos, through the block cache unless the
+     *  caller wants the file left open at it */
+    bool ReadFromDisk(CDiskTxPos pos, FILE** pfileRet=NULL);
 
     friend bool operator==(const CTransaction& a, const CTransaction& b)
     {
@@ -407,41 +481,41 @@ public:
     bool ReadFromDisk(CTxDB& txdb, COutPoint prevout, CTxIndex& txindexRet);
     bool ReadFromDisk(CTxDB& txdb, COutPoint prevout);
     bool ReadFromDisk(COutPoint prevout);
-    bool DisconnectInputs(CTxDB& txdb);
 
-    /** Fetch from memory and/or disk. inputsRet keys are transaction hashes.
+    /** Fetch the outputs this transaction spends. inputsRet keys are outpoints.
 
-     @param[in] txdb    Transaction database
-     @param[in] mapTestPool List of pending changes to the transaction index database
-     @param[in] fBlock  True if being called to add a new best-block to the chain
-     @param[in] fMiner  True if being called by CreateNewBlock
-     @param[out] inputsRet  Pointers to this transaction's inputs
+     @param[in] view    Unspent outputs of the chain the transaction is checked on
+     @param[in] fMempool    Also take outputs of memory pool transactions
+     @param[out] inputsRet  The outputs this transaction spends
      @param[out] fInvalid   returns true if transaction is invalid
-     @return    Returns true if all inputs are in txdb or mapTestPool
+     @return    Returns true if all inputs are unspent in the view or the pool
      */
-    bool FetchInputs(CTxDB& txdb, const std::map<uint256, CTxIndex>& mapTestPool,
-                     bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid);
+    bool FetchInputs(const CCoinsView& view, bool fMempool, MapPrevOut& inputsRet, bool& fInvalid) const;
 
-    /** Sanity check previous transactions, then, if all checks succeed,
-        mark them as spent by this transaction.
+    /** Sanity check the outputs this transaction spends and verify its
+        scripts against them. Marking them spent is up to the caller's view.
 
-        @param[in] inputs   Previous transactions (from FetchInputs)
-        @param[out] mapTestPool Keeps track of inputs that need to be updated on disk
-        @param[in] posThisTx    Position of this transaction on disk
-        @param[in] pindexBlock
+        @param[in] inputs   Outputs being spent (from FetchInputs)
+        @param[in] pindexBlock  Block the transaction goes into, or the tip for the pool
         @param[in] fBlock   true if called from ConnectBlock
-        @param[in] fMiner   true if called from CreateNewBlock
         @return Returns true if all checks succeed
      */
-    bool ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
-                       std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS, bool fValidateSig = true);
+    bool ConnectInputs(const MapPrevOut& inputs, const CBlockIndex* pindexBlock, bool fBlock,
+                       unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS, bool fValidateSig = true) const;
     bool CheckTransaction() const;
     bool GetCoinAge(CTxDB& txdb, const CBlockIndex* pindexPrev, uint64_t& nCoinAge) const;
 
-    const CTxOut& GetOutputFor(const CTxIn& input, const MapPrevTx& inputs) const;
+    const CTxOut& GetOutputFor(const CTxIn& input, const MapPrevOut& inputs) const;
 };
 
+/** Copy tx into a shared, immutable transaction with its hash computed once */
+inline CTransactionRef MakeTransactionRef(const CTransaction& tx)
+{
+    CTransaction* ptx = new CTransaction(tx);
+    ptx->MakeImmutable();
+    return CTransactionRef(ptx);
+}
+
 
 
 
@@ -461,11 +535,11 @@ public:
 };
 
 /** Check for standard transaction types
-    @param[in] mapInputs    Map of previous transactions that have outputs we're spending
+    @param[in] mapInputs    Map of the outputs we're spending
     @return True if all inputs (scriptSigs) use only standard transaction forms
     @see CTransaction::FetchInputs
 */
-bool AreInputsStandard(const CTransaction& tx, const MapPrevTx& mapInputs);
+bool AreInputsStandard(const CTransaction& tx, const MapPrevOut& mapInputs);
 
 /** Count ECDSA signature operations the old-fashioned (pre-0.6) way
     @return number of sigops this transaction's outputs will produce when spent
@@ -475,11 +549,11 @@ unsigned int GetLegacySigOpCount(const CTransaction& tx);
 
 /** Count ECDSA signature operations in pay-to-script-hash inputs.
 
-    @param[in] mapInputs    Map of previous transactions that have outputs we're spending
+    @param[in] mapInputs    Map of the outputs we're spending
     @return maximum number of sigops required to validate this transaction's inputs
     @see CTransaction::FetchInputs
  */
-unsigned int GetP2SHSigOpCount(const CTransaction& tx, const MapPrevTx& mapInputs);
+unsigned int GetP2SHSigOpCount(const CTransaction& tx, const MapPrevOut& mapInputs);
 
 inline bool AllowFree(double dPriority)
 {
@@ -556,9 +630,9 @@ public:
 
 
 
-/**  A txdb record that contains the disk location of a transaction and the
- * locations of transactions that spend its outputs.  vSpent is really only
- * used as a flag, but having the location is very helpful for debugging.
+/**  A txdb record that contains the disk location of a transaction.  Spends
+ * are tracked by the unspent output set (see coins.h); vSpent is left empty
+ * and only read so records written by older versions still deserialize.
  */
 class CTxIndex
 {
@@ -571,10 +645,9 @@ public:
         SetNull();
     }
 
-    CTxIndex(const CDiskTxPos& posIn, unsigned int nOutputs)
+    explicit CTxIndex(const CDiskTxPos& posIn)
     {
         pos = posIn;
-        vSpent.resize(nOutputs);
     }
 
     IMPLEMENT_SERIALIZE
@@ -750,24 +823,9 @@ public:
         return maxTransactionTime;
     }
 
-    uint256 BuildMerkleTree() const
-    {
-        vMerkleTree.clear();
-        BOOST_FOREACH(const CTransaction& tx, vtx)
-            vMerkleTree.push_back(tx.GetHash());
-        int j = 0;
-        for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
-        {
-            for (int i = 0; i < nSize; i += 2)
-            {
-                int i2 = std::min(i+1, nSize-1);
-                vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                           BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
-            }
-            j += nSize;
-        }
-        return (vMerkleTree.empty() ? 0 : vMerkleTree.back());
-    }
+    uint256 BuildMerkleTree() const;
+    /** Build the merkle tree from the hashes of vtx, computed already */
+    uint256 BuildMerkleTree(const std::vector<uint256>& vTxHashes) const;
 
     std::vector<uint256> GetMerkleBranch(int nIndex) const
     {
@@ -801,57 +859,16 @@ public:
     }
 
 
-    bool WriteToDisk(unsigned int& nFileRet, unsigned int& nBlockPosRet)
-    {
-        // Open history file to append
-        CAutoFile fileout = CAutoFile(AppendBlockFile(nFileRet), SER_DISK, CLIENT_VERSION);
-        if (fileout.IsNull())
-            return error("CBlock::WriteToDisk() : AppendBlockFile failed");
-
-        // Write index header
-        unsigned int nSize = fileout.GetSerializeSize(*this);
-        fileout << FLATDATA(Params().MessageStart()) << nSize;
+    bool WriteToDisk(unsigned int& nFileRet, unsigned int& nBlockPosRet);
 
-        // Write block
-        long fileOutPos = ftell(fileout.Get());
-        if (fileOutPos < 0)
-            return error("CBlock::WriteToDisk() : ftell failed");
-        nBlockPosRet = fileOutPos;
-        fileout << *this;
+    /** Read straight from the block file, bypassing the block cache */
+    bool ReadFromFile(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions);
 
-        // Flush stdio buffers and commit to disk before returning
-        fflush(fileout.Get());
-        if (!IsInitialBlockDownload() || (nBestHeight+1) % 500 == 0)
-            FileCommit(fileout.Get());
-
-        return true;
-    }
-
-    bool ReadFromDisk(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions=true)
-    {
-        SetNull();
-
-        // Open history file to read
-        CAutoFile filein = CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
-        if (filein.IsNull())
-            return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
-        if (!fReadTransactions)
-            filein.nType |= SER_BLOCKHEADERONLY;
-
-        // Read block
-        try {
-            filein >> *this;
-        }
-        catch (std::exception &e) {
-            return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
-        }
-
-        // Check the header
-        if (fReadTransactions && IsProofOfWork() && !CheckProofOfWork(GetPoWHash(), nBits))
-            return error("CBlock::ReadFromDisk() : errors in block header");
-
-        return true;
-    }
+    /** Read a block, or only its header, taking a copy from the block cache
+     *  when it holds it. A full block read here is not added to the cache,
+     *  so scans over the whole chain do not evict the blocks in use; see
+     *  ReadBlockFromDisk. Headers are. */
+    bool ReadFromDisk(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions=true);
 
 
 
@@ -878,8 +895,8 @@ public:
     }
 
 
-    bool DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex);
-    bool ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck=false);
+    bool DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex, CCoinsView& view);
+    bool ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, CCoinsView& view, bool fJustCheck=false);
     bool ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions=true);
     bool SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew);
     bool AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const uint256& hashProof);
@@ -1431,6 +1448,7 @@ public:
 class CWalletInterface {
 protected:
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock, bool fConnect) =0;
+    virtual void SyncBlock(const CBlock &block, bool fConnect) =0;
     virtual void EraseFromWallet(const uint256 &hash) =0;
     virtual void SetBestChain(const CBlockLocator &locator) =0;
     virtual bool UpdatedTransaction(const uint256 &hash) =0;
@@ -16,8 +16,9 @@ CCriticalSection cs_masternodepayments;
 
 /** Object for who's going to get paid on which blocks */
 CMasternodePayments masternodePayments;
-// keep track of Masternode votes I've seen
-map<uint256, CMasternodePaymentWinner> mapSeenMasternodeVotes;
+// keep track of Masternode votes I've seen; votes are for the next 20 blocks at most,
+// so a few hours of them is all that is worth answering getdata for
+boundedmap<uint256, CMasternodePaymentWinner> mapSeenMasternodeVotes(20000, 3*60*60);
 
 int CMasternodePayments::GetMinMasternodePaymentsProto() {
     return MIN_MASTERNODE_PAYMENT_PROTO_VERSION_1;
@@ -54,7 +55,12 @@ void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDa
         CAdvantagecoinAddress address2(address1);
 
         uint256 hash = winner.GetHash();
-        if(mapSeenMasternodeVotes.count(hash)) {
+        bool fSeen;
+        {
+            LOCK(cs_masternodepayments);
+            fSeen = mapSeenMasternodeVotes.count(hash);
+        }
+        if(fSeen) {
             if(fDebug) LogPrintf("mnw - seen vote %s Addr %s Height %d bestHeight %d\n", hash.ToString().c_str(), address2.ToString().c_str(), winner.nBlockHeight, pindexBest->nHeight);
             return;
         }
@@ -78,7 +84,10 @@ void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDa
             return;
         }
 
-        mapSeenMasternodeVotes.insert(make_pair(hash, winner));
+        {
+            LOCK(cs_masternodepayments);
+            mapSeenMasternodeVotes.insert(make_pair(hash, winner));
+        }
 
         if(masternodePayments.AddWinningMasternode(winner)){
             masternodePayments.Relay(winner);
@@ -145,27 +154,77 @@ uint64_t CMasternodePayments::CalculateScore(uint256 blockHash, CTxIn& vin)
 
 bool CMasternodePayments::GetBlockPayee(int nBlockHeight, CScript& payee, CTxIn& vin)
 {
-    BOOST_FOREACH(CMasternodePaymentWinner& winner, vWinning){
-        if(winner.nBlockHeight == nBlockHeight) {
-            payee = winner.payee;
-            vin = winner.vin;
-            return true;
-        }
-    }
+    LOCK(cs_masternodepayments);
 
-    return false;
+    std::map<int, CMasternodePaymentWinner>::iterator it = mapWinning.find(nBlockHeight);
+    if(it == mapWinning.end()) return false;
+
+    payee = it->second.payee;
+    vin = it->second.vin;
+    return true;
 }
 
 bool CMasternodePayments::GetWinningMasternode(int nBlockHeight, CTxIn& vinOut)
 {
-    BOOST_FOREACH(CMasternodePaymentWinner& winner, vWinning){
-        if(winner.nBlockHeight == nBlockHeight) {
-            vinOut = winner.vin;
-            return true;
-        }
-    }
+    LOCK(cs_masternodepayments);
 
-    return false;
+    std::map<int, CMasternodePaymentWinner>::iterator it = mapWinning.find(nBlockHeight);
+    if(it == mapWinning.end()) return false;
+
+    vinOut = it->second.vin;
+    return true;
+}
+
+void CMasternodePayments::GetPaymentOrder(const std::set<COutPoint>& setAmong, std::vector<COutPoint>& vOrder)
+{
+    LOCK(cs_masternodepayments);
+
+    vOrder.clear();
+    for(std::set<std::pair<int, COutPoint> >::iterator it = setLastPaid.begin(); it != setLastPaid.end(); ++it)
+        if(setAmong.count(it->second)) vOrder.push_back(it->second);
+}
+
+void CMasternodePayments::AddPaidHeight(const COutPoint& outpoint, int nBlockHeight)
+{
+    std::set<int>& setHeights = mapPaidHeights[outpoint];
+    if(!setHeights.empty()) setLastPaid.erase(make_pair(*setHeights.rbegin(), outpoint));
+    setHeights.insert(nBlockHeight);
+    setLastPaid.insert(make_pair(*setHeights.rbegin(), outpoint));
+}
+
+void CMasternodePayments::RemovePaidHeight(const COutPoint& outpoint, int nBlockHeight)
+{
+    std::map<COutPoint, std::set<int> >::iterator it = mapPaidHeights.find(outpoint);
+    if(it == mapPaidHeights.end()) return;
+
+    setLastPaid.erase(make_pair(*it->second.rbegin(), outpoint));
+    it->second.erase(nBlockHeight);
+    if(it->second.empty())
+        mapPaidHeights.erase(it);
+    else
+        setLastPaid.insert(make_pair(*it->second.rbegin(), outpoint));
+}
+
+void CMasternodePayments::RebuildIndex()
+{
+    mapPaidHeights.clear();
+    setLastPaid.clear();
+    for(std::map<int, CMasternodePaymentWinner>::iterator it = mapWinning.begin(); it != mapWinning.end(); ++it)
+        AddPaidHeight(it->second.vin.prevout, it->first);
+}
+
+void CMasternodePayments::Clear()
+{
+    LOCK(cs_masternodepayments);
+    mapWinning.clear();
+    mapPaidHeights.clear();
+    setLastPaid.clear();
+}
+
+int CMasternodePayments::size()
+{
+    LOCK(cs_masternodepayments);
+    return mapWinning.size();
 }
 
 bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerIn)
@@ -177,32 +236,33 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
 
     winnerIn.score = CalculateScore(blockHash, winnerIn.vin);
 
-    bool foundBlock = false;
-    BOOST_FOREACH(CMasternodePaymentWinner& winner, vWinning){
-        if(winner.nBlockHeight == winnerIn.nBlockHeight) {
-            foundBlock = true;
-            if(winner.score < winnerIn.score){
-                winner.score = winnerIn.score;
-                winner.vin = winnerIn.vin;
-                winner.payee = winnerIn.payee;
-                winner.vchSig = winnerIn.vchSig;
+    LOCK(cs_masternodepayments);
 
-                mapSeenMasternodeVotes.insert(make_pair(winnerIn.GetHash(), winnerIn));
+    std::map<int, CMasternodePaymentWinner>::iterator it = mapWinning.find(winnerIn.nBlockHeight);
+    if(it != mapWinning.end()){
+        CMasternodePaymentWinner& winner = it->second;
+        if(winner.score < winnerIn.score){
+            RemovePaidHeight(winner.vin.prevout, winner.nBlockHeight);
+            winner.score = winnerIn.score;
+            winner.vin = winnerIn.vin;
+            winner.payee = winnerIn.payee;
+            winner.vchSig = winnerIn.vchSig;
+            AddPaidHeight(winner.vin.prevout, winner.nBlockHeight);
 
-                return true;
-            }
-        }
-    }
+            mapSeenMasternodeVotes.insert(make_pair(winnerIn.GetHash(), winnerIn));
 
-    // if it's not in the vector
-    if(!foundBlock){
-        vWinning.push_back(winnerIn);
-        mapSeenMasternodeVotes.insert(make_pair(winnerIn.GetHash(), winnerIn));
+            return true;
+        }
 
-        return true;
+        return false;
     }
 
-    return false;
+    // not known yet
+    mapWinning.insert(make_pair(winnerIn.nBlockHeight, winnerIn));
+    AddPaidHeight(winnerIn.vin.prevout, winnerIn.nBlockHeight);
+    mapSeenMasternodeVotes.insert(make_pair(winnerIn.GetHash(), winnerIn));
+
+    return true;
 }
 
 void CMasternodePayments::CleanPaymentList()
@@ -213,13 +273,11 @@ void CMasternodePayments::CleanPaymentList()
 
     int nLimit = std::max(((int)mnodeman.size())*((int)1.25), 1000);
 
-    vector<CMasternodePaymentWinner>::iterator it;
-    for(it=vWinning.begin();it<vWinning.end();it++){
-        if(pindexBest->nHeight - (*it).nBlockHeight > nLimit){
-            if(fDebug) LogPrintf("CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", (*it).nBlockHeight);
-            vWinning.erase(it);
-            break;
-        }
+    std::map<int, CMasternodePaymentWinner>::iterator it = mapWinning.begin();
+    while(it != mapWinning.end() && pindexBest->nHeight - it->first > nLimit){
+        if(fDebug) LogPrintf("CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", it->first);
+        RemovePaidHeight(it->second.vin.prevout, it->first);
+        mapWinning.erase(it++);
     }
 }
 
@@ -240,19 +298,22 @@ bool CMasternodePayments::ProcessBlock(int nBlockHeight)
 
     LogPrintf(" ProcessBlock Start nHeight %d - vin %s. \n", nBlockHeight, activeMasternode.vin.ToString().c_str());
 
-    std::vector<CTxIn> vecLastPayments;
-    BOOST_REVERSE_FOREACH(CMasternodePaymentWinner& winner, vWinning)
+    // the masternodes paid in the last full payment cycle, most recent first
+    std::set<COutPoint> setLastPayments;
+    int nLastPayments = 0;
+    for(std::map<int, CMasternodePaymentWinner>::reverse_iterator it = mapWinning.rbegin(); it != mapWinning.rend(); ++it)
     {
         //if we already have the same vin - we have one full payment cycle, break
-        if(vecLastPayments.size() > (unsigned int)nMinimumAge) break;
-        vecLastPayments.push_back(winner.vin);
+        if(nLastPayments > nMinimumAge) break;
+        setLastPayments.insert(it->second.vin.prevout);
+        nLastPayments++;
     }
 
     // pay to the oldest MN that still had no payment but its input is old enough and it was active long enough
-    CMasternode *pmn = mnodeman.FindOldestNotInVec(vecLastPayments, nMinimumAge);
+    CMasternode *pmn = mnodeman.FindOldestNotInSet(setLastPayments, nMinimumAge);
     if(pmn != NULL)
     {
-        LogPrintf(" Found by FindOldestNotInVec \n");
+        LogPrintf(" Found by FindOldestNotInSet \n");
 
         newWinner.score = 0;
         newWinner.nBlockHeight = nBlockHeight;
@@ -267,14 +328,16 @@ bool CMasternodePayments::ProcessBlock(int nBlockHeight)
         payeeSource = GetScriptForDestination(pmn->pubkey.GetID());
     }
 
-    //if we can't find new MN to get paid, pick first active MN counting back from the end of vecLastPayments list
+    //if we can't find new MN to get paid, pick the active MN whose last payment is the oldest
     if(newWinner.nBlockHeight == 0 && nMinimumAge > 0)
     {
         LogPrintf(" Find by reverse \n");
 
-        BOOST_REVERSE_FOREACH(CTxIn& vinLP, vecLastPayments)
+        std::vector<COutPoint> vOrder;
+        GetPaymentOrder(setLastPayments, vOrder);
+        BOOST_FOREACH(const COutPoint& outpoint, vOrder)
         {
-            CMasternode* pmn = mnodeman.Find(vinLP);
+            CMasternode* pmn = mnodeman.Find(CTxIn(outpoint));
             if(pmn != NULL)
             {
                 pmn->Check();
@@ -339,9 +402,12 @@ void CMasternodePayments::Sync(CNode* node)
 {
     LOCK(cs_masternodepayments);
 
-    BOOST_FOREACH(CMasternodePaymentWinner& winner, vWinning)
-        if(winner.nBlockHeight >= pindexBest->nHeight-10 && winner.nBlockHeight <= pindexBest->nHeight + 20)
-            node->PushMessage("mnw", winner);
+    if(pindexBest == NULL) return;
+
+    std::map<int, CMasternodePaymentWinner>::iterator it = mapWinning.lower_bound(pindexBest->nHeight - 10);
+    std::map<int, CMasternodePaymentWinner>::iterator itEnd = mapWinning.upper_bound(pindexBest->nHeight + 20);
+    for(; it != itEnd; ++it)
+        node->PushMessage("mnw", it->second);
 }
 
 
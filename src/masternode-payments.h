@@ -12,14 +12,16 @@
 #include "base58.h"
 #include "mainfunctions.h"
 #include "masternode.h"
+#include "boundedmap.h"
 
 using namespace std;
 
 class CMasternodePayments;
 class CMasternodePaymentWinner;
 
+extern CCriticalSection cs_masternodepayments;
 extern CMasternodePayments masternodePayments;
-extern map<uint256, CMasternodePaymentWinner> mapSeenMasternodeVotes;
+extern boundedmap<uint256, CMasternodePaymentWinner> mapSeenMasternodeVotes;
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
@@ -65,20 +67,42 @@ public:
 class CMasternodePayments
 {
 private:
-    std::vector<CMasternodePaymentWinner> vWinning;
+    // winner of each block height
+    std::map<int, CMasternodePaymentWinner> mapWinning;
+    // heights each masternode is paid at, and the same ordered by last payment
+    std::map<COutPoint, std::set<int> > mapPaidHeights;
+    std::set<std::pair<int, COutPoint> > setLastPaid;
     int nSyncedFromPeer;
     std::string strMasterPrivKey;
     std::string strMainPubKey;
     bool enabled;
     int nLastBlockHeight;
 
+    void AddPaidHeight(const COutPoint& outpoint, int nBlockHeight);
+    void RemovePaidHeight(const COutPoint& outpoint, int nBlockHeight);
+    void RebuildIndex();
+
 public:
 
     CMasternodePayments() {
         strMainPubKey = "0430a870a5a1e8a85b816c64cb86d6aa4955134efe72c458246fb84cfd5221c111ee84dfc0dbf160d339415044259519eae2840ab3ffe86368f3f9a93ec22e3f4d";
         enabled = false;
+        nLastBlockHeight = 0;
     }
 
+    // serialized into mncache.dat after the masternode list
+    IMPLEMENT_SERIALIZE
+    (
+        {
+                LOCK(cs_masternodepayments);
+                unsigned char nStoreVersion = 0;
+                READWRITE(nStoreVersion);
+                READWRITE(mapWinning);
+                if (fRead)
+                    const_cast<CMasternodePayments*>(this)->RebuildIndex();
+        }
+    )
+
     bool SetPrivKey(std::string strPrivKey);
     bool CheckSignature(CMasternodePaymentWinner& winner);
     bool Sign(CMasternodePaymentWinner& winner);
@@ -99,6 +123,12 @@ public:
     int GetMinMasternodePaymentsProto();
 
     bool GetBlockPayee(int nBlockHeight, CScript& payee, CTxIn& vin);
+
+    // The masternodes of setAmong that have a stored payment, the one paid longest ago first
+    void GetPaymentOrder(const std::set<COutPoint>& setAmong, std::vector<COutPoint>& vOrder);
+
+    void Clear();
+    int size();
 };
 
 
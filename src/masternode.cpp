@@ -12,8 +12,9 @@
 CCriticalSection cs_masternodes;
 // keep track of the scanning errors I've seen
 map<uint256, int> mapSeenMasternodeScanningErrors;
-// cache block hashes as we calculate them
-std::map<int64_t, uint256> mapCacheBlockHashes;
+// cache block hashes as we calculate them, for the heights payments and rankings look at
+boundedmap<int64_t, uint256> mapCacheBlockHashes(5000);
+CCriticalSection cs_mapCacheBlockHashes;
 
 
 struct CompareValueOnly
@@ -33,9 +34,13 @@ bool GetBlockHash(uint256& hash, int nBlockHeight)
     if(nBlockHeight == 0)
         nBlockHeight = pindexBest->nHeight;
 
-    if(mapCacheBlockHashes.count(nBlockHeight)){
-        hash = mapCacheBlockHashes[nBlockHeight];
-        return true;
+    {
+        LOCK(cs_mapCacheBlockHashes);
+        boundedmap<int64_t, uint256>::iterator it = mapCacheBlockHashes.find(nBlockHeight);
+        if(it != mapCacheBlockHashes.end()){
+            hash = it->second;
+            return true;
+        }
     }
 
     const CBlockIndex *BlockLastSolved = pindexBest;
@@ -51,6 +56,7 @@ bool GetBlockHash(uint256& hash, int nBlockHeight)
     for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
         if(n >= nBlocksAgo){
             hash = BlockReading->GetBlockHash();
+            LOCK(cs_mapCacheBlockHashes);
             mapCacheBlockHashes[nBlockHeight] = hash;
             return true;
         }
@@ -198,7 +204,6 @@ uint256 CMasternode::CalculateScore(int mod, int64_t nBlockHeight)
     unsigned int iAddrHash;
     memcpy(&iAddrHash, &hash4, 4);
     iAddrHash = iAddrHash << 11;
-    fprintf(stderr, "CalculateScore():MN addr:%s, AddrHash:%X\n", strAddr.c_str(), iAddrHash); //for Debug
     CBlockIndex* pIndexWork = pindexBest;
     for (iLastPaid = 1; iLastPaid < 4095; iLastPaid++)
     {
@@ -212,7 +217,7 @@ uint256 CMasternode::CalculateScore(int mod, int64_t nBlockHeight)
     rInt32 = (rInt32 >> 12);
     rInt32 = (rInt32 | (iLastPaid<<20));
     r = rInt32;
-    fprintf(stderr, "\t iLastPaid:%d, rInt32:%X\n", iLastPaid, rInt32);
+    LogPrint("masternode", "CalculateScore() : MN addr %s, AddrHash %X, iLastPaid %d, rInt32 %X\n", strAddr, iAddrHash, iLastPaid, rInt32);
     return r;
 
 }
@@ -228,16 +233,18 @@ void CMasternode::Check()
     //once spent, stop doing the checks
     if(activeState == MASTERNODE_VIN_SPENT) return;
 
+    int prevState = activeState;
+    activeState = CheckState();
+    if(activeState != prevState) mnodeman.NotifyStateChanged();
+}
 
-    if(!UpdatedWithin(MASTERNODE_REMOVAL_SECONDS)){
-        activeState = MASTERNODE_REMOVE;
-        return;
-    }
+int CMasternode::CheckState()
+{
+    if(!UpdatedWithin(MASTERNODE_REMOVAL_SECONDS))
+        return MASTERNODE_REMOVE;
 
-    if(!UpdatedWithin(MASTERNODE_EXPIRATION_SECONDS)){
-        activeState = MASTERNODE_EXPIRED;
-        return;
-    }
+    if(!UpdatedWithin(MASTERNODE_EXPIRATION_SECONDS))
+        return MASTERNODE_EXPIRED;
 
     if(!unitTest){
         CValidationState state;
@@ -246,11 +253,51 @@ void CMasternode::Check()
         tx.vin.push_back(vin);
         tx.vout.push_back(vout);
 
-	if(!AcceptableInputs(mempool, tx, false, NULL)){
-            activeState = MASTERNODE_VIN_SPENT;
-            return;
-        }
+	if(!AcceptableInputs(mempool, tx, false, NULL))
+            return MASTERNODE_VIN_SPENT;
     }
 
-    activeState = MASTERNODE_ENABLED; // OK
+    return MASTERNODE_ENABLED; // OK
+}
+
+CMasternodeListEntry::CMasternodeListEntry()
+{
+    sigTime = 0;
+    lastTimeSeen = 0;
+    protocolVersion = 0;
+    rewardPercentage = 0;
+    isOldNode = true;
+}
+
+CMasternodeListEntry::CMasternodeListEntry(const CMasternode& mn)
+{
+    vin = mn.vin;
+    addr = mn.addr;
+    pubkey = mn.pubkey;
+    pubkey2 = mn.pubkey2;
+    sig = mn.sig;
+    sigTime = mn.sigTime;
+    lastTimeSeen = mn.lastTimeSeen;
+    protocolVersion = mn.protocolVersion;
+    rewardAddress = mn.rewardAddress;
+    rewardPercentage = mn.rewardPercentage;
+    isOldNode = mn.isOldNode;
+}
+
+std::string CMasternodeListEntry::GetSignatureMessage() const
+{
+    std::string vchPubKey(pubkey.begin(), pubkey.end());
+    std::string vchPubKey2(pubkey2.begin(), pubkey2.end());
+
+    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    if(!isOldNode)
+        strMessage += rewardAddress.ToString() + boost::lexical_cast<std::string>(rewardPercentage);
+    return strMessage;
+}
+
+bool CMasternodeListEntry::VerifySignature() const
+{
+    std::vector<unsigned char> vchSig(sig);
+    std::string errorMessage = "";
+    return darkSendSigner.VerifyMessage(pubkey, vchSig, GetSignatureMessage(), errorMessage);
 }
@@ -11,6 +11,7 @@
 #include "key.h"
 #include "util.h"
 #include "base58.h"
+#include "boundedmap.h"
 #include "mainfunctions.h"
 #include "script.h"
 #include "masternode.h"
@@ -39,7 +40,9 @@ using namespace std;
 class CMasternode;
 
 extern CCriticalSection cs_masternodes;
-extern map<int64_t, uint256> mapCacheBlockHashes;
+// block hashes by height, as GetBlockHash found them; guarded by cs_mapCacheBlockHashes
+extern boundedmap<int64_t, uint256> mapCacheBlockHashes;
+extern CCriticalSection cs_mapCacheBlockHashes;
 
 bool GetBlockHash(uint256& hash, int nBlockHeight);
 
@@ -209,6 +212,8 @@ public:
     }
 
     void Check();
+    // The state Check() would move an unspent masternode to
+    int CheckState();
 
     bool UpdatedWithin(int seconds)
     {
@@ -252,4 +257,46 @@ public:
     }
 };
 
+//
+// The signed announcement of a masternode, as carried in batches by the list sync ("mnlist").
+// Old style entries (isOldNode) were signed without the reward fields, like "dsee".
+//
+class CMasternodeListEntry
+{
+public:
+    CTxIn vin;
+    CService addr;
+    CPubKey pubkey;
+    CPubKey pubkey2;
+    std::vector<unsigned char> sig;
+    int64_t sigTime;
+    int64_t lastTimeSeen;
+    int protocolVersion;
+    CScript rewardAddress;
+    int rewardPercentage;
+    bool isOldNode;
+
+    CMasternodeListEntry();
+    CMasternodeListEntry(const CMasternode& mn);
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(vin);
+        READWRITE(addr);
+        READWRITE(pubkey);
+        READWRITE(pubkey2);
+        READWRITE(sig);
+        READWRITE(sigTime);
+        READWRITE(lastTimeSeen);
+        READWRITE(protocolVersion);
+        READWRITE(rewardAddress);
+        READWRITE(rewardPercentage);
+        READWRITE(isOldNode);
+    )
+
+    // The message the masternode signed, the same one "dsee"/"dsee+" are checked against
+    std::string GetSignatureMessage() const;
+    bool VerifySignature() const;
+};
+
 #endif
@@ -7,6 +7,8 @@
 #include "addrman.h"
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
 
 
 /** Masternode manager */
@@ -41,7 +43,7 @@ CMasternodeDB::CMasternodeDB()
     strMagicMessage = "MasternodeCache";
 }
 
-bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
+bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave, const CMasternodePayments* ppaymentsToSave)
 {
     int64_t nStart = GetTimeMillis();
 
@@ -50,6 +52,9 @@ bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
     ssMasternodes << strMagicMessage; // masternode cache file specific magic message
     ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
     ssMasternodes << mnodemanToSave;
+    // payment winners follow the list; older versions stop reading before them
+    if (ppaymentsToSave)
+        ssMasternodes << *ppaymentsToSave;
     uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
     ssMasternodes << hash;
 
@@ -75,7 +80,7 @@ bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
     return true;
 }
 
-CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad)
+CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, CMasternodePayments* ppaymentsToLoad)
 {
     int64_t nStart = GetTimeMillis();
     // open input file, and associate with CAutoFile
@@ -144,9 +149,15 @@ CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad)
 
         // de-serialize address data into one CMnList object
         ssMasternodes >> mnodemanToLoad;
+
+        // files written by older versions end here
+        if (ppaymentsToLoad && !ssMasternodes.empty())
+            ssMasternodes >> *ppaymentsToLoad;
     }
     catch (std::exception &e) {
         mnodemanToLoad.Clear();
+        if (ppaymentsToLoad)
+            ppaymentsToLoad->Clear();
         error("%s : Deserialize or I/O error - %s", __func__, e.what());
         return IncorrectFormat;
     }
@@ -154,6 +165,8 @@ CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad)
     mnodemanToLoad.CheckAndRemove(); // clean out expired
     LogPrintf("Loaded info from mncache.dat  %dms\n", GetTimeMillis() - nStart);
     LogPrintf("  %s\n", mnodemanToLoad.ToString());
+    if (ppaymentsToLoad)
+        LogPrintf("  Masternode payment winners: %d\n", ppaymentsToLoad->size());
 
     return Ok;
 }
@@ -182,15 +195,28 @@ void DumpMasternodes()
         }
     }
     LogPrintf("Writting info to mncache.dat...\n");
-    mndb.Write(mnodeman);
+    mndb.Write(mnodeman, &masternodePayments);
 
     LogPrintf("Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
+// Shared by all CMasternodeMan objects; only mnodeman is ever ranked
+static boost::atomic<uint64_t> nMasternodeStateGeneration(0);
+
 CMasternodeMan::CMasternodeMan() {
     nDsqCount = 0;
 }
 
+void CMasternodeMan::NotifyStateChanged()
+{
+    nMasternodeStateGeneration++;
+}
+
+uint64_t CMasternodeMan::GetStateGeneration() const
+{
+    return nMasternodeStateGeneration;
+}
+
 bool CMasternodeMan::Add(CMasternode &mn)
 {
     LOCK(cs);
@@ -201,6 +227,7 @@ bool CMasternodeMan::Add(CMasternode &mn)
     {
         LogPrint("masternode", "CMasternodeMan: Adding new masternode %s - %i now\n", mn.addr.ToString().c_str(), size() + 1);
         vMasternodes.push_back(mn);
+        NotifyStateChanged();
         return true;
     }
 
@@ -244,6 +271,7 @@ void CMasternodeMan::CheckAndRemove()
         if((*it).activeState == CMasternode::MASTERNODE_REMOVE || (*it).activeState == CMasternode::MASTERNODE_VIN_SPENT || (*it).protocolVersion < nMasternodeMinProtocol){
             LogPrint("masternode", "CMasternodeMan: Removing inactive masternode %s - %i now\n", (*it).addr.ToString().c_str(), size() - 1);
             it = vMasternodes.erase(it);
+            NotifyStateChanged();
         } else {
             ++it;
         }
@@ -285,6 +313,7 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    NotifyStateChanged();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -330,11 +359,69 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
             return;
         }
     }
-    pnode->PushMessage("dseg", CTxIn());
+    if (pnode->nVersion >= MIN_MNLIST_SYNC_PROTO_VERSION) {
+        // tell the peer what we already have, it only sends back what we're missing
+        std::vector<std::pair<COutPoint, int64_t> > vInv;
+        GetListInventory(vInv);
+        pnode->PushMessage("mnget", GetListDigest(), vInv);
+    } else {
+        pnode->PushMessage("dseg", CTxIn());
+    }
     int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
 
+void CMasternodeMan::GetListInventory(std::vector<std::pair<COutPoint, int64_t> >& vInv)
+{
+    LOCK(cs);
+
+    vInv.clear();
+    vInv.reserve(vMasternodes.size());
+    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
+        // the same entries dseg hands out
+        if(mn.addr.IsRFC1918() || !mn.IsEnabled()) continue;
+        vInv.push_back(std::make_pair(mn.vin.prevout, mn.sigTime));
+    }
+    std::sort(vInv.begin(), vInv.end());
+}
+
+uint256 CMasternodeMan::GetListDigest()
+{
+    std::vector<std::pair<COutPoint, int64_t> > vInv;
+    GetListInventory(vInv);
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << vInv;
+    return ss.GetHash();
+}
+
+void CMasternodeMan::GetListDiff(const std::vector<std::pair<COutPoint, int64_t> >& vInvPeer, std::vector<CMasternodeListEntry>& vDiff)
+{
+    std::map<COutPoint, int64_t> mapPeer(vInvPeer.begin(), vInvPeer.end());
+
+    LOCK(cs);
+
+    vDiff.clear();
+    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
+        if(mn.addr.IsRFC1918() || !mn.IsEnabled()) continue;
+        std::map<COutPoint, int64_t>::const_iterator it = mapPeer.find(mn.vin.prevout);
+        if(it != mapPeer.end() && it->second >= mn.sigTime) continue;
+        vDiff.push_back(CMasternodeListEntry(mn));
+    }
+}
+
+static bool VerifyListEntry(const std::vector<CMasternodeListEntry>& vEntries, std::vector<char>& vValid, size_t i)
+{
+    vValid[i] = vEntries[i].VerifySignature();
+    return true;
+}
+
+void CMasternodeMan::VerifyListEntries(const std::vector<CMasternodeListEntry>& vEntries, std::vector<char>& vValid)
+{
+    vValid.assign(vEntries.size(), false);
+    ParallelFor(vEntries.size(), 16, boost::bind(&VerifyListEntry, boost::cref(vEntries), boost::ref(vValid), _1));
+}
+
 CMasternode *CMasternodeMan::Find(const CTxIn &vin)
 {
     LOCK(cs);
@@ -347,7 +434,9 @@ CMasternode *CMasternodeMan::Find(const CTxIn &vin)
     return NULL;
 }
 
-CMasternode* CMasternodeMan::FindOldestNotInVec(const std::vector<CTxIn> &vVins, int nMinimumAge)
+// A scan of the list: the order is nLastPaid, which is known for every
+// masternode, while the stored payments only cover the recent winners
+CMasternode* CMasternodeMan::FindOldestNotInSet(const std::set<COutPoint> &setExclude, int nMinimumAge)
 {
     LOCK(cs);
 
@@ -360,14 +449,7 @@ CMasternode* CMasternodeMan::FindOldestNotInVec(const std::vector<CTxIn> &vVins,
 
         if(mn.GetMasternodeInputAge() < nMinimumAge) continue;
 
-        bool found = false;
-        BOOST_FOREACH(const CTxIn& vin, vVins)
-            if(mn.vin.prevout == vin.prevout)
-            {   
-                found = true;
-                break;
-            }
-        if(found) continue;
+        if(setExclude.count(mn.vin.prevout)) continue;
 
         if(pOldestMasternode == NULL || pOldestMasternode->SecondsSincePayment() < mn.SecondsSincePayment())
         {
@@ -493,6 +575,39 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     return -1;
 }
 
+std::vector<CTxIn> CMasternodeMan::GetMasternodeQuorum(int64_t nBlockHeight, unsigned int nCount, int minProtocol)
+{
+    std::vector<pair<unsigned int, CTxIn> > vecMasternodeScores;
+    std::vector<CTxIn> vecQuorum;
+
+    //make sure we know about this block
+    uint256 hash = 0;
+    if(!GetBlockHash(hash, nBlockHeight)) return vecQuorum;
+
+    LOCK(cs);
+
+    // same ranking as GetMasternodeRank with fOnlyActive
+    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
+
+        if(mn.protocolVersion < minProtocol) continue;
+        mn.Check();
+        if(!mn.IsEnabled()) continue;
+
+        uint256 n = mn.CalculateScore(1, nBlockHeight);
+        unsigned int n2 = 0;
+        memcpy(&n2, &n, sizeof(n2));
+
+        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
+    }
+
+    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareValueOnly());
+
+    for(unsigned int i = 0; i < vecMasternodeScores.size() && i < nCount; i++)
+        vecQuorum.push_back(vecMasternodeScores[i].second);
+
+    return vecQuorum;
+}
+
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
     std::vector<pair<unsigned int, CMasternode> > vecMasternodeScores;
@@ -698,6 +813,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                     pmn->sig = vchSig;
                     pmn->protocolVersion = protocolVersion;
                     pmn->addr = addr;
+                    NotifyStateChanged();
                     pmn->Check();
                     pmn->isOldNode = true;
                     if(pmn->IsEnabled())
@@ -708,89 +824,29 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             return;
         }
 
-        // make sure the vout that was signed is related to the transaction that spawned the masternode
-        //  - this is expensive, so it's only done once per masternode
-        if(!darkSendSigner.IsVinAssociatedWithPubkey(vin, pubkey)) {
-            LogPrintf("dsee - Got mismatched pubkey and vin\n");
-            Misbehaving(pfrom->GetId(), 100);
+        if(!CheckNewEntryCollateral(pfrom, strCommand, vin, pubkey, addr, sigTime))
             return;
-        }
-
-        LogPrint("masternode", "dsee - Got NEW masternode entry %s\n", addr.ToString().c_str());
-
-        // make sure it's still unspent
-        //  - this is checked later by .check() in many places and by ThreadCheckDarkSendPool()
-
-        CValidationState state;
-        CTransaction tx = CTransaction();
-        CTxOut vout = CTxOut((GetMNCollateral(pindexBest->nHeight)-1)*CREDIT, darkSendPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-        bool fAcceptable = false;
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if(!lockMain) return;
-            fAcceptable = AcceptableInputs(mempool, tx, false, NULL);
-        }
-        if(fAcceptable){
-            LogPrint("masternode", "dsee - Accepted masternode entry %i %i\n", count, current);
-
-            if(GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS){
-                LogPrintf("dsee - Input must have least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
-                Misbehaving(pfrom->GetId(), 20);
-                return;
-            }
-
-            // verify that sig time is legit in past
-            // should be at least not earlier than block when 10000 TansferCoin tx got MASTERNODE_MIN_CONFIRMATIONS
-            uint256 hashBlock = 0;
-            GetTransaction(vin.prevout.hash, tx, hashBlock);
-            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
-            if (mi != mapBlockIndex.end() && (*mi).second)
-            {
-                CBlockIndex* pMNIndex = (*mi).second; // block for 10000 TansferCoin tx -> 1 confirmation
-                CBlockIndex* pConfIndex = FindBlockByHeight((pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1)); // block where tx got MASTERNODE_MIN_CONFIRMATIONS
-                if(pConfIndex->GetBlockTime() > sigTime)
-                {
-                    LogPrintf("dsee - Bad sigTime %d for masternode %20s %105s (%i conf block is at %d)\n",
-                              sigTime, addr.ToString(), vin.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
-                    return;
-                }
-            }
-
-            // add our masternode
-            CMasternode mn(addr, vin, pubkey, vchSig, sigTime, pubkey2, protocolVersion, rewardAddress, rewardPercentage);
-            mn.UpdateLastSeen(lastUpdated);
 
-            if (!CheckNode((CAddress)addr)){
-                mn.ChangePortStatus(false);
-            } else {
-                addrman.Add(CAddress(addr), pfrom->addr, 2*60*60); // use this as a peer
-            }
-            
-            mn.ChangeNodeStatus(true);
-            this->Add(mn);
-
-            // if it matches our masternodeprivkey, then we've been remotely activated
-            if(pubkey2 == activeMasternode.pubKeyMasternode && protocolVersion == PROTOCOL_VERSION){
-                activeMasternode.EnableHotColdMasterNode(vin, addr);
-                }
+        // add our masternode
+        CMasternode mn(addr, vin, pubkey, vchSig, sigTime, pubkey2, protocolVersion, rewardAddress, rewardPercentage);
+        mn.UpdateLastSeen(lastUpdated);
 
-            if(count == -1 && !isLocal)
-                mnodeman.RelayOldMasternodeEntry(vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion);
-            
+        if (!CheckNode((CAddress)addr)){
+            mn.ChangePortStatus(false);
         } else {
-            LogPrintf("dsee - Rejected masternode entry %s\n", addr.ToString().c_str());
+            addrman.Add(CAddress(addr), pfrom->addr, 2*60*60); // use this as a peer
+        }
+        
+        mn.ChangeNodeStatus(true);
+        this->Add(mn);
 
-            int nDoS = 0;
-            if (state.IsInvalid(nDoS))
-            {
-                LogPrintf("dsee - %s from %s %s was not accepted into the memory pool\n", tx.GetHash().ToString().c_str(),
-                    pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str());
-                if (nDoS > 0)
-                    Misbehaving(pfrom->GetId(), nDoS);
-            }
+        // if it matches our masternodeprivkey, then we've been remotely activated
+        if(pubkey2 == activeMasternode.pubKeyMasternode && protocolVersion >= MIN_POOL_PEER_PROTO_VERSION){
+            activeMasternode.EnableHotColdMasterNode(vin, addr);
         }
+
+        if(count == -1 && !isLocal)
+            mnodeman.RelayOldMasternodeEntry(vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion);
     }
 
     else if (strCommand == "dsee+") { //DarkSend Election Entry+
@@ -908,6 +964,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                     pmn->addr = addr;
                     pmn->rewardAddress = rewardAddress;
                     pmn->rewardPercentage = rewardPercentage;                    
+                    NotifyStateChanged();
                     pmn->Check();
                     pmn->isOldNode = false;
                     if(pmn->IsEnabled())
@@ -918,98 +975,37 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             return;
         }
 
-        // make sure the vout that was signed is related to the transaction that spawned the masternode
-        //  - this is expensive, so it's only done once per masternode
-        if(!darkSendSigner.IsVinAssociatedWithPubkey(vin, pubkey)) {
-            LogPrintf("dsee+ - Got mismatched pubkey and vin\n");
-            Misbehaving(pfrom->GetId(), 100);
+        if(!CheckNewEntryCollateral(pfrom, strCommand, vin, pubkey, addr, sigTime))
             return;
-        }
-
-        LogPrint("masternode", "dsee+ - Got NEW masternode entry %s\n", addr.ToString().c_str());
-
-        // make sure it's still unspent
-        //  - this is checked later by .check() in many places and by ThreadCheckDarkSendPool()
 
-        CValidationState state;
-        CTransaction tx = CTransaction();
-        CTxOut vout = CTxOut((GetMNCollateral(pindexBest->nHeight)-1)*CREDIT, darkSendPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-        bool fAcceptable = false;
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if(!lockMain) return;
-            fAcceptable = AcceptableInputs(mempool, tx, false, NULL);
+        //doesn't support multisig addresses
+        if(rewardAddress.IsPayToScriptHash()){
+            rewardAddress = CScript();
+            rewardPercentage = 0;
         }
-        if(fAcceptable){
-            LogPrint("masternode", "dsee+ - Accepted masternode entry %i %i\n", count, current);
 
-            if(GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS){
-                LogPrintf("dsee+ - Input must have least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
-                Misbehaving(pfrom->GetId(), 20);
-                return;
-            }
-
-            // verify that sig time is legit in past
-            // should be at least not earlier than block when 10000 TansferCoin tx got MASTERNODE_MIN_CONFIRMATIONS
-            uint256 hashBlock = 0;
-            GetTransaction(vin.prevout.hash, tx, hashBlock);
-            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
-           if (mi != mapBlockIndex.end() && (*mi).second)
-            {
-                CBlockIndex* pMNIndex = (*mi).second; // block for 10000 TansferCoin tx -> 1 confirmation
-                CBlockIndex* pConfIndex = FindBlockByHeight((pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1)); // block where tx got MASTERNODE_MIN_CONFIRMATIONS
-                if(pConfIndex->GetBlockTime() > sigTime)
-                {
-                    LogPrintf("dsee+ - Bad sigTime %d for masternode %20s %105s (%i conf block is at %d)\n",
-                              sigTime, addr.ToString(), vin.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
-                    return;
-                }
-            }
-
-
-            //doesn't support multisig addresses
-            if(rewardAddress.IsPayToScriptHash()){
-                rewardAddress = CScript();
-                rewardPercentage = 0;
-            }
-
-            // add our masternode
-            CMasternode mn(addr, vin, pubkey, vchSig, sigTime, pubkey2, protocolVersion, rewardAddress, rewardPercentage);
-            mn.UpdateLastSeen(lastUpdated);
-
-            if (!CheckNode((CAddress)addr)){
-                mn.ChangePortStatus(false);
-            } else {
-                addrman.Add(CAddress(addr), pfrom->addr, 2*60*60); // use this as a peer
-            }
-            
-            mn.ChangeNodeStatus(false);
-            this->Add(mn);
-            
-            // if it matches our masternodeprivkey, then we've been remotely activated
-            if(pubkey2 == activeMasternode.pubKeyMasternode && protocolVersion == PROTOCOL_VERSION){
-                activeMasternode.EnableHotColdMasterNode(vin, addr);
-                }
-
-            if(count == -1 && !isLocal)
-                mnodeman.RelayMasternodeEntry(vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion, rewardAddress, rewardPercentage);
+        // add our masternode
+        CMasternode mn(addr, vin, pubkey, vchSig, sigTime, pubkey2, protocolVersion, rewardAddress, rewardPercentage);
+        mn.UpdateLastSeen(lastUpdated);
 
+        if (!CheckNode((CAddress)addr)){
+            mn.ChangePortStatus(false);
         } else {
-            LogPrintf("dsee+ - Rejected masternode entry %s\n", addr.ToString().c_str());
-
-            int nDoS = 0;
-            if (state.IsInvalid(nDoS))
-            {
-                LogPrintf("dsee+ - %s from %s %s was not accepted into the memory pool\n", tx.GetHash().ToString().c_str(),
-                    pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str());
-                if (nDoS > 0)
-                    Misbehaving(pfrom->GetId(), nDoS);
-            }
+            addrman.Add(CAddress(addr), pfrom->addr, 2*60*60); // use this as a peer
+        }
+        
+        mn.ChangeNodeStatus(false);
+        this->Add(mn);
+        
+        // if it matches our masternodeprivkey, then we've been remotely activated
+        if(pubkey2 == activeMasternode.pubKeyMasternode && protocolVersion >= MIN_POOL_PEER_PROTO_VERSION){
+            activeMasternode.EnableHotColdMasterNode(vin, addr);
         }
+
+        if(count == -1 && !isLocal)
+            mnodeman.RelayMasternodeEntry(vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion, rewardAddress, rewardPercentage);
     }
-    
+
     else if (strCommand == "dseep") { //DarkSend Election Entry Ping
 
         CTxIn vin;
@@ -1052,7 +1048,10 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
                 if(!pmn->UpdatedWithin(MASTERNODE_MIN_DSEEP_SECONDS))
                 {
-                    if(stop) pmn->Disable();
+                    if(stop) {
+                        pmn->Disable();
+                        NotifyStateChanged();
+                    }
                     else
                     {
                         pmn->UpdateLastSeen();
@@ -1172,6 +1171,215 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         LogPrintf("dseg - Sent %d masternode entries to %s\n", i, pfrom->addr.ToString().c_str());
     }
 
+    else if (strCommand == "mnget") { //Get the masternode entries we have and the peer doesn't
+
+        uint256 hashDigest;
+        std::vector<std::pair<COutPoint, int64_t> > vInvPeer;
+        vRecv >> hashDigest >> vInvPeer;
+
+        if(!pfrom->addr.IsRFC1918() && Params().NetworkID() == CChainParams::MAIN)
+        {
+            std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pfrom->addr);
+            if (i != mAskedUsForMasternodeList.end())
+            {
+                int64_t t = (*i).second;
+                if (GetTime() < t) {
+                    Misbehaving(pfrom->GetId(), 34);
+                    LogPrintf("mnget - peer already asked me for the list\n");
+                    return;
+                }
+            }
+
+            int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
+            mAskedUsForMasternodeList[pfrom->addr] = askAgain;
+        }
+
+        if(hashDigest == GetListDigest()) {
+            LogPrint("masternode", "mnget - %s is in sync with us\n", pfrom->addr.ToString());
+            return;
+        }
+
+        std::vector<CMasternodeListEntry> vDiff;
+        GetListDiff(vInvPeer, vDiff);
+
+        for(unsigned int i = 0; i < vDiff.size(); i += MASTERNODES_LIST_BATCH_SIZE) {
+            std::vector<CMasternodeListEntry> vBatch(vDiff.begin() + i, vDiff.begin() + std::min((size_t)i + MASTERNODES_LIST_BATCH_SIZE, vDiff.size()));
+            pfrom->PushMessage("mnlist", vBatch);
+        }
+
+        LogPrintf("mnget - Sent %d of our masternode entries to %s\n", (int)vDiff.size(), pfrom->addr.ToString().c_str());
+    }
+
+    else if (strCommand == "mnlist") { //Batch of masternode entries answering mnget
+
+        // only as the answer to our mnget, so peers can't make us check signatures at will
+        {
+            LOCK(cs);
+            std::map<CNetAddr, int64_t>::iterator it = mWeAskedForMasternodeList.find(pfrom->addr);
+            if (it == mWeAskedForMasternodeList.end() || GetTime() >= (*it).second) {
+                LogPrint("masternode", "mnlist - we didn't ask %s for the list, ignoring\n", pfrom->addr.ToString());
+                return;
+            }
+        }
+
+        std::vector<CMasternodeListEntry> vEntries;
+        vRecv >> vEntries;
+
+        if(vEntries.size() > MASTERNODES_LIST_BATCH_SIZE) {
+            LogPrintf("mnlist - too many entries %d\n", (int)vEntries.size());
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
+
+        // drop what is malformed or no news to us before paying for signature checks
+        std::vector<CMasternodeListEntry> vCheck;
+        BOOST_FOREACH(const CMasternodeListEntry& entry, vEntries) {
+            if(entry.sigTime < 1426700641 || entry.sigTime > entry.lastTimeSeen || entry.addr.GetPort() == 0)
+                continue;
+            if(entry.sigTime > GetAdjustedTime() + 60 * 60)
+                continue;
+            if(entry.protocolVersion < MIN_POOL_PEER_PROTO_VERSION || !entry.vin.scriptSig.empty())
+                continue;
+            if(entry.rewardPercentage < 0 || entry.rewardPercentage > 100)
+                continue;
+            if(!entry.pubkey.IsValid() || !entry.pubkey2.IsValid()) {
+                LogPrintf("mnlist - bad pubkey for %s\n", entry.vin.ToString());
+                Misbehaving(pfrom->GetId(), 100);
+                return;
+            }
+            CMasternode* pmn = Find(entry.vin);
+            if(pmn != NULL && pmn->sigTime >= entry.sigTime)
+                continue;
+            vCheck.push_back(entry);
+        }
+
+        std::vector<char> vValid;
+        VerifyListEntries(vCheck, vValid);
+
+        for(unsigned int i = 0; i < vCheck.size(); i++) {
+            if(!vValid[i]) {
+                LogPrintf("mnlist - Got bad masternode address signature %s\n", vCheck[i].vin.ToString());
+                Misbehaving(pfrom->GetId(), 100);
+                return;
+            }
+            ProcessListEntry(pfrom, vCheck[i]);
+        }
+
+        LogPrint("masternode", "mnlist - Got %d masternode entries, %d new or updated, from %s\n", (int)vEntries.size(), (int)vCheck.size(), pfrom->addr.ToString());
+    }
+
+}
+
+bool CMasternodeMan::CheckNewEntryCollateral(CNode* pfrom, const std::string& strCommand, CTxIn vin, CPubKey pubkey, const CService& addr, int64_t sigTime)
+{
+    // make sure the vout that was signed is related to the transaction that spawned the masternode
+    //  - this is expensive, so it's only done once per masternode
+    if(!darkSendSigner.IsVinAssociatedWithPubkey(vin, pubkey)) {
+        LogPrintf("%s - Got mismatched pubkey and vin\n", strCommand);
+        Misbehaving(pfrom->GetId(), 100);
+        return false;
+    }
+
+    LogPrint("masternode", "%s - Got NEW masternode entry %s\n", strCommand, addr.ToString().c_str());
+
+    // make sure it's still unspent
+    //  - this is checked later by .check() in many places and by ThreadCheckDarkSendPool()
+
+    CTransaction tx = CTransaction();
+    CTxOut vout = CTxOut((GetMNCollateral(pindexBest->nHeight)-1)*CREDIT, darkSendPool.collateralPubKey);
+    tx.vin.push_back(vin);
+    tx.vout.push_back(vout);
+    bool fAcceptable = false;
+    {
+        TRY_LOCK(cs_main, lockMain);
+        if(!lockMain) return false;
+        fAcceptable = AcceptableInputs(mempool, tx, false, NULL);
+    }
+    if(!fAcceptable) {
+        LogPrintf("%s - Rejected masternode entry %s\n", strCommand, addr.ToString().c_str());
+        return false;
+    }
+
+    if(GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS){
+        LogPrintf("%s - Input must have least %d confirmations\n", strCommand, MASTERNODE_MIN_CONFIRMATIONS);
+        Misbehaving(pfrom->GetId(), 20);
+        return false;
+    }
+
+    // verify that sig time is legit in past
+    // should be at least not earlier than block when 10000 TansferCoin tx got MASTERNODE_MIN_CONFIRMATIONS
+    uint256 hashBlock = 0;
+    GetTransaction(vin.prevout.hash, tx, hashBlock);
+    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi != mapBlockIndex.end() && (*mi).second)
+    {
+        CBlockIndex* pMNIndex = (*mi).second; // block for 10000 TansferCoin tx -> 1 confirmation
+        CBlockIndex* pConfIndex = FindBlockByHeight((pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1)); // block where tx got MASTERNODE_MIN_CONFIRMATIONS
+        if(pConfIndex->GetBlockTime() > sigTime)
+        {
+            LogPrintf("%s - Bad sigTime %d for masternode %20s %105s (%i conf block is at %d)\n",
+                      strCommand, sigTime, addr.ToString(), vin.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Take an entry from a list sync whose signature checked out; these aren't relayed,
+// like the dsee entries of a dseg answer
+void CMasternodeMan::ProcessListEntry(CNode* pfrom, const CMasternodeListEntry& entry)
+{
+    CMasternode* pmn = Find(entry.vin);
+    if(pmn != NULL)
+    {
+        // mn.pubkey = pubkey, IsVinAssociatedWithPubkey is validated once when it was added,
+        //   after that they just need to match
+        if(pmn->pubkey != entry.pubkey || pmn->sigTime >= entry.sigTime) return;
+
+        LogPrint("masternode", "mnlist - Got updated entry for %s\n", entry.addr.ToString().c_str());
+        pmn->isPortOpen = CheckNode((CAddress)entry.addr);
+        pmn->pubkey2 = entry.pubkey2;
+        pmn->sigTime = entry.sigTime;
+        pmn->sig = entry.sig;
+        pmn->protocolVersion = entry.protocolVersion;
+        pmn->addr = entry.addr;
+        pmn->rewardAddress = entry.rewardAddress;
+        pmn->rewardPercentage = entry.rewardPercentage;
+        pmn->isOldNode = entry.isOldNode;
+        pmn->lastTimeSeen = std::max(pmn->lastTimeSeen, entry.lastTimeSeen);
+        NotifyStateChanged();
+        pmn->Check();
+        return;
+    }
+
+    if(!CheckNewEntryCollateral(pfrom, "mnlist", entry.vin, entry.pubkey, entry.addr, entry.sigTime))
+        return;
+
+    CScript rewardAddress = entry.rewardAddress;
+    int rewardPercentage = entry.rewardPercentage;
+    //doesn't support multisig addresses
+    if(rewardAddress.IsPayToScriptHash()){
+        rewardAddress = CScript();
+        rewardPercentage = 0;
+    }
+
+    CMasternode mn(entry.addr, entry.vin, entry.pubkey, entry.sig, entry.sigTime, entry.pubkey2, entry.protocolVersion, rewardAddress, rewardPercentage);
+    mn.UpdateLastSeen(entry.lastTimeSeen);
+
+    if (!CheckNode((CAddress)entry.addr)){
+        mn.ChangePortStatus(false);
+    } else {
+        addrman.Add(CAddress(entry.addr), pfrom->addr, 2*60*60); // use this as a peer
+    }
+
+    mn.ChangeNodeStatus(entry.isOldNode);
+    this->Add(mn);
+
+    // if it matches our masternodeprivkey, then we've been remotely activated
+    if(entry.pubkey2 == activeMasternode.pubKeyMasternode && entry.protocolVersion >= MIN_POOL_PEER_PROTO_VERSION){
+        activeMasternode.EnableHotColdMasterNode(mn.vin, mn.addr);
+    }
 }
 
 void CMasternodeMan::RelayOldMasternodeEntry(const CTxIn vin, const CService addr, const std::vector<unsigned char> vchSig, const int64_t nNow, const CPubKey pubkey, const CPubKey pubkey2, const int count, const int current, const int64_t lastUpdated, const int protocolVersion)
@@ -1206,6 +1414,7 @@ void CMasternodeMan::Remove(CTxIn vin)
         if((*it).vin == vin){
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).addr.ToString().c_str(), size() - 1);
             vMasternodes.erase(it);
+            NotifyStateChanged();
             break;
         } else {
             ++it;
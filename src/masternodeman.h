@@ -19,6 +19,8 @@
 
 #define MASTERNODES_DUMP_SECONDS               (15*60)
 #define MASTERNODES_DSEG_SECONDS               (3*60*60)
+// most entries carried by one "mnlist" message
+#define MASTERNODES_LIST_BATCH_SIZE            100
 
 using namespace std;
 
@@ -31,6 +33,8 @@ extern void Misbehaving(NodeId nodeid, int howmuch);
 void DumpMasternodes();
 
 /** Access to the MN database (mncache.dat) */
+class CMasternodePayments;
+
 class CMasternodeDB
 {
 private:
@@ -48,8 +52,8 @@ public:
     };
 
     CMasternodeDB();
-    bool Write(const CMasternodeMan &mnodemanToSave);
-    ReadResult Read(CMasternodeMan& mnodemanToLoad);
+    bool Write(const CMasternodeMan &mnodemanToSave, const CMasternodePayments* ppaymentsToSave = NULL);
+    ReadResult Read(CMasternodeMan& mnodemanToLoad, CMasternodePayments* ppaymentsToLoad = NULL);
 };
 
 class CMasternodeMan
@@ -106,18 +110,33 @@ public:
     // Clear masternode vector
     void Clear();
 
+    // Count a change that can reorder the enabled masternodes: one added or
+    // removed, enabled or disabled, or a newer announcement taken
+    void NotifyStateChanged();
+    // Changes so far; rankings cached by others are stale once it moves
+    uint64_t GetStateGeneration() const;
+
     int CountEnabled(int protocolVersion = -1);
 
     int CountMasternodesAboveProtocol(int protocolVersion);
 
     void DsegUpdate(CNode* pnode);
 
+    // What a list sync hands out, as (collateral, sigTime) pairs sorted by collateral
+    void GetListInventory(std::vector<std::pair<COutPoint, int64_t> >& vInv);
+    // Hash of the list inventory; peers with the same digest have nothing to send each other
+    uint256 GetListDigest();
+    // The entries a peer holding vInvPeer is missing or has an older announcement of
+    void GetListDiff(const std::vector<std::pair<COutPoint, int64_t> >& vInvPeer, std::vector<CMasternodeListEntry>& vDiff);
+    // Check the signatures of a batch of entries, on all cores for big batches
+    static void VerifyListEntries(const std::vector<CMasternodeListEntry>& vEntries, std::vector<char>& vValid);
+
     // Find an entry
     CMasternode* Find(const CTxIn& vin);
     CMasternode* Find(const CPubKey& pubKeyMasternode);
 
-    //Find an entry thta do not match every entry provided vector
-    CMasternode* FindOldestNotInVec(const std::vector<CTxIn> &vVins, int nMinimumAge);
+    // Find the longest unpaid entry that is not in the provided set
+    CMasternode* FindOldestNotInSet(const std::set<COutPoint> &setExclude, int nMinimumAge);
 
     // Find a random entry
     CMasternode* FindRandom();
@@ -132,6 +151,8 @@ public:
 
     std::vector<pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol=0);
     int GetMasternodeRank(const CTxIn &vin, int64_t nBlockHeight, int minProtocol=0, bool fOnlyActive=true);
+    // Get the vins of the nCount best ranked active masternodes for this block, best first
+    std::vector<CTxIn> GetMasternodeQuorum(int64_t nBlockHeight, unsigned int nCount, int minProtocol=0);
     CMasternode* GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol=0, bool fOnlyActive=true);
 
     void ProcessMasternodeConnections();
@@ -153,6 +174,11 @@ public:
 
     void Remove(CTxIn vin);
 
+private:
+    // Checks on the collateral of a masternode we hear about for the first time
+    bool CheckNewEntryCollateral(CNode* pfrom, const std::string& strCommand, CTxIn vin, CPubKey pubkey, const CService& addr, int64_t sigTime);
+    void ProcessListEntry(CNode* pfrom, const CMasternodeListEntry& entry);
+
 };
 
 #endif
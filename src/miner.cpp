@@ -61,14 +61,16 @@ void SHA256Transform(void* pstate, void* pinput, const void* pinit)
 class COrphan
 {
 public:
-    CTransaction* ptx;
+    const CTransaction* ptx;
+    const CMempoolInputs* pinputs;
     set<uint256> setDependsOn;
     double dPriority;
     double dFeePerKb;
 
-    COrphan(CTransaction* ptxIn)
+    COrphan(const CTransaction* ptxIn, const CMempoolInputs* pinputsIn)
     {
         ptx = ptxIn;
+        pinputs = pinputsIn;
         dPriority = dFeePerKb = 0;
     }
 };
@@ -79,7 +81,7 @@ uint64_t nLastBlockSize = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
  
 // We want to sort transactions by priority and fee, so:
-typedef boost::tuple<double, double, CTransaction*> TxPriority;
+typedef boost::tuple<double, double, const CTransaction*, const CMempoolInputs*> TxPriority;
 class TxPriorityCompare
 {
     bool byFee;
@@ -169,8 +171,11 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, int64_t* pFe
     int64_t nFees = 0;
 	{
 		LOCK2(cs_main, mempool.cs);
-		CTxDB txdb("r");
 		//>A<
+		// Priorities, fees and limits come from what was resolved when each
+		// transaction entered the pool (see CTxMemPool::mapTxInputs), so
+		// filling the block reads nothing from disk. Only the scripts of the
+		// transactions picked for the block are checked again, as a last check.
 				// Priority order to process transactions
 		list<COrphan> vOrphan; // list memory doesn't move
 		map<uint256, vector<COrphan*> > mapDependers;
@@ -178,33 +183,30 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, int64_t* pFe
 		// This vector will be sorted into a priority queue:
 		vector<TxPriority> vecPriority;
 		vecPriority.reserve(mempool.mapTx.size());
-		for (map<uint256, CTransaction>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+		for (map<uint256, CTransactionRef>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
 		{
-			CTransaction& tx = (*mi).second;
+			const CTransaction& tx = *(*mi).second;
 			if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
 				continue;
 
+			map<uint256, CMempoolInputs>::const_iterator ii = mempool.mapTxInputs.find((*mi).first);
+			if (ii == mempool.mapTxInputs.end())
+				continue;
+			const CMempoolInputs& inputs = (*ii).second;
+
 			COrphan* porphan = NULL;
 			double dPriority = 0;
-			int64_t nTotalIn = 0;
-			bool fMissingInputs = false;
-			BOOST_FOREACH(const CTxIn& txin, tx.vin)
+			bool fSkip = false;
+			for (unsigned int i = 0; i < tx.vin.size(); i++)
 			{
-				// Read prev transaction
-				CTransaction txPrev;
-				CTxIndex txindex;
-				if (!txPrev.ReadFromDisk(txdb, txin.prevout, txindex))
+				const CTxIn& txin = tx.vin[i];
+				const CMempoolPrevOut& prev = inputs.vPrevOut[i];
+				if (prev.nHeight == MEMPOOL_HEIGHT)
 				{
-					// This should never happen; all transactions in the memory
-					// pool should connect to either transactions in the chain
-					// or other transactions in the memory pool.
+					// Parent left the chain in a reorg and did not come back
 					if (!mempool.mapTx.count(txin.prevout.hash))
 					{
-						LogPrintf("ERROR: mempool transaction missing input\n");
-						if (fDebug) assert("mempool transaction missing input" == 0);
-						fMissingInputs = true;
-						if (porphan)
-							vOrphan.pop_back();
+						fSkip = true;
 						break;
 					}
 
@@ -212,30 +214,39 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, int64_t* pFe
 					if (!porphan)
 					{
 						// Use list for automatic deletion
-						vOrphan.push_back(COrphan(&tx));
+						vOrphan.push_back(COrphan(&tx, &inputs));
 						porphan = &vOrphan.back();
 					}
 					mapDependers[txin.prevout.hash].push_back(porphan);
 					porphan->setDependsOn.insert(txin.prevout.hash);
-					nTotalIn += mempool.mapTx[txin.prevout.hash].vout[txin.prevout.n].nValue;
 					continue;
 				}
-				int64_t nValueIn = txPrev.vout[txin.prevout.n].nValue;
-				nTotalIn += nValueIn;
 
-				int nConf = txindex.GetDepthInMainChain();
-				dPriority += (double)nValueIn * nConf;
+				// Coinbase and coinstake outputs must mature before they can
+				// be spent in the block being built
+				if (prev.fCoinBase && pindexPrev->nHeight - prev.nHeight < nCoinbaseMaturity)
+				{
+					fSkip = true;
+					break;
+				}
+
+				dPriority += (double)prev.txout.nValue * (nHeight - prev.nHeight);
+			}
+			if (fSkip)
+			{
+				if (porphan)
+					vOrphan.pop_back();
+				continue;
 			}
-			if (fMissingInputs) continue;
 
 			// Priority is sum(valuein * age) / txsize
-			unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+			unsigned int nTxSize = inputs.nTxSize;
 			dPriority /= nTxSize;
 
 			// This is a more accurate fee-per-kilobyte than is used by the client code, because the
 			// client code rounds up the size to the nearest 1K. That's good, because it gives an
 			// incentive to create smaller transactions.
-			double dFeePerKb = double(nTotalIn - tx.GetValueOut()) / (double(nTxSize) / 1000.0);
+			double dFeePerKb = double(inputs.nValueIn - tx.GetValueOut()) / (double(nTxSize) / 1000.0);
 
 			if (porphan)
 			{
@@ -243,11 +254,10 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, int64_t* pFe
 				porphan->dFeePerKb = dFeePerKb;
 			}
 			else
-				vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &(*mi).second));
+				vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &tx, &inputs));
 		}
 
 		// Collect transactions into block
-		map<uint256, CTxIndex> mapTestPool;
 		uint64_t nBlockSize = 1000;
 		uint64_t nBlockTx = 0;
 		int nBlockSigOps = 100;
@@ -261,18 +271,19 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, int64_t* pFe
 			// Take highest priority transaction off the priority queue:
 			double dPriority = vecPriority.front().get<0>();
 			double dFeePerKb = vecPriority.front().get<1>();
-			CTransaction& tx = *(vecPriority.front().get<2>());
+			const CTransaction& tx = *(vecPriority.front().get<2>());
+			const CMempoolInputs& inputs = *(vecPriority.front().get<3>());
 
 			std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
 			vecPriority.pop_back();
 
 			// Size limits
-			unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+			unsigned int nTxSize = inputs.nTxSize;
 			if (nBlockSize + nTxSize >= nBlockMaxSize)
 				continue;
 
-			// Legacy limits on sigOps:
-			unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+			// Legacy and P2SH limits on sigOps:
+			unsigned int nTxSigOps = inputs.nSigOps;
 			if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
 				continue;
 
@@ -294,27 +305,20 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, int64_t* pFe
 				std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
 			}
 
-			// Connecting shouldn't fail due to dependency on other memory pool transactions
-			// because we're already processing them in order of dependency
-			map<uint256, CTxIndex> mapTestPoolTmp(mapTestPool);
-			MapPrevTx mapInputs;
-			bool fInvalid;
-			if (!tx.FetchInputs(txdb, mapTestPoolTmp, false, true, mapInputs, fInvalid))
-				continue;
-
-			int64_t nTxFees = tx.GetValueIn(mapInputs) - tx.GetValueOut();
-
-			nTxSigOps += GetP2SHSigOpCount(tx, mapInputs);
-			if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+			// Timestamps, values and double spends were checked when the
+			// transaction entered the pool and the cached inputs follow the
+			// chain, with parents in the pool already placed above. Note the
+			// flags: we don't want to set mempool/IsStandard() policy here, but
+			// we still have to ensure that the block we create only contains
+			// transactions that are valid in new blocks.
+			CSignatureHasher sighasher(tx);
+			bool fValid = true;
+			for (unsigned int i = 0; i < tx.vin.size() && fValid; i++)
+				fValid = VerifyScript(tx.vin[i].scriptSig, inputs.vPrevOut[i].txout.scriptPubKey, tx, i, MANDATORY_SCRIPT_VERIFY_FLAGS, 0, &sighasher);
+			if (!fValid)
 				continue;
 
-			// Note that flags: we don't want to set mempool/IsStandard()
-			// policy here, but we still have to ensure that the block we
-			// create only contains transactions that are valid in new blocks.
-			if (!tx.ConnectInputs(txdb, mapInputs, mapTestPoolTmp, CDiskTxPos(1, 1, 1), pindexPrev, false, true, MANDATORY_SCRIPT_VERIFY_FLAGS))
-				continue;
-			mapTestPoolTmp[tx.GetHash()] = CTxIndex(CDiskTxPos(1, 1, 1), tx.vout.size());
-			swap(mapTestPool, mapTestPoolTmp);
+			int64_t nTxFees = inputs.nValueIn - tx.GetValueOut();
 
 			// Added
 			pblock->vtx.push_back(tx);
@@ -340,7 +344,7 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, int64_t* pFe
 						porphan->setDependsOn.erase(hash);
 						if (porphan->setDependsOn.empty())
 						{
-							vecPriority.push_back(TxPriority(porphan->dPriority, porphan->dFeePerKb, porphan->ptx));
+							vecPriority.push_back(TxPriority(porphan->dPriority, porphan->dFeePerKb, porphan->ptx, porphan->pinputs));
 							std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
 						}
 					}
@@ -356,6 +360,7 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, int64_t* pFe
 		// >A<
 		if (!fProofOfStake){
 			int64_t blockValue = GetProofOfWorkReward(pindexPrev->nHeight + 1, nFees);
+			assert(!pblock->vtx[0].IsImmutable());
 			pblock->vtx[0].vout[0].nValue = (int64_t)((double)blockValue - (nFees * (nHeight == 1 ? 0.00 : 0.24)));
 			if (nHeight > 1) {
 				CTxOut treasuryOut(nFees * 0.24 + (nHeight % 100 ? 0 : 200000000000), Params().GetTreasuryRewardScript());
@@ -390,6 +395,7 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
     ++nExtraNonce;
 
     unsigned int nHeight = pindexPrev->nHeight+1; // Height first in coinbase required for block.version=2
+    assert(!pblock->vtx[0].IsImmutable());
     pblock->vtx[0].vin[0].scriptSig = (CScript() << nHeight << CBigNum(nExtraNonce)) + CREDITBASE_FLAGS;
     assert(pblock->vtx[0].vin[0].scriptSig.size() <= 100);
 
@@ -0,0 +1,270 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "orphanpool.h"
+
+#include "blockcache.h"
+#include "boundedmap.h"
+#include "util.h"
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+COrphanTxPool orphantxpool(DEFAULT_MAX_ORPHAN_TRANSACTIONS, DEFAULT_MAX_ORPHAN_TX_SIZE << 20);
+
+size_t OrphanTxUsage(const CTransaction& tx)
+{
+    // The pool node with the sender and expiry, and per input the node
+    // indexing it by the output it spends
+    size_t nUsage = TransactionUsage(tx) + sizeof(uint256) + sizeof(NodeId) + sizeof(int64_t) + 2 * sizeof(size_t) + 5 * sizeof(void*);
+    nUsage += tx.vin.size() * (sizeof(COutPoint) + sizeof(uint256) + 10 * sizeof(void*));
+    return nUsage;
+}
+
+COrphanTxPool::COrphanTxPool(size_t nMaxOrphansIn, size_t nMaxUsageIn) : nUsage(0), nMaxOrphans(nMaxOrphansIn), nMaxUsage(nMaxUsageIn),
+                                                                         nNextSweep(0), nEvicted(0), nExpired(0)
+{
+}
+
+void COrphanTxPool::SetLimits(size_t nMaxOrphansIn, size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxOrphans = nMaxOrphansIn;
+    nMaxUsage = nMaxUsageIn;
+    while (!vOrphans.empty() && (mapOrphans.size() > nMaxOrphans || nUsage > nMaxUsage))
+    {
+        Erase(vOrphans[insecure_rand() % vOrphans.size()]);
+        nEvicted++;
+    }
+}
+
+void COrphanTxPool::Erase(COrphanMap::iterator it)
+{
+    const uint256& hash = it->first;
+    BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
+    {
+        map<COutPoint, set<uint256> >::iterator itPrev = mapOrphansByPrev.find(txin.prevout);
+        if (itPrev == mapOrphansByPrev.end())
+            continue;
+        itPrev->second.erase(hash);
+        if (itPrev->second.empty())
+            mapOrphansByPrev.erase(itPrev);
+    }
+
+    // Fill its slot with the last one
+    size_t nPos = it->second.nPos;
+    vOrphans[nPos] = vOrphans.back();
+    vOrphans[nPos]->second.nPos = nPos;
+    vOrphans.pop_back();
+
+    map<NodeId, CPeerUsage>::iterator itPeer = mapPeerUsage.find(it->second.fromPeer);
+    if (itPeer != mapPeerUsage.end())
+    {
+        itPeer->second.nUsage -= it->second.nUsage;
+        if (--itPeer->second.nOrphans == 0)
+            mapPeerUsage.erase(itPeer);
+    }
+    nUsage -= it->second.nUsage;
+    mapOrphans.erase(it);
+}
+
+bool COrphanTxPool::AddTx(const CTransaction& tx, NodeId peer)
+{
+    LOCK(cs);
+    Expire();
+
+    uint256 hash = tx.GetHash();
+    if (mapOrphans.count(hash) || nMaxOrphans == 0)
+        return false;
+
+    // Ignore big transactions, to avoid a send-big-orphans memory
+    // exhaustion attack. If a peer has a legitimate large transaction with
+    // a missing parent then we assume it will rebroadcast it later, after
+    // the parent transaction(s) have been mined or received.
+    size_t nSize = tx.GetSerializeSize(SER_NETWORK, CTransaction::CURRENT_VERSION);
+    if (nSize > MAX_ORPHAN_TX_SIZE)
+    {
+        LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", nSize, hash.ToString());
+        return false;
+    }
+
+    // A peer cannot push out the orphans of the others
+    size_t nTxUsage = OrphanTxUsage(tx);
+    map<NodeId, CPeerUsage>::iterator itPeer = mapPeerUsage.find(peer);
+    if (itPeer != mapPeerUsage.end() &&
+        (itPeer->second.nOrphans >= max(nMaxOrphans / ORPHAN_PEER_SHARE, (size_t)1) ||
+         itPeer->second.nUsage + nTxUsage > nMaxUsage / ORPHAN_PEER_SHARE))
+    {
+        LogPrint("mempool", "ignoring orphan tx %s, peer=%d holds %u orphans already\n", hash.ToString(), peer, itPeer->second.nOrphans);
+        return false;
+    }
+
+    while (!vOrphans.empty() && (mapOrphans.size() >= nMaxOrphans || nUsage + nTxUsage > nMaxUsage))
+    {
+        Erase(vOrphans[insecure_rand() % vOrphans.size()]);
+        nEvicted++;
+    }
+
+    COrphanMap::iterator it = mapOrphans.insert(make_pair(hash, COrphanTx())).first;
+    COrphanTx& orphan = it->second;
+    orphan.tx = tx;
+    orphan.tx.MakeImmutable();
+    orphan.fromPeer = peer;
+    orphan.nTimeExpire = GetTime() + ORPHAN_TX_EXPIRE_TIME;
+    orphan.nUsage = nTxUsage;
+    orphan.nPos = vOrphans.size();
+    vOrphans.push_back(it);
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        mapOrphansByPrev[txin.prevout].insert(hash);
+
+    CPeerUsage& usage = mapPeerUsage[peer];
+    usage.nOrphans++;
+    usage.nUsage += nTxUsage;
+    nUsage += nTxUsage;
+
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u)\n", hash.ToString(), mapOrphans.size());
+    return true;
+}
+
+bool COrphanTxPool::HaveTx(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapOrphans.count(hash) != 0;
+}
+
+bool COrphanTxPool::GetTx(const uint256& hash, CTransaction& txRet) const
+{
+    LOCK(cs);
+    COrphanMap::const_iterator it = mapOrphans.find(hash);
+    if (it == mapOrphans.end())
+        return false;
+    txRet = it->second.tx;
+    return true;
+}
+
+bool COrphanTxPool::EraseTx(const uint256& hash)
+{
+    LOCK(cs);
+    COrphanMap::iterator it = mapOrphans.find(hash);
+    if (it == mapOrphans.end())
+        return false;
+    Erase(it);
+    return true;
+}
+
+void COrphanTxPool::GetChildren(const uint256& hashParent, vector<uint256>& vChildren) const
+{
+    LOCK(cs);
+    set<uint256> setChildren;
+    // The outputs of a transaction are consecutive in the index
+    for (map<COutPoint, set<uint256> >::const_iterator it = mapOrphansByPrev.lower_bound(COutPoint(hashParent, 0));
+         it != mapOrphansByPrev.end() && it->first.hash == hashParent; ++it)
+    {
+        BOOST_FOREACH(const uint256& hash, it->second)
+            if (setChildren.insert(hash).second)
+                vChildren.push_back(hash);
+    }
+}
+
+unsigned int COrphanTxPool::EraseForPeer(NodeId peer)
+{
+    LOCK(cs);
+    if (!mapPeerUsage.count(peer))
+        return 0;
+    unsigned int nErased = 0;
+    for (size_t i = 0; i < vOrphans.size(); )
+    {
+        // Erasing moves the last orphan to i
+        if (vOrphans[i]->second.fromPeer == peer)
+        {
+            Erase(vOrphans[i]);
+            nErased++;
+        }
+        else
+            i++;
+    }
+    if (nErased > 0)
+        LogPrint("mempool", "erased %u orphan tx from peer=%d\n", nErased, peer);
+    return nErased;
+}
+
+unsigned int COrphanTxPool::EraseForBlock(const CBlock& block)
+{
+    LOCK(cs);
+    if (mapOrphans.empty())
+        return 0;
+    unsigned int nErased = 0;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        COrphanMap::iterator it = mapOrphans.find(tx.GetHash());
+        if (it != mapOrphans.end())
+        {
+            Erase(it);
+            nErased++;
+        }
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            map<COutPoint, set<uint256> >::iterator itPrev = mapOrphansByPrev.find(txin.prevout);
+            if (itPrev == mapOrphansByPrev.end())
+                continue;
+            // Erasing the spenders updates the index under us
+            vector<uint256> vConflicts(itPrev->second.begin(), itPrev->second.end());
+            BOOST_FOREACH(const uint256& hash, vConflicts)
+            {
+                Erase(mapOrphans.find(hash));
+                nErased++;
+            }
+        }
+    }
+    if (nErased > 0)
+        LogPrint("mempool", "erased %u orphan tx included or conflicted by block\n", nErased);
+    return nErased;
+}
+
+unsigned int COrphanTxPool::Expire()
+{
+    LOCK(cs);
+    int64_t nNow = GetTime();
+    if (nNow < nNextSweep)
+        return 0;
+    nNextSweep = nNow + ORPHAN_TX_EXPIRE_INTERVAL;
+
+    unsigned int nErased = 0;
+    for (size_t i = 0; i < vOrphans.size(); )
+    {
+        if (vOrphans[i]->second.nTimeExpire <= nNow)
+        {
+            Erase(vOrphans[i]);
+            nErased++;
+        }
+        else
+            i++;
+    }
+    nExpired += nErased;
+    if (nErased > 0)
+        LogPrint("mempool", "erased %u expired orphan tx\n", nErased);
+    return nErased;
+}
+
+size_t COrphanTxPool::size() const
+{
+    LOCK(cs);
+    return mapOrphans.size();
+}
+
+CCacheInfo COrphanTxPool::GetInfo(const string& strName) const
+{
+    LOCK(cs);
+    CCacheInfo info;
+    info.strName = strName;
+    info.nEntries = mapOrphans.size();
+    info.nMaxEntries = nMaxOrphans;
+    info.nMaxAge = ORPHAN_TX_EXPIRE_TIME;
+    info.nUsage = nUsage;
+    info.nEvicted = nEvicted + nExpired;
+    return info;
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCREDIT_ORPHANPOOL_H
+#define BITCREDIT_ORPHANPOOL_H
+
+#include "mainfunctions.h"
+#include "sync.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct CCacheInfo;
+
+/** Default for -maxorphantx, orphan transactions kept in memory */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 1000;
+/** Default for -maxorphantxsize, in megabytes */
+static const int64_t DEFAULT_MAX_ORPHAN_TX_SIZE = 5;
+/** Larger orphan transactions are not kept; peers announce them again
+ *  once their parents are known */
+static const unsigned int MAX_ORPHAN_TX_SIZE = 5000;
+/** A single peer may hold at most this share (1/n) of the pool */
+static const unsigned int ORPHAN_PEER_SHARE = 4;
+/** Seconds an orphan transaction is kept at most */
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Seconds between looks for expired orphan transactions */
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+
+/**
+ * Transactions whose inputs are not known yet, kept until their parents
+ * arrive. The pool is bounded in count and in memory, and no single peer
+ * may fill more than its share of either. Past the bounds, a transaction
+ * picked at random goes; those older than ORPHAN_TX_EXPIRE_TIME go too.
+ *
+ * Orphans are indexed by the outputs they spend, so accepting a parent
+ * only hands back the orphans spending it, and a block connected removes
+ * the orphans it includes or conflicts with.
+ */
+class COrphanTxPool
+{
+private:
+    struct COrphanTx
+    {
+        CTransaction tx;
+        NodeId fromPeer;
+        int64_t nTimeExpire;
+        size_t nUsage;
+        size_t nPos; // in vOrphans
+    };
+    typedef std::map<uint256, COrphanTx> COrphanMap;
+
+    struct CPeerUsage
+    {
+        size_t nOrphans;
+        size_t nUsage;
+    };
+
+    mutable CCriticalSection cs;
+    COrphanMap mapOrphans;
+    std::map<COutPoint, std::set<uint256> > mapOrphansByPrev;
+    std::vector<COrphanMap::iterator> vOrphans; // to pick one at random
+    std::map<NodeId, CPeerUsage> mapPeerUsage;
+    size_t nUsage;
+    size_t nMaxOrphans;
+    size_t nMaxUsage;
+    int64_t nNextSweep;
+    uint64_t nEvicted;
+    uint64_t nExpired;
+
+    void Erase(COrphanMap::iterator it);
+
+public:
+    COrphanTxPool(size_t nMaxOrphansIn, size_t nMaxUsageIn);
+
+    void SetLimits(size_t nMaxOrphansIn, size_t nMaxUsageIn);
+
+    /**
+     * Keep tx, received from peer, until its parents arrive. Returns false
+     * if it is already kept, too large, or the peer holds its share of the
+     * pool already; room is made for it by evicting other orphans.
+     */
+    bool AddTx(const CTransaction& tx, NodeId peer);
+    bool HaveTx(const uint256& hash) const;
+    bool GetTx(const uint256& hash, CTransaction& txRet) const;
+    bool EraseTx(const uint256& hash);
+
+    /** The orphans spending outputs of the transaction hashParent */
+    void GetChildren(const uint256& hashParent, std::vector<uint256>& vChildren) const;
+
+    /** Forget the orphans a disconnected peer sent; returns how many */
+    unsigned int EraseForPeer(NodeId peer);
+    /** Forget the orphans a connected block includes or double spends */
+    unsigned int EraseForBlock(const CBlock& block);
+    /** Forget the orphans that expired; returns how many */
+    unsigned int Expire();
+
+    size_t size() const;
+    CCacheInfo GetInfo(const std::string& strName) const;
+};
+
+/** Estimated memory an orphan transaction takes in the pool */
+size_t OrphanTxUsage(const CTransaction& tx);
+
+extern COrphanTxPool orphantxpool;
+
+#endif
@@ -0,0 +1,312 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCREDIT_PREVECTOR_H
+#define BITCREDIT_PREVECTOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <vector>
+
+#pragma pack(push, 1)
+/**
+ * A vector of plain data that keeps up to N elements inside the object and
+ * only allocates on the heap when it grows beyond them, for the many small
+ * vectors (scripts, mostly) that would otherwise cost an allocation each.
+ *
+ * It has the parts of the std::vector interface the code uses, with plain
+ * pointers as iterators. T must be copyable with memcpy and is not
+ * constructed or destroyed, so only use it for fundamental types.
+ */
+template<unsigned int N, typename T, typename Size = uint32_t, typename Diff = int32_t>
+class prevector
+{
+public:
+    typedef Size size_type;
+    typedef Diff difference_type;
+    typedef T value_type;
+    typedef value_type& reference;
+    typedef const value_type& const_reference;
+    typedef value_type* pointer;
+    typedef const value_type* const_pointer;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+private:
+    // Up to N: the size, with the elements in direct. Beyond: the size plus
+    // N + 1, with the elements on the heap
+    size_type _size;
+    union
+    {
+        char direct[sizeof(T) * N];
+        struct
+        {
+            size_type capacity;
+            char* indirect;
+        } heap;
+    } _union;
+
+    bool is_direct() const { return _size <= N; }
+    T* direct_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.direct) + pos; }
+    const T* direct_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.direct) + pos; }
+    T* indirect_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.heap.indirect) + pos; }
+    const T* indirect_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.heap.indirect) + pos; }
+    T* item_ptr(difference_type pos) { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+    const T* item_ptr(difference_type pos) const { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+
+    void change_capacity(size_type new_capacity)
+    {
+        if (new_capacity <= N)
+        {
+            if (!is_direct())
+            {
+                char* indirect = _union.heap.indirect;
+                _size -= N + 1;
+                memcpy(_union.direct, indirect, _size * sizeof(T));
+                free(indirect);
+            }
+        }
+        else if (!is_direct())
+        {
+            char* indirect = static_cast<char*>(realloc(_union.heap.indirect, ((size_t)sizeof(T)) * new_capacity));
+            if (!indirect)
+                throw std::bad_alloc();
+            _union.heap.indirect = indirect;
+            _union.heap.capacity = new_capacity;
+        }
+        else
+        {
+            char* indirect = static_cast<char*>(malloc(((size_t)sizeof(T)) * new_capacity));
+            if (!indirect)
+                throw std::bad_alloc();
+            memcpy(indirect, _union.direct, _size * sizeof(T));
+            _union.heap.indirect = indirect;
+            _union.heap.capacity = new_capacity;
+            _size += N + 1;
+        }
+    }
+
+    // Make room for count elements at pos
+    T* open_gap(size_type pos, size_type count)
+    {
+        size_type new_size = size() + count;
+        if (capacity() < new_size)
+            change_capacity(new_size + (new_size >> 1));
+        T* p = item_ptr(pos);
+        memmove(p + count, p, (size() - pos) * sizeof(T));
+        _size += count;
+        return p;
+    }
+
+public:
+    prevector() : _size(0) {}
+
+    explicit prevector(size_type n) : _size(0) { resize(n); }
+
+    prevector(size_type n, const T& val) : _size(0) { assign(n, val); }
+
+    template<typename InputIterator>
+    prevector(InputIterator first, InputIterator last) : _size(0) { assign(first, last); }
+
+    prevector(const prevector& other) : _size(0) { assign(other.begin(), other.end()); }
+
+    ~prevector()
+    {
+        if (!is_direct())
+            free(_union.heap.indirect);
+    }
+
+    prevector& operator=(const prevector& other)
+    {
+        if (&other != this)
+            assign(other.begin(), other.end());
+        return *this;
+    }
+
+    size_type size() const { return is_direct() ? _size : _size - N - 1; }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return is_direct() ? N : _union.heap.capacity; }
+
+    iterator begin() { return item_ptr(0); }
+    const_iterator begin() const { return item_ptr(0); }
+    iterator end() { return item_ptr(size()); }
+    const_iterator end() const { return item_ptr(size()); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    T& operator[](size_type pos) { return *item_ptr(pos); }
+    const T& operator[](size_type pos) const { return *item_ptr(pos); }
+    T& front() { return *item_ptr(0); }
+    const T& front() const { return *item_ptr(0); }
+    T& back() { return *item_ptr(size() - 1); }
+    const T& back() const { return *item_ptr(size() - 1); }
+    T* data() { return item_ptr(0); }
+    const T* data() const { return item_ptr(0); }
+
+    void reserve(size_type new_capacity)
+    {
+        if (new_capacity > capacity())
+            change_capacity(new_capacity);
+    }
+
+    void shrink_to_fit() { change_capacity(size()); }
+
+    // New elements are zero
+    void resize(size_type new_size)
+    {
+        size_type cur_size = size();
+        if (new_size <= cur_size)
+        {
+            _size -= cur_size - new_size;
+            return;
+        }
+        reserve(new_size);
+        memset(item_ptr(cur_size), 0, (new_size - cur_size) * sizeof(T));
+        _size += new_size - cur_size;
+    }
+
+    // Keeps the capacity, so a cleared vector refills without allocating
+    void clear() { resize(0); }
+
+    void assign(size_type n, const T& val)
+    {
+        T value = val;
+        clear();
+        reserve(n);
+        for (size_type i = 0; i < n; i++)
+            *item_ptr(i) = value;
+        _size += n;
+    }
+
+    template<typename InputIterator>
+    void assign(InputIterator first, InputIterator last)
+    {
+        size_type n = std::distance(first, last);
+        clear();
+        reserve(n);
+        T* p = item_ptr(0);
+        for (; first != last; ++first)
+            *p++ = *first;
+        _size += n;
+    }
+
+    void assign(const T* first, const T* last)
+    {
+        if (first >= begin() && first < end())
+        {
+            // From this vector itself, which reserve may reallocate
+            prevector tmp(first, last);
+            swap(tmp);
+            return;
+        }
+        size_type n = last - first;
+        clear();
+        reserve(n);
+        if (n)
+            memcpy(item_ptr(0), first, n * sizeof(T));
+        _size += n;
+    }
+    void assign(T* first, T* last) { assign((const T*)first, (const T*)last); }
+
+    iterator insert(iterator pos, const T& value)
+    {
+        T val = value;
+        T* p = open_gap(pos - begin(), 1);
+        *p = val;
+        return p;
+    }
+
+    void insert(iterator pos, size_type count, const T& value)
+    {
+        T val = value;
+        T* p = open_gap(pos - begin(), count);
+        for (size_type i = 0; i < count; i++)
+            p[i] = val;
+    }
+
+    template<typename InputIterator>
+    void insert(iterator pos, InputIterator first, InputIterator last)
+    {
+        size_type count = std::distance(first, last);
+        T* p = open_gap(pos - begin(), count);
+        for (; first != last; ++first)
+            *p++ = *first;
+    }
+
+    void insert(iterator pos, const T* first, const T* last)
+    {
+        if (first >= begin() && first < end())
+        {
+            // From this vector itself, which open_gap may move
+            std::vector<T> tmp(first, last);
+            if (!tmp.empty())
+                insert(pos, &tmp[0], &tmp[0] + tmp.size());
+            return;
+        }
+        size_type count = last - first;
+        T* p = open_gap(pos - begin(), count);
+        if (count)
+            memcpy(p, first, count * sizeof(T));
+    }
+    void insert(iterator pos, T* first, T* last) { insert(pos, (const T*)first, (const T*)last); }
+
+    iterator erase(iterator pos) { return erase(pos, pos + 1); }
+
+    iterator erase(iterator first, iterator last)
+    {
+        T* e = end();
+        memmove(first, last, (e - last) * sizeof(T));
+        _size -= last - first;
+        return first;
+    }
+
+    void push_back(const T& value)
+    {
+        T val = value;
+        size_type new_size = size() + 1;
+        if (capacity() < new_size)
+            change_capacity(new_size + (new_size >> 1));
+        *item_ptr(new_size - 1) = val;
+        _size++;
+    }
+
+    void pop_back() { _size--; }
+
+    void swap(prevector& other)
+    {
+        // Bitwise: the heap buffer changes hands, nothing is copied or freed
+        char tmp[sizeof(prevector)];
+        memcpy(tmp, (const void*)this, sizeof(prevector));
+        memcpy((void*)this, (const void*)&other, sizeof(prevector));
+        memcpy((void*)&other, tmp, sizeof(prevector));
+    }
+
+    // Heap memory used, for memory accounting
+    size_t allocated_memory() const { return is_direct() ? 0 : ((size_t)sizeof(T)) * _union.heap.capacity; }
+
+    bool operator==(const prevector& other) const
+    {
+        return size() == other.size() && memcmp(item_ptr(0), other.item_ptr(0), size() * sizeof(T)) == 0;
+    }
+
+    bool operator!=(const prevector& other) const { return !(*this == other); }
+
+    bool operator<(const prevector& other) const
+    {
+        return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
+    }
+};
+#pragma pack(pop)
+
+#endif
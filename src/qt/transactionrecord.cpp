@@ -257,7 +257,6 @@ void TransactionRecord::updateStatus(const CWalletTx &wtx)
     status.countsForBalance = wtx.IsTrusted() && !(wtx.GetBlocksToMaturity() > 0);
     status.depth = wtx.GetDepthInMainChain();
     status.cur_num_blocks = nBestHeight;
-    status.cur_num_ix_locks = nCompleteTXLocks;
 
     if (!IsFinalTx(wtx, nBestHeight + 1))
     {
@@ -326,7 +325,14 @@ void TransactionRecord::updateStatus(const CWalletTx &wtx)
 bool TransactionRecord::statusUpdateNeeded()
 {
     AssertLockHeld(cs_main);
-    return status.cur_num_blocks != nBestHeight || status.cur_num_ix_locks != nCompleteTXLocks;
+    return status.cur_num_blocks != nBestHeight;
+}
+
+bool TransactionRecord::statusSettled() const
+{
+    // Confirmed means past the recommended depth for normal transactions and
+    // mature for generated ones; from there on only the depth changes
+    return status.cur_num_blocks != -1 && status.status == TransactionStatus::Confirmed;
 }
 
 QString TransactionRecord::getTxID() const
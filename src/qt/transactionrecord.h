@@ -56,9 +56,6 @@ public:
 
     /** Current number of blocks (to know whether cached status is still valid) */
     int cur_num_blocks;
-
-    //** Know when to update transaction for ix locks **/
-    int cur_num_ix_locks;
 };
 
 /** UI model for a transaction. A core transaction can be represented by multiple UI transactions if it has
@@ -143,6 +140,15 @@ public:
     /** Return whether a status update is needed.
      */
     bool statusUpdateNeeded();
+
+    /** Return whether new blocks can only add to the confirmation count of
+        this record. Such records are not looked up in the wallet again.
+     */
+    bool statusSettled() const;
+
+    /** Make the next access look the status up in the wallet again.
+     */
+    void invalidateStatus() { status.cur_num_blocks = -1; }
 };
 
 #endif // TRANSACTIONRECORD_H
@@ -156,8 +156,15 @@ public:
             parent->endRemoveRows();
             break;
         case CT_UPDATED:
-            // Miscellaneous updates -- nothing to do, status update will take care of this, and is only computed for
-            // visible transactions.
+            // Confirmed, conflicted, locked or its block disconnected -- new blocks alone would not refresh
+            // a settled status, so look it up again the next time the rows are shown.
+            if(inModel)
+            {
+                for(QList<TransactionRecord>::iterator it = lower; it != upper; ++it)
+                    it->invalidateStatus();
+                emit parent->dataChanged(parent->index(lowerIndex, TransactionTableModel::Status),
+                                         parent->index(upperIndex-1, TransactionTableModel::ToAddress));
+            }
             break;
         }
     }
@@ -173,6 +180,22 @@ public:
         {
             TransactionRecord *rec = &cachedWallet[idx];
 
+            // Settled rows only count confirmations up, no need to ask the wallet.
+            // A lower tip means blocks were disconnected, and this row's may be
+            // one of them, so look it up again as for any other row.
+            int nHeight = nBestHeight;
+            if(rec->statusSettled() && nHeight < rec->status.cur_num_blocks)
+                rec->invalidateStatus();
+            if(rec->statusSettled())
+            {
+                if(rec->status.cur_num_blocks != nHeight)
+                {
+                    rec->status.depth += nHeight - rec->status.cur_num_blocks;
+                    rec->status.cur_num_blocks = nHeight;
+                }
+                return rec;
+            }
+
             // Get required locks upfront. This avoids the GUI from getting
             // stuck if the core is holding the locks for a longer time - for
             // example, during a wallet rescan.
@@ -252,12 +275,26 @@ void TransactionTableModel::updateTransaction(const QString &hash, int status, b
 
 void TransactionTableModel::updateConfirmations()
 {
-    // Blocks came in since last poll.
+    // Blocks came in since last update.
     // Invalidate status (number of confirmations) and (possibly) description
-    //  for all rows. Qt is smart enough to only actually request the data for the
-    //  visible rows.
-    emit dataChanged(index(0, Status), index(priv->size()-1, Status));
-    emit dataChanged(index(0, ToAddress), index(priv->size()-1, ToAddress));
+    //  for the rows whose status can still change. Settled rows keep their
+    //  place in the sort order and are brought up to date when drawn; this
+    //  keeps the filter proxy from re-sorting the whole wallet every block.
+    //  Rows settled above a lowered tip are not settled any more.
+    int nHeight = nBestHeight;
+    int nFirst = -1;
+    for(int i = 0; i <= priv->size(); i++)
+    {
+        bool fSettled = (i == priv->size() || (priv->cachedWallet[i].statusSettled() &&
+                                               priv->cachedWallet[i].status.cur_num_blocks <= nHeight));
+        if(!fSettled && nFirst == -1)
+            nFirst = i;
+        else if(fSettled && nFirst != -1)
+        {
+            emit dataChanged(index(nFirst, Status), index(i-1, ToAddress));
+            nFirst = -1;
+        }
+    }
 }
 
 int TransactionTableModel::rowCount(const QModelIndex &parent) const
@@ -34,19 +34,27 @@ WalletModel::WalletModel(CWallet *wallet, OptionsModel *optionsModel, QObject *p
     fProcessingQueuedTransactions(false),
     optionsModel(optionsModel), addressTableModel(0), transactionTableModel(0),
     cachedBalance(0), cachedStake(0), cachedUnconfirmedBalance(0), cachedImmatureBalance(0),
+    cachedAnonymizedBalance(0), cachedWatchOnlyBalance(0), cachedWatchOnlyStake(0),
+    cachedWatchUnconfBalance(0), cachedWatchImmatureBalance(0),
     cachedEncryptionStatus(Unencrypted),
-    cachedNumBlocks(0)
+    cachedNumBlocks(0), cachedTxLocks(0), cachedDarksendRounds(0)
 {
     fHaveWatchOnly = wallet->HaveWatchOnly();
-    fForceCheckBalanceChanged = false;
+    fForceCheckBalanceChanged = true;
 
     addressTableModel = new AddressTableModel(wallet, this);
     transactionTableModel = new TransactionTableModel(wallet, this);
 
-    // This timer will be fired repeatedly to update the balance
+    // This timer is started by wallet and block notifications from the core,
+    // so that a burst of them costs a single balance update
     pollTimer = new QTimer(this);
+    pollTimer->setSingleShot(true);
+    pollTimer->setInterval(MODEL_UPDATE_DELAY);
     connect(pollTimer, SIGNAL(timeout()), this, SLOT(pollBalanceChanged()));
-    pollTimer->start(MODEL_UPDATE_DELAY);
+    pollTimer->start();
+
+    // The anonymized balance depends on the number of rounds
+    connect(optionsModel, SIGNAL(darksendRoundsChanged(int)), this, SLOT(updateTransaction()));
 
     subscribeToCoreSignals();
 }
@@ -129,27 +137,44 @@ void WalletModel::updateStatus()
 
 void WalletModel::pollBalanceChanged()
 {
-    // Get required locks upfront. This avoids the GUI from getting stuck on
-    // periodical polls if the core is holding the locks for a longer time -
-    // for example, during a wallet rescan.
+    // Get required locks upfront. This avoids the GUI from getting stuck if
+    // the core is holding the locks for a longer time - for example, during a
+    // wallet rescan. Try again later in that case.
     TRY_LOCK(cs_main, lockMain);
     if(!lockMain)
+    {
+        pollTimer->start();
         return;
+    }
     TRY_LOCK(wallet->cs_wallet, lockWallet);
     if(!lockWallet)
+    {
+        pollTimer->start();
         return;
+    }
+
+    bool fNewBlocks = (nBestHeight != cachedNumBlocks);
+    if(fNewBlocks)
+    {
+        cachedNumBlocks = nBestHeight;
+        if(transactionTableModel)
+            transactionTableModel->updateConfirmations();
+    }
+
+    // Unless the wallet itself changed, a block can only move amounts that
+    // are waiting for confirmations or maturity, so wallets without any skip
+    // the full balance scans
+    bool fPendingAmounts = cachedStake || cachedUnconfirmedBalance || cachedImmatureBalance ||
+        cachedWatchOnlyStake || cachedWatchUnconfBalance || cachedWatchImmatureBalance;
 
-    if(fForceCheckBalanceChanged || nBestHeight != cachedNumBlocks || nDarksendRounds != cachedDarksendRounds || cachedTxLocks != nCompleteTXLocks)
+    if(fForceCheckBalanceChanged || (fNewBlocks && fPendingAmounts) || nDarksendRounds != cachedDarksendRounds || cachedTxLocks != nCompleteTXLocks)
     {
         fForceCheckBalanceChanged = false;
 
         // Balance and number of transactions might have changed
-        cachedNumBlocks = nBestHeight;
         cachedDarksendRounds = nDarksendRounds;
 
         checkBalanceChanged();
-        if(transactionTableModel)
-            transactionTableModel->updateConfirmations();
     }
 }
 
@@ -185,6 +210,7 @@ void WalletModel::checkBalanceChanged()
         cachedAnonymizedBalance = newAnonymizedBalance;
         cachedTxLocks = nCompleteTXLocks;
         cachedWatchOnlyBalance = newWatchOnlyBalance;
+        cachedWatchOnlyStake = newWatchOnlyStake;
         cachedWatchUnconfBalance = newWatchUnconfBalance;
         cachedWatchImmatureBalance = newWatchImmatureBalance;
         emit balanceChanged(newBalance, newStake, newUnconfirmedBalance, newImmatureBalance, newAnonymizedBalance,
@@ -196,6 +222,15 @@ void WalletModel::updateTransaction()
 {
     // Balance and number of transactions might have changed
     fForceCheckBalanceChanged = true;
+    if(!pollTimer->isActive())
+        pollTimer->start();
+}
+
+void WalletModel::updateBlockTip()
+{
+    // Confirmations and maturity might have changed
+    if(!pollTimer->isActive())
+        pollTimer->start();
 }
 
 void WalletModel::updateAddressBook(const QString &address, const QString &label, bool isMine, int status)
@@ -717,6 +752,11 @@ static void ShowProgress(WalletModel *walletmodel, const std::string &title, int
 }
 
 
+static void NotifyBlockTip(WalletModel *walletmodel, int nHeight)
+{
+    QMetaObject::invokeMethod(walletmodel, "updateBlockTip", Qt::QueuedConnection);
+}
+
 static void NotifyWatchonlyChanged(WalletModel *walletmodel, bool fHaveWatchonly)
 {
     QMetaObject::invokeMethod(walletmodel, "updateWatchOnlyFlag", Qt::QueuedConnection,
@@ -730,6 +770,7 @@ void WalletModel::subscribeToCoreSignals()
     wallet->NotifyAddressBookChanged.connect(boost::bind(NotifyAddressBookChanged, this, _1, _2, _3, _4, _5));
     wallet->NotifyTransactionChanged.connect(boost::bind(NotifyTransactionChanged, this, _1, _2, _3));
     wallet->ShowProgress.connect(boost::bind(ShowProgress, this, _1, _2));
+    uiInterface.NotifyBlockTip.connect(boost::bind(NotifyBlockTip, this, _1));
     wallet->NotifyWatchonlyChanged.disconnect(boost::bind(NotifyWatchonlyChanged, this, _1));
 }
 
@@ -740,6 +781,7 @@ void WalletModel::unsubscribeFromCoreSignals()
     wallet->NotifyAddressBookChanged.disconnect(boost::bind(NotifyAddressBookChanged, this, _1, _2, _3, _4, _5));
     wallet->NotifyTransactionChanged.disconnect(boost::bind(NotifyTransactionChanged, this, _1, _2, _3));
     wallet->ShowProgress.disconnect(boost::bind(ShowProgress, this, _1, _2));
+    uiInterface.NotifyBlockTip.disconnect(boost::bind(NotifyBlockTip, this, _1));
     wallet->NotifyWatchonlyChanged.disconnect(boost::bind(NotifyWatchonlyChanged, this, _1));
 }
 
@@ -262,11 +262,14 @@ public slots:
     void updateStatus();
     /* New transaction, or transaction changed status */
     void updateTransaction();
+    /* New best block */
+    void updateBlockTip();
     /* New, updated or removed address book entry */
     void updateAddressBook(const QString &address, const QString &label, bool isMine, int status);
     /* Watch-only added */
     void updateWatchOnlyFlag(bool fHaveWatchonly);
-    /* Current, immature or unconfirmed balance might have changed - emit 'balanceChanged' if so */
+    /* Current, immature or unconfirmed balance might have changed - emit 'balanceChanged' if so.
+       Run off pollTimer after a core notification. */
     void pollBalanceChanged();
     /* Needed to update fProcessingQueuedTransactions through a QueuedConnection */
     void setProcessingQueuedTransactions(bool value) { fProcessingQueuedTransactions = value; }
@@ -7,7 +7,21 @@
 #include "rpcserver.h"
 #include "mainfunctions.h"
 #include "kernel.h"
+#include "blockcache.h"
+#include "blockfile.h"
 #include "checkpoints.h"
+#include "coins.h"
+#include "txdb.h"
+#include "base58.h"
+#include "boundedmap.h"
+#include "instantx.h"
+#include "masternode.h"
+#include "masternode-payments.h"
+#include "orphanpool.h"
+#ifdef ENABLE_WALLET
+#include "init.h"
+#include "wallet.h"
+#endif
 
 using namespace json_spirit;
 using namespace std;
@@ -107,38 +121,80 @@ double GetPoSKernelPS()
     return result;
 }
 
-Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPrintTransactionDetail)
+// What blockToJSON reports of a block's index entry. getblock copies it out
+// under cs_main and builds the JSON, transactions and all, after letting go.
+struct CBlockIndexInfo
+{
+    int nConfirmations;
+    int nHeight;
+    int64_t nMint;
+    int64_t nMoneySupply;
+    double dDifficulty;
+    uint256 nBlockTrust;
+    uint256 nChainTrust;
+    uint256 hashPrev;
+    uint256 hashNext;
+    bool fProofOfStake;
+    bool fStakeModifier;
+    uint256 hashProof;
+    unsigned int nEntropyBit;
+    uint64_t nStakeModifier;
+};
+
+static CBlockIndexInfo GetBlockIndexInfo(const CBlockIndex* blockindex)
+{
+    AssertLockHeld(cs_main);
+    CBlockIndexInfo info;
+    // Only report confirmations if the block is on the main chain
+    info.nConfirmations = blockindex->IsInMainChain() ? nBestHeight - blockindex->nHeight + 1 : -1;
+    info.nHeight = blockindex->nHeight;
+#ifndef LOWMEM
+    info.nMint = blockindex->nMint;
+#else
+    info.nMint = 0;
+#endif
+    info.nMoneySupply = blockindex->nMoneySupply;
+    info.dDifficulty = GetDifficulty(blockindex);
+    info.nBlockTrust = blockindex->GetBlockTrust();
+    info.nChainTrust = blockindex->nChainTrust;
+    info.hashPrev = blockindex->pprev ? blockindex->pprev->GetBlockHash() : 0;
+    info.hashNext = blockindex->pnext ? blockindex->pnext->GetBlockHash() : 0;
+    info.fProofOfStake = blockindex->IsProofOfStake();
+    info.fStakeModifier = blockindex->GeneratedStakeModifier();
+    info.hashProof = blockindex->hashProof;
+    info.nEntropyBit = blockindex->GetStakeEntropyBit();
+    info.nStakeModifier = blockindex->nStakeModifier;
+    return info;
+}
+
+Object blockToJSON(const CBlock& block, const CBlockIndexInfo& info, bool fPrintTransactionDetail)
 {
     Object result;
     result.push_back(Pair("hash", block.GetHash().GetHex()));
-    int confirmations = -1;
-    // Only report confirmations if the block is on the main chain
-    if (blockindex->IsInMainChain())
-        confirmations = nBestHeight - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
+    result.push_back(Pair("confirmations", info.nConfirmations));
     result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
+    result.push_back(Pair("height", info.nHeight));
     result.push_back(Pair("version", block.nVersion));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
 #ifndef LOWMEM
-    result.push_back(Pair("mint", ValueFromAmount(blockindex->nMint)));
+    result.push_back(Pair("mint", ValueFromAmount(info.nMint)));
 #endif
-    result.push_back(Pair("moneysupply", ValueFromAmount(blockindex->nMoneySupply)));
+    result.push_back(Pair("moneysupply", ValueFromAmount(info.nMoneySupply)));
     result.push_back(Pair("time", (int64_t)block.GetBlockTime()));
     result.push_back(Pair("nonce", (uint64_t)block.nNonce));
     result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("blocktrust", leftTrim(blockindex->GetBlockTrust().GetHex(), '0')));
-    result.push_back(Pair("chaintrust", leftTrim(blockindex->nChainTrust.GetHex(), '0')));
-    if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    if (blockindex->pnext)
-        result.push_back(Pair("nextblockhash", blockindex->pnext->GetBlockHash().GetHex()));
-
-    result.push_back(Pair("flags", strprintf("%s%s", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work", blockindex->GeneratedStakeModifier()? " stake-modifier": "")));
-    result.push_back(Pair("proofhash", blockindex->hashProof.GetHex()));
-    result.push_back(Pair("entropybit", (int)blockindex->GetStakeEntropyBit()));
-    result.push_back(Pair("modifier", strprintf("%016x", blockindex->nStakeModifier)));
+    result.push_back(Pair("difficulty", info.dDifficulty));
+    result.push_back(Pair("blocktrust", leftTrim(info.nBlockTrust.GetHex(), '0')));
+    result.push_back(Pair("chaintrust", leftTrim(info.nChainTrust.GetHex(), '0')));
+    if (info.hashPrev != 0)
+        result.push_back(Pair("previousblockhash", info.hashPrev.GetHex()));
+    if (info.hashNext != 0)
+        result.push_back(Pair("nextblockhash", info.hashNext.GetHex()));
+
+    result.push_back(Pair("flags", strprintf("%s%s", info.fProofOfStake? "proof-of-stake" : "proof-of-work", info.fStakeModifier? " stake-modifier": "")));
+    result.push_back(Pair("proofhash", info.hashProof.GetHex()));
+    result.push_back(Pair("entropybit", (int)info.nEntropyBit));
+    result.push_back(Pair("modifier", strprintf("%016x", info.nStakeModifier)));
     Array txinfo;
     BOOST_FOREACH (const CTransaction& tx, block.vtx)
     {
@@ -170,7 +226,7 @@ Value getbestblockhash(const Array& params, bool fHelp)
             "getbestblockhash\n"
             "Returns the hash of the best block in the longest block chain.");
 
-    return hashBestChain.GetHex();
+    return GetChainTip().hashBlock.GetHex();
 }
 
 Value getblockcount(const Array& params, bool fHelp)
@@ -180,7 +236,7 @@ Value getblockcount(const Array& params, bool fHelp)
             "getblockcount\n"
             "Returns the number of blocks in the longest block chain.");
 
-    return nBestHeight;
+    return GetChainTip().nHeight;
 }
 
 
@@ -194,7 +250,10 @@ Value getdifficulty(const Array& params, bool fHelp)
     //Object obj;
     //obj.push_back(Pair("proof-of-work",        GetDifficulty()));
     //obj.push_back(Pair("proof-of-stake",       GetDifficulty(GetLastBlockIndex(pindexBest, true))));
-    return GetDifficulty(GetLastBlockIndex(pindexBest, true));
+    CChainTip tip = GetChainTip();
+    if (tip.pindex == NULL)
+        return 1.0;
+    return GetDifficulty(GetLastBlockIndex(tip.pindex, true));
 }
 
 
@@ -223,6 +282,8 @@ Value getblockhash(const Array& params, bool fHelp)
             "Returns hash of block in best-block-chain at <index>.");
 
     int nHeight = params[0].get_int();
+
+    LOCK(cs_main);
     if (nHeight < 0 || nHeight > nBestHeight)
         throw runtime_error("Block number out of range.");
 
@@ -241,14 +302,26 @@ Value getblock(const Array& params, bool fHelp)
     std::string strHash = params[0].get_str();
     uint256 hash(strHash);
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+    }
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-    block.ReadFromDisk(pblockindex, true);
+    // Block index entries are never freed, so the disk read can run unlocked
+    CBlockRef pblock;
+    if (!ReadBlockFromDisk(pblockindex, pblock))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
-    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+    CBlockIndexInfo info;
+    {
+        LOCK(cs_main);
+        info = GetBlockIndexInfo(pblockindex);
+    }
+    return blockToJSON(*pblock, info, params.size() > 1 ? params[1].get_bool() : false);
 }
 
 Value getblockbynumber(const Array& params, bool fHelp)
@@ -260,20 +333,26 @@ Value getblockbynumber(const Array& params, bool fHelp)
             "Returns details of a block with given block-number.");
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > nBestHeight)
+
+    // Walk back from the published tip; pprev links never change once set
+    CChainTip tip = GetChainTip();
+    if (nHeight < 0 || nHeight > tip.nHeight)
         throw runtime_error("Block number out of range.");
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
+    const CBlockIndex* pblockindex = tip.pindex;
     while (pblockindex->nHeight > nHeight)
         pblockindex = pblockindex->pprev;
 
-    uint256 hash = *pblockindex->phashBlock;
-
-    pblockindex = mapBlockIndex[hash];
-    block.ReadFromDisk(pblockindex, true);
+    CBlockRef pblock;
+    if (!ReadBlockFromDisk(pblockindex, pblock))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
-    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+    CBlockIndexInfo info;
+    {
+        LOCK(cs_main);
+        info = GetBlockIndexInfo(pblockindex);
+    }
+    return blockToJSON(*pblock, info, params.size() > 1 ? params[1].get_bool() : false);
 }
 
 // ppcoin: get information of sync-checkpoint
@@ -295,3 +374,158 @@ Value getcheckpoint(const Array& params, bool fHelp)
 
     return result;
 }
+
+Value getdbstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "Returns statistics of the transaction database, the unspent output cache and the block files.");
+
+    CTxDBStats stats;
+    CTxDB("r").GetStats(stats);
+
+    Object result;
+    result.push_back(Pair("profile",            stats.strProfile));
+    result.push_back(Pair("commits",            (uint64_t)stats.nCommits));
+    result.push_back(Pair("synccommits",        (uint64_t)stats.nSyncCommits));
+    result.push_back(Pair("stalls",             (uint64_t)stats.nStalls));
+    result.push_back(Pair("stalltime_ms",       stats.nStallTimeMs));
+    uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+    result.push_back(Pair("cachehits",          (uint64_t)stats.nCacheHits));
+    result.push_back(Pair("cachemisses",        (uint64_t)stats.nCacheMisses));
+    result.push_back(Pair("cachehitrate",       nLookups ? (double)stats.nCacheHits / nLookups : 0.0));
+    Array levels;
+    BOOST_FOREACH(int nFiles, stats.vFilesAtLevel)
+        levels.push_back(nFiles);
+    result.push_back(Pair("filesatlevel",       levels));
+    result.push_back(Pair("compactionread_mb",  stats.nCompactionReadMB));
+    result.push_back(Pair("compactionwrite_mb", stats.nCompactionWriteMB));
+    result.push_back(Pair("compacting",         stats.fCompacting));
+    if (stats.nLastCompaction)
+        result.push_back(Pair("lastcompaction", DateTimeStrFormat(stats.nLastCompaction)));
+
+    if (pcoinsTip)
+    {
+        CCoinsStats coins;
+        pcoinsTip->GetStats(coins);
+        Object utxo;
+        utxo.push_back(Pair("bestblock",        coins.hashBlock.GetHex()));
+        utxo.push_back(Pair("entries",          (uint64_t)coins.nEntries));
+        utxo.push_back(Pair("dirty",            (uint64_t)coins.nDirty));
+        utxo.push_back(Pair("stake",            (uint64_t)coins.nStake));
+        utxo.push_back(Pair("stakeusage",       (uint64_t)coins.nStakeUsage));
+        utxo.push_back(Pair("usage",            (uint64_t)coins.nUsage));
+        utxo.push_back(Pair("maxusage",         (uint64_t)coins.nMaxUsage));
+        utxo.push_back(Pair("hits",             (uint64_t)coins.nHits));
+        utxo.push_back(Pair("misses",           (uint64_t)coins.nMisses));
+        utxo.push_back(Pair("flushes",          (uint64_t)coins.nFlushes));
+        utxo.push_back(Pair("flushtime_ms",     coins.nFlushTimeMs));
+        result.push_back(Pair("utxocache", utxo));
+    }
+
+    CBlockFileStats files;
+    GetBlockFileStats(files);
+    Object blockfiles;
+    blockfiles.push_back(Pair("openfiles",      files.nOpenFiles));
+    blockfiles.push_back(Pair("opens",          files.nOpens));
+    blockfiles.push_back(Pair("reads",          files.nReads));
+    blockfiles.push_back(Pair("readbytes",      files.nReadBytes));
+    blockfiles.push_back(Pair("appends",        files.nAppends));
+    blockfiles.push_back(Pair("appendbytes",    files.nAppendBytes));
+    blockfiles.push_back(Pair("syncs",          files.nSyncs));
+    blockfiles.push_back(Pair("synctime_ms",    files.nSyncTimeMs));
+    result.push_back(Pair("blockfiles", blockfiles));
+
+    return result;
+}
+
+static Object CacheInfoToJSON(const CCacheInfo& info)
+{
+    Object entry;
+    entry.push_back(Pair("entries",    (uint64_t)info.nEntries));
+    entry.push_back(Pair("maxentries", (uint64_t)info.nMaxEntries));
+    entry.push_back(Pair("maxage",     info.nMaxAge));
+    entry.push_back(Pair("usage",      (uint64_t)info.nUsage));
+    entry.push_back(Pair("evicted",    info.nEvicted));
+    return entry;
+}
+
+Value getmemoryinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmemoryinfo\n"
+            "Returns the size, limits and estimated memory use in bytes of the in-memory caches.\n"
+            "A maxentries or maxage of 0 means no limit.");
+
+    vector<CCacheInfo> vInfo;
+    GetInstantXCacheInfo(vInfo);
+    {
+        LOCK(cs_masternodepayments);
+        vInfo.push_back(mapSeenMasternodeVotes.GetInfo("masternodevotes"));
+    }
+    {
+        LOCK(cs_mapCacheBlockHashes);
+        vInfo.push_back(mapCacheBlockHashes.GetInfo("blockhashes"));
+    }
+    vInfo.push_back(orphantxpool.GetInfo("orphantransactions"));
+    {
+        LOCK(cs_main);
+        vInfo.push_back(GetOrphanBlocksInfo());
+    }
+#ifdef ENABLE_WALLET
+    if (pwalletMain)
+    {
+        LOCK(pwalletMain->cs_wallet);
+        vInfo.push_back(GetDarksendRoundsCacheInfo());
+    }
+#endif
+
+    Object result;
+    uint64_t nTotal = 0;
+    BOOST_FOREACH(const CCacheInfo& info, vInfo)
+    {
+        result.push_back(Pair(info.strName, CacheInfoToJSON(info)));
+        nTotal += info.nUsage;
+    }
+
+    size_t nAddresses;
+    uint64_t nHits, nMisses;
+    CAdvantagecoinAddress::GetCacheStats(nAddresses, nHits, nMisses);
+    Object addresses;
+    addresses.push_back(Pair("entries",      (uint64_t)nAddresses));
+    addresses.push_back(Pair("hits",         nHits));
+    addresses.push_back(Pair("misses",       nMisses));
+    result.push_back(Pair("addresscache", addresses));
+
+    if (pcoinsTip)
+    {
+        CCoinsStats coins;
+        pcoinsTip->GetStats(coins);
+        Object utxo;
+        utxo.push_back(Pair("entries",       (uint64_t)coins.nEntries));
+        utxo.push_back(Pair("usage",         (uint64_t)coins.nUsage));
+        utxo.push_back(Pair("maxusage",      (uint64_t)coins.nMaxUsage));
+        result.push_back(Pair("utxocache", utxo));
+        nTotal += coins.nUsage;
+    }
+
+    CBlockCacheStats blocks;
+    blockcache.GetStats(blocks);
+    Object blockcacheinfo;
+    blockcacheinfo.push_back(Pair("blocks",       blocks.nBlocks));
+    blockcacheinfo.push_back(Pair("headers",      blocks.nHeaders));
+    blockcacheinfo.push_back(Pair("transactions", blocks.nTransactions));
+    blockcacheinfo.push_back(Pair("usage",        blocks.nUsage));
+    blockcacheinfo.push_back(Pair("maxusage",     blocks.nMaxUsage));
+    blockcacheinfo.push_back(Pair("hits",         blocks.nHits));
+    blockcacheinfo.push_back(Pair("misses",       blocks.nMisses));
+    blockcacheinfo.push_back(Pair("evicted",      blocks.nEvicted));
+    blockcacheinfo.push_back(Pair("invalidated",  blocks.nInvalidated));
+    result.push_back(Pair("blockcache", blockcacheinfo));
+    nTotal += blocks.nUsage;
+
+    result.push_back(Pair("totalusage", nTotal));
+    return result;
+}
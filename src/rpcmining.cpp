@@ -576,7 +576,7 @@ Value getblocktemplate(const Array& params, bool fHelp)
     Array transactions;
     map<uint256, int64_t> setTxIndex;
     int i = 0;
-    CTxDB txdb("r");
+    CCoinsView view(pcoinsTip);
     BOOST_FOREACH (CTransaction& tx, pblock->vtx)
     {
         uint256 txHash = tx.GetHash();
@@ -593,18 +593,19 @@ Value getblocktemplate(const Array& params, bool fHelp)
 
         entry.push_back(Pair("hash", txHash.GetHex()));
 
-        MapPrevTx mapInputs;
-        map<uint256, CTxIndex> mapUnused;
+        MapPrevOut mapInputs;
         bool fInvalid = false;
-        if (tx.FetchInputs(txdb, mapUnused, false, false, mapInputs, fInvalid))
+        if (tx.FetchInputs(view, true, mapInputs, fInvalid))
         {
             entry.push_back(Pair("fee", (int64_t)(tx.GetValueIn(mapInputs) - tx.GetValueOut())));
 
             Array deps;
-            BOOST_FOREACH (MapPrevTx::value_type& inp, mapInputs)
+            set<uint256> setParents;
+            BOOST_FOREACH (const MapPrevOut::value_type& inp, mapInputs)
             {
-                if (setTxIndex.count(inp.first))
-                    deps.push_back(setTxIndex[inp.first]);
+                const uint256& hashParent = inp.first.hash;
+                if (setTxIndex.count(hashParent) && setParents.insert(hashParent).second)
+                    deps.push_back(setTxIndex[hashParent]);
             }
             entry.push_back(Pair("depends", deps));
 
@@ -38,36 +38,48 @@ Value getinfo(const Array& params, bool fHelp)
     proxyType proxy;
     GetProxy(NET_IPV4, proxy);
 
+    // Runs without the global RPC locks: chain state comes from the published
+    // tip and the balances from the wallet's snapshot, which falls back to
+    // the last ones computed rather than wait for cs_main.
+    CChainTip tip = GetChainTip();
+    int nConnections;
+    {
+        LOCK(cs_vNodes);
+        nConnections = (int)vNodes.size();
+    }
+
     Object obj, diff;
     obj.push_back(Pair("version",       FormatFullVersion()));
     obj.push_back(Pair("protocolversion",(int)PROTOCOL_VERSION));
 #ifdef ENABLE_WALLET
     if (pwalletMain) {
+        CWalletBalances balances = pwalletMain->GetBalancesSnapshot();
         obj.push_back(Pair("walletversion", pwalletMain->GetVersion()));
-        obj.push_back(Pair("balance",       ValueFromAmount(pwalletMain->GetBalance())));
+        obj.push_back(Pair("balance",       ValueFromAmount(balances.nBalance)));
         if(!fLiteMode)
-            obj.push_back(Pair("darksend_balance", ValueFromAmount(pwalletMain->GetAnonymizedBalance())));
-        obj.push_back(Pair("newmint",       ValueFromAmount(pwalletMain->GetNewMint())));
-        obj.push_back(Pair("stake",         ValueFromAmount(pwalletMain->GetStake())));
+            obj.push_back(Pair("darksend_balance", ValueFromAmount(balances.nAnonymized)));
+        obj.push_back(Pair("newmint",       ValueFromAmount(balances.nNewMint)));
+        obj.push_back(Pair("stake",         ValueFromAmount(balances.nStake)));
     }
 #endif
-    obj.push_back(Pair("blocks",        (int)nBestHeight));
+    obj.push_back(Pair("blocks",        tip.nHeight));
     obj.push_back(Pair("timeoffset",    (int64_t)GetTimeOffset()));
 #ifndef LOWMEM
-    obj.push_back(Pair("moneysupply",   ValueFromAmount(pindexBest->nMoneySupply)));
+    obj.push_back(Pair("moneysupply",   ValueFromAmount(tip.pindex ? tip.pindex->nMoneySupply : 0)));
 #endif
-    obj.push_back(Pair("connections",   (int)vNodes.size()));
+    obj.push_back(Pair("connections",   nConnections));
     obj.push_back(Pair("proxy",         (proxy.first.IsValid() ? proxy.first.ToStringIPPort() : string())));
     obj.push_back(Pair("ip",            GetLocalAddress(NULL).ToStringIP()));
 
     //diff.push_back(Pair("proof-of-work",  GetDifficulty()));
     //diff.push_back(Pair("proof-of-stake", GetDifficulty(GetLastBlockIndex(pindexBest, true))));
-    obj.push_back(Pair("difficulty",    GetDifficulty(GetLastBlockIndex(pindexBest, true))));
+    obj.push_back(Pair("difficulty",    tip.pindex ? GetDifficulty(GetLastBlockIndex(tip.pindex, true)) : 1.0));
 
     obj.push_back(Pair("testnet",       TestNet()));
 #ifdef ENABLE_WALLET
     if (pwalletMain) {
         obj.push_back(Pair("keypoololdest", (int64_t)pwalletMain->GetOldestKeyPoolTime()));
+        LOCK(pwalletMain->cs_wallet);
         obj.push_back(Pair("keypoolsize",   (int)pwalletMain->GetKeyPoolSize()));
     }
     obj.push_back(Pair("paytxfee",      ValueFromAmount(nTransactionFee)));
@@ -221,8 +221,8 @@ static const CRPCCommand vRPCCommands[] =
   //  ------------------------  -----------------------  ---------- ---------- ---------
     { "help",                   &help,                   true,      true,      false },
     { "stop",                   &stop,                   true,      true,      false },
-    { "getbestblockhash",       &getbestblockhash,       true,      false,     false },
-    { "getblockcount",          &getblockcount,          true,      false,     false },
+    { "getbestblockhash",       &getbestblockhash,       true,      true,      false },
+    { "getblockcount",          &getblockcount,          true,      true,      false },
     { "getconnectioncount",     &getconnectioncount,     true,      false,     false },
     { "getpeerinfo",            &getpeerinfo,            true,      false,     false },
     { "addnode",                &addnode,                true,      true,      false },
@@ -232,19 +232,21 @@ static const CRPCCommand vRPCCommands[] =
     { "listbanned",             &listbanned,             true,      false,     false },
     { "clearbanned",            &clearbanned,            true,      false,     false },
     { "getnettotals",           &getnettotals,           true,      true,      false },
-    { "getdifficulty",          &getdifficulty,          true,      false,     false },
-    { "getinfo",                &getinfo,                true,      false,     false },
-    { "getrawmempool",          &getrawmempool,          true,      false,     false },
-    { "getblock",               &getblock,               false,     false,     false },
-    { "getblockbynumber",       &getblockbynumber,       false,     false,     false },
-    { "getblockhash",           &getblockhash,           false,     false,     false },
-    { "getrawtransaction",      &getrawtransaction,      false,     false,     false },
+    { "getdifficulty",          &getdifficulty,          true,      true,      false },
+    { "getinfo",                &getinfo,                true,      true,      false },
+    { "getrawmempool",          &getrawmempool,          true,      true,      false },
+    { "getblock",               &getblock,               false,     true,      false },
+    { "getblockbynumber",       &getblockbynumber,       false,     true,      false },
+    { "getblockhash",           &getblockhash,           false,     true,      false },
+    { "getrawtransaction",      &getrawtransaction,      false,     true,      false },
     { "createrawtransaction",   &createrawtransaction,   false,     false,     false },
-    { "decoderawtransaction",   &decoderawtransaction,   false,     false,     false },
-    { "decodescript",           &decodescript,           false,     false,     false },
+    { "decoderawtransaction",   &decoderawtransaction,   false,     true,      false },
+    { "decodescript",           &decodescript,           false,     true,      false },
     { "signrawtransaction",     &signrawtransaction,     false,     false,     false },
     { "sendrawtransaction",     &sendrawtransaction,     false,     false,     false },
     { "getcheckpoint",          &getcheckpoint,          true,      false,     false },
+    { "getdbstats",             &getdbstats,             true,      true,      false },
+    { "getmemoryinfo",          &getmemoryinfo,          true,      true,      false },
     { "sendalert",              &sendalert,              false,     false,     false },
     { "validateaddress",        &validateaddress,        true,      false,     false },
     { "validatepubkey",         &validatepubkey,         true,      false,     false },
@@ -277,14 +279,14 @@ static const CRPCCommand vRPCCommands[] =
     { "walletpassphrasechange", &walletpassphrasechange, false,     false,     true },
     { "walletlock",             &walletlock,             true,      false,     true },
     { "encryptwallet",          &encryptwallet,          false,     false,     true },
-    { "getbalance",             &getbalance,             false,     false,     true },
+    { "getbalance",             &getbalance,             false,     true,      true },
     { "move",                   &movecmd,                false,     false,     true },
     { "sendfrom",               &sendfrom,               false,     false,     true },
     { "sendmany",               &sendmany,               false,     false,     true },
     { "addmultisigaddress",     &addmultisigaddress,     false,     false,     true },
     { "addredeemscript",        &addredeemscript,        false,     false,     true },
     { "gettransaction",         &gettransaction,         false,     false,     true },
-    { "listtransactions",       &listtransactions,       false,     false,     true },
+    { "listtransactions",       &listtransactions,       false,     true,      true },
     { "listaddressgroupings",   &listaddressgroupings,   false,     false,     true },
     { "signmessage",            &signmessage,            false,     false,     true },
     { "getwork",                &getwork,                true,      false,     true },
@@ -295,9 +297,9 @@ static const CRPCCommand vRPCCommands[] =
     { "listsinceblock",         &listsinceblock,         false,     false,     true },
     { "dumpprivkey",            &dumpprivkey,            false,     false,     true },
     { "dumpwallet",             &dumpwallet,             true,      false,     true },
-    { "importprivkey",          &importprivkey,          false,     false,     true },
-    { "importwallet",           &importwallet,           false,     false,     true },
-    { "importaddress",          &importaddress,          false,     false,     true },
+    { "importprivkey",          &importprivkey,          false,     true,      true },
+    { "importwallet",           &importwallet,           false,     true,      true },
+    { "importaddress",          &importaddress,          false,     true,      true },
     { "listunspent",            &listunspent,            false,     false,     true },
     { "settxfee",               &settxfee,               false,     false,     true },
     { "getsubsidy",             &getsubsidy,             true,      true,      false },
@@ -313,7 +315,9 @@ static const CRPCCommand vRPCCommands[] =
     { "checkkernel",            &checkkernel,            true,      false,     true },
     { "getnewstealthaddress",   &getnewstealthaddress,   false,     false,     true },
     { "liststealthaddresses",   &liststealthaddresses,   false,     false,     true },
-    { "scanforalltxns",         &scanforalltxns,         false,     false,     false },
+    { "scanforalltxns",         &scanforalltxns,         false,     true,      true },
+    { "abortrescan",            &abortrescan,            true,      true,      true },
+    { "getrescaninfo",          &getrescaninfo,          true,      true,      true },
     { "scanforstealthtxns",     &scanforstealthtxns,     false,     false,     false },
     { "importstealthaddress",   &importstealthaddress,   false,     false,     true },
     { "sendtostealthaddress",   &sendtostealthaddress,   false,     false,     true },
@@ -847,6 +851,10 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
         // Execute
         Value result;
         {
+            // Read-only chain, mempool and wallet queries are marked threadSafe
+            // and run in parallel on the -rpcthreads workers, taking what locks
+            // they need themselves; everything else is serialized behind the
+            // global locks.
             if (pcmd->threadSafe)
                 result = pcmd->actor(params, false);
 #ifdef ENABLE_WALLET
@@ -49,6 +49,12 @@ void EnsureWalletIsUnlocked()
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Wallet is unlocked for staking only.");
 }
 
+void EnsureWalletIsNotRescanning()
+{
+    if (pwalletMain->fScanningWallet)
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error: A wallet rescan is in progress, wait for it or stop it with abortrescan first.");
+}
+
 void WalletTxToJSON(const CWalletTx& wtx, Object& entry)
 {
     int confirms = wtx.GetDepthInMainChain(false);
@@ -769,6 +775,7 @@ Value getbalance(const Array& params, bool fHelp)
         // (GetBalance() sums up all unspent TxOuts)
         // getbalance and getbalance '*' 0 should return the same number.
         CAmount nBalance = 0;
+        LOCK2(cs_main, pwalletMain->cs_wallet);
         for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
         {
             const CWalletTx& wtx = (*it).second;
@@ -796,6 +803,7 @@ Value getbalance(const Array& params, bool fHelp)
 
     string strAccount = AccountFromValue(params[0]);
 
+    LOCK2(cs_main, pwalletMain->cs_wallet);
     CAmount nBalance = GetAccountBalance(strAccount, nMinDepth, filter);
 
     return ValueFromAmount(nBalance);
@@ -1537,19 +1545,24 @@ Value listtransactions(const Array& params, bool fHelp)
 
     Array ret;
 
-    const CWallet::TxItems & txOrdered = pwalletMain->wtxOrdered;
-
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+    // Only the walk over the wallet needs the locks; the paging below works
+    // on the copy it made
     {
-        CWalletTx *const pwtx = (*it).second.first;
-        if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
-        CAccountingEntry *const pacentry = (*it).second.second;
-        if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
-
-        if ((int)ret.size() >= (nCount+nFrom)) break;
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        const CWallet::TxItems & txOrdered = pwalletMain->wtxOrdered;
+
+        // iterate backwards until we have nCount items to return:
+        for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+        {
+            CWalletTx *const pwtx = (*it).second.first;
+            if (pwtx != 0)
+                ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
+            CAccountingEntry *const pacentry = (*it).second.second;
+            if (pacentry != 0)
+                AcentryToJSON(*pacentry, strAccount, ret);
+
+            if ((int)ret.size() >= (nCount+nFrom)) break;
+        }
     }
     // ret is newest to oldest
 
@@ -2491,6 +2504,8 @@ Value scanforalltxns(const Array& params, bool fHelp)
             "scanforalltxns [fromHeight]\n"
             "Scan blockchain for owned transactions.");
 
+    EnsureWalletIsNotRescanning();
+
     Object result;
     int32_t nFromHeight = 0;
 
@@ -2503,6 +2518,7 @@ Value scanforalltxns(const Array& params, bool fHelp)
 
     if (nFromHeight > 0)
     {
+        LOCK(cs_main);
         pindex = mapBlockIndex[hashBestChain];
         while (pindex->nHeight > nFromHeight
             && pindex->pprev)
@@ -2513,16 +2529,63 @@ Value scanforalltxns(const Array& params, bool fHelp)
         throw runtime_error("Genesis Block is not set.");
 
     {
-        LOCK2(cs_main, pwalletMain->cs_wallet);
-
+        LOCK(pwalletMain->cs_wallet);
         pwalletMain->MarkDirty();
+    }
 
-        pwalletMain->ScanForWalletTransactions(pindex, true);
+    if (pwalletMain->ScanForWalletTransactions(pindex, true) < 0)
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error: A wallet rescan is in progress, wait for it or stop it with abortrescan first.");
+
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
         pwalletMain->ReacceptWalletTransactions();
     }
 
-    result.push_back(Pair("result", "Scan complete."));
+    result.push_back(Pair("result", pwalletMain->fAbortRescan ? "Scan aborted." : "Scan complete."));
+
+    return result;
+}
+
+Value abortrescan(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "abortrescan\n"
+            "Stops the wallet rescan in progress, if any.\n"
+            "Blocks already scanned keep the transactions found in them.");
+
+    if (!pwalletMain->fScanningWallet)
+        return false;
+
+    pwalletMain->AbortRescan();
+    return true;
+}
+
+Value getrescaninfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrescaninfo\n"
+            "Returns the progress of the wallet rescan in progress, if any.");
+
+    Object result;
+    bool fScanning = pwalletMain->fScanningWallet;
+    result.push_back(Pair("scanning", fScanning));
+    if (!fScanning)
+        return result;
 
+    int nStart = pwalletMain->nScanStartHeight;
+    int nHeight = pwalletMain->nScanHeight;
+    int nEnd = pwalletMain->nScanEndHeight;
+    int64_t nElapsed = GetTimeMillis() - pwalletMain->nScanStartTime;
+    double dProgress = nEnd > nStart ? (double)(nHeight - nStart) / (nEnd - nStart) : 0;
+    result.push_back(Pair("progress", dProgress));
+    result.push_back(Pair("height", nHeight));
+    result.push_back(Pair("startheight", nStart));
+    result.push_back(Pair("endheight", nEnd));
+    result.push_back(Pair("duration", nElapsed / 1000));
+    if (nHeight > nStart)
+        result.push_back(Pair("eta", (int64_t)(nElapsed * (nEnd - nHeight) / (nHeight - nStart) / 1000)));
     return result;
 }
 
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/foreach.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/tuple/tuple_comparison.hpp>
 
@@ -106,15 +107,11 @@ const char* ScriptErrorString(const ScriptError serror)
 }
 
 
-bool CheckSig(vector<unsigned char> vchSig, const vector<unsigned char> &vchPubKey, const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, int flags);
+bool CheckSig(vector<unsigned char> vchSig, const vector<unsigned char> &vchPubKey, const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, int flags, CSignatureHasher* pSigHasher);
 
 static const valtype vchFalse(0);
 static const valtype vchZero(0);
 static const valtype vchTrue(1, 1);
-static const CBigNum bnZero(0);
-static const CBigNum bnOne(1);
-static const CBigNum bnFalse(0);
-static const CBigNum bnTrue(1);
 static const size_t nDefaultMaxNumSize = 4;
 
 
@@ -126,6 +123,42 @@ CBigNum CastToBigNum(const valtype& vch, const size_t nMaxNumSize = nDefaultMaxN
     return CBigNum(CBigNum(vch).getvch());
 }
 
+// The number CastToBigNum() reads, without a bignum: little-endian, with the
+// sign in the top bit of the last byte
+int64_t CastToInt64(const valtype& vch, const size_t nMaxNumSize = nDefaultMaxNumSize)
+{
+    if (vch.size() > nMaxNumSize)
+        throw runtime_error("CastToBigNum() : overflow");
+    if (vch.empty())
+        return 0;
+    int64_t n = 0;
+    for (size_t i = 0; i < vch.size(); i++)
+        n |= (int64_t)vch[i] << (8 * i);
+    if (vch.back() & 0x80)
+        return -(n & ~((int64_t)0x80 << (8 * (vch.size() - 1))));
+    return n;
+}
+
+// The shortest encoding of n, as CBigNum(n).getvch() gives it
+void SetScriptNum(valtype& vch, int64_t n)
+{
+    vch.clear();
+    if (n == 0)
+        return;
+    bool fNegative = n < 0;
+    uint64_t nAbs = fNegative ? -(uint64_t)n : (uint64_t)n;
+    while (nAbs)
+    {
+        vch.push_back(nAbs & 0xff);
+        nAbs >>= 8;
+    }
+    // The top bit is the sign: add a byte for it if the magnitude uses it
+    if (vch.back() & 0x80)
+        vch.push_back(fNegative ? 0x80 : 0);
+    else if (fNegative)
+        vch.back() |= 0x80;
+}
+
 bool CastToBool(const valtype& vch)
 {
     for (unsigned int i = 0; i < vch.size(); i++)
@@ -435,16 +468,57 @@ bool static CheckPubKeyEncoding(const valtype &vchSig) {
     return true;
 }
 
-bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType)
+namespace {
+
+/**
+ * Buffers the interpreter reuses from one script to the next, one set per
+ * thread, so that verifying an input allocates nothing once the buffers have
+ * grown to the sizes its scripts need.
+ */
+struct CScriptArena
+{
+    CScriptStack stack;
+    CScriptStack stackCopy;
+    CScriptStack altstack;
+    valtype vchPushValue;
+    vector<bool> vfExec;
+    CScript scriptCode;    // the script a signature signs
+    CScript scriptSigPush; // the push of a signature, deleted from scriptCode
+    CScript scriptRedeem;  // the serialized script of a pay-to-script-hash input
+};
+
+boost::thread_specific_ptr<CScriptArena> pScriptArena;
+
+CScriptArena& GetScriptArena()
+{
+    if (!pScriptArena.get())
+        pScriptArena.reset(new CScriptArena());
+    return *pScriptArena;
+}
+
+} // anon namespace
+
+// Subset of script starting at the most recent codeseparator, without the
+// pushes of the signatures, since there's no way for a signature to sign itself
+static void DeleteSignature(CScriptArena& arena, const valtype& vchSig)
 {
-    CAutoBN_CTX pctx;
+    arena.scriptSigPush.resize(0);
+    arena.scriptSigPush << vchSig;
+    arena.scriptCode.FindAndDelete(arena.scriptSigPush);
+}
+
+bool EvalScript(CScriptStack& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, CSignatureHasher* pSigHasher)
+{
+    CScriptArena& arena = GetScriptArena();
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
     CScript::const_iterator pbegincodehash = script.begin();
     opcodetype opcode;
-    valtype vchPushValue;
-    vector<bool> vfExec;
-    vector<valtype> altstack;
+    valtype& vchPushValue = arena.vchPushValue;
+    vector<bool>& vfExec = arena.vfExec;
+    CScriptStack& altstack = arena.altstack;
+    vfExec.clear();
+    altstack.clear();
     if (script.size() > 10000)
         return false;
     int nOpCount = 0;
@@ -484,7 +558,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                 return false;
 
             if (fExec && 0 <= opcode && opcode <= OP_PUSHDATA4)
-                stack.push_back(vchPushValue);
+                stack.push().swap(vchPushValue);
             else if (fExec || (OP_IF <= opcode && opcode <= OP_ENDIF))
             switch (opcode)
             {
@@ -510,8 +584,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                 case OP_16:
                 {
                     // ( -- value)
-                    CBigNum bn((int)opcode - (int)(OP_1 - 1));
-                    stack.push_back(bn.getvch());
+                    SetScriptNum(stack.push(), (int)opcode - (int)(OP_1 - 1));
                 }
                 break;
 
@@ -543,7 +616,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                         fValue = CastToBool(vch);
                         if (opcode == OP_NOTIF)
                             fValue = !fValue;
-                        popstack(stack);
+                        stack.pop_back();
                     }
                     vfExec.push_back(fValue);
                 }
@@ -573,7 +646,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                         return false;
                     bool fValue = CastToBool(stacktop(-1));
                     if (fValue)
-                        popstack(stack);
+                        stack.pop_back();
                     else
                         return false;
                 }
@@ -593,8 +666,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                 {
                     if (stack.size() < 1)
                         return false;
-                    altstack.push_back(stacktop(-1));
-                    popstack(stack);
+                    valtype& vch = altstack.push();
+                    vch.swap(stacktop(-1));
+                    stack.pop_back();
                 }
                 break;
 
@@ -602,8 +676,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                 {
                     if (altstack.size() < 1)
                         return false;
-                    stack.push_back(altstacktop(-1));
-                    popstack(altstack);
+                    valtype& vch = stack.push();
+                    vch.swap(altstacktop(-1));
+                    altstack.pop_back();
                 }
                 break;
 
@@ -612,8 +687,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x1 x2 -- )
                     if (stack.size() < 2)
                         return false;
-                    popstack(stack);
-                    popstack(stack);
+                    stack.pop_back();
+                    stack.pop_back();
                 }
                 break;
 
@@ -622,10 +697,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x1 x2 -- x1 x2 x1 x2)
                     if (stack.size() < 2)
                         return false;
-                    valtype vch1 = stacktop(-2);
-                    valtype vch2 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(stacktop(-2));
+                    stack.push_back(stacktop(-2));
                 }
                 break;
 
@@ -634,12 +707,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x1 x2 x3 -- x1 x2 x3 x1 x2 x3)
                     if (stack.size() < 3)
                         return false;
-                    valtype vch1 = stacktop(-3);
-                    valtype vch2 = stacktop(-2);
-                    valtype vch3 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
-                    stack.push_back(vch3);
+                    stack.push_back(stacktop(-3));
+                    stack.push_back(stacktop(-3));
+                    stack.push_back(stacktop(-3));
                 }
                 break;
 
@@ -648,10 +718,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x1 x2 x3 x4 -- x1 x2 x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return false;
-                    valtype vch1 = stacktop(-4);
-                    valtype vch2 = stacktop(-3);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(stacktop(-4));
+                    stack.push_back(stacktop(-4));
                 }
                 break;
 
@@ -660,11 +728,12 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
                     if (stack.size() < 6)
                         return false;
-                    valtype vch1 = stacktop(-6);
-                    valtype vch2 = stacktop(-5);
-                    stack.erase(stack.end()-6, stack.end()-4);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    for (int i = 0; i < 2; i++)
+                    {
+                        valtype& vch = stack.push();
+                        vch.swap(stacktop(-7));
+                    }
+                    stack.erase(stack.size() - 8, stack.size() - 6);
                 }
                 break;
 
@@ -683,17 +752,16 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x - 0 | x x)
                     if (stack.size() < 1)
                         return false;
-                    valtype vch = stacktop(-1);
-                    if (CastToBool(vch))
-                        stack.push_back(vch);
+                    if (CastToBool(stacktop(-1)))
+                        stack.push_back(stacktop(-1));
                 }
                 break;
 
                 case OP_DEPTH:
                 {
                     // -- stacksize
-                    CBigNum bn(stack.size());
-                    stack.push_back(bn.getvch());
+                    int64_t nDepth = stack.size();
+                    SetScriptNum(stack.push(), nDepth);
                 }
                 break;
 
@@ -702,7 +770,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x -- )
                     if (stack.size() < 1)
                         return false;
-                    popstack(stack);
+                    stack.pop_back();
                 }
                 break;
 
@@ -711,8 +779,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x -- x x)
                     if (stack.size() < 1)
                         return false;
-                    valtype vch = stacktop(-1);
-                    stack.push_back(vch);
+                    stack.push_back(stacktop(-1));
                 }
                 break;
 
@@ -721,7 +788,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x1 x2 -- x2)
                     if (stack.size() < 2)
                         return false;
-                    stack.erase(stack.end() - 2);
+                    stack.erase(stack.size() - 2);
                 }
                 break;
 
@@ -730,8 +797,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x1 x2 -- x1 x2 x1)
                     if (stack.size() < 2)
                         return false;
-                    valtype vch = stacktop(-2);
-                    stack.push_back(vch);
+                    stack.push_back(stacktop(-2));
                 }
                 break;
 
@@ -742,14 +808,18 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (xn ... x2 x1 x0 n - ... x2 x1 x0 xn)
                     if (stack.size() < 2)
                         return false;
-                    int n = CastToBigNum(stacktop(-1)).getint();
-                    popstack(stack);
+                    int n = CastToInt64(stacktop(-1));
+                    stack.pop_back();
                     if (n < 0 || n >= (int)stack.size())
                         return false;
-                    valtype vch = stacktop(-n-1);
                     if (opcode == OP_ROLL)
-                        stack.erase(stack.end()-n-1);
-                    stack.push_back(vch);
+                    {
+                        valtype& vch = stack.push();
+                        vch.swap(stacktop(-n-2));
+                        stack.erase(stack.size() - n - 2);
+                    }
+                    else
+                        stack.push_back(stacktop(-n-1));
                 }
                 break;
 
@@ -779,8 +849,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x1 x2 -- x2 x1 x2)
                     if (stack.size() < 2)
                         return false;
-                    valtype vch = stacktop(-1);
-                    stack.insert(stack.end()-2, vch);
+                    stack.insert(stack.size() - 2, stacktop(-1));
                 }
                 break;
 
@@ -796,7 +865,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     valtype& vch1 = stacktop(-2);
                     valtype& vch2 = stacktop(-1);
                     vch1.insert(vch1.end(), vch2.begin(), vch2.end());
-                    popstack(stack);
+                    stack.pop_back();
                     if (stacktop(-1).size() > MAX_SCRIPT_ELEMENT_SIZE)
                         return false;
                 }
@@ -808,8 +877,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     if (stack.size() < 3)
                         return false;
                     valtype& vch = stacktop(-3);
-                    int nBegin = CastToBigNum(stacktop(-2)).getint();
-                    int nEnd = nBegin + CastToBigNum(stacktop(-1)).getint();
+                    int nBegin = CastToInt64(stacktop(-2));
+                    int nEnd = nBegin + CastToInt64(stacktop(-1));
                     if (nBegin < 0 || nEnd < nBegin)
                         return false;
                     if (nBegin > (int)vch.size())
@@ -818,8 +887,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                         nEnd = vch.size();
                     vch.erase(vch.begin() + nEnd, vch.end());
                     vch.erase(vch.begin(), vch.begin() + nBegin);
-                    popstack(stack);
-                    popstack(stack);
+                    stack.pop_back();
+                    stack.pop_back();
                 }
                 break;
 
@@ -830,7 +899,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     if (stack.size() < 2)
                         return false;
                     valtype& vch = stacktop(-2);
-                    int nSize = CastToBigNum(stacktop(-1)).getint();
+                    int nSize = CastToInt64(stacktop(-1));
                     if (nSize < 0)
                         return false;
                     if (nSize > (int)vch.size())
@@ -839,7 +908,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                         vch.erase(vch.begin() + nSize, vch.end());
                     else
                         vch.erase(vch.begin(), vch.end() - nSize);
-                    popstack(stack);
+                    stack.pop_back();
                 }
                 break;
 
@@ -848,8 +917,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (in -- in size)
                     if (stack.size() < 1)
                         return false;
-                    CBigNum bn(stacktop(-1).size());
-                    stack.push_back(bn.getvch());
+                    int64_t nSize = stacktop(-1).size();
+                    SetScriptNum(stack.push(), nSize);
                 }
                 break;
 
@@ -898,7 +967,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                         for (unsigned int i = 0; i < vch1.size(); i++)
                             vch1[i] ^= vch2[i];
                     }
-                    popstack(stack);
+                    stack.pop_back();
                 }
                 break;
 
@@ -917,13 +986,13 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // zero bytes after it (numerically, 0x01 == 0x0001 == 0x000001)
                     //if (opcode == OP_NOTEQUAL)
                     //    fEqual = !fEqual;
-                    popstack(stack);
-                    popstack(stack);
+                    stack.pop_back();
+                    stack.pop_back();
                     stack.push_back(fEqual ? vchTrue : vchFalse);
                     if (opcode == OP_EQUALVERIFY)
                     {
                         if (fEqual)
-                            popstack(stack);
+                            stack.pop_back();
                         else
                             return false;
                     }
@@ -934,10 +1003,11 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                 //
                 // Numeric
                 //
+                // Operands are at most 4 bytes, so results fit easily in
+                // 64 bits. The disabled opcodes are rejected above.
+                //
                 case OP_1ADD:
                 case OP_1SUB:
-                case OP_2MUL:
-                case OP_2DIV:
                 case OP_NEGATE:
                 case OP_ABS:
                 case OP_NOT:
@@ -946,31 +1016,23 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (in -- out)
                     if (stack.size() < 1)
                         return false;
-                    CBigNum bn = CastToBigNum(stacktop(-1));
+                    int64_t n = CastToInt64(stacktop(-1));
                     switch (opcode)
                     {
-                    case OP_1ADD:       bn += bnOne; break;
-                    case OP_1SUB:       bn -= bnOne; break;
-                    case OP_2MUL:       bn <<= 1; break;
-                    case OP_2DIV:       bn >>= 1; break;
-                    case OP_NEGATE:     bn = -bn; break;
-                    case OP_ABS:        if (bn < bnZero) bn = -bn; break;
-                    case OP_NOT:        bn = (bn == bnZero); break;
-                    case OP_0NOTEQUAL:  bn = (bn != bnZero); break;
+                    case OP_1ADD:       n += 1; break;
+                    case OP_1SUB:       n -= 1; break;
+                    case OP_NEGATE:     n = -n; break;
+                    case OP_ABS:        if (n < 0) n = -n; break;
+                    case OP_NOT:        n = (n == 0); break;
+                    case OP_0NOTEQUAL:  n = (n != 0); break;
                     default:            assert(!"invalid opcode"); break;
                     }
-                    popstack(stack);
-                    stack.push_back(bn.getvch());
+                    SetScriptNum(stacktop(-1), n);
                 }
                 break;
 
                 case OP_ADD:
                 case OP_SUB:
-                case OP_MUL:
-                case OP_DIV:
-                case OP_MOD:
-                case OP_LSHIFT:
-                case OP_RSHIFT:
                 case OP_BOOLAND:
                 case OP_BOOLOR:
                 case OP_NUMEQUAL:
@@ -986,67 +1048,33 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x1 x2 -- out)
                     if (stack.size() < 2)
                         return false;
-                    CBigNum bn1 = CastToBigNum(stacktop(-2));
-                    CBigNum bn2 = CastToBigNum(stacktop(-1));
-                    CBigNum bn;
+                    int64_t n1 = CastToInt64(stacktop(-2));
+                    int64_t n2 = CastToInt64(stacktop(-1));
+                    int64_t n;
                     switch (opcode)
                     {
-                    case OP_ADD:
-                        bn = bn1 + bn2;
-                        break;
-
-                    case OP_SUB:
-                        bn = bn1 - bn2;
-                        break;
-
-                    case OP_MUL:
-                        if (!BN_mul(&bn, &bn1, &bn2, pctx))
-                            return false;
-                        break;
-
-                    case OP_DIV:
-                        if (!BN_div(&bn, NULL, &bn1, &bn2, pctx))
-                            return false;
-                        break;
-
-                    case OP_MOD:
-                        if (!BN_mod(&bn, &bn1, &bn2, pctx))
-                            return false;
-                        break;
-
-                    case OP_LSHIFT:
-                        if (bn2 < bnZero || bn2 > CBigNum(2048))
-                            return false;
-                        bn = bn1 << bn2.getulong();
-                        break;
-
-                    case OP_RSHIFT:
-                        if (bn2 < bnZero || bn2 > CBigNum(2048))
-                            return false;
-                        bn = bn1 >> bn2.getulong();
-                        break;
-
-                    case OP_BOOLAND:             bn = (bn1 != bnZero && bn2 != bnZero); break;
-                    case OP_BOOLOR:              bn = (bn1 != bnZero || bn2 != bnZero); break;
-                    case OP_NUMEQUAL:            bn = (bn1 == bn2); break;
-                    case OP_NUMEQUALVERIFY:      bn = (bn1 == bn2); break;
-                    case OP_NUMNOTEQUAL:         bn = (bn1 != bn2); break;
-                    case OP_LESSTHAN:            bn = (bn1 < bn2); break;
-                    case OP_GREATERTHAN:         bn = (bn1 > bn2); break;
-                    case OP_LESSTHANOREQUAL:     bn = (bn1 <= bn2); break;
-                    case OP_GREATERTHANOREQUAL:  bn = (bn1 >= bn2); break;
-                    case OP_MIN:                 bn = (bn1 < bn2 ? bn1 : bn2); break;
-                    case OP_MAX:                 bn = (bn1 > bn2 ? bn1 : bn2); break;
-                    default:                     assert(!"invalid opcode"); break;
+                    case OP_ADD:                 n = n1 + n2; break;
+                    case OP_SUB:                 n = n1 - n2; break;
+                    case OP_BOOLAND:             n = (n1 != 0 && n2 != 0); break;
+                    case OP_BOOLOR:              n = (n1 != 0 || n2 != 0); break;
+                    case OP_NUMEQUAL:            n = (n1 == n2); break;
+                    case OP_NUMEQUALVERIFY:      n = (n1 == n2); break;
+                    case OP_NUMNOTEQUAL:         n = (n1 != n2); break;
+                    case OP_LESSTHAN:            n = (n1 < n2); break;
+                    case OP_GREATERTHAN:         n = (n1 > n2); break;
+                    case OP_LESSTHANOREQUAL:     n = (n1 <= n2); break;
+                    case OP_GREATERTHANOREQUAL:  n = (n1 >= n2); break;
+                    case OP_MIN:                 n = (n1 < n2 ? n1 : n2); break;
+                    case OP_MAX:                 n = (n1 > n2 ? n1 : n2); break;
+                    default:                     assert(!"invalid opcode"); n = 0; break;
                     }
-                    popstack(stack);
-                    popstack(stack);
-                    stack.push_back(bn.getvch());
+                    stack.pop_back();
+                    SetScriptNum(stacktop(-1), n);
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
                         if (CastToBool(stacktop(-1)))
-                            popstack(stack);
+                            stack.pop_back();
                         else
                             return false;
                     }
@@ -1058,13 +1086,13 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x min max -- out)
                     if (stack.size() < 3)
                         return false;
-                    CBigNum bn1 = CastToBigNum(stacktop(-3));
-                    CBigNum bn2 = CastToBigNum(stacktop(-2));
-                    CBigNum bn3 = CastToBigNum(stacktop(-1));
-                    bool fValue = (bn2 <= bn1 && bn1 < bn3);
-                    popstack(stack);
-                    popstack(stack);
-                    popstack(stack);
+                    int64_t n1 = CastToInt64(stacktop(-3));
+                    int64_t n2 = CastToInt64(stacktop(-2));
+                    int64_t n3 = CastToInt64(stacktop(-1));
+                    bool fValue = (n2 <= n1 && n1 < n3);
+                    stack.pop_back();
+                    stack.pop_back();
+                    stack.pop_back();
                     stack.push_back(fValue ? vchTrue : vchFalse);
                 }
                 break;
@@ -1083,25 +1111,25 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     if (stack.size() < 1)
                         return false;
                     valtype& vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    unsigned char hash[32];
+                    size_t nHashSize = (opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32;
                     if (opcode == OP_RIPEMD160)
-                        RIPEMD160(&vch[0], vch.size(), &vchHash[0]);
+                        RIPEMD160(&vch[0], vch.size(), hash);
                     else if (opcode == OP_SHA1)
-                        SHA1(&vch[0], vch.size(), &vchHash[0]);
+                        SHA1(&vch[0], vch.size(), hash);
                     else if (opcode == OP_SHA256)
-                        SHA256(&vch[0], vch.size(), &vchHash[0]);
+                        SHA256(&vch[0], vch.size(), hash);
                     else if (opcode == OP_HASH160)
                     {
                         uint160 hash160 = Hash160(vch);
-                        memcpy(&vchHash[0], &hash160, sizeof(hash160));
+                        memcpy(hash, &hash160, sizeof(hash160));
                     }
                     else if (opcode == OP_HASH256)
                     {
-                        uint256 hash = Hash(vch.begin(), vch.end());
-                        memcpy(&vchHash[0], &hash, sizeof(hash));
+                        uint256 hash256 = Hash(vch.begin(), vch.end());
+                        memcpy(hash, &hash256, sizeof(hash256));
                     }
-                    popstack(stack);
-                    stack.push_back(vchHash);
+                    vch.assign(hash, hash + nHashSize);
                 }
                 break;
 
@@ -1122,25 +1150,23 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     valtype& vchSig    = stacktop(-2);
                     valtype& vchPubKey = stacktop(-1);
 
-                    // Subset of script starting at the most recent codeseparator
-                    CScript scriptCode(pbegincodehash, pend);
-
-                    // Drop the signature, since there's no way for a signature to sign itself
-                    scriptCode.FindAndDelete(CScript(vchSig));
+                    CScript& scriptCode = arena.scriptCode;
+                    scriptCode.assign(pbegincodehash, pend);
+                    DeleteSignature(arena, vchSig);
 
                     if ((flags & SCRIPT_VERIFY_STRICTENC) && (!CheckSignatureEncoding(vchSig) || !CheckPubKeyEncoding(vchPubKey)))
                         return false;
 
                     bool fSuccess = CheckSignatureEncoding(vchSig) && CheckPubKeyEncoding(vchPubKey) &&
-                        CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags);
+                        CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags, pSigHasher);
 
-                    popstack(stack);
-                    popstack(stack);
+                    stack.pop_back();
+                    stack.pop_back();
                     stack.push_back(fSuccess ? vchTrue : vchFalse);
                     if (opcode == OP_CHECKSIGVERIFY)
                     {
                         if (fSuccess)
-                            popstack(stack);
+                            stack.pop_back();
                         else
                             return false;
                     }
@@ -1156,7 +1182,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     if ((int)stack.size() < i)
                         return false;
 
-                    int nKeysCount = CastToBigNum(stacktop(-i)).getint();
+                    int nKeysCount = CastToInt64(stacktop(-i));
                     if (nKeysCount < 0 || nKeysCount > 20)
                         return false;
                     nOpCount += nKeysCount;
@@ -1167,7 +1193,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     if ((int)stack.size() < i)
                         return false;
 
-                    int nSigsCount = CastToBigNum(stacktop(-i)).getint();
+                    int nSigsCount = CastToInt64(stacktop(-i));
                     if (nSigsCount < 0 || nSigsCount > nKeysCount)
                         return false;
                     int isig = ++i;
@@ -1175,15 +1201,10 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     if ((int)stack.size() < i)
                         return false;
 
-                    // Subset of script starting at the most recent codeseparator
-                    CScript scriptCode(pbegincodehash, pend);
-
-                    // Drop the signatures, since there's no way for a signature to sign itself
+                    CScript& scriptCode = arena.scriptCode;
+                    scriptCode.assign(pbegincodehash, pend);
                     for (int k = 0; k < nSigsCount; k++)
-                    {
-                        valtype& vchSig = stacktop(-isig-k);
-                        scriptCode.FindAndDelete(CScript(vchSig));
-                    }
+                        DeleteSignature(arena, stacktop(-isig-k));
 
                     bool fSuccess = true;
                     while (fSuccess && nSigsCount > 0)
@@ -1196,7 +1217,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
 
                         // Check signature
                         bool fOk = CheckSignatureEncoding(vchSig) && CheckPubKeyEncoding(vchPubKey) &&
-                            CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags);
+                            CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags, pSigHasher);
 
                         if (fOk)
                         {
@@ -1214,7 +1235,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
 
                     // Clean up stack of actual arguments
                     while (i-- > 1)
-                        popstack(stack);
+                        stack.pop_back();
 
                     // A bug causes CHECKMULTISIG to consume one extra argument
                     // whose contents were not checked in any way.
@@ -1226,14 +1247,14 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                         return false;
                     if ((flags & SCRIPT_VERIFY_NULLDUMMY) && stacktop(-1).size())
                         return error("CHECKMULTISIG dummy argument not null");
-                    popstack(stack);
+                    stack.pop_back();
 
                     stack.push_back(fSuccess ? vchTrue : vchFalse);
 
                     if (opcode == OP_CHECKMULTISIGVERIFY)
                     {
                         if (fSuccess)
-                            popstack(stack);
+                            stack.pop_back();
                         else
                             return false;
                     }
@@ -1261,6 +1282,16 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
     return true;
 }
 
+bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, CSignatureHasher* pSigHasher)
+{
+    CScriptStack stackEval;
+    stackEval.assign(stack);
+    bool fResult = EvalScript(stackEval, script, txTo, nIn, flags, nHashType, pSigHasher);
+    // Callers look at what a failed script left on the stack too
+    stackEval.CopyTo(stack);
+    return fResult;
+}
+
 bool static IsLowDERSignature(const valtype &vchSig, ScriptError* serror) {
     if (!IsDERSignature(vchSig)) {
         return set_error(serror, SCRIPT_ERR_SIG_DER);
@@ -2016,76 +2047,144 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
 
 
 
-uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+// Stream the transaction as the signature hash sees it into ss: the other
+// inputs' signatures blanked out, scriptCode in place of the signed one's, and
+// what the hash type leaves out dropped or nulled.
+static void SerializeSignatureTx(CHashWriter& ss, const CTransaction& txTo, const CScript& scriptCode, unsigned int nIn, int nHashType)
 {
-    if (nIn >= txTo.vin.size())
+    const bool fAnyoneCanPay = nHashType & SIGHASH_ANYONECANPAY;
+    const bool fHashNone = (nHashType & 0x1f) == SIGHASH_NONE;
+    const bool fHashSingle = (nHashType & 0x1f) == SIGHASH_SINGLE;
+
+    ss << txTo.nVersion << txTo.nTime;
+
+    // Blank out other inputs completely, not recommended for open transactions
+    unsigned int nInputs = fAnyoneCanPay ? 1 : txTo.vin.size();
+    WriteCompactSize(ss, nInputs);
+    for (unsigned int i = 0; i < nInputs; i++)
     {
-        LogPrintf("ERROR: SignatureHash() : nIn=%d out of range\n", nIn);
-        return 1;
+        unsigned int nInput = fAnyoneCanPay ? nIn : i;
+        const CTxIn& txin = txTo.vin[nInput];
+        ss << txin.prevout;
+        if (nInput == nIn)
+            ss << scriptCode;
+        else
+            ss << CScript();
+        // Let the others update at will
+        if (nInput != nIn && (fHashNone || fHashSingle))
+            ss << (unsigned int)0;
+        else
+            ss << txin.nSequence;
     }
-    CTransaction txTmp(txTo);
 
-    // In case concatenating two scripts ends up with two codeseparators,
-    // or an extra one at the end, this prevents all those possible incompatibilities.
-    scriptCode.FindAndDelete(CScript(OP_CODESEPARATOR));
+    // Wildcard payee, or only lock-in the txout payee at same index as txin
+    unsigned int nOutputs = fHashNone ? 0 : (fHashSingle ? nIn + 1 : txTo.vout.size());
+    WriteCompactSize(ss, nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++)
+    {
+        if (fHashSingle && i != nIn)
+            ss << CTxOut();
+        else
+            ss << txTo.vout[i];
+    }
 
-    // Blank out other inputs' signatures
-    for (unsigned int i = 0; i < txTmp.vin.size(); i++)
-        txTmp.vin[i].scriptSig = CScript();
-    txTmp.vin[nIn].scriptSig = scriptCode;
+    ss << txTo.nLockTime;
+}
 
-    // Blank out some of the outputs
-    if ((nHashType & 0x1f) == SIGHASH_NONE)
-    {
-        // Wildcard payee
-        txTmp.vout.clear();
+// In case concatenating two scripts ends up with two codeseparators,
+// or an extra one at the end, this prevents all those possible incompatibilities.
+// Scripts without one, which is nearly all of them, are hashed without a copy.
+static const CScript& StripCodeSeparators(const CScript& scriptCode, CScript& scriptStripped)
+{
+    if (scriptCode.Find(OP_CODESEPARATOR) == 0)
+        return scriptCode;
+    scriptStripped = scriptCode;
+    scriptStripped.FindAndDelete(CScript(OP_CODESEPARATOR));
+    return scriptStripped;
+}
 
-        // Let the others update at will
-        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
-            if (i != nIn)
-                txTmp.vin[i].nSequence = 0;
+static bool CheckSignatureHashArgs(const CTransaction& txTo, unsigned int nIn, int nHashType)
+{
+    if (nIn >= txTo.vin.size())
+    {
+        LogPrintf("ERROR: SignatureHash() : nIn=%d out of range\n", nIn);
+        return false;
     }
-    else if ((nHashType & 0x1f) == SIGHASH_SINGLE)
+    if ((nHashType & 0x1f) == SIGHASH_SINGLE && nIn >= txTo.vout.size())
     {
-        // Only lock-in the txout payee at same index as txin
-        unsigned int nOut = nIn;
-        if (nOut >= txTmp.vout.size())
-        {
-            LogPrintf("ERROR: SignatureHash() : nOut=%d out of range\n", nOut);
-            return 1;
-        }
-        txTmp.vout.resize(nOut+1);
-        for (unsigned int i = 0; i < nOut; i++)
-            txTmp.vout[i].SetNull();
-
-        // Let the others update at will
-        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
-            if (i != nIn)
-                txTmp.vin[i].nSequence = 0;
+        LogPrintf("ERROR: SignatureHash() : nOut=%d out of range\n", nIn);
+        return false;
     }
+    return true;
+}
 
-    // Blank out other inputs completely, not recommended for open transactions
-    if (nHashType & SIGHASH_ANYONECANPAY)
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+{
+    if (!CheckSignatureHashArgs(txTo, nIn, nHashType))
+        return 1;
+
+    CScript scriptStripped;
+    CHashWriter ss(SER_GETHASH, 0);
+    SerializeSignatureTx(ss, txTo, StripCodeSeparators(scriptCode, scriptStripped), nIn, nHashType);
+    ss << nHashType;
+    return ss.GetHash();
+}
+
+void CSignatureHasher::Precompute()
+{
+    // With SIGHASH_ALL every input but the signed one is hashed blanked out,
+    // so the hash state after the inputs before it can be kept, and what
+    // follows it is the same bytes whichever input is signed
+    CDataStream ssTail(SER_GETHASH, 0);
+    vTailPos.reserve(txTo.vin.size() + 1);
+    for (unsigned int i = 0; i < txTo.vin.size(); i++)
     {
-        txTmp.vin[0] = txTmp.vin[nIn];
-        txTmp.vin.resize(1);
+        vTailPos.push_back(ssTail.size());
+        ssTail << txTo.vin[i].prevout << CScript() << txTo.vin[i].nSequence;
     }
+    vTailPos.push_back(ssTail.size());
+    ssTail << txTo.vout << txTo.nLockTime;
+    vchTail.assign(ssTail.begin(), ssTail.end());
 
-    // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
-    ss << txTmp << nHashType;
+    ss << txTo.nVersion << txTo.nTime;
+    WriteCompactSize(ss, txTo.vin.size());
+    vMidstate.reserve(txTo.vin.size());
+    for (unsigned int i = 0; i < txTo.vin.size(); i++)
+    {
+        vMidstate.push_back(ss);
+        ss.write((const char*)&vchTail[vTailPos[i]], vTailPos[i + 1] - vTailPos[i]);
+    }
+    fPrecomputed = true;
+}
+
+uint256 CSignatureHasher::SignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType)
+{
+    if (nHashType != SIGHASH_ALL || txTo.vin.size() < 2)
+        return ::SignatureHash(scriptCode, txTo, nIn, nHashType);
+    if (!CheckSignatureHashArgs(txTo, nIn, nHashType))
+        return 1;
+    if (!fPrecomputed)
+        Precompute();
+
+    CScript scriptStripped;
+    CHashWriter ss(vMidstate[nIn]);
+    ss << txTo.vin[nIn].prevout << StripCodeSeparators(scriptCode, scriptStripped) << txTo.vin[nIn].nSequence;
+    ss.write((const char*)&vchTail[vTailPos[nIn + 1]], vchTail.size() - vTailPos[nIn + 1]);
+    ss << nHashType;
     return ss.GetHash();
 }
 
 
-bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType)
+bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType, CSignatureHasher* pSigHasher)
 {
     assert(nIn < txTo.vin.size());
+    assert(!txTo.IsImmutable());
     CTxIn& txin = txTo.vin[nIn];
 
     // Leave out the signature from the hash, since a signature can't sign itself.
     // The checksig op will also drop the signatures from its hash.
-    uint256 hash = SignatureHash(fromPubKey, txTo, nIn, nHashType);
+    uint256 hash = pSigHasher ? pSigHasher->SignatureHash(fromPubKey, nIn, nHashType) : SignatureHash(fromPubKey, txTo, nIn, nHashType);
 
     txnouttype whichType;
     if (!Solver(keystore, fromPubKey, hash, nHashType, txin.scriptSig, whichType))
@@ -2099,28 +2198,28 @@ bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransa
         CScript subscript = txin.scriptSig;
 
         // Recompute txn hash using subscript in place of scriptPubKey:
-        uint256 hash2 = SignatureHash(subscript, txTo, nIn, nHashType);
+        uint256 hash2 = pSigHasher ? pSigHasher->SignatureHash(subscript, nIn, nHashType) : SignatureHash(subscript, txTo, nIn, nHashType);
 
         txnouttype subType;
         bool fSolved =
             Solver(keystore, subscript, hash2, nHashType, txin.scriptSig, subType) && subType != TX_SCRIPTHASH;
         // Append serialized subscript whether or not it is completely signed:
-        txin.scriptSig << static_cast<valtype>(subscript);
+        txin.scriptSig << valtype(subscript.begin(), subscript.end());
         if (!fSolved) return false;
     }
 
     // Test solution
-    return VerifyScript(txin.scriptSig, fromPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, SignatureChecker(txTo, nIn));
+    return VerifyScript(txin.scriptSig, fromPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, SignatureChecker(txTo, nIn, pSigHasher));
 }
 
-bool SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType)
+bool SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType, CSignatureHasher* pSigHasher)
 {
     assert(nIn < txTo.vin.size());
     CTxIn& txin = txTo.vin[nIn];
     assert(txin.prevout.n < txFrom.vout.size());
     const CTxOut& txout = txFrom.vout[txin.prevout.n];
 
-    return SignSignature(keystore, txout.scriptPubKey, txTo, nIn, nHashType);
+    return SignSignature(keystore, txout.scriptPubKey, txTo, nIn, nHashType, pSigHasher);
 }
 
 
@@ -2183,7 +2282,7 @@ public:
 };
 
 bool CheckSig(vector<unsigned char> vchSig, const vector<unsigned char> &vchPubKey, const CScript &scriptCode,
-              const CTransaction& txTo, unsigned int nIn, int nHashType, int flags)
+              const CTransaction& txTo, unsigned int nIn, int nHashType, int flags, CSignatureHasher* pSigHasher)
 {
     static CSignatureCache signatureCache;
 
@@ -2200,7 +2299,7 @@ bool CheckSig(vector<unsigned char> vchSig, const vector<unsigned char> &vchPubK
         return false;
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
+    uint256 sighash = pSigHasher ? pSigHasher->SignatureHash(scriptCode, nIn, nHashType) : SignatureHash(scriptCode, txTo, nIn, nHashType);
 
     if (signatureCache.Get(sighash, vchSig, pubkey))
         return true;
@@ -2698,7 +2797,7 @@ bool SignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn, const vec
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
+    uint256 sighash = pSigHasher ? pSigHasher->SignatureHash(scriptCode, nIn, nHashType) : SignatureHash(scriptCode, txTo, nIn, nHashType);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -2707,15 +2806,21 @@ bool SignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn, const vec
 }
 
 
-bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType)
+bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, CSignatureHasher* pSigHasher)
 {
-    vector<vector<unsigned char> > stack, stackCopy;
-    if (!EvalScript(stack, scriptSig, txTo, nIn, flags, nHashType))
+    // The stacks of this thread, which keep their buffers from one input to the next
+    CScriptArena& arena = GetScriptArena();
+    CScriptStack& stack = arena.stack;
+    CScriptStack& stackCopy = arena.stackCopy;
+    stack.clear();
+    if (!EvalScript(stack, scriptSig, txTo, nIn, flags, nHashType, pSigHasher))
         return false;
 
-    stackCopy = stack;
+    bool fP2SH = scriptPubKey.IsPayToScriptHash();
+    if (fP2SH)
+        stackCopy.assign(stack);
 
-    if (!EvalScript(stack, scriptPubKey, txTo, nIn, flags, nHashType))
+    if (!EvalScript(stack, scriptPubKey, txTo, nIn, flags, nHashType, pSigHasher))
         return false;
     if (stack.empty())
         return false;
@@ -2724,16 +2829,17 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         return false;
 
     // Additional validation for spend-to-script-hash transactions:
-    if (scriptPubKey.IsPayToScriptHash())
+    if (fP2SH)
     {
         if (!scriptSig.IsPushOnly()) // scriptSig must be literals-only
             return false;            // or validation fails
 
         const valtype& pubKeySerialized = stackCopy.back();
-        CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
-        popstack(stackCopy);
+        CScript& pubKey2 = arena.scriptRedeem;
+        pubKey2.assign(pubKeySerialized.begin(), pubKeySerialized.end());
+        stackCopy.pop_back();
 
-        if (!EvalScript(stackCopy, pubKey2, txTo, nIn, flags, nHashType))
+        if (!EvalScript(stackCopy, pubKey2, txTo, nIn, flags, nHashType, pSigHasher))
             return false;
         if (stackCopy.empty())
             return false;
@@ -2824,7 +2930,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         bool fSolved =
             Solver(keystore, subscript, hash2, nHashType, txin.scriptSig, subType) && subType != TX_SCRIPTHASH;
         // Append serialized subscript whether or not it is completely signed:
-        txin.scriptSig << static_cast<valtype>(subscript);
+        txin.scriptSig << valtype(subscript.begin(), subscript.end());
         if (!fSolved) return false;
     }
 
@@ -2843,7 +2949,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
     return SignSignature(keystore, txout.scriptPubKey, txTo, nIn, nHashType);
 }*/
 
-bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType)
+bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, CSignatureHasher* pSigHasher)
 {
     assert(nIn < txTo.vin.size());
     const CTxIn& txin = txTo.vin[nIn];
@@ -2854,7 +2960,7 @@ bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsig
     if (txin.prevout.hash != txFrom.GetHash())
         return false;
 
-    return VerifyScript(txin.scriptSig, txout.scriptPubKey, txTo, nIn, flags, nHashType);
+    return VerifyScript(txin.scriptSig, txout.scriptPubKey, txTo, nIn, flags, nHashType, pSigHasher);
 }
 
 static CScript PushAll(const vector<valtype>& values)
@@ -2895,7 +3001,7 @@ static CScript CombineMultisig(CScript scriptPubKey, const CTransaction& txTo, u
             if (sigs.count(pubkey))
                 continue; // Already got a sig for this pubkey
 
-            if (CheckSig(sig, pubkey, scriptPubKey, txTo, nIn, 0, 0))
+            if (CheckSig(sig, pubkey, scriptPubKey, txTo, nIn, 0, 0, NULL))
             {
                 sigs[pubkey] = sig;
                 break;
@@ -3032,9 +3138,9 @@ bool CScript::IsPayToScriptHash() const
 {
     // Extra-fast test for pay-to-script-hash CScripts:
     return (this->size() == 23 &&
-            this->at(0) == OP_HASH160 &&
-            this->at(1) == 0x14 &&
-            this->at(22) == OP_EQUAL);
+            (*this)[0] == OP_HASH160 &&
+            (*this)[1] == 0x14 &&
+            (*this)[22] == OP_EQUAL);
 }
 
 bool CScript::HasCanonicalPushes() const
@@ -6,6 +6,8 @@
 #ifndef H_BITCREDIT_SCRIPT
 #define H_BITCREDIT_SCRIPT
 
+#include <algorithm>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -14,8 +16,10 @@
 #include <boost/foreach.hpp>
 #include <boost/variant.hpp>
 
+#include "hash.h"
 #include "keystore.h"
 #include "bignum.h"
+#include "prevector.h"
 #include "util.h"
 #include "stealth.h"
 
@@ -25,6 +29,7 @@ class CKeyStore;
 class CTransaction;
 
 class BaseSignatureChecker;
+class CSignatureHasher;
 
 static const unsigned int MAX_SCRIPT_ELEMENT_SIZE = 520; // bytes
 static const unsigned int MAX_OP_RETURN_RELAY = 40;      // bytes
@@ -538,8 +543,15 @@ private:
 
 
 
+/**
+ * Storage of a script: up to 36 bytes inline, enough for pay-to-pubkey (35),
+ * pay-to-pubkey-hash (25) and pay-to-script-hash (23) outputs, which are
+ * then copied and held without a heap allocation each.
+ */
+typedef prevector<36, unsigned char> CScriptBase;
+
 /** Serialized script, used inside transaction inputs and outputs */
-class CScript : public std::vector<unsigned char>
+class CScript : public CScriptBase
 {
 protected:
     CScript& push_int64(int64_t n)
@@ -572,11 +584,14 @@ protected:
 
 public:
     CScript() { }
-    CScript(const CScript& b) : std::vector<unsigned char>(b.begin(), b.end()) { }
-    CScript(const_iterator pbegin, const_iterator pend) : std::vector<unsigned char>(pbegin, pend) { }
-#ifndef _MSC_VER
-    CScript(const unsigned char* pbegin, const unsigned char* pend) : std::vector<unsigned char>(pbegin, pend) { }
-#endif
+    CScript(const CScript& b) : CScriptBase(b.begin(), b.end()) { }
+    CScript& operator=(const CScript& b)
+    {
+        CScriptBase::operator=(b);
+        return *this;
+    }
+    CScript(const_iterator pbegin, const_iterator pend) : CScriptBase(pbegin, pend) { }
+    CScript(std::vector<unsigned char>::const_iterator pbegin, std::vector<unsigned char>::const_iterator pend) : CScriptBase(pbegin, pend) { }
 
     CScript& operator+=(const CScript& b)
     {
@@ -887,16 +902,34 @@ public:
 
     CScriptID GetID() const
     {
-        return CScriptID(Hash160(*this));
+        return CScriptID(Hash160(begin(), end()));
     }
 
     void clear()
     {
-        // The default std::vector::clear() does not release memory.
-        std::vector<unsigned char>().swap(*this);
+        // The default prevector::clear() does not release memory.
+        CScriptBase::clear();
+        shrink_to_fit();
     }
 };
 
+inline unsigned int GetSerializeSize(const CScript& v, int nType, int nVersion)
+{
+    return GetSerializeSize((const CScriptBase&)v, nType, nVersion);
+}
+
+template<typename Stream>
+void Serialize(Stream& os, const CScript& v, int nType, int nVersion)
+{
+    Serialize(os, (const CScriptBase&)v, nType, nVersion);
+}
+
+template<typename Stream>
+void Unserialize(Stream& is, CScript& v, int nType, int nVersion)
+{
+    Unserialize(is, (CScriptBase&)v, nType, nVersion);
+}
+
 /** Compact serializer for scripts.
  *
  *  It detects common cases and encodes them much more efficiently.
@@ -970,9 +1003,121 @@ public:
     }
 };
 
+/** Stack slots CScriptStack::clear() keeps, with their buffers */
+static const unsigned int MAX_SCRIPT_STACK_SLOTS_KEPT = 64;
+
+/**
+ * A main or alt stack of the script interpreter. Popped elements keep their
+ * buffers for the next push, so a stack that is reused for one script after
+ * another stops allocating once its elements have grown to the sizes the
+ * scripts push. Elements are moved by swapping buffers, never copied.
+ */
+class CScriptStack
+{
+private:
+    std::vector<valtype> vSlots;
+    size_t nSize;
+
+public:
+    CScriptStack() : nSize(0) {}
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    valtype& at(size_t n)
+    {
+        if (n >= nSize)
+            throw std::out_of_range("CScriptStack::at() : out of range");
+        return vSlots[n];
+    }
+    const valtype& at(size_t n) const { return const_cast<CScriptStack*>(this)->at(n); }
+    valtype& back() { return at(nSize - 1); }
+    const valtype& back() const { return at(nSize - 1); }
+
+    // Push an empty element, in a buffer a popped element left
+    valtype& push()
+    {
+        if (nSize == vSlots.size())
+            vSlots.resize(nSize + 1);
+        valtype& vch = vSlots[nSize++];
+        vch.clear();
+        return vch;
+    }
+
+    // vch may be an element of this stack
+    void push_back(const valtype& vch)
+    {
+        if (nSize == vSlots.size())
+        {
+            valtype vchCopy(vch);
+            vSlots.resize(nSize + 1);
+            vSlots[nSize].swap(vchCopy);
+        }
+        else
+            vSlots[nSize].assign(vch.begin(), vch.end());
+        nSize++;
+    }
+
+    void pop_back()
+    {
+        if (nSize == 0)
+            throw std::runtime_error("popstack() : stack empty");
+        nSize--;
+    }
+
+    // Remove elements [nBegin, nEnd), moving those above them down
+    void erase(size_t nBegin, size_t nEnd)
+    {
+        if (nBegin > nEnd || nEnd > nSize)
+            throw std::out_of_range("CScriptStack::erase() : out of range");
+        std::rotate(vSlots.begin() + nBegin, vSlots.begin() + nEnd, vSlots.begin() + nSize);
+        nSize -= nEnd - nBegin;
+    }
+    void erase(size_t nPos) { erase(nPos, nPos + 1); }
+
+    // Insert a copy of vch below element nPos
+    void insert(size_t nPos, const valtype& vch)
+    {
+        if (nPos > nSize)
+            throw std::out_of_range("CScriptStack::insert() : out of range");
+        push_back(vch);
+        std::rotate(vSlots.begin() + nPos, vSlots.begin() + nSize - 1, vSlots.begin() + nSize);
+    }
+
+    // Empty the stack, keeping the buffers of its lowest slots
+    void clear()
+    {
+        nSize = 0;
+        if (vSlots.size() > MAX_SCRIPT_STACK_SLOTS_KEPT)
+            vSlots.resize(MAX_SCRIPT_STACK_SLOTS_KEPT);
+    }
+
+    void assign(const CScriptStack& other)
+    {
+        if (&other == this)
+            return;
+        clear();
+        for (size_t i = 0; i < other.size(); i++)
+            push_back(other.vSlots[i]);
+    }
+
+    void assign(const std::vector<valtype>& v)
+    {
+        clear();
+        for (size_t i = 0; i < v.size(); i++)
+            push_back(v[i]);
+    }
+
+    void CopyTo(std::vector<valtype>& v) const
+    {
+        v.assign(vSlots.begin(), vSlots.begin() + nSize);
+    }
+};
+
 
 bool IsDERSignature(const valtype &vchSig, bool haveHashType = true);
-bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType);
+bool EvalScript(CScriptStack& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, CSignatureHasher* pSigHasher = NULL);
+bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, CSignatureHasher* pSigHasher = NULL);
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::vector<unsigned char> >& vSolutionsRet);
 int ScriptSigArgsExpected(txnouttype t, const std::vector<std::vector<unsigned char> >& vSolutions);
@@ -982,10 +1127,10 @@ isminetype IsMine(const CKeyStore& keystore, const CTxDestination& dest);
 void ExtractAffectedKeys(const CKeyStore &keystore, const CScript& scriptPubKey, std::vector<CKeyID> &vKeys);
 bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet);
 bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<CTxDestination>& addressRet, int& nRequiredRet);
-bool SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
-bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
-bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType);
-bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType);
+bool SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL, CSignatureHasher* pSigHasher = NULL);
+bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL, CSignatureHasher* pSigHasher = NULL);
+bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, CSignatureHasher* pSigHasher = NULL);
+bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, CSignatureHasher* pSigHasher = NULL);
 
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 
@@ -998,7 +1143,29 @@ CScript GetScriptForMultisig(int nRequired, const std::vector<CPubKey>& keys);
 
 bool Solver(const CKeyStore& keystore, const CScript& scriptPubKey, uint256 hash, int nHashType,
                   CScript& scriptSigRet, txnouttype& whichTypeRet);
-//uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+
+/** Signature hashes of the inputs of one transaction. For SIGHASH_ALL the
+ *  hash state after each blanked out input and the serialized inputs and
+ *  outputs that follow it are computed once, so signing or verifying every
+ *  input of a large transaction does not copy or reserialize it for each one.
+ *  Only the scriptSigs of txTo may change while the hasher is in use.
+ */
+class CSignatureHasher
+{
+private:
+    const CTransaction& txTo;
+    bool fPrecomputed;
+    std::vector<CHashWriter> vMidstate;       // after the inputs before input i
+    std::vector<unsigned char> vchTail;       // blanked inputs, outputs, nLockTime
+    std::vector<unsigned int> vTailPos;       // where input i starts in vchTail
+
+    void Precompute();
+
+public:
+    explicit CSignatureHasher(const CTransaction& txToIn) : txTo(txToIn), fPrecomputed(false) {}
+    uint256 SignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType);
+};
 
 
 class BaseSignatureChecker
@@ -1017,12 +1184,13 @@ class SignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction& txTo;
     unsigned int nIn;
+    CSignatureHasher* pSigHasher;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    SignatureChecker(const CTransaction& txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    SignatureChecker(const CTransaction& txToIn, unsigned int nInIn, CSignatureHasher* pSigHasherIn = NULL) : txTo(txToIn), nIn(nInIn), pSigHasher(pSigHasherIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
 };
 
@@ -20,6 +20,7 @@
 #include <boost/tuple/tuple.hpp>
 
 #include "allocators.h"
+#include "prevector.h"
 #include "version.h"
 
 class CAutoFile;
@@ -450,7 +451,12 @@ template<typename Stream, typename T, typename A> void Unserialize_impl(Stream&
 template<typename Stream, typename T, typename A> void Unserialize_impl(Stream& is, std::vector<T, A>& v, int nType, int nVersion, const boost::false_type&);
 template<typename Stream, typename T, typename A> inline void Unserialize(Stream& is, std::vector<T, A>& v, int nType, int nVersion);
 
-// others derived from vector
+// prevector
+template<unsigned int N, typename T> inline unsigned int GetSerializeSize(const prevector<N, T>& v, int nType, int nVersion);
+template<typename Stream, unsigned int N, typename T> void Serialize(Stream& os, const prevector<N, T>& v, int nType, int nVersion);
+template<typename Stream, unsigned int N, typename T> void Unserialize(Stream& is, prevector<N, T>& v, int nType, int nVersion);
+
+// CScript, derived from prevector
 extern inline unsigned int GetSerializeSize(const CScript& v, int nType, int nVersion);
 template<typename Stream> void Serialize(Stream& os, const CScript& v, int nType, int nVersion);
 template<typename Stream> void Unserialize(Stream& is, CScript& v, int nType, int nVersion);
@@ -631,25 +637,40 @@ inline void Unserialize(Stream& is, std::vector<T, A>& v, int nType, int nVersio
 
 
 //
-// others derived from vector
+// prevector, of fundamental types only, serialized as a vector
 //
-inline unsigned int GetSerializeSize(const CScript& v, int nType, int nVersion)
+template<unsigned int N, typename T>
+inline unsigned int GetSerializeSize(const prevector<N, T>& v, int nType, int nVersion)
 {
-    return GetSerializeSize((const std::vector<unsigned char>&)v, nType, nVersion);
+    return GetSizeOfCompactSize(v.size()) + v.size() * sizeof(T);
 }
 
-template<typename Stream>
-void Serialize(Stream& os, const CScript& v, int nType, int nVersion)
+template<typename Stream, unsigned int N, typename T>
+void Serialize(Stream& os, const prevector<N, T>& v, int nType, int nVersion)
 {
-    Serialize(os, (const std::vector<unsigned char>&)v, nType, nVersion);
+    WriteCompactSize(os, v.size());
+    if (!v.empty())
+        os.write((char*)&v[0], v.size() * sizeof(T));
 }
 
-template<typename Stream>
-void Unserialize(Stream& is, CScript& v, int nType, int nVersion)
+template<typename Stream, unsigned int N, typename T>
+void Unserialize(Stream& is, prevector<N, T>& v, int nType, int nVersion)
 {
-    Unserialize(is, (std::vector<unsigned char>&)v, nType, nVersion);
+    // Limit size per read so bogus size value won't cause out of memory
+    v.clear();
+    unsigned int nSize = ReadCompactSize(is);
+    unsigned int i = 0;
+    while (i < nSize)
+    {
+        unsigned int blk = std::min(nSize - i, (unsigned int)(1 + 4999999 / sizeof(T)));
+        v.resize(i + blk);
+        is.read((char*)&v[i], blk * sizeof(T));
+        i += blk;
+    }
 }
 
+// CScript, derived from prevector, is defined in script.h
+
 
 
 //
@@ -14,6 +14,7 @@
 #include "protocol.h"
 #include "spork.h"
 #include "mainfunctions.h"
+#include <boost/atomic.hpp>
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -27,6 +28,63 @@ CSporkManager sporkManager;
 std::map<uint256, CSporkMessage> mapSporks;
 std::map<int, CSporkMessage> mapSporksActive;
 
+// Values sporks take until the network tells us otherwise, by ID - SPORK_START; -1 is unknown
+static const int64_t nSporkDefaults[SPORK_END - SPORK_START + 1] = {
+    SPORK_1_MASTERNODE_PAYMENTS_ENFORCEMENT_DEFAULT,
+    SPORK_2_INSTANTX_DEFAULT,
+    SPORK_3_INSTANTX_BLOCK_FILTERING_DEFAULT,
+    -1,
+    SPORK_5_MAX_VALUE_DEFAULT,
+    SPORK_6_REPLAY_BLOCKS_DEFAULT,
+    SPORK_7_MASTERNODE_SCANNING, // its ID doubles as its default: active
+    SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT,
+    SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT,
+    SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT,
+    SPORK_11_RESET_BUDGET_DEFAULT,
+    SPORK_12_RECONSIDER_BLOCKS_DEFAULT,
+    SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT,
+};
+
+// Current value and activation flag of every spork, read without locks by
+// IsSporkActive/GetSporkValue. The flags only change when a spork message
+// arrives or the earliest pending activation time (nNextSporkChange) passes.
+// They are computed on first use, not at static initialization, when
+// cs_sporkflags and the clock may not be usable yet.
+static CCriticalSection cs_sporkflags;
+static boost::atomic<int64_t> nSporkValues[SPORK_END - SPORK_START + 1];
+static boost::atomic<bool> fSporkActive[SPORK_END - SPORK_START + 1];
+static boost::atomic<int64_t> nNextSporkChange;
+static boost::atomic<bool> fSporkFlagsReady;
+
+// Called with cs_sporkflags held
+static void LoadSporkDefaults()
+{
+    static bool fLoaded = false;
+    if (fLoaded) return;
+    for (int i = 0; i <= SPORK_END - SPORK_START; i++)
+        nSporkValues[i] = nSporkDefaults[i];
+    fLoaded = true;
+}
+
+static void UpdateSporkFlags()
+{
+    LOCK(cs_sporkflags);
+    LoadSporkDefaults();
+
+    int64_t nNow = GetTime();
+    int64_t nNext = std::numeric_limits<int64_t>::max();
+    for (int i = 0; i <= SPORK_END - SPORK_START; i++)
+    {
+        int64_t nValue = nSporkValues[i];
+        if (nValue == -1) nValue = 4070908800; //2099-1-1
+        fSporkActive[i] = nValue < nNow;
+        if (nValue >= nNow && nValue < nNext)
+            nNext = nValue;
+    }
+    nNextSporkChange = nNext;
+    fSporkFlagsReady = true;
+}
+
 void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if(fLiteMode) return; //disable all darksend/masternode related functionality
@@ -59,7 +117,7 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
         }
 
         mapSporks[hash] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        SetSporkActive(spork);
         sporkManager.Relay(spork);
 
         //does a task if needed
@@ -77,59 +135,45 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 
 }
 
+void SetSporkActive(const CSporkMessage& spork)
+{
+    mapSporksActive[spork.nSporkID] = spork;
+
+    LOCK(cs_sporkflags);
+    LoadSporkDefaults();
+    if (spork.nSporkID >= SPORK_START && spork.nSporkID <= SPORK_END)
+        nSporkValues[spork.nSporkID - SPORK_START] = spork.nValue;
+    UpdateSporkFlags();
+}
+
+void CheckSporkSchedule()
+{
+    if (GetTime() >= nNextSporkChange)
+        UpdateSporkFlags();
+}
+
 // grab the spork, otherwise say it's off
 bool IsSporkActive(int nSporkID)
 {
-    int64_t r = -1;
-
-    if(mapSporksActive.count(nSporkID)){
-        r = mapSporksActive[nSporkID].nValue;
-    } else {
-        if(nSporkID == SPORK_1_MASTERNODE_PAYMENTS_ENFORCEMENT) r = SPORK_1_MASTERNODE_PAYMENTS_ENFORCEMENT_DEFAULT;
-        if(nSporkID == SPORK_2_INSTANTX) r = SPORK_2_INSTANTX_DEFAULT;
-        if(nSporkID == SPORK_3_INSTANTX_BLOCK_FILTERING) r = SPORK_3_INSTANTX_BLOCK_FILTERING_DEFAULT;
-        if(nSporkID == SPORK_5_MAX_VALUE) r = SPORK_5_MAX_VALUE_DEFAULT;
-        if(nSporkID == SPORK_6_REPLAY_BLOCKS) r = SPORK_6_REPLAY_BLOCKS_DEFAULT;
-        if(nSporkID == SPORK_7_MASTERNODE_SCANNING) r = SPORK_7_MASTERNODE_SCANNING;
-        if(nSporkID == SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) r = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
-        if(nSporkID == SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT) r = SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT;
-        if(nSporkID == SPORK_10_MASTERNODE_PAY_UPDATED_NODES) r = SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT;
-        if(nSporkID == SPORK_11_RESET_BUDGET) r = SPORK_11_RESET_BUDGET_DEFAULT;
-        if(nSporkID == SPORK_12_RECONSIDER_BLOCKS) r = SPORK_12_RECONSIDER_BLOCKS_DEFAULT;
-        if(nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) r = SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
-
-        if(r == -1) LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
+    if (nSporkID < SPORK_START || nSporkID > SPORK_END) {
+        LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
+        return false;
     }
-    if(r == -1) r = 4070908800; //return 2099-1-1 by default
 
-    return r < GetTime();
+    if (!fSporkFlagsReady) UpdateSporkFlags();
+    return fSporkActive[nSporkID - SPORK_START];
 }
 
 // grab the value of the spork on the network, or the default
 int64_t GetSporkValue(int nSporkID)
 {
-    int64_t r = -1;
-
-    if(mapSporksActive.count(nSporkID)){
-        r = mapSporksActive[nSporkID].nValue;
-    } else {
-        if(nSporkID == SPORK_1_MASTERNODE_PAYMENTS_ENFORCEMENT) r = SPORK_1_MASTERNODE_PAYMENTS_ENFORCEMENT_DEFAULT;
-        if(nSporkID == SPORK_2_INSTANTX) r = SPORK_2_INSTANTX_DEFAULT;
-        if(nSporkID == SPORK_3_INSTANTX_BLOCK_FILTERING) r = SPORK_3_INSTANTX_BLOCK_FILTERING_DEFAULT;
-        if(nSporkID == SPORK_5_MAX_VALUE) r = SPORK_5_MAX_VALUE_DEFAULT;
-        if(nSporkID == SPORK_6_REPLAY_BLOCKS) r = SPORK_6_REPLAY_BLOCKS_DEFAULT;
-        if(nSporkID == SPORK_7_MASTERNODE_SCANNING) r = SPORK_7_MASTERNODE_SCANNING;
-        if(nSporkID == SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) r = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
-        if(nSporkID == SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT) r = SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT;
-        if(nSporkID == SPORK_10_MASTERNODE_PAY_UPDATED_NODES) r = SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT;
-        if(nSporkID == SPORK_11_RESET_BUDGET) r = SPORK_11_RESET_BUDGET_DEFAULT;
-        if(nSporkID == SPORK_12_RECONSIDER_BLOCKS) r = SPORK_12_RECONSIDER_BLOCKS_DEFAULT;
-        if(nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) r = SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
-
-        if(r == -1) LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
+    if (nSporkID < SPORK_START || nSporkID > SPORK_END) {
+        LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
+        return -1;
     }
 
-    return r;
+    if (!fSporkFlagsReady) UpdateSporkFlags();
+    return nSporkValues[nSporkID - SPORK_START];
 }
 
 void ExecuteSpork(int nSporkID, int nValue)
@@ -220,7 +264,7 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue)
     if(Sign(msg)){
         Relay(msg);
         mapSporks[msg.GetHash()] = msg;
-        mapSporksActive[nSporkID] = msg;
+        SetSporkActive(msg);
         return true;
     }
 
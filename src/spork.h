@@ -33,6 +33,9 @@ using namespace boost;
 #define SPORK_12_RECONSIDER_BLOCKS                            10011
 #define SPORK_13_ENABLE_SUPERBLOCKS                           10012
 
+#define SPORK_START                                           SPORK_1_MASTERNODE_PAYMENTS_ENFORCEMENT
+#define SPORK_END                                             SPORK_13_ENABLE_SUPERBLOCKS
+
 #define SPORK_1_MASTERNODE_PAYMENTS_ENFORCEMENT_DEFAULT       2428537599  //2018-12-30 23:59:59 GMT // NOT USED
 #define SPORK_2_INSTANTX_DEFAULT                              978307200   //2018-1-1 23:59:59 GMT
 #define SPORK_3_INSTANTX_BLOCK_FILTERING_DEFAULT              978307200   //2018-1-1 23:59:59 GMT
@@ -67,6 +70,11 @@ extern CSporkManager sporkManager;
 void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 int64_t GetSporkValue(int nSporkID);
 bool IsSporkActive(int nSporkID);
+// Take a verified spork message as the network's setting
+void SetSporkActive(const CSporkMessage& spork);
+// Recompute the activation flags if a spork's activation time has passed since;
+// run every second by the "sporks" thread and on every new best block
+void CheckSporkSchedule();
 void ExecuteSpork(int nSporkID, int nValue);
 //void ReprocessBlocks(int nBlocks);
 
@@ -14,21 +14,17 @@ BOOST_AUTO_TEST_SUITE(Checkpoints_tests)
 
 BOOST_AUTO_TEST_CASE(sanity)
 {
-    uint256 p11111 = uint256("0x0000000069e244f73d78e8fd29ba2fd2ed618bd6fa2ee92559f542fdb26e7c1d");
-    uint256 p134444 = uint256("0x00000000000005b12ffd4cd315cd34ffd4a594f430ac814c91184a0d42d2b0fe");
-    BOOST_CHECK(Checkpoints::CheckBlock(11111, p11111));
-    BOOST_CHECK(Checkpoints::CheckBlock(134444, p134444));
+    uint256 pGenesis = uint256("0x00004cd62c655e1492e4d87736f23fdd6ad260980007b72bc33373aed2b79258");
+    uint256 pOther = uint256("0x00000f06f6a899218ad9709372ffda0dddbe54a024f7d8356cd23eb6921d6b01");
+    BOOST_CHECK(Checkpoints::CheckHardened(0, pGenesis));
 
-    
     // Wrong hashes at checkpoints should fail:
-    BOOST_CHECK(!Checkpoints::CheckBlock(11111, p134444));
-    BOOST_CHECK(!Checkpoints::CheckBlock(134444, p11111));
+    BOOST_CHECK(!Checkpoints::CheckHardened(0, pOther));
 
     // ... but any hash not at a checkpoint should succeed:
-    BOOST_CHECK(Checkpoints::CheckBlock(11111+1, p134444));
-    BOOST_CHECK(Checkpoints::CheckBlock(134444+1, p11111));
+    BOOST_CHECK(Checkpoints::CheckHardened(0+1, pOther));
 
-    BOOST_CHECK(Checkpoints::GetTotalBlocksEstimate() >= 134444);
-}    
+    BOOST_CHECK(Checkpoints::GetTotalBlocksEstimate() >= 0);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
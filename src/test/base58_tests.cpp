@@ -6,8 +6,30 @@
 #include "base58.h"
 #include "util.h"
 
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
 using namespace json_spirit;
-extern Array read_json(const std::string& filename);
+
+// The vectors in test/data, found from the source directory or where the build put them
+static Array read_json(const std::string& filename)
+{
+    boost::filesystem::path testFile = boost::filesystem::current_path() / "test" / "data" / filename;
+#ifdef TEST_DATA_DIR
+    if (!boost::filesystem::exists(testFile))
+        testFile = boost::filesystem::path(BOOST_PP_STRINGIZE(TEST_DATA_DIR)) / filename;
+#endif
+    std::ifstream ifs(testFile.string().c_str(), std::ifstream::in);
+    Value v;
+    if (!read_stream(ifs, v))
+    {
+        BOOST_ERROR("Cannot open test data " << testFile.string());
+        return Array();
+    }
+    return v.get_array();
+}
 
 BOOST_AUTO_TEST_SUITE(base58_tests)
 
@@ -76,6 +98,10 @@ public:
     {
         return (exp_addrType == "none");
     }
+    bool operator()(const CStealthAddress &sxAddr) const
+    {
+        return false;
+    }
 };
 
 // Visitor to check address payload
@@ -99,6 +125,10 @@ public:
     {
         return exp_payload.size() == 0;
     }
+    bool operator()(const CStealthAddress &sxAddr) const
+    {
+        return false;
+    }
 };
 
 // Goal: check that parsed keys match test payload
@@ -215,7 +245,7 @@ BOOST_AUTO_TEST_CASE(base58_keys_valid_gen)
                 continue;
             }
             CAdvantagecoinAddress addrOut;
-            BOOST_CHECK_MESSAGE(boost::apply_visitor(CAdvantagecoinAddressVisitor(&addrOut), dest), "encode dest: " + strTest);
+            BOOST_CHECK_MESSAGE(addrOut.Set(dest), "encode dest: " + strTest);
             BOOST_CHECK_MESSAGE(addrOut.ToString() == exp_base58string, "mismatch: " + strTest);
         }
     }
@@ -223,7 +253,7 @@ BOOST_AUTO_TEST_CASE(base58_keys_valid_gen)
     // Visiting a CNoDestination must fail
     CAdvantagecoinAddress dummyAddr;
     CTxDestination nodest = CNoDestination();
-    BOOST_CHECK(!boost::apply_visitor(CAdvantagecoinAddressVisitor(&dummyAddr), nodest));
+    BOOST_CHECK(!dummyAddr.Set(nodest));
 
     SelectParams(CChainParams::MAIN);
 }
@@ -255,6 +285,72 @@ BOOST_AUTO_TEST_CASE(base58_keys_invalid)
     }
 }
 
+// Goal: random byte strings survive a base58 and base58check round trip,
+// including leading zero bytes and the long strings stealth addresses need
+BOOST_AUTO_TEST_CASE(base58_roundtrip)
+{
+    std::vector<unsigned char> result;
+    for (int i = 0; i < 1000; i++)
+    {
+        std::vector<unsigned char> data(insecure_rand() % 150);
+        for (unsigned int j = 0; j < data.size(); j++)
+            data[j] = (j < (unsigned int)(i % 4)) ? 0 : insecure_rand();
+
+        std::string str = EncodeBase58(data);
+        BOOST_CHECK(DecodeBase58(str, result));
+        BOOST_CHECK(result == data);
+
+        str = EncodeBase58Check(data);
+        BOOST_CHECK(DecodeBase58Check(str, result));
+        BOOST_CHECK(result == data);
+
+        // A flipped character never passes the checksum
+        str[str.size() / 2] = (str[str.size() / 2] == 'z') ? 'y' : 'z';
+        BOOST_CHECK(!DecodeBase58Check(str, result));
+    }
+
+    BOOST_CHECK(DecodeBase58("  1112  ", result));
+    BOOST_CHECK(result.size() == 4 && result[3] == 1);
+    BOOST_CHECK(!DecodeBase58("11O2", result));
+    BOOST_CHECK(!DecodeBase58("12 3", result));
+}
+
+// Goal: cached address encodings match the uncached ones, also after the
+// cache rolled over
+BOOST_AUTO_TEST_CASE(base58_address_cache)
+{
+    std::vector<CKeyID> vKeyID;
+    for (int i = 0; i < 10000; i++)
+    {
+        uint160 id;
+        for (unsigned int j = 0; j < id.size(); j++)
+            *(id.begin() + j) = insecure_rand();
+        vKeyID.push_back(CKeyID(id));
+    }
+
+    for (int nPass = 0; nPass < 2; nPass++)
+    {
+        BOOST_FOREACH(const CKeyID& keyID, vKeyID)
+        {
+            CAdvantagecoinAddress addr(keyID);
+            std::string str = addr.ToString();
+            BOOST_CHECK_EQUAL(str, addr.CBase58Data::ToString());
+            CKeyID keyIDRet;
+            BOOST_CHECK(CAdvantagecoinAddress(str).GetKeyID(keyIDRet) && keyIDRet == keyID);
+        }
+    }
+
+    // Same payload, different version: never served from the other's entry
+    CAdvantagecoinAddress addrKey(vKeyID[0]);
+    CAdvantagecoinAddress addrScript = CAdvantagecoinAddress(CScriptID(vKeyID[0]));
+    BOOST_CHECK(addrKey.ToString() != addrScript.ToString());
+    BOOST_CHECK(CAdvantagecoinAddress(addrScript.ToString()).IsScript());
+
+    size_t nEntries;
+    uint64_t nHits, nMisses;
+    CAdvantagecoinAddress::GetCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK(nEntries > 0 && nEntries <= 8192);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -0,0 +1,122 @@
+#include <boost/test/unit_test.hpp>
+
+#include "mainfunctions.h"
+#include "util.h"
+
+#include <algorithm>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(block_tests)
+
+// The merkle tree as it was built before it was split into chunks: one
+// level after the other, on one thread
+static uint256 NaiveMerkleTree(const vector<uint256>& vLeaves, vector<uint256>& vTree)
+{
+    vTree = vLeaves;
+    int j = 0;
+    for (int nSize = vLeaves.size(); nSize > 1; nSize = (nSize + 1) / 2)
+    {
+        for (int i = 0; i < nSize; i += 2)
+        {
+            int i2 = std::min(i + 1, nSize - 1);
+            vTree.push_back(Hash(BEGIN(vTree[j + i]), END(vTree[j + i]),
+                                 BEGIN(vTree[j + i2]), END(vTree[j + i2])));
+        }
+        j += nSize;
+    }
+    return (vTree.empty() ? 0 : vTree.back());
+}
+
+BOOST_AUTO_TEST_CASE(merkle_tree_chunked)
+{
+    static const size_t nSizes[] = {0, 1, 2, 255, 256, 257, 1023, 1024, 1025, 2049, 5003};
+    for (unsigned int n = 0; n < sizeof(nSizes) / sizeof(nSizes[0]); n++)
+    {
+        vector<uint256> vLeaves;
+        for (size_t i = 0; i < nSizes[n]; i++)
+            vLeaves.push_back(Hash(BEGIN(i), END(i)));
+
+        vector<uint256> vExpected;
+        uint256 hashExpected = NaiveMerkleTree(vLeaves, vExpected);
+
+        CBlock block;
+        uint256 hashRoot = block.BuildMerkleTree(vLeaves);
+        BOOST_CHECK_MESSAGE(hashRoot == hashExpected, "root differs for " << nSizes[n] << " leaves");
+        BOOST_CHECK_MESSAGE(block.vMerkleTree == vExpected, "tree differs for " << nSizes[n] << " leaves");
+    }
+}
+
+// A proof-of-work block of nTx transactions that pass CheckTransaction
+static CBlock TestBlock(unsigned int nTx)
+{
+    CBlock block;
+    block.nTime = GetAdjustedTime();
+    block.nBits = 0x1e0fffff;
+    for (unsigned int i = 0; i < nTx; i++)
+    {
+        CTransaction tx;
+        tx.nTime = block.nTime - 60;
+        tx.vin.resize(1);
+        if (i == 0)
+            tx.vin[0].scriptSig = CScript() << OP_1 << OP_0;
+        else
+        {
+            tx.vin[0].prevout = COutPoint(Hash(BEGIN(i), END(i)), 0);
+            tx.vin[0].scriptSig = CScript() << OP_TRUE;
+        }
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * CREDIT;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        block.vtx.push_back(tx);
+    }
+    return block;
+}
+
+// Break transaction nBad, add a later one from the future and make two
+// transactions before them the same, then check the block's transactions
+// one by one in block order and return the DoS score of the first failure
+static int SpoilTestBlock(CBlock& block, unsigned int nBad)
+{
+    block.vtx[nBad].vin.clear();
+    block.vtx[nBad + 1].nTime = block.nTime + 60;
+    block.vtx[2] = block.vtx[1];
+    block.hashMerkleRoot = block.BuildMerkleTree();
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        CTransaction tx(block.vtx[i]);
+        tx.nDoS = 0;
+        if (!tx.CheckTransaction())
+            return tx.nDoS;
+        if (block.GetBlockTime() < (int64_t)tx.nTime)
+            return 50;
+    }
+    return 100;
+}
+
+BOOST_AUTO_TEST_CASE(checkblock_first_error)
+{
+    // Checked one by one, and on several threads past the threshold
+    static const unsigned int nSizes[] = {MIN_PARALLEL_CHECK_TRANSACTIONS / 2, MIN_PARALLEL_CHECK_TRANSACTIONS * 4};
+    for (unsigned int n = 0; n < sizeof(nSizes) / sizeof(nSizes[0]); n++)
+    {
+        // The invalid transaction is found before the one from the future
+        // and the duplicate, wherever the threads are when they fail
+        CBlock block = TestBlock(nSizes[n]);
+        int nDoSExpected = SpoilTestBlock(block, nSizes[n] - 3);
+        BOOST_CHECK_EQUAL(nDoSExpected, 10);
+        BOOST_CHECK(!block.CheckBlock(false, true, false));
+        BOOST_CHECK_EQUAL(block.nDoS, nDoSExpected);
+
+        // Failing the time check first reports that instead
+        CBlock blockTime = TestBlock(nSizes[n]);
+        blockTime.vtx[3].nTime = blockTime.nTime + 60;
+        nDoSExpected = SpoilTestBlock(blockTime, nSizes[n] - 3);
+        BOOST_CHECK_EQUAL(nDoSExpected, 50);
+        BOOST_CHECK(!blockTime.CheckBlock(false, true, false));
+        BOOST_CHECK_EQUAL(blockTime.nDoS, nDoSExpected);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+#include <boost/test/unit_test.hpp>
+
+#include "blockcache.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(blockcache_tests)
+
+static CTransactionRef TestTransaction(int n)
+{
+    CTransaction tx;
+    tx.nTime = 1500000000;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(uint256(n + 1), n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = n;
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return MakeTransactionRef(tx);
+}
+
+static CBlockRef TestBlock(int nTx)
+{
+    CBlock* pblock = new CBlock();
+    pblock->nTime = 1500000000;
+    pblock->nBits = 0x1d00ffff;
+    for (int i = 0; i < nTx; i++)
+        pblock->vtx.push_back(*TestTransaction(i));
+    return CBlockRef(pblock);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lookup)
+{
+    CBlockCache cache(1 << 20);
+    CBlockCacheStats stats;
+    CBlockRef pblock;
+    CTransactionRef ptx;
+    uint256 hashBlock;
+
+    BOOST_CHECK(!cache.GetBlock(1, 100, false, pblock));
+    cache.AddBlock(1, 100, TestBlock(10));
+    BOOST_CHECK(cache.GetBlock(1, 100, false, pblock));
+    BOOST_CHECK_EQUAL(pblock->vtx.size(), 10U);
+    BOOST_CHECK(cache.GetBlock(1, 100, true, pblock));
+
+    // A header answers header lookups only, and does not replace a full block
+    CBlockRef pheader(new CBlock());
+    cache.AddBlock(1, 500, pheader);
+    BOOST_CHECK(cache.GetBlock(1, 500, true, pblock));
+    BOOST_CHECK(!cache.GetBlock(1, 500, false, pblock));
+    cache.AddBlock(1, 100, pheader);
+    BOOST_CHECK(cache.GetBlock(1, 100, false, pblock));
+
+    // Transactions are found by position, and by hash once their block is known
+    CTransactionRef ptx1 = TestTransaction(1), ptx2 = TestTransaction(2);
+    cache.AddTransaction(CDiskTxPos(1, 100, 190), ptx1);
+    cache.AddTransaction(CDiskTxPos(1, 100, 290), ptx2, uint256(7), cache.GetEpoch());
+    BOOST_CHECK(cache.GetTransaction(CDiskTxPos(1, 100, 190), ptx));
+    BOOST_CHECK(ptx == ptx1);
+    BOOST_CHECK(!cache.GetTransaction(ptx1->GetHash(), ptx, hashBlock));
+    BOOST_CHECK(cache.GetTransaction(ptx2->GetHash(), ptx, hashBlock));
+    BOOST_CHECK(ptx == ptx2);
+    BOOST_CHECK(hashBlock == uint256(7));
+
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nBlocks, 1U);
+    BOOST_CHECK_EQUAL(stats.nHeaders, 1U);
+    BOOST_CHECK_EQUAL(stats.nTransactions, 2U);
+    BOOST_CHECK_EQUAL(stats.nHits, 6U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 3U);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_reorg)
+{
+    CBlockCache cache(1 << 20);
+    CBlockRef pblock;
+    CTransactionRef ptx;
+    uint256 hashBlock;
+
+    cache.AddBlock(1, 100, TestBlock(2));
+    cache.AddBlock(1, 900, TestBlock(2));
+    CTransactionRef ptx1 = TestTransaction(1), ptx2 = TestTransaction(2);
+    cache.AddTransaction(CDiskTxPos(1, 100, 190), ptx1, uint256(7), cache.GetEpoch());
+    cache.AddTransaction(CDiskTxPos(1, 900, 990), ptx2, uint256(8), cache.GetEpoch());
+
+    // Disconnecting the first block drops it and its transactions only
+    uint64_t nEpoch = cache.GetEpoch();
+    cache.EraseBlock(1, 100);
+    BOOST_CHECK(!cache.GetBlock(1, 100, true, pblock));
+    BOOST_CHECK(!cache.GetTransaction(CDiskTxPos(1, 100, 190), ptx));
+    BOOST_CHECK(!cache.GetTransaction(ptx1->GetHash(), ptx, hashBlock));
+    BOOST_CHECK(cache.GetBlock(1, 900, false, pblock));
+    BOOST_CHECK(cache.GetTransaction(ptx2->GetHash(), ptx, hashBlock));
+
+    // A lookup that started before it cannot index its result by hash
+    cache.AddTransaction(CDiskTxPos(1, 100, 190), ptx1, uint256(7), nEpoch);
+    BOOST_CHECK(cache.GetTransaction(CDiskTxPos(1, 100, 190), ptx));
+    BOOST_CHECK(!cache.GetTransaction(ptx1->GetHash(), ptx, hashBlock));
+
+    CBlockCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nInvalidated, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_usage)
+{
+    CBlockRef pblockSmall = TestBlock(10);
+    size_t nBlockUsage = BlockUsage(*pblockSmall);
+    BOOST_CHECK(nBlockUsage > 10 * TransactionUsage(*TestTransaction(0)));
+
+    CBlockCache cache(10 * nBlockUsage);
+    CBlockRef pblock;
+    for (unsigned int i = 0; i < 20; i++)
+        cache.AddBlock(1, 1000 * (i + 1), TestBlock(10));
+
+    // Least recently used first out
+    CBlockCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK(stats.nUsage <= stats.nMaxUsage);
+    BOOST_CHECK(stats.nBlocks >= 5 && stats.nBlocks < 10);
+    BOOST_CHECK_EQUAL(stats.nEvicted, 20 - stats.nBlocks);
+    BOOST_CHECK(!cache.GetBlock(1, 1000, false, pblock));
+    BOOST_CHECK(cache.GetBlock(1, 20000, false, pblock));
+
+    unsigned int nOldest = 20 - stats.nBlocks + 1;
+    BOOST_CHECK(cache.GetBlock(1, 1000 * nOldest, false, pblock));
+    cache.AddBlock(1, 50000, TestBlock(10));
+    BOOST_CHECK(cache.GetBlock(1, 1000 * nOldest, false, pblock));
+    BOOST_CHECK(!cache.GetBlock(1, 1000 * (nOldest + 1), false, pblock));
+
+    // A block larger than the whole budget is not kept
+    cache.AddBlock(1, 60000, TestBlock(200));
+    BOOST_CHECK(!cache.GetBlock(1, 60000, false, pblock));
+
+    cache.SetMaxUsage(0);
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nBlocks, 0U);
+    BOOST_CHECK_EQUAL(stats.nUsage, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,147 @@
+#include <boost/test/unit_test.hpp>
+
+#include "blockfilter.h"
+#include "hash.h"
+#include "mainfunctions.h"
+#include "util.h"
+
+using namespace std;
+
+static BlockFilterElement RandomElement()
+{
+    uint256 hash = GetRandHash();
+    CScript script = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(hash.begin(), hash.begin() + 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return BlockFilterElement(script.begin(), script.end());
+}
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+BOOST_AUTO_TEST_CASE(siphash)
+{
+    // Reference vectors of SipHash-2-4 with the key 00 01 .. 0f
+    const uint64_t k0 = 0x0706050403020100ULL, k1 = 0x0F0E0D0C0B0A0908ULL;
+    unsigned char data[15];
+    for (int i = 0; i < 15; i++)
+        data[i] = i;
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, data, 0), 0x726fdb47dd0e0e31ULL);
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, data, 1), 0x74f839c593dc67fdULL);
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, data, 8), 0x93f5f5799a932462ULL);
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, data, 15), 0xa129ca6149be45e5ULL);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_match)
+{
+    uint256 hashBlock = GetRandHash();
+    BlockFilterElements elements;
+    for (int i = 0; i < 1000; i++)
+        elements.insert(RandomElement());
+    CBlockFilter filter(hashBlock, elements);
+    BOOST_CHECK_EQUAL(filter.GetElementCount(), 1000U);
+
+    // Round trip through the database format
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << filter;
+    CBlockFilter filter2;
+    ss >> filter2;
+    BOOST_CHECK(filter2.GetBlockHash() == hashBlock);
+
+    BOOST_FOREACH(const BlockFilterElement& element, elements)
+        BOOST_CHECK(filter2.Match(element));
+
+    // About one false positive in BLOCK_FILTER_M queries
+    int nFalsePositives = 0;
+    BlockFilterElements queries;
+    for (int i = 0; i < 100000; i++)
+    {
+        BlockFilterElement element = RandomElement();
+        if (filter2.Match(element))
+            nFalsePositives++;
+        if (i < 1000)
+            queries.insert(element);
+    }
+    BOOST_CHECK(nFalsePositives <= 5);
+
+    // A batch query matches if any element does
+    if (!filter2.MatchAny(queries))
+    {
+        queries.insert(*elements.rbegin());
+        BOOST_CHECK(filter2.MatchAny(queries));
+    }
+
+    // Different blocks hash the same scripts differently
+    CBlockFilter filterOther(GetRandHash(), elements);
+    BOOST_CHECK(filterOther.MatchAny(elements));
+    BOOST_CHECK(!CBlockFilter(hashBlock, BlockFilterElements()).MatchAny(elements));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_elements)
+{
+    CBlock block;
+    block.vtx.resize(2);
+    block.vtx[0].vout.resize(1);
+    block.vtx[1].vout.resize(4);
+    block.vtx[1].vout[0].scriptPubKey = CScript() << OP_RETURN << vector<unsigned char>(33, 0x02);
+    BlockFilterElement element = RandomElement();
+    block.vtx[1].vout[1].scriptPubKey = CScript(element.begin(), element.end());
+    vector<unsigned char> vchKey1(33, 0x02), vchKey2(33, 0x03);
+    block.vtx[1].vout[3].scriptPubKey = CScript() << OP_1 << vchKey1 << vchKey2 << OP_2 << OP_CHECKMULTISIG;
+    BlockFilterElement spent = RandomElement();
+
+    BlockFilterElements elements;
+    GetBlockFilterElements(block, vector<CScript>(1, CScript(spent.begin(), spent.end())), elements);
+
+    // Empty outputs are left out, OP_RETURN outputs all give the same element
+    // and bare multisig outputs add their keys
+    BOOST_CHECK_EQUAL(elements.size(), 6U);
+    BOOST_CHECK(elements.count(element));
+    BOOST_CHECK(elements.count(vchKey1));
+    BOOST_CHECK(elements.count(vchKey2));
+    BOOST_CHECK(elements.count(spent));
+    BOOST_CHECK(elements.count(BlockFilterStealthElement()));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_rescan)
+{
+    // Blocks of which few pay the wallet: the ones whose filter matches
+    // hold every payment, and few others do
+    const int nBlocks = 500;
+    BlockFilterElements wallet;
+    for (int i = 0; i < 50; i++)
+        wallet.insert(RandomElement());
+
+    int nPaying = 0, nMatched = 0;
+    for (int n = 0; n < nBlocks; n++)
+    {
+        CBlock block;
+        block.vtx.resize(50);
+        BOOST_FOREACH(CTransaction& tx, block.vtx)
+        {
+            tx.vin.resize(1);
+            tx.vin[0].prevout.hash = GetRandHash();
+            tx.vout.resize(2);
+            for (int i = 0; i < 2; i++)
+            {
+                BlockFilterElement element = RandomElement();
+                tx.vout[i].scriptPubKey = CScript(element.begin(), element.end());
+            }
+        }
+        bool fPays = n % 25 == 0;
+        if (fPays)
+        {
+            const BlockFilterElement& element = *wallet.begin();
+            block.vtx[n % 50].vout[0].scriptPubKey = CScript(element.begin(), element.end());
+            nPaying++;
+        }
+
+        BlockFilterElements elements;
+        GetBlockFilterElements(block, vector<CScript>(), elements);
+        bool fMatch = CBlockFilter(block.GetHash(), elements).MatchAny(wallet);
+        if (fPays)
+            BOOST_CHECK(fMatch);
+        if (fMatch)
+            nMatched++;
+    }
+    BOOST_CHECK(nMatched >= nPaying && nMatched < 2 * nPaying);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,100 @@
+#include <boost/test/unit_test.hpp>
+
+#include "boundedmap.h"
+#include "hash.h"
+#include "uint256.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(boundedmap_tests)
+
+BOOST_AUTO_TEST_CASE(boundedmap_size)
+{
+    boundedmap<int, int> map(100);
+    for (int i = 0; i < 1000; i++)
+        map.insert(make_pair(i, i));
+    BOOST_CHECK_EQUAL(map.size(), 100U);
+    BOOST_CHECK(map.count(999));
+    BOOST_CHECK(!map.count(899));
+    BOOST_CHECK_EQUAL(map.oldest()->first, 900);
+    BOOST_CHECK_EQUAL(map.GetInfo("test").nEvicted, 900U);
+
+    // A touched entry goes to the back of the queue
+    map.touch(map.find(900));
+    map.insert(make_pair(1000, 1000));
+    BOOST_CHECK(map.count(900));
+    BOOST_CHECK(!map.count(901));
+    BOOST_CHECK_EQUAL(map.oldest()->first, 902);
+
+    // and inserting a key already there changes nothing
+    BOOST_CHECK(!map.insert(make_pair(1000, 0)).second);
+    BOOST_CHECK_EQUAL(map.find(1000)->second, 1000);
+    BOOST_CHECK_EQUAL(map.size(), 100U);
+
+    map.erase(950);
+    map.erase(map.find(902));
+    BOOST_CHECK_EQUAL(map.size(), 98U);
+    BOOST_CHECK_EQUAL(map.oldest()->first, 903);
+    map.clear();
+    BOOST_CHECK(map.oldest() == map.end());
+    BOOST_CHECK_EQUAL(map.DynamicUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(boundedmap_age)
+{
+    int64_t nNow = GetTime();
+    SetMockTime(nNow);
+    boundedmap<int, int> map(0, 60);
+    for (int i = 0; i < 10; i++)
+        map.insert(make_pair(i, i));
+    SetMockTime(nNow + 30);
+    for (int i = 10; i < 20; i++)
+        map.insert(make_pair(i, i));
+    map.touch(map.find(5));
+
+    // Expired entries go on the next insert, or when asked to
+    SetMockTime(nNow + 61);
+    BOOST_CHECK_EQUAL(map.size(), 20U);
+    map.expire();
+    BOOST_CHECK_EQUAL(map.size(), 11U);
+    BOOST_CHECK(map.count(5));
+    SetMockTime(nNow + 91);
+    map[20] = 20;
+    BOOST_CHECK_EQUAL(map.size(), 1U);
+    BOOST_CHECK(map.count(20));
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(boundedmap_usage)
+{
+    boundedmap<uint256, vector<unsigned char> > map(1000);
+    BOOST_CHECK_EQUAL(map.DynamicUsage(), 0U);
+    for (int i = 0; i < 1000; i++)
+        map.insert(make_pair(Hash(BEGIN(i), END(i)), vector<unsigned char>(100)));
+    size_t nUsage = map.DynamicUsage();
+    BOOST_CHECK(nUsage > 1000 * (100 + 2 * sizeof(uint256)));
+
+    // Growing an entry in place counts once it is reported
+    int n = 0;
+    boundedmap<uint256, vector<unsigned char> >::iterator it = map.find(Hash(BEGIN(n), END(n)));
+    it->second.resize(200);
+    BOOST_CHECK_EQUAL(map.DynamicUsage(), nUsage);
+    map.resized(it);
+    BOOST_CHECK_EQUAL(map.DynamicUsage(), nUsage + 100);
+
+    // and evicting or erasing it gives back what it took
+    for (int i = 1000; i < 2000; i++)
+        map.insert(make_pair(Hash(BEGIN(i), END(i)), vector<unsigned char>(100)));
+    BOOST_CHECK_EQUAL(map.DynamicUsage(), nUsage);
+    for (int i = 1000; i < 2000; i++)
+        map.erase(Hash(BEGIN(i), END(i)));
+    BOOST_CHECK_EQUAL(map.DynamicUsage(), 0U);
+
+    CCacheInfo info = map.GetInfo("test");
+    BOOST_CHECK_EQUAL(info.strName, "test");
+    BOOST_CHECK_EQUAL(info.nMaxEntries, 1000U);
+    BOOST_CHECK_EQUAL(info.nEvicted, 1000U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,374 @@
+#include <boost/test/unit_test.hpp>
+
+#include "blockfile.h"
+#include "chainfunctions.h"
+#include "coins.h"
+#include "mainfunctions.h"
+#include "txdb.h"
+
+using namespace std;
+
+// Each case writes outputs and best blocks of its own sets to the shared
+// database; put back what pcoinsTip, still at the genesis block and so
+// without a single output, has stored
+struct CoinsTestingSetup
+{
+    ~CoinsTestingSetup()
+    {
+        CTxDB txdb("r+");
+        txdb.EraseCoins();
+        pcoinsTip->Flush();
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(coins_tests, CoinsTestingSetup)
+
+static void CheckSameCoin(const CCoin& coin, const CCoin& coinExpected)
+{
+    BOOST_CHECK(coin.txout == coinExpected.txout);
+    BOOST_CHECK_EQUAL(coin.nHeight, coinExpected.nHeight);
+    BOOST_CHECK_EQUAL(coin.nTime, coinExpected.nTime);
+    BOOST_CHECK_EQUAL(coin.nBlockTime, coinExpected.nBlockTime);
+    BOOST_CHECK_EQUAL(coin.nFlags, coinExpected.nFlags);
+}
+
+static CCoin MakeTestCoin(int64_t nValue)
+{
+    CTransaction tx;
+    tx.nTime = GetTime();
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return CCoin(tx, 0, 10, tx.nTime);
+}
+
+// A proof-of-stake block on pindexPrev, written to the block files and the
+// tx index the way ConnectBlock leaves them: an empty coinbase, a coinstake
+// spending vSpend[0], and a transaction for each other outpoint
+static CBlockIndex* AddTestBlock(CBlockIndex* pindexPrev, const vector<COutPoint>& vSpend)
+{
+    CBlock block;
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.nTime = pindexPrev->nTime + 64;
+    block.nBits = pindexPrev->nBits;
+
+    CTransaction txCoinBase;
+    txCoinBase.nTime = block.nTime;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << (int64_t)GetRand(1 << 30);
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].SetEmpty();
+    block.vtx.push_back(txCoinBase);
+
+    for (unsigned int i = 0; i < vSpend.size(); i++)
+    {
+        CTransaction tx;
+        tx.nTime = block.nTime;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = vSpend[i];
+        tx.vin[0].scriptSig = CScript() << OP_TRUE;
+        tx.vout.resize(i == 0 ? 3 : 2);
+        for (unsigned int j = 0; j < tx.vout.size(); j++)
+        {
+            tx.vout[j].nValue = (j + 1) * CREDIT;
+            tx.vout[j].scriptPubKey = CScript() << OP_TRUE;
+        }
+        if (i == 0)
+            tx.vout[0].SetEmpty();
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    BOOST_REQUIRE(block.IsProofOfStake());
+
+    unsigned int nFile, nBlockPos;
+    BOOST_REQUIRE(block.WriteToDisk(nFile, nBlockPos));
+    BOOST_REQUIRE(CommitBlockFile());
+
+    CTxDB txdb("r+");
+    txdb.TxnBegin();
+    unsigned int nTxPos = nBlockPos + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) - (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(block.vtx.size());
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        txdb.UpdateTxIndex(tx.GetHash(), CTxIndex(CDiskTxPos(nFile, nBlockPos, nTxPos)));
+        nTxPos += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+    }
+    BOOST_REQUIRE(txdb.TxnCommit());
+
+    CBlockIndex* pindex = new CBlockIndex(nFile, nBlockPos, block);
+    pindex->phashBlock = &mapBlockIndex.insert(make_pair(block.GetHash(), pindex)).first->first;
+    pindex->pprev = pindexPrev;
+    pindex->nHeight = pindexPrev->nHeight + 1;
+    return pindex;
+}
+
+static uint256 TxHash(const CBlockIndex* pindex, unsigned int nTx)
+{
+    CBlock block;
+    BOOST_REQUIRE(block.ReadFromDisk(pindex));
+    return block.vtx[nTx].GetHash();
+}
+
+// Genesis - 0 - A1 - A2
+//                 \- B2 - B3
+struct CCoinsTestChain
+{
+    CBlockIndex* pindex0;
+    CBlockIndex* pindexA1;
+    CBlockIndex* pindexA2;
+    CBlockIndex* pindexB2;
+    CBlockIndex* pindexB3;
+};
+
+static const CCoinsTestChain& TestChain()
+{
+    static CCoinsTestChain chain;
+    if (chain.pindex0)
+        return chain;
+
+    LOCK(cs_main);
+    vector<COutPoint> vSpend;
+    vSpend.push_back(COutPoint(Params().GenesisBlock().vtx[0].GetHash(), 0));
+    chain.pindex0 = AddTestBlock(pindexGenesisBlock, vSpend);
+
+    uint256 hashStake0 = TxHash(chain.pindex0, 1);
+    vSpend.clear();
+    vSpend.push_back(COutPoint(hashStake0, 1));
+    vSpend.push_back(COutPoint(hashStake0, 2));
+    chain.pindexA1 = AddTestBlock(chain.pindex0, vSpend);
+
+    uint256 hashStakeA1 = TxHash(chain.pindexA1, 1), hashTxA1 = TxHash(chain.pindexA1, 2);
+    vSpend.clear();
+    vSpend.push_back(COutPoint(hashStakeA1, 1));
+    vSpend.push_back(COutPoint(hashTxA1, 0));
+    chain.pindexA2 = AddTestBlock(chain.pindexA1, vSpend);
+
+    vSpend.clear();
+    vSpend.push_back(COutPoint(hashStakeA1, 2));
+    chain.pindexB2 = AddTestBlock(chain.pindexA1, vSpend);
+
+    vSpend.clear();
+    vSpend.push_back(COutPoint(TxHash(chain.pindexB2, 1), 1));
+    chain.pindexB3 = AddTestBlock(chain.pindexB2, vSpend);
+    return chain;
+}
+
+BOOST_AUTO_TEST_CASE(coins_flush_flags)
+{
+    uint256 vHash[4];
+    CBlockIndex vIndex[4];
+    for (int i = 0; i < 4; i++)
+    {
+        vHash[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHash[i];
+    }
+
+    CCoinsCache coins(1 << 20);
+    CCoinsStats stats;
+    COutPoint outA(GetRandHash(), 0), outB(GetRandHash(), 0);
+    CCoin coinA = MakeTestCoin(CREDIT), coin;
+
+    // A new output is dirty until written
+    CCoinsChanges changes;
+    changes[outA] = coinA;
+    BOOST_CHECK(coins.ApplyChanges(changes, NULL, &vIndex[0]));
+    coins.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK_EQUAL(stats.nDirty, 1U);
+    BOOST_CHECK(!CTxDB("r").ReadCoin(outA, coin));
+
+    // and kept as a read cache after
+    BOOST_CHECK(coins.Flush());
+    coins.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK_EQUAL(stats.nDirty, 0U);
+    BOOST_CHECK(CTxDB("r").ReadCoin(outA, coin));
+    CheckSameCoin(coin, coinA);
+
+    // Spending a stored output erases it at the next flush
+    changes.clear();
+    changes[outA] = CCoin();
+    BOOST_CHECK(coins.ApplyChanges(changes, &vIndex[0], &vIndex[1]));
+    BOOST_CHECK(!coins.GetCoin(outA, coin, &vIndex[1]));
+    coins.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nDirty, 1U);
+    BOOST_CHECK(CTxDB("r").ReadCoin(outA, coin));
+    BOOST_CHECK(coins.Flush());
+    BOOST_CHECK(!CTxDB("r").ReadCoin(outA, coin));
+    coins.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nEntries, 0U);
+
+    // An output created and spent between two flushes never reaches the database
+    changes.clear();
+    changes[outB] = coinA;
+    BOOST_CHECK(coins.ApplyChanges(changes, &vIndex[1], &vIndex[2]));
+    changes[outB] = CCoin();
+    BOOST_CHECK(coins.ApplyChanges(changes, &vIndex[2], &vIndex[3]));
+    coins.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nEntries, 0U);
+    BOOST_CHECK(coins.Flush());
+    BOOST_CHECK(!CTxDB("r").ReadCoin(outB, coin));
+    BOOST_CHECK(coins.GetBestBlock() == vHash[3]);
+}
+
+BOOST_AUTO_TEST_CASE(coins_apply_changes_mismatch)
+{
+    uint256 vHash[3];
+    CBlockIndex vIndex[3];
+    for (int i = 0; i < 3; i++)
+    {
+        vHash[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHash[i];
+    }
+
+    CCoinsCache coins(1 << 20);
+    CCoinsChanges changes;
+    BOOST_CHECK(coins.ApplyChanges(changes, NULL, &vIndex[0]));
+
+    // Changes staged on another block than the set's are refused whole
+    COutPoint out(GetRandHash(), 0);
+    changes[out] = MakeTestCoin(CREDIT);
+    BOOST_CHECK(!coins.ApplyChanges(changes, &vIndex[1], &vIndex[2]));
+    BOOST_CHECK(!coins.ApplyChanges(changes, NULL, &vIndex[2]));
+    BOOST_CHECK(coins.GetBestBlock() == vHash[0]);
+    CCoin coin;
+    BOOST_CHECK(!coins.GetCoin(out, coin, &vIndex[0]));
+}
+
+BOOST_AUTO_TEST_CASE(coins_connect_disconnect)
+{
+    const CCoinsTestChain& chain = TestChain();
+    LOCK(cs_main);
+    CTxDB txdb("r");
+    CCoinsCache coins(1 << 20);
+    BOOST_REQUIRE(coins.SyncToTip(txdb, chain.pindexA1));
+
+    CBlock blockA1, blockA2;
+    BOOST_REQUIRE(blockA1.ReadFromDisk(chain.pindexA1));
+    BOOST_REQUIRE(blockA2.ReadFromDisk(chain.pindexA2));
+
+    // Empty outputs of the coinbase and coinstake are in the set
+    CCoin coin, coinStakeA1, coinTxA1;
+    BOOST_CHECK(coins.GetCoin(COutPoint(blockA1.vtx[0].GetHash(), 0), coin, chain.pindexA1));
+    BOOST_CHECK(coin.IsCoinBase() && coin.txout.IsEmpty());
+    BOOST_CHECK(coins.GetCoin(COutPoint(blockA1.vtx[1].GetHash(), 0), coin, chain.pindexA1));
+    BOOST_CHECK(coin.IsCoinStake() && coin.txout.IsEmpty());
+    BOOST_REQUIRE(coins.GetCoin(COutPoint(blockA1.vtx[1].GetHash(), 1), coinStakeA1, chain.pindexA1));
+    BOOST_REQUIRE(coins.GetCoin(COutPoint(blockA1.vtx[2].GetHash(), 0), coinTxA1, chain.pindexA1));
+    BOOST_CHECK(coinStakeA1.IsCoinStake());
+    BOOST_CHECK_EQUAL(coinStakeA1.nHeight, chain.pindexA1->nHeight);
+    BOOST_CHECK_EQUAL(coinStakeA1.nBlockTime, chain.pindexA1->nTime);
+
+    // Connecting A2 spends them
+    {
+        CCoinsView view(&coins);
+        BOOST_CHECK(view.GetBestBlock() == chain.pindexA1);
+        BOOST_FOREACH(const CTransaction& tx, blockA2.vtx)
+            view.ConnectTransaction(tx, chain.pindexA2);
+        view.SetBestBlock(chain.pindexA2);
+        BOOST_CHECK(!view.GetCoin(COutPoint(blockA1.vtx[1].GetHash(), 1), coin));
+        BOOST_CHECK(view.GetCoin(COutPoint(blockA2.vtx[2].GetHash(), 1), coin));
+        // The set only sees the view's changes on flush
+        BOOST_CHECK(coins.GetCoin(COutPoint(blockA1.vtx[1].GetHash(), 1), coin, chain.pindexA1));
+        BOOST_CHECK(view.Flush());
+    }
+    BOOST_CHECK(coins.GetBestBlock() == chain.pindexA2->GetBlockHash());
+    BOOST_CHECK(!coins.GetCoin(COutPoint(blockA1.vtx[1].GetHash(), 1), coin, chain.pindexA2));
+    BOOST_CHECK(!coins.GetCoin(COutPoint(blockA1.vtx[2].GetHash(), 0), coin, chain.pindexA2));
+    BOOST_CHECK(coins.GetCoin(COutPoint(blockA2.vtx[0].GetHash(), 0), coin, chain.pindexA2));
+
+    // and taking it back restores exactly what it spent
+    {
+        CCoinsView view(&coins);
+        BOOST_CHECK(view.DisconnectBlock(txdb, blockA2));
+        BOOST_CHECK(view.GetBestBlock() == chain.pindexA1);
+        BOOST_CHECK(view.Flush());
+    }
+    BOOST_CHECK(coins.GetBestBlock() == chain.pindexA1->GetBlockHash());
+    BOOST_REQUIRE(coins.GetCoin(COutPoint(blockA1.vtx[1].GetHash(), 1), coin, chain.pindexA1));
+    CheckSameCoin(coin, coinStakeA1);
+    BOOST_REQUIRE(coins.GetCoin(COutPoint(blockA1.vtx[2].GetHash(), 0), coin, chain.pindexA1));
+    CheckSameCoin(coin, coinTxA1);
+    for (unsigned int i = 0; i < blockA2.vtx.size(); i++)
+        for (unsigned int n = 0; n < blockA2.vtx[i].vout.size(); n++)
+            BOOST_CHECK(!coins.GetCoin(COutPoint(blockA2.vtx[i].GetHash(), n), coin, chain.pindexA1));
+
+    // A view only takes back the block it is at
+    CCoinsView view(&coins);
+    BOOST_CHECK(!view.DisconnectBlock(txdb, blockA2));
+}
+
+BOOST_AUTO_TEST_CASE(coins_sync_across_fork)
+{
+    const CCoinsTestChain& chain = TestChain();
+    LOCK(cs_main);
+    CTxDB txdb("r");
+    CCoinsCache coins(1 << 20);
+    BOOST_REQUIRE(coins.SyncToTip(txdb, chain.pindexA1));
+    CCoin coinStakeA1, coinTxA1, coin;
+    uint256 hashStakeA1 = TxHash(chain.pindexA1, 1), hashTxA1 = TxHash(chain.pindexA1, 2);
+    BOOST_REQUIRE(coins.GetCoin(COutPoint(hashStakeA1, 1), coinStakeA1, chain.pindexA1));
+    BOOST_REQUIRE(coins.GetCoin(COutPoint(hashTxA1, 0), coinTxA1, chain.pindexA1));
+
+    BOOST_REQUIRE(coins.SyncToTip(txdb, chain.pindexA2));
+    BOOST_CHECK(!coins.GetCoin(COutPoint(hashStakeA1, 1), coin, chain.pindexA2));
+
+    // Over to the other branch: A2 is taken back, B2 and B3 connected
+    BOOST_REQUIRE(coins.SyncToTip(txdb, chain.pindexB3));
+    BOOST_CHECK(coins.GetBestBlock() == chain.pindexB3->GetBlockHash());
+    BOOST_CHECK(!coins.GetCoin(COutPoint(hashStakeA1, 1), coin, chain.pindexA2));
+    BOOST_REQUIRE(coins.GetCoin(COutPoint(hashStakeA1, 1), coin, chain.pindexB3));
+    CheckSameCoin(coin, coinStakeA1);
+    BOOST_REQUIRE(coins.GetCoin(COutPoint(hashTxA1, 0), coin, chain.pindexB3));
+    CheckSameCoin(coin, coinTxA1);
+    BOOST_CHECK(!coins.GetCoin(COutPoint(hashStakeA1, 2), coin, chain.pindexB3));
+    BOOST_CHECK(!coins.GetCoin(COutPoint(TxHash(chain.pindexA2, 1), 1), coin, chain.pindexB3));
+    BOOST_CHECK(!coins.GetCoin(COutPoint(TxHash(chain.pindexB2, 1), 1), coin, chain.pindexB3));
+    BOOST_REQUIRE(coins.GetCoin(COutPoint(TxHash(chain.pindexB3, 1), 2), coin, chain.pindexB3));
+    BOOST_CHECK_EQUAL(coin.nHeight, chain.pindexB3->nHeight);
+
+    // and back
+    BOOST_REQUIRE(coins.SyncToTip(txdb, chain.pindexA2));
+    BOOST_CHECK(!coins.GetCoin(COutPoint(hashStakeA1, 1), coin, chain.pindexA2));
+    BOOST_REQUIRE(coins.GetCoin(COutPoint(hashStakeA1, 2), coin, chain.pindexA2));
+    BOOST_CHECK(!coins.GetCoin(COutPoint(TxHash(chain.pindexB3, 1), 2), coin, chain.pindexA2));
+}
+
+BOOST_AUTO_TEST_CASE(coins_load_rebuild)
+{
+    const CCoinsTestChain& chain = TestChain();
+    LOCK(cs_main);
+    CBlockIndex* pindexBestSaved = pindexBest;
+    pindexBest = chain.pindexB3;
+    CCoin coin;
+    COutPoint outStale(GetRandHash(), 0);
+    {
+        CTxDB txdb("r+");
+
+        // A missing set is rebuilt from the blocks
+        BOOST_REQUIRE(txdb.EraseCoins());
+        CCoinsCache coins(1 << 20);
+        BOOST_CHECK(coins.Load(txdb));
+        BOOST_CHECK(coins.GetBestBlock() == chain.pindexB3->GetBlockHash());
+        BOOST_CHECK(coins.GetCoin(COutPoint(TxHash(chain.pindexB3, 1), 2), coin, chain.pindexB3));
+        BOOST_CHECK(coins.GetCoin(COutPoint(TxHash(chain.pindexA1, 1), 1), coin, chain.pindexB3));
+        BOOST_CHECK(!coins.GetCoin(COutPoint(Params().GenesisBlock().vtx[0].GetHash(), 0), coin, chain.pindexB3));
+        int nVersion = 0;
+        BOOST_CHECK(txdb.ReadCoinsVersion(nVersion));
+        BOOST_CHECK_EQUAL(nVersion, COINS_VERSION);
+
+        // and one written by an older version as well, dropping what it held
+        BOOST_REQUIRE(txdb.WriteCoin(outStale, MakeTestCoin(CREDIT)));
+        BOOST_REQUIRE(txdb.WriteCoinsVersion(COINS_VERSION - 1));
+    }
+    {
+        CTxDB txdb("r+");
+        CCoinsCache coins(1 << 20);
+        BOOST_CHECK(coins.Load(txdb));
+        BOOST_CHECK(coins.GetBestBlock() == chain.pindexB3->GetBlockHash());
+        BOOST_CHECK(!coins.GetCoin(outStale, coin, chain.pindexB3));
+        BOOST_CHECK(coins.GetCoin(COutPoint(TxHash(chain.pindexB3, 1), 2), coin, chain.pindexB3));
+    }
+    pindexBest = pindexBestSaved;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,48 @@
+#include <boost/test/unit_test.hpp>
+
+#include "instantx.h"
+
+using namespace std;
+
+static CConsensusVote TestVote(const uint256& txHash, unsigned int nMasternode, int nBlockHeight)
+{
+    CConsensusVote vote;
+    vote.vinMasternode = CTxIn(COutPoint(uint256(nMasternode + 1), 0));
+    vote.txHash = txHash;
+    vote.nBlockHeight = nBlockHeight;
+    return vote;
+}
+
+BOOST_AUTO_TEST_SUITE(instantx_tests)
+
+BOOST_AUTO_TEST_CASE(lock_votes_distinct)
+{
+    uint256 txHash = GetRandHash();
+    CTransactionLock lock;
+    lock.txHash = txHash;
+    lock.nBlockHeight = 100;
+
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        CConsensusVote vote = TestVote(txHash, i, 100);
+        BOOST_CHECK(lock.AddSignature(vote));
+    }
+    BOOST_CHECK_EQUAL(lock.CountSignatures(), 3);
+
+    // A replayed vote, or another one from the same masternode, is not counted
+    CConsensusVote replay = TestVote(txHash, 1, 100);
+    BOOST_CHECK(!lock.AddSignature(replay));
+    CConsensusVote other = TestVote(txHash, 2, 101);
+    BOOST_CHECK(!lock.AddSignature(other));
+    BOOST_CHECK_EQUAL(lock.CountSignatures(), 3);
+    BOOST_CHECK_EQUAL(lock.vecConsensusVotes.size(), 3U);
+
+    // Votes for another height count once the lock moves to it
+    CConsensusVote later = TestVote(txHash, 3, 101);
+    BOOST_CHECK(lock.AddSignature(later));
+    BOOST_CHECK_EQUAL(lock.CountSignatures(), 3);
+    lock.SetBlockHeight(101);
+    BOOST_CHECK_EQUAL(lock.CountSignatures(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
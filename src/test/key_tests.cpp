@@ -10,17 +10,17 @@
 
 using namespace std;
 
-static const string strSecret1     ("5HxWvvfubhXpYYpS3tJkw6fq9jE9j18THftkZjHHfmFiWtmAbrj");
-static const string strSecret2     ("5KC4ejrDjv152FGwP386VD1i2NYc5KkfSMyv1nGy1VGDxGHqVY3");
-static const string strSecret1C    ("Kwr371tjA9u2rFSMZjTNun2PXXP3WPZu2afRHTcta6KxEUdm1vEw");
-static const string strSecret2C    ("L3Hq7a8FEQwJkW1M2GNKDW28546Vp5miewcCzSqUD9kCAXrJdS3g");
-static const CAdvantagecoinAddress addr1 ("1QFqqMUD55ZV3PJEJZtaKCsQmjLT6JkjvJ");
-static const CAdvantagecoinAddress addr2 ("1F5y5E5FMc5YzdJtB9hLaUe43GDxEKXENJ");
-static const CAdvantagecoinAddress addr1C("1NoJrossxPBKfCHuJXT4HadJrXRE9Fxiqs");
-static const CAdvantagecoinAddress addr2C("1CRj2HyM1CXWzHAXLQtiGLyggNT9WQqsDs");
+static const string strSecret1     ("37c8TrVqD3a6nE3b8CxowFhVdKCUUEMY98Hkhza24ApWSSLe8w9");
+static const string strSecret2     ("38qgBfg9MG3MFvW6TMn9VN3NVxWvpYykHpNvA3ZhPtq1smfZnH5");
+static const string strSecret1C    ("ALA3wXUFnAM6WcaRcooLATsjMHKeFBweSsAwuw6jezLgvxg55wq4");
+static const string strSecret2C    ("ARbqx5hmrRPNQs9R5LiGUBsTtp36Yt9U5E7jcvKKJ3kvs1wo9PLp");
+static const CAdvantagecoinAddress addr1 ("Af2iUrKqQEDdrMWDsDYuU68WFLG9QXSB5F");
+static const CAdvantagecoinAddress addr2 ("AVrqiivsgkjhobWsjoMfjMu9Ws9eaWfJ7o");
+static const CAdvantagecoinAddress addr1C("AdaBWJjWHXqUUAVtsB7PSTtQL8LvTwkyA9");
+static const CAdvantagecoinAddress addr2C("ATCbfnpyLMBfoFNWu4Z3REEn9yNqsN9n4Y");
 
 
-static const string strAddressBad("1HV9Lc3sNHZxwj4Zk6fB38tEmBryq2cBiF");
+static const string strAddressBad("AYG1z6uVhSE7khGZJkKWC29LEnngCs9oJP");
 
 
 #ifdef KEY_TESTS_DUMPINFO
@@ -76,10 +76,10 @@ BOOST_AUTO_TEST_CASE(key_test1)
     CPubKey pubkey1C = key1C.GetPubKey();
     CPubKey pubkey2C = key2C.GetPubKey();
 
-    BOOST_CHECK(addr1.Get()  == CTxDestination(pubkey1.GetID()));
-    BOOST_CHECK(addr2.Get()  == CTxDestination(pubkey2.GetID()));
-    BOOST_CHECK(addr1C.Get() == CTxDestination(pubkey1C.GetID()));
-    BOOST_CHECK(addr2C.Get() == CTxDestination(pubkey2C.GetID()));
+    BOOST_CHECK(addr1 == CAdvantagecoinAddress(pubkey1.GetID()));
+    BOOST_CHECK(addr2 == CAdvantagecoinAddress(pubkey2.GetID()));
+    BOOST_CHECK(addr1C == CAdvantagecoinAddress(pubkey1C.GetID()));
+    BOOST_CHECK(addr2C == CAdvantagecoinAddress(pubkey2C.GetID()));
 
     for (int n=0; n<16; n++)
     {
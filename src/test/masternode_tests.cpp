@@ -0,0 +1,232 @@
+#include <boost/test/unit_test.hpp>
+
+#include "darksend.h"
+#include "masternode-payments.h"
+#include "masternodeman.h"
+#include "net.h"
+#include "protocol.h"
+#include "util.h"
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+// All test masternodes announce this address. The test holds a connection
+// to it, so the port check of an updated entry passes without dialing out.
+static const CService addrTestMasternodes("8.8.8.8", 9999);
+
+static CMasternodeListEntry MakeTestEntry(const CKey& key, int n, int64_t nSigTime)
+{
+    CMasternodeListEntry entry;
+    entry.vin = CTxIn(Hash(BEGIN(n), END(n)), 1);
+    entry.addr = addrTestMasternodes;
+    entry.pubkey = key.GetPubKey();
+    entry.pubkey2 = key.GetPubKey();
+    entry.sigTime = nSigTime;
+    entry.lastTimeSeen = nSigTime;
+    entry.protocolVersion = PROTOCOL_VERSION;
+    entry.isOldNode = false;
+
+    string errorMessage;
+    BOOST_CHECK(darkSendSigner.SignMessage(entry.GetSignatureMessage(), errorMessage, entry.sig, key));
+    return entry;
+}
+
+static void AddTestMasternode(CMasternodeMan& man, const CMasternodeListEntry& entry)
+{
+    CMasternode mn(entry.addr, entry.vin, entry.pubkey, entry.sig, entry.sigTime, entry.pubkey2,
+                   entry.protocolVersion, entry.rewardAddress, entry.rewardPercentage);
+    mn.unitTest = true; // the collateral is not in the unspent set
+    mn.UpdateLastSeen(entry.lastTimeSeen);
+    mn.ChangeNodeStatus(entry.isOldNode);
+    man.Add(mn);
+}
+
+// Hand the messages pushed to from over to the masternode manager at the
+// other end, which sees them as coming from pfrom; returns how many
+static int DeliverMessages(CNode& from, CMasternodeMan& man, CNode& pfrom)
+{
+    deque<CSerializeData> vSend;
+    {
+        LOCK(from.cs_vSend);
+        vSend.swap(from.vSendMsg);
+        from.nSendSize = 0;
+    }
+    BOOST_FOREACH(const CSerializeData& data, vSend)
+    {
+        CDataStream vRecv(data.begin(), data.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CMessageHeader hdr;
+        vRecv >> hdr;
+        string strCommand = hdr.GetCommand();
+        man.ProcessMessage(&pfrom, strCommand, vRecv);
+    }
+    return vSend.size();
+}
+
+BOOST_AUTO_TEST_SUITE(masternode_tests)
+
+BOOST_AUTO_TEST_CASE(list_entry_signature)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CMasternodeListEntry entry = MakeTestEntry(key, 1, GetAdjustedTime());
+    BOOST_CHECK(entry.VerifySignature());
+
+    // dsee entries are signed without the reward fields
+    entry.rewardPercentage = 10;
+    BOOST_CHECK(!entry.VerifySignature());
+    entry.isOldNode = true;
+    BOOST_CHECK(!entry.VerifySignature());
+
+    CMasternodeListEntry entry2 = MakeTestEntry(key, 2, GetAdjustedTime());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << entry2;
+    CMasternodeListEntry entry3;
+    ss >> entry3;
+    BOOST_CHECK(entry3.VerifySignature());
+    entry3.sigTime++;
+    BOOST_CHECK(!entry3.VerifySignature());
+
+    vector<CMasternodeListEntry> vEntries;
+    for (int i = 0; i < 40; i++)
+        vEntries.push_back(MakeTestEntry(key, i, GetAdjustedTime()));
+    vEntries[17].sig[10] ^= 1;
+    vector<char> vValid;
+    CMasternodeMan::VerifyListEntries(vEntries, vValid);
+    for (unsigned int i = 0; i < vEntries.size(); i++)
+        BOOST_CHECK_EQUAL((bool)vValid[i], i != 17);
+}
+
+BOOST_AUTO_TEST_CASE(list_sync_mnget)
+{
+    static const int nMasternodes = 150;
+    int64_t nNow = GetAdjustedTime();
+
+    // List messages are only handled once the chain is synced
+    CBlockIndex* pindexSaved = pindexBest;
+    CBlockIndex tip;
+    tip.nTime = nNow;
+    pindexBest = &tip;
+
+    CNode nodeMasternodes(INVALID_SOCKET, CAddress(addrTestMasternodes));
+    {
+        LOCK(cs_vNodes);
+        vNodes.push_back(&nodeMasternodes);
+    }
+
+    // Connections between the node and the seed, each seen from one end
+    CNode toSeed(INVALID_SOCKET, CAddress(CService("10.0.0.1", 9999)));
+    CNode toNode(INVALID_SOCKET, CAddress(CService("10.0.0.2", 9999)), "", true);
+    toSeed.nVersion = toNode.nVersion = PROTOCOL_VERSION;
+
+    // The seed has heard newer announcements of every tenth masternode
+    vector<CKey> vKeys(nMasternodes);
+    CMasternodeMan seed, node, nodeInSync;
+    for (int i = 0; i < nMasternodes; i++)
+    {
+        vKeys[i].MakeNewKey(true);
+        CMasternodeListEntry entry = MakeTestEntry(vKeys[i], i, nNow - 600);
+        AddTestMasternode(node, entry);
+        if (i % 10 == 0)
+            entry = MakeTestEntry(vKeys[i], i, nNow - 60);
+        AddTestMasternode(seed, entry);
+        AddTestMasternode(nodeInSync, entry);
+    }
+    BOOST_CHECK(node.GetListDigest() != seed.GetListDigest());
+    uint256 hashNodeDigest = node.GetListDigest();
+
+    // An mnlist nobody asked for is dropped before any signature is checked
+    vector<CMasternodeListEntry> vDiff;
+    vector<pair<COutPoint, int64_t> > vInv;
+    node.GetListInventory(vInv);
+    seed.GetListDiff(vInv, vDiff);
+    BOOST_CHECK_EQUAL(vDiff.size(), (size_t)nMasternodes / 10);
+    toNode.PushMessage("mnlist", vDiff);
+    BOOST_CHECK_EQUAL(DeliverMessages(toNode, node, toSeed), 1);
+    BOOST_CHECK(node.GetListDigest() == hashNodeDigest);
+
+    // Asked with mnget, the seed sends only the newer announcements
+    node.DsegUpdate(&toSeed);
+    BOOST_CHECK_EQUAL(DeliverMessages(toSeed, seed, toNode), 1);
+    BOOST_CHECK_EQUAL(DeliverMessages(toNode, node, toSeed), 1);
+    BOOST_CHECK(node.GetListDigest() == seed.GetListDigest());
+    BOOST_CHECK_EQUAL(node.size(), nMasternodes);
+
+    // A node with the same list is told nothing
+    nodeInSync.DsegUpdate(&toSeed);
+    BOOST_CHECK_EQUAL(DeliverMessages(toSeed, seed, toNode), 1);
+    BOOST_CHECK_EQUAL(DeliverMessages(toNode, nodeInSync, toSeed), 0);
+
+    {
+        LOCK(cs_vNodes);
+        vNodes.erase(find(vNodes.begin(), vNodes.end(), &nodeMasternodes));
+    }
+    pindexBest = pindexSaved;
+}
+
+BOOST_AUTO_TEST_CASE(payment_order)
+{
+    // Winners as mncache.dat stores them: masternode n is paid at heights
+    // 100 + n and, for the even ones, again at 200 - n
+    map<int, CMasternodePaymentWinner> mapWinning;
+    set<COutPoint> setAll;
+    for (int n = 0; n < 10; n++)
+    {
+        CMasternodePaymentWinner winner;
+        winner.vin = CTxIn(Hash(BEGIN(n), END(n)), 1);
+        winner.payee = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+        winner.nBlockHeight = 100 + n;
+        mapWinning[winner.nBlockHeight] = winner;
+        if (n % 2 == 0)
+        {
+            winner.nBlockHeight = 200 - n;
+            mapWinning[winner.nBlockHeight] = winner;
+        }
+        setAll.insert(winner.vin.prevout);
+    }
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (unsigned char)0 << mapWinning;
+
+    // Loading rebuilds the order: the odd ones by their only payment, then
+    // the even ones by their last, which comes later the smaller n is
+    CMasternodePayments payments;
+    ss >> payments;
+    BOOST_CHECK_EQUAL(payments.size(), 15);
+    vector<COutPoint> vOrder;
+    payments.GetPaymentOrder(setAll, vOrder);
+    BOOST_REQUIRE_EQUAL(vOrder.size(), 10U);
+    static const int nExpected[] = { 1, 3, 5, 7, 9, 8, 6, 4, 2, 0 };
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK(vOrder[i] == CTxIn(Hash(BEGIN(nExpected[i]), END(nExpected[i])), 1).prevout);
+
+    // Only the masternodes asked about, and only those with a payment
+    set<COutPoint> setSome;
+    setSome.insert(vOrder[2]);
+    setSome.insert(vOrder[7]);
+    int nUnpaid = 10;
+    setSome.insert(CTxIn(Hash(BEGIN(nUnpaid), END(nUnpaid)), 1).prevout);
+    vector<COutPoint> vSome;
+    payments.GetPaymentOrder(setSome, vSome);
+    BOOST_REQUIRE_EQUAL(vSome.size(), 2U);
+    BOOST_CHECK(vSome[0] == vOrder[2]);
+    BOOST_CHECK(vSome[1] == vOrder[7]);
+
+    // Written out and read back, the payments and their order are the same
+    CDataStream ssCopy(SER_DISK, CLIENT_VERSION);
+    ssCopy << payments;
+    CMasternodePayments paymentsCopy;
+    ssCopy >> paymentsCopy;
+    BOOST_CHECK_EQUAL(paymentsCopy.size(), 15);
+    vector<COutPoint> vOrderCopy;
+    paymentsCopy.GetPaymentOrder(setAll, vOrderCopy);
+    BOOST_CHECK(vOrderCopy == vOrder);
+    CScript payee;
+    CTxIn vin;
+    BOOST_CHECK(paymentsCopy.GetBlockPayee(196, payee, vin));
+    BOOST_CHECK(vin.prevout == vOrder[7]);
+    BOOST_CHECK(payee == mapWinning[196].payee);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,106 @@
+#include <boost/test/unit_test.hpp>
+
+#include "mainfunctions.h"
+#include "miner.h"
+#include "txmempool.h"
+#include "util.h"
+#include "wallet.h"
+
+BOOST_AUTO_TEST_SUITE(miner_tests)
+
+// Fill the pool with nTx independent transactions whose inputs were
+// confirmed a while ago, the way AcceptToMemoryPool would have left them
+static void FillMempool(int nTx, int nInputHeight)
+{
+    mempool.clear();
+    for (int i = 0; i < nTx; i++)
+    {
+        CTransaction tx;
+        tx.nTime = GetAdjustedTime() - 60;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.hash = Hash(BEGIN(i), END(i));
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * CREDIT;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+        CMempoolInputs inputs;
+        inputs.vPrevOut.resize(1);
+        inputs.vPrevOut[0].txout.nValue = 1 * CREDIT + (1 + i % 100) * CENT;
+        inputs.vPrevOut[0].txout.scriptPubKey = CScript() << OP_TRUE;
+        inputs.vPrevOut[0].nHeight = nInputHeight;
+        inputs.vPrevOut[0].fCoinBase = false;
+        inputs.nValueIn = inputs.vPrevOut[0].txout.nValue;
+        inputs.nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        inputs.nSigOps = GetLegacySigOpCount(tx);
+
+        mempool.addUnchecked(tx.GetHash(), tx, inputs);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CreateNewBlock_inputcache)
+{
+    CBlockIndex* pindexSaved = pindexBest;
+    int nBestHeightSaved = nBestHeight;
+
+    CBlockIndex tip;
+    tip.nHeight = 1000;
+    tip.nTime = GetAdjustedTime() - 120;
+    tip.SetProofOfStake();
+    pindexBest = &tip;
+    nBestHeight = tip.nHeight;
+
+    CReserveKey reservekey(NULL);
+
+    // Every transaction whose inputs matured goes in, with its fee; the
+    // cached inputs are all block assembly looks at
+    static const int nPoolSize = 200;
+    FillMempool(nPoolSize, tip.nHeight - 100);
+    int64_t nExpectedFees = 0;
+    for (std::map<uint256, CMempoolInputs>::const_iterator it = mempool.mapTxInputs.begin(); it != mempool.mapTxInputs.end(); ++it)
+        nExpectedFees += it->second.nValueIn - 1 * CREDIT;
+    {
+        int64_t nFees = 0;
+        CBlock* pblock = CreateNewBlock(reservekey, true, &nFees);
+        BOOST_CHECK(pblock != NULL);
+        if (pblock)
+        {
+            BOOST_CHECK_EQUAL(pblock->vtx.size(), (size_t)nPoolSize + 1);
+            BOOST_CHECK_EQUAL(nFees, nExpectedFees);
+            delete pblock;
+        }
+    }
+
+    // A spender whose script fails against the cached output stays out
+    FillMempool(1, tip.nHeight - 100);
+    mempool.mapTxInputs.begin()->second.vPrevOut[0].txout.scriptPubKey = CScript() << OP_FALSE;
+    {
+        int64_t nFees = 0;
+        CBlock* pblock = CreateNewBlock(reservekey, true, &nFees);
+        BOOST_CHECK(pblock != NULL);
+        if (pblock)
+        {
+            BOOST_CHECK_EQUAL(pblock->vtx.size(), 1U);
+            delete pblock;
+        }
+    }
+
+    // A coinbase output that has not matured yet must keep its spender out
+    FillMempool(1, tip.nHeight);
+    mempool.mapTxInputs.begin()->second.vPrevOut[0].fCoinBase = true;
+    int64_t nFees = 0;
+    CBlock* pblock = CreateNewBlock(reservekey, true, &nFees);
+    BOOST_CHECK(pblock != NULL);
+    if (pblock)
+    {
+        BOOST_CHECK_EQUAL(pblock->vtx.size(), 1U);
+        delete pblock;
+    }
+
+    mempool.clear();
+    pindexBest = pindexSaved;
+    nBestHeight = nBestHeightSaved;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,119 @@
+#include <boost/test/unit_test.hpp>
+
+#include "boundedmap.h"
+#include "orphanpool.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(orphanpool_tests)
+
+static CTransaction OrphanTx(const uint256& hashParent, unsigned int n)
+{
+    CTransaction tx;
+    tx.nTime = 1500000000;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashParent, n);
+    tx.vin[0].scriptSig = CScript() << vector<unsigned char>(72, 0x30);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = n + 1;
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(orphanpool_children)
+{
+    COrphanTxPool pool(100, 1 << 20);
+    uint256 hashParent = GetRandHash(), hashOther = GetRandHash();
+    CTransaction tx0 = OrphanTx(hashParent, 0), tx1 = OrphanTx(hashParent, 1), tx2 = OrphanTx(hashOther, 0);
+
+    BOOST_CHECK(pool.AddTx(tx0, 1));
+    BOOST_CHECK(pool.AddTx(tx1, 1));
+    BOOST_CHECK(pool.AddTx(tx2, 2));
+    BOOST_CHECK(!pool.AddTx(tx0, 2));
+    BOOST_CHECK(pool.HaveTx(tx1.GetHash()));
+
+    // Accepting a parent hands back the orphans spending it, and only those
+    vector<uint256> vChildren;
+    pool.GetChildren(hashParent, vChildren);
+    BOOST_CHECK_EQUAL(vChildren.size(), 2U);
+    vChildren.clear();
+    pool.GetChildren(tx0.GetHash(), vChildren);
+    BOOST_CHECK(vChildren.empty());
+
+    CTransaction tx;
+    BOOST_CHECK(pool.GetTx(tx2.GetHash(), tx));
+    BOOST_CHECK(tx.GetHash() == tx2.GetHash());
+    BOOST_CHECK(pool.EraseTx(tx2.GetHash()));
+    BOOST_CHECK(!pool.EraseTx(tx2.GetHash()));
+
+    // A block spending the same output as an orphan conflicts with it
+    CBlock block;
+    block.vtx.push_back(OrphanTx(hashParent, 0));
+    block.vtx[0].vout[0].nValue = 7;
+    BOOST_CHECK_EQUAL(pool.EraseForBlock(block), 1U);
+    BOOST_CHECK(!pool.HaveTx(tx0.GetHash()));
+    BOOST_CHECK(pool.HaveTx(tx1.GetHash()));
+
+    BOOST_CHECK_EQUAL(pool.EraseForPeer(1), 1U);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetInfo("orphans").nUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(orphanpool_limits)
+{
+    COrphanTxPool pool(40, 1 << 20);
+
+    // A peer holds a quarter of the pool at most
+    for (unsigned int i = 0; i < 20; i++)
+        pool.AddTx(OrphanTx(GetRandHash(), i), 1);
+    BOOST_CHECK_EQUAL(pool.size(), 40U / ORPHAN_PEER_SHARE);
+
+    // Past the limit, orphans picked at random go
+    for (NodeId peer = 2; peer < 10; peer++)
+        for (unsigned int i = 0; i < 10; i++)
+            BOOST_CHECK(pool.AddTx(OrphanTx(GetRandHash(), i), peer));
+    CCacheInfo info = pool.GetInfo("orphans");
+    BOOST_CHECK_EQUAL(info.nEntries, 40U);
+    BOOST_CHECK_EQUAL(info.nEvicted, 40U / ORPHAN_PEER_SHARE + 80U - 40U);
+
+    // and in memory
+    size_t nTxUsage = OrphanTxUsage(OrphanTx(0, 0));
+    pool.SetLimits(40, 10 * nTxUsage);
+    BOOST_CHECK(pool.size() <= 10U);
+    BOOST_CHECK(pool.GetInfo("orphans").nUsage <= 10 * nTxUsage);
+
+    // Large orphans are not kept at all
+    CTransaction tx = OrphanTx(GetRandHash(), 0);
+    tx.vout.resize(200, tx.vout[0]);
+    BOOST_CHECK(!pool.AddTx(tx, 20));
+}
+
+BOOST_AUTO_TEST_CASE(orphanpool_expiry)
+{
+    COrphanTxPool pool(100, 1 << 20);
+    SetMockTime(1500000000);
+    CTransaction tx0 = OrphanTx(GetRandHash(), 0);
+    BOOST_CHECK(pool.AddTx(tx0, 1));
+
+    SetMockTime(1500000000 + ORPHAN_TX_EXPIRE_TIME / 2);
+    CTransaction tx1 = OrphanTx(GetRandHash(), 1);
+    BOOST_CHECK(pool.AddTx(tx1, 1));
+
+    SetMockTime(1500000000 + ORPHAN_TX_EXPIRE_TIME);
+    BOOST_CHECK_EQUAL(pool.Expire(), 1U);
+    BOOST_CHECK(!pool.HaveTx(tx0.GetHash()));
+    BOOST_CHECK(pool.HaveTx(tx1.GetHash()));
+
+    // Expired ones are looked for every ORPHAN_TX_EXPIRE_INTERVAL only
+    int64_t nExpire1 = 1500000000 + ORPHAN_TX_EXPIRE_TIME * 3 / 2;
+    SetMockTime(nExpire1 - 1);
+    BOOST_CHECK_EQUAL(pool.Expire(), 0U);
+    SetMockTime(nExpire1);
+    BOOST_CHECK_EQUAL(pool.Expire(), 0U);
+    SetMockTime(nExpire1 - 1 + ORPHAN_TX_EXPIRE_INTERVAL);
+    BOOST_CHECK_EQUAL(pool.Expire(), 1U);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
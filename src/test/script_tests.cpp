@@ -0,0 +1,237 @@
+#include <boost/test/unit_test.hpp>
+
+#include "key.h"
+#include "keystore.h"
+#include "mainfunctions.h"
+#include "script.h"
+#include "util.h"
+
+using namespace std;
+
+// Evaluate script on an empty stack; the stack it leaves as hex, bottom first,
+// or "fail"
+static string Eval(const CScript& script)
+{
+    vector<valtype> stack;
+    if (!EvalScript(stack, script, CTransaction(), 0, SCRIPT_VERIFY_NONE, 0))
+        return "fail";
+    string str;
+    for (unsigned int i = 0; i < stack.size(); i++)
+        str += (i ? " " : "") + HexStr(stack[i]);
+    return str;
+}
+
+static valtype ParseHexV(const char* psz)
+{
+    return ParseHex(psz);
+}
+
+BOOST_AUTO_TEST_SUITE(script_tests)
+
+BOOST_AUTO_TEST_CASE(script_numbers)
+{
+    // Results are the shortest encoding, sign in the top bit
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_1 << OP_1SUB), "");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_1NEGATE), "81");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_1NEGATE << OP_ABS), "01");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_16 << OP_NEGATE), "90");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("7f") << OP_1ADD), "8000");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("80") << OP_1SUB), "81");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("ffffff7f") << OP_1ADD), "0000008000");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("ffffffff") << OP_1SUB), "0000008080");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("ffffff7f") << ParseHexV("ffffff7f") << OP_ADD), "feffffff00");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("0100") << OP_2 << OP_SUB), "81");
+
+    // Negative zero and padded numbers read as their value
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("80") << OP_NOT), "01");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("000080") << OP_0 << OP_NUMEQUAL), "01");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("0100") << OP_1 << OP_NUMEQUAL), "01");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("0100") << OP_1 << OP_EQUAL), "");
+
+    // Comparisons, min/max and within
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_1NEGATE << OP_0 << OP_LESSTHAN), "01");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_1NEGATE << OP_0 << OP_GREATERTHANOREQUAL), "");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_1NEGATE << OP_5 << OP_MAX), "05");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_1NEGATE << OP_5 << OP_MIN), "81");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_3 << OP_3 << OP_5 << OP_WITHIN), "01");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_5 << OP_3 << OP_5 << OP_WITHIN), "");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_0 << OP_2 << OP_BOOLOR << OP_2 << OP_BOOLAND), "01");
+
+    // Operands are at most 4 bytes, results may be 5
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("0000008000") << OP_1ADD), "fail");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("ffffff7f") << OP_1ADD << OP_1ADD), "fail");
+    BOOST_CHECK_EQUAL(Eval(CScript() << ParseHexV("0000008000") << OP_SIZE), "0000008000 05");
+
+    // Disabled arithmetic fails even where it is not executed
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_2 << OP_3 << OP_MUL), "fail");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_0 << OP_IF << OP_2MUL << OP_ENDIF), "fail");
+}
+
+BOOST_AUTO_TEST_CASE(script_stack_ops)
+{
+    CScript s123456 = CScript() << OP_1 << OP_2 << OP_3 << OP_4 << OP_5 << OP_6;
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_2ROT)), "03 04 05 06 01 02");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_2SWAP)), "01 02 05 06 03 04");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_3DUP)), "01 02 03 04 05 06 04 05 06");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_2OVER)), "01 02 03 04 05 06 03 04");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_ROT)), "01 02 03 05 06 04");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_NIP)), "01 02 03 04 06");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_TUCK)), "01 02 03 04 06 05 06");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_4 << OP_PICK)), "01 02 03 04 05 06 02");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_4 << OP_ROLL)), "01 03 04 05 06 02");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_0 << OP_ROLL)), "01 02 03 04 05 06");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_6 << OP_ROLL)), "fail");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_DEPTH)), "01 02 03 04 05 06 06");
+    BOOST_CHECK_EQUAL(Eval(s123456 + (CScript() << OP_TOALTSTACK << OP_TOALTSTACK << OP_DROP << OP_FROMALTSTACK)), "01 02 03 05");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_FROMALTSTACK), "fail");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_0 << OP_IFDUP << OP_1 << OP_IFDUP), " 01 01");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_1 << OP_IF << OP_2 << OP_ELSE << OP_3 << OP_ENDIF), "02");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_1 << OP_IF << OP_2), "fail");
+
+    // The altstack does not carry over from one script to the next
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_1 << OP_TOALTSTACK), "");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_FROMALTSTACK), "fail");
+
+    // Stack size limit, main and alt stacks together
+    CScript s999;
+    for (int i = 0; i < 999; i++)
+        s999 << OP_1;
+    BOOST_CHECK(Eval(s999 + (CScript() << OP_TOALTSTACK << OP_1)) != "fail");
+    BOOST_CHECK_EQUAL(Eval(s999 + (CScript() << OP_TOALTSTACK << OP_1 << OP_1)), "fail");
+
+    // Hashes replace the top element
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_0 << OP_SHA256), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    BOOST_CHECK_EQUAL(Eval(CScript() << OP_0 << OP_HASH160 << OP_SIZE << OP_NIP), "14");
+}
+
+BOOST_AUTO_TEST_CASE(script_stack_reuse)
+{
+    CScriptStack stack;
+    stack.push_back(valtype(100, 1));
+    stack.push_back(valtype(1, 2));
+    const unsigned char* pBuffer = &stack.at(0)[0];
+
+    // Popped elements keep their buffers for the next push
+    stack.pop_back();
+    stack.pop_back();
+    BOOST_CHECK(stack.empty());
+    valtype& vch = stack.push();
+    BOOST_CHECK(vch.empty());
+    vch.assign(50, 3);
+    BOOST_CHECK(&vch[0] == pBuffer);
+
+    // A copy of an element of the stack itself, while it grows
+    for (int i = 0; i < 100; i++)
+        stack.push_back(stack.at(0));
+    BOOST_CHECK_EQUAL(stack.size(), 101U);
+    BOOST_CHECK(stack.back() == valtype(50, 3));
+
+    stack.insert(0, valtype(1, 4));
+    BOOST_CHECK(stack.at(0) == valtype(1, 4));
+    BOOST_CHECK(stack.at(1) == valtype(50, 3));
+    stack.erase(0, 2);
+    BOOST_CHECK_EQUAL(stack.size(), 100U);
+
+    BOOST_CHECK_THROW(stack.at(100), std::out_of_range);
+    stack.clear();
+    BOOST_CHECK_THROW(stack.pop_back(), std::runtime_error);
+
+    vector<valtype> v(3, valtype(2, 5));
+    stack.assign(v);
+    stack.CopyTo(v);
+    BOOST_CHECK_EQUAL(v.size(), 3U);
+    BOOST_CHECK(v[2] == valtype(2, 5));
+}
+
+BOOST_AUTO_TEST_CASE(script_p2sh)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+
+    CScript redeem = CScript() << OP_2 << OP_ADD << OP_5 << OP_EQUAL;
+    CScript scriptPubKey = GetScriptForDestination(CScriptID(redeem.GetID()));
+
+    CScript scriptSig = CScript() << OP_3 << valtype(redeem.begin(), redeem.end());
+    BOOST_CHECK(VerifyScript(scriptSig, scriptPubKey, tx, 0, SCRIPT_VERIFY_NONE, 0));
+
+    scriptSig = CScript() << OP_4 << valtype(redeem.begin(), redeem.end());
+    BOOST_CHECK(!VerifyScript(scriptSig, scriptPubKey, tx, 0, SCRIPT_VERIFY_NONE, 0));
+
+    // The redeem script only runs off a push-only scriptSig
+    scriptSig = CScript() << OP_1 << OP_2 << OP_ADD << valtype(redeem.begin(), redeem.end());
+    BOOST_CHECK(!VerifyScript(scriptSig, scriptPubKey, tx, 0, SCRIPT_VERIFY_NONE, 0));
+}
+
+BOOST_AUTO_TEST_CASE(script_multisig)
+{
+    CBasicKeyStore keystore;
+    vector<CPubKey> keys;
+    for (int i = 0; i < 3; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i % 2 == 0);
+        keystore.AddKey(key);
+        keys.push_back(key.GetPubKey());
+    }
+
+    CScript multisig = GetScriptForMultisig(2, keys);
+    keystore.AddCScript(multisig);
+
+    CScript vScriptPubKeys[2] = { multisig, GetScriptForDestination(CScriptID(multisig.GetID())) };
+    for (int n = 0; n < 2; n++)
+    {
+        CTransaction txFrom;
+        txFrom.vout.resize(1);
+        txFrom.vout[0].scriptPubKey = vScriptPubKeys[n];
+
+        CTransaction txTo;
+        txTo.vin.resize(1);
+        txTo.vout.resize(1);
+        txTo.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+        BOOST_CHECK(SignSignature(keystore, txFrom, txTo, 0));
+        BOOST_CHECK(VerifyScript(txTo.vin[0].scriptSig, vScriptPubKeys[n], txTo, 0, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_NOCACHE, 0));
+
+        // Not for another transaction
+        txTo.vout[0].nValue = 1;
+        BOOST_CHECK(!VerifyScript(txTo.vin[0].scriptSig, vScriptPubKeys[n], txTo, 0, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_NOCACHE, 0));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(script_storage)
+{
+    // Standard output scripts are stored inline
+    CScript p2pkh = CScript() << OP_DUP << OP_HASH160 << uint160(1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    BOOST_CHECK_EQUAL(p2pkh.size(), 25U);
+    BOOST_CHECK_EQUAL(p2pkh.allocated_memory(), 0U);
+
+    // Longer ones move to the heap, and back when cleared
+    CScript script = p2pkh;
+    script += p2pkh;
+    script += script;
+    BOOST_CHECK_EQUAL(script.size(), 100U);
+    BOOST_CHECK(script.allocated_memory() >= 100U);
+    BOOST_CHECK(CScript(script.begin() + 75, script.end()) == p2pkh);
+    script.erase(script.begin(), script.begin() + 75);
+    BOOST_CHECK(script == p2pkh);
+    script.clear();
+    BOOST_CHECK(script.empty());
+    BOOST_CHECK_EQUAL(script.allocated_memory(), 0U);
+
+    // Serialized as the vector it was
+    vector<unsigned char> vch(p2pkh.begin(), p2pkh.end());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << p2pkh;
+    CDataStream ssVector(SER_NETWORK, PROTOCOL_VERSION);
+    ssVector << vch;
+    BOOST_CHECK(ss.str() == ssVector.str());
+    BOOST_CHECK_EQUAL(::GetSerializeSize(p2pkh, SER_NETWORK, PROTOCOL_VERSION), ssVector.size());
+
+    vch.resize(300, 0x51);
+    ssVector.clear();
+    ssVector << vch;
+    ssVector >> script;
+    BOOST_CHECK(script == CScript(vch.begin(), vch.end()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,175 @@
+#include <boost/test/unit_test.hpp>
+
+#include "mainfunctions.h"
+#include "script.h"
+#include "util.h"
+
+using namespace std;
+
+// The signature hash as it was computed before: copy the transaction, blank
+// it out and hash the copy
+static uint256 SignatureHashOld(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+{
+    if (nIn >= txTo.vin.size())
+        return 1;
+    CTransaction txTmp(txTo);
+
+    scriptCode.FindAndDelete(CScript(OP_CODESEPARATOR));
+
+    for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+        txTmp.vin[i].scriptSig = CScript();
+    txTmp.vin[nIn].scriptSig = scriptCode;
+
+    if ((nHashType & 0x1f) == SIGHASH_NONE)
+    {
+        txTmp.vout.clear();
+        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+            if (i != nIn)
+                txTmp.vin[i].nSequence = 0;
+    }
+    else if ((nHashType & 0x1f) == SIGHASH_SINGLE)
+    {
+        unsigned int nOut = nIn;
+        if (nOut >= txTmp.vout.size())
+            return 1;
+        txTmp.vout.resize(nOut+1);
+        for (unsigned int i = 0; i < nOut; i++)
+            txTmp.vout[i].SetNull();
+        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+            if (i != nIn)
+                txTmp.vin[i].nSequence = 0;
+    }
+
+    if (nHashType & SIGHASH_ANYONECANPAY)
+    {
+        txTmp.vin[0] = txTmp.vin[nIn];
+        txTmp.vin.resize(1);
+    }
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txTmp << nHashType;
+    return ss.GetHash();
+}
+
+static void RandomScript(CScript& script)
+{
+    static const opcodetype oplist[] = {OP_FALSE, OP_1, OP_2, OP_3, OP_CHECKSIG, OP_IF, OP_VERIF, OP_RETURN, OP_CODESEPARATOR};
+    script = CScript();
+    int ops = insecure_rand() % 10;
+    for (int i = 0; i < ops; i++)
+        script << oplist[insecure_rand() % (sizeof(oplist) / sizeof(oplist[0]))];
+}
+
+static void RandomTransaction(CTransaction& tx, bool fSingle)
+{
+    tx.nVersion = insecure_rand();
+    tx.nTime = insecure_rand();
+    tx.vin.clear();
+    tx.vout.clear();
+    tx.nLockTime = (insecure_rand() % 2) ? insecure_rand() : 0;
+    int ins = (insecure_rand() % 4) + 1;
+    int outs = fSingle ? ins : (insecure_rand() % 4) + 1;
+    for (int in = 0; in < ins; in++)
+    {
+        tx.vin.push_back(CTxIn());
+        CTxIn& txin = tx.vin.back();
+        txin.prevout.hash = GetRandHash();
+        txin.prevout.n = insecure_rand() % 4;
+        RandomScript(txin.scriptSig);
+        txin.nSequence = (insecure_rand() % 2) ? insecure_rand() : (unsigned int)-1;
+    }
+    for (int out = 0; out < outs; out++)
+    {
+        tx.vout.push_back(CTxOut());
+        CTxOut& txout = tx.vout.back();
+        txout.nValue = insecure_rand() % 100000000;
+        RandomScript(txout.scriptPubKey);
+    }
+}
+
+// A consolidation spending nInputs pay-to-pubkey-hash outputs, signed
+static void LargeTransaction(CTransaction& tx, int nInputs)
+{
+    tx.vin.resize(nInputs);
+    for (int i = 0; i < nInputs; i++)
+    {
+        tx.vin[i].prevout.hash = Hash(BEGIN(i), END(i));
+        tx.vin[i].prevout.n = 0;
+        tx.vin[i].scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+    }
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 5 * CREDIT;
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x01) << OP_EQUALVERIFY << OP_CHECKSIG;
+    tx.vout[1].nValue = 1 * CREDIT;
+    tx.vout[1].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x02) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+BOOST_AUTO_TEST_SUITE(sighash_tests)
+
+BOOST_AUTO_TEST_CASE(sighash_random)
+{
+    seed_insecure_rand(false);
+
+    for (int i = 0; i < 20000; i++)
+    {
+        int nHashType = insecure_rand();
+        CTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+        int nIn = insecure_rand() % txTo.vin.size();
+
+        uint256 sho = SignatureHashOld(scriptCode, txTo, nIn, nHashType);
+        BOOST_CHECK(SignatureHash(scriptCode, txTo, nIn, nHashType) == sho);
+        BOOST_CHECK(CSignatureHasher(txTo).SignatureHash(scriptCode, nIn, nHashType) == sho);
+    }
+
+    // Every input of one transaction through the same hasher, for each hash type
+    static const int nHashTypes[] = { SIGHASH_ALL, SIGHASH_NONE, SIGHASH_SINGLE,
+        SIGHASH_ALL | SIGHASH_ANYONECANPAY, SIGHASH_NONE | SIGHASH_ANYONECANPAY, SIGHASH_SINGLE | SIGHASH_ANYONECANPAY };
+    for (int i = 0; i < 1000; i++)
+    {
+        CTransaction txTo;
+        RandomTransaction(txTo, true);
+        CSignatureHasher sighasher(txTo);
+        for (unsigned int nIn = 0; nIn < txTo.vin.size(); nIn++)
+        {
+            CScript scriptCode;
+            RandomScript(scriptCode);
+            for (unsigned int n = 0; n < sizeof(nHashTypes) / sizeof(nHashTypes[0]); n++)
+                BOOST_CHECK(sighasher.SignatureHash(scriptCode, nIn, nHashTypes[n]) == SignatureHashOld(scriptCode, txTo, nIn, nHashTypes[n]));
+            // scriptSigs may change while the hasher is in use
+            txTo.vin[nIn].scriptSig = scriptCode;
+        }
+    }
+
+    // Out of range inputs and SIGHASH_SINGLE without a matching output hash to one
+    CTransaction txTo;
+    RandomTransaction(txTo, false);
+    txTo.vout.resize(1);
+    txTo.vin.resize(2);
+    CSignatureHasher sighasher(txTo);
+    BOOST_CHECK(sighasher.SignatureHash(CScript(), 2, SIGHASH_ALL) == 1);
+    BOOST_CHECK(SignatureHash(CScript(), txTo, 2, SIGHASH_ALL) == 1);
+    BOOST_CHECK(sighasher.SignatureHash(CScript(), 1, SIGHASH_SINGLE) == 1);
+    BOOST_CHECK(SignatureHashOld(CScript(), txTo, 1, SIGHASH_SINGLE) == 1);
+}
+
+BOOST_AUTO_TEST_CASE(sighash_large)
+{
+    CScript scriptCode = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x03) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    // The midstates of a large consolidation give the hashes of the old way;
+    // copying it for every input is slow, so check a sample of them
+    CTransaction txTo;
+    LargeTransaction(txTo, 10000);
+    CSignatureHasher sighasher(txTo);
+    for (int i = 0; i < 10000; i++)
+    {
+        uint256 hash = sighasher.SignatureHash(scriptCode, i, SIGHASH_ALL);
+        if (i % 97 == 0 || i == 9999)
+            BOOST_CHECK(hash == SignatureHashOld(scriptCode, txTo, i, SIGHASH_ALL));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
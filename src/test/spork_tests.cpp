@@ -0,0 +1,78 @@
+#include <boost/test/unit_test.hpp>
+
+#include "mainfunctions.h"
+#include "spork.h"
+#include "util.h"
+
+using namespace std;
+
+// The lookup IsSporkActive used to do on every call
+static bool IsSporkActiveMap(int nSporkID)
+{
+    int64_t r = -1;
+    if (mapSporksActive.count(nSporkID))
+        r = mapSporksActive[nSporkID].nValue;
+    else
+    {
+        if (nSporkID == SPORK_1_MASTERNODE_PAYMENTS_ENFORCEMENT) r = SPORK_1_MASTERNODE_PAYMENTS_ENFORCEMENT_DEFAULT;
+        if (nSporkID == SPORK_2_INSTANTX) r = SPORK_2_INSTANTX_DEFAULT;
+        if (nSporkID == SPORK_3_INSTANTX_BLOCK_FILTERING) r = SPORK_3_INSTANTX_BLOCK_FILTERING_DEFAULT;
+        if (nSporkID == SPORK_5_MAX_VALUE) r = SPORK_5_MAX_VALUE_DEFAULT;
+        if (nSporkID == SPORK_6_REPLAY_BLOCKS) r = SPORK_6_REPLAY_BLOCKS_DEFAULT;
+        if (nSporkID == SPORK_7_MASTERNODE_SCANNING) r = SPORK_7_MASTERNODE_SCANNING;
+        if (nSporkID == SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) r = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
+        if (nSporkID == SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT) r = SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT;
+        if (nSporkID == SPORK_10_MASTERNODE_PAY_UPDATED_NODES) r = SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT;
+        if (nSporkID == SPORK_11_RESET_BUDGET) r = SPORK_11_RESET_BUDGET_DEFAULT;
+        if (nSporkID == SPORK_12_RECONSIDER_BLOCKS) r = SPORK_12_RECONSIDER_BLOCKS_DEFAULT;
+        if (nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) r = SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
+    }
+    if (r == -1) r = 4070908800;
+    return r < GetTime();
+}
+
+static void SetTestSpork(int nSporkID, int64_t nValue)
+{
+    CSporkMessage spork;
+    spork.nSporkID = nSporkID;
+    spork.nValue = nValue;
+    spork.nTimeSigned = GetTime();
+    SetSporkActive(spork);
+}
+
+BOOST_AUTO_TEST_SUITE(spork_tests)
+
+BOOST_AUTO_TEST_CASE(spork_flags)
+{
+    for (int nSporkID = SPORK_START; nSporkID <= SPORK_END; nSporkID++)
+        BOOST_CHECK_EQUAL(IsSporkActive(nSporkID), IsSporkActiveMap(nSporkID));
+    BOOST_CHECK(IsSporkActive(SPORK_2_INSTANTX));
+    BOOST_CHECK(!IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT));
+    BOOST_CHECK_EQUAL(GetSporkValue(SPORK_5_MAX_VALUE), SPORK_5_MAX_VALUE_DEFAULT);
+    BOOST_CHECK(!IsSporkActive(SPORK_END + 1));
+
+    // A spork message takes effect at once
+    int64_t nNow = GetTime();
+    SetTestSpork(SPORK_2_INSTANTX, nNow + 3600);
+    BOOST_CHECK(!IsSporkActive(SPORK_2_INSTANTX));
+    SetTestSpork(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT, nNow + 60);
+    BOOST_CHECK(!IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT));
+
+    // and a scheduled activation once its time has passed
+    SetMockTime(nNow + 120);
+    CheckSporkSchedule();
+    BOOST_CHECK(IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT));
+    BOOST_CHECK(!IsSporkActive(SPORK_2_INSTANTX));
+    SetMockTime(nNow + 7200);
+    CheckSporkSchedule();
+    BOOST_CHECK(IsSporkActive(SPORK_2_INSTANTX));
+    for (int nSporkID = SPORK_START; nSporkID <= SPORK_END; nSporkID++)
+        BOOST_CHECK_EQUAL(IsSporkActive(nSporkID), IsSporkActiveMap(nSporkID));
+    SetMockTime(0);
+
+    SetTestSpork(SPORK_2_INSTANTX, SPORK_2_INSTANTX_DEFAULT);
+    SetTestSpork(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT, SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT);
+    mapSporksActive.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,57 @@
+// Copyright (c) 2018 The Advantage developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#define BOOST_TEST_MODULE Advantage Test Suite
+#include <boost/test/unit_test.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include "blockfile.h"
+#include "chainfunctions.h"
+#include "db.h"
+#include "init.h"
+#include "mainfunctions.h"
+#include "util.h"
+#include "wallet.h"
+
+extern void noui_connect();
+
+// A fresh data directory with the genesis block and an in-memory wallet,
+// set up once for the whole run
+struct TestingSetup
+{
+    boost::filesystem::path pathTemp;
+
+    TestingSetup()
+    {
+        fPrintToDebugLog = false;
+        noui_connect();
+        SelectParams(CChainParams::MAIN);
+        bitdb.MakeMock();
+        pathTemp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("test_advantage_%%%%-%%%%");
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+        StartParallelWorkers();
+        if (!LoadBlockIndex())
+            throw std::runtime_error("TestingSetup : LoadBlockIndex failed");
+
+        bool fFirstRun;
+        pwalletMain = new CWallet("wallet.dat");
+        pwalletMain->LoadWallet(fFirstRun);
+        RegisterWallet(pwalletMain);
+    }
+
+    ~TestingSetup()
+    {
+        UnregisterWallet(pwalletMain);
+        delete pwalletMain;
+        pwalletMain = NULL;
+        StopParallelWorkers();
+        CloseBlockFiles();
+        bitdb.Flush(true);
+        boost::filesystem::remove_all(pathTemp);
+    }
+};
+
+BOOST_GLOBAL_FIXTURE(TestingSetup);
@@ -0,0 +1,66 @@
+#include <boost/test/unit_test.hpp>
+
+#include "mainfunctions.h"
+#include "util.h"
+
+using namespace std;
+
+// A wallet-sized transaction: a few inputs with signatures, two outputs
+static CTransaction MakeTestTx(int nSeed)
+{
+    CTransaction tx;
+    tx.vin.resize(4);
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        tx.vin[i].prevout.hash = Hash(BEGIN(nSeed), END(nSeed));
+        tx.vin[i].prevout.n = i;
+        tx.vin[i].scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+    }
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 5 * CREDIT;
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x01) << OP_EQUALVERIFY << OP_CHECKSIG;
+    tx.vout[1].nValue = 1 * CREDIT;
+    tx.vout[1].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x02) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return tx;
+}
+
+BOOST_AUTO_TEST_SUITE(transaction_tests)
+
+BOOST_AUTO_TEST_CASE(hash_cache)
+{
+    CTransaction tx = MakeTestTx(1);
+    uint256 hash = SerializeHash(tx);
+    BOOST_CHECK(!tx.IsImmutable());
+    BOOST_CHECK(tx.GetHash() == hash);
+
+    tx.MakeImmutable();
+    BOOST_CHECK(tx.IsImmutable());
+    BOOST_CHECK(tx.GetHash() == hash);
+
+    // Copies are builders again and hash what they hold
+    CTransaction txCopy(tx);
+    BOOST_CHECK(!txCopy.IsImmutable());
+    txCopy.vout[1].nValue += 1;
+    BOOST_CHECK(txCopy.GetHash() != hash);
+    // and cache the hash of what they hold, not of what they were copied from
+    txCopy.MakeImmutable();
+    BOOST_CHECK(txCopy.GetHash() == SerializeHash(txCopy));
+    BOOST_CHECK(txCopy.GetHash() != hash);
+    txCopy = tx;
+    BOOST_CHECK(!txCopy.IsImmutable());
+    BOOST_CHECK(txCopy.GetHash() == hash);
+
+    // Reading into an immutable object starts over
+    CTransaction txOther = MakeTestTx(2);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << txOther;
+    ss >> tx;
+    BOOST_CHECK(!tx.IsImmutable());
+    BOOST_CHECK(tx.GetHash() == txOther.GetHash());
+
+    CTransactionRef ptx = MakeTransactionRef(txOther);
+    BOOST_CHECK(ptx->IsImmutable());
+    BOOST_CHECK(ptx->GetHash() == txOther.GetHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
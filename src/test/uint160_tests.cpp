@@ -10,7 +10,7 @@ BOOST_AUTO_TEST_CASE(uint160_equality)
     uint160 num2 = 11;
     BOOST_CHECK(num1+1 == num2);
 
-    uint64 num3 = 10;
+    uint64_t num3 = 10;
     BOOST_CHECK(num1 == num3);
     BOOST_CHECK(num1+num2 == num3+num2);
 }
@@ -0,0 +1,70 @@
+#include <boost/test/unit_test.hpp>
+
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(util_tests)
+
+// Each index goes to one thread only, so the counts need no lock
+static bool CountCall(vector<int>& vCalls, size_t nStopAt, size_t i)
+{
+    vCalls[i]++;
+    return i != nStopAt;
+}
+
+static bool ThrowAt(size_t nThrowAt, size_t i)
+{
+    if (i == nThrowAt)
+        throw std::runtime_error("ThrowAt");
+    return true;
+}
+
+static bool CountNested(vector<int>& vCalls, size_t i)
+{
+    vector<int> vInner(100);
+    ParallelFor(vInner.size(), 16, boost::bind(&CountCall, boost::ref(vInner), vInner.size(), _1));
+    for (size_t j = 0; j < vInner.size(); j++)
+        if (vInner[j] != 1)
+            return false;
+    vCalls[i]++;
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for)
+{
+    // Every index is handed out once, on one thread or several
+    static const size_t nSizes[] = { 0, 1, 15, 1000 };
+    for (unsigned int n = 0; n < sizeof(nSizes) / sizeof(nSizes[0]); n++)
+    {
+        vector<int> vCalls(nSizes[n]);
+        ParallelFor(nSizes[n], 16, boost::bind(&CountCall, boost::ref(vCalls), nSizes[n], _1));
+        for (size_t i = 0; i < nSizes[n]; i++)
+            BOOST_CHECK_EQUAL(vCalls[i], 1);
+    }
+
+    // A call returning false stops the loop past the indexes already handed out
+    vector<int> vCalls(100000);
+    ParallelFor(vCalls.size(), 16, boost::bind(&CountCall, boost::ref(vCalls), 100, _1));
+    size_t nCalled = 0;
+    for (size_t i = 0; i < vCalls.size(); i++)
+    {
+        BOOST_CHECK(vCalls[i] <= 1);
+        if (i <= 100)
+            BOOST_CHECK_EQUAL(vCalls[i], 1);
+        nCalled += vCalls[i];
+    }
+    BOOST_CHECK(nCalled < vCalls.size());
+
+    // An exception on any thread reaches the caller, and the workers carry on
+    BOOST_CHECK_THROW(ParallelFor(100000, 16, boost::bind(&ThrowAt, 5000, _1)), std::runtime_error);
+    BOOST_CHECK_THROW(ParallelFor(100000, 16, boost::bind(&ThrowAt, 0, _1)), std::runtime_error);
+
+    // Calls nest, from the calling thread and from the workers
+    vector<int> vOuter(64);
+    ParallelFor(vOuter.size(), 16, boost::bind(&CountNested, boost::ref(vOuter), _1));
+    for (size_t i = 0; i < vOuter.size(); i++)
+        BOOST_CHECK_EQUAL(vOuter[i], 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,169 @@
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include "base58.h"
+#include "db.h"
+#include "key.h"
+#include "util.h"
+#include "wallet.h"
+#include "walletdb.h"
+
+using namespace std;
+
+// Wallet files live in a directory of their own, removed with them
+struct WalletDBTestingSetup
+{
+    boost::filesystem::path pathTemp;
+
+    WalletDBTestingSetup()
+    {
+        pathTemp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("walletdb_tests_%%%%-%%%%");
+        boost::filesystem::create_directories(pathTemp);
+    }
+
+    ~WalletDBTestingSetup()
+    {
+        // Detach the files from the environment before they go
+        bitdb.Flush(false);
+        boost::filesystem::remove_all(pathTemp);
+    }
+
+    string File(const string& strName) const
+    {
+        return (pathTemp / strName).string();
+    }
+};
+
+static CTransaction MakeTestTx(int n)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = Hash(BEGIN(n), END(n));
+    tx.vin[0].prevout.n = 0;
+    tx.vin[0].scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 1 * CREDIT;
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x01) << OP_EQUALVERIFY << OP_CHECKSIG;
+    tx.vout[1].nValue = 2 * CREDIT;
+    tx.vout[1].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 0x02) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_SUITE(walletdb_tests, WalletDBTestingSetup)
+
+BOOST_AUTO_TEST_CASE(LoadWallet_records)
+{
+    // Every record type a used wallet holds, with transactions and keys
+    // interleaved with the rest in the file
+    string strFile = File("wallet_records.dat");
+    vector<uint256> vHash;
+    vector<CPubKey> vPubKey;
+    CPubKey vchDefaultKey;
+    CScript redeemScript;
+    {
+        CWalletDB walletdb(strFile, "cr+");
+        BOOST_CHECK(walletdb.WriteMinVersion(FEATURE_LATEST));
+        for (int i = 0; i < 200; i++)
+        {
+            CWalletTx wtx(NULL, MakeTestTx(i));
+            // the last ones predate transaction ordering
+            wtx.nOrderPos = i < 150 ? i : -1;
+            BOOST_CHECK(walletdb.WriteTx(wtx.GetHash(), wtx));
+            vHash.push_back(wtx.GetHash());
+        }
+        for (int i = 0; i < 20; i++)
+        {
+            CKey key;
+            key.MakeNewKey(true);
+            CPubKey pubkey = key.GetPubKey();
+            BOOST_CHECK(walletdb.WriteKey(pubkey, key.GetPrivKey(), CKeyMetadata(1000 + i)));
+            BOOST_CHECK(walletdb.WriteName(CBitcoinAddress(pubkey.GetID()).ToString(), strprintf("label %d", i)));
+            if (i < 10)
+                BOOST_CHECK(walletdb.WritePool(i + 1, CKeyPool(pubkey)));
+            vPubKey.push_back(pubkey);
+        }
+        vchDefaultKey = vPubKey[15];
+        BOOST_CHECK(walletdb.WriteDefaultKey(vchDefaultKey));
+        redeemScript.SetMultisig(1, vector<CPubKey>(vPubKey.begin(), vPubKey.begin() + 2));
+        BOOST_CHECK(walletdb.WriteCScript(Hash160(redeemScript), redeemScript));
+        CAccountingEntry ae;
+        ae.strAccount = "acct";
+        ae.nCreditDebit = 1;
+        ae.nTime = 1333333333;
+        ae.nOrderPos = 150;
+        ae.nEntryNo = 0;
+        BOOST_CHECK(walletdb.WriteAccountingEntry_Backend(ae));
+        BOOST_CHECK(walletdb.WriteOrderPosNext(151));
+    }
+
+    CWallet wallet(strFile);
+    bool fFirstRun;
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    BOOST_CHECK(!fFirstRun);
+
+    // Transactions come out immutable, bound to the wallet and all ordered
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), vHash.size());
+    BOOST_FOREACH(const uint256& hash, vHash)
+    {
+        map<uint256, CWalletTx>::const_iterator mi = wallet.mapWallet.find(hash);
+        BOOST_REQUIRE(mi != wallet.mapWallet.end());
+        BOOST_CHECK((*mi).second.IsImmutable());
+        BOOST_CHECK((*mi).second.GetHash() == hash);
+        BOOST_CHECK((*mi).second.nOrderPos >= 0);
+    }
+    BOOST_CHECK_EQUAL(wallet.wtxOrdered.size(), vHash.size() + 1);
+    set<int64_t> setOrderPos;
+    for (CWallet::TxItems::const_iterator it = wallet.wtxOrdered.begin(); it != wallet.wtxOrdered.end(); ++it)
+        setOrderPos.insert((*it).first);
+    BOOST_CHECK_EQUAL(setOrderPos.size(), vHash.size() + 1);
+    BOOST_CHECK(wallet.nOrderPosNext >= (int64_t)(vHash.size() + 1));
+    BOOST_CHECK_EQUAL(wallet.laccentries.size(), 1U);
+
+    // Keys with their metadata, labels, pool and default key
+    BOOST_FOREACH(const CPubKey& pubkey, vPubKey)
+    {
+        BOOST_CHECK(wallet.HaveKey(pubkey.GetID()));
+        BOOST_CHECK(wallet.mapKeyMetadata.count(pubkey.GetID()));
+        BOOST_CHECK(wallet.mapAddressBook.count(pubkey.GetID()));
+    }
+    BOOST_CHECK_EQUAL(wallet.mapAddressBook[vPubKey[3].GetID()], "label 3");
+    BOOST_CHECK_EQUAL(wallet.nTimeFirstKey, 1000);
+    BOOST_CHECK_EQUAL(wallet.setKeyPool.size(), 10U);
+    BOOST_CHECK(wallet.vchDefaultKey == vchDefaultKey);
+    BOOST_CHECK(wallet.HaveCScript(redeemScript.GetID()));
+}
+
+BOOST_AUTO_TEST_CASE(write_batch)
+{
+    // Writes made inside a batch, through their own CWalletDB the way
+    // CWalletTx::WriteToDisk makes them, land together when it ends
+    string strFile = File("wallet_batch.dat");
+    static const int nTx = 100;
+    {
+        CDBBatch batch(strFile);
+        for (int i = 0; i < nTx; i++)
+        {
+            CWalletTx wtx(NULL, MakeTestTx(i));
+            wtx.nOrderPos = i;
+            BOOST_CHECK(CWalletDB(strFile, "cr+").WriteTx(wtx.GetHash(), wtx));
+        }
+
+        // Explicit transactions nest inside the batch
+        CWalletDB walletdb(strFile);
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.WriteOrderPosNext(nTx));
+        BOOST_CHECK(walletdb.TxnCommit());
+    }
+
+    CWallet wallet(strFile);
+    bool fFirstRun;
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), (size_t)nTx);
+    BOOST_CHECK_EQUAL(wallet.nOrderPosNext, nTx);
+
+    // A key pool refill is written as one batch too
+    BOOST_CHECK(wallet.TopUpKeyPool(100));
+    BOOST_CHECK_EQUAL(wallet.setKeyPool.size(), 101U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,7 +4,9 @@
 // file license.txt or http://www.opensource.org/licenses/mit-license.php.
 
 #include <map>
+#include <sstream>
 
+#include <boost/atomic.hpp>
 #include <boost/version.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -26,11 +28,101 @@ using namespace boost;
 
 leveldb::DB *txdb; // global pointer for LevelDB object instance
 
-static leveldb::Options GetOptions() {
+// Commits slower than this count as write stalls in getdbstats
+static const int64_t TXDB_STALL_MS = 100;
+
+// LevelDB settings per workload, selected with -dbprofile. Initial download
+// is write heavy: big memtables mean fewer, larger level-0 files and fewer
+// compactions, and chain commits need not wait for the disk even with
+// -dbsync. Low memory keeps buffers, open tables and caches small.
+// Compression stays on everywhere: the options are fixed for as long as
+// the database is open, and tables written during initial download are
+// kept after it.
+static const CTxDBProfile txdbProfiles[] = {
+    // name      write buffer       open files  block size  compress  sync
+    { "default",  4 * 1024 * 1024,   64,         4096,       true,     true  },
+    { "ibd",      64 * 1024 * 1024,  1000,       16384,      true,     false },
+    { "lowmem",   1 * 1024 * 1024,   32,         4096,       true,     true  },
+};
+
+// Block cache that counts lookups, so getdbstats can report a hit rate
+class CCountingCache : public leveldb::Cache
+{
+private:
+    leveldb::Cache* base;
+
+public:
+    boost::atomic<uint64_t> nHits;
+    boost::atomic<uint64_t> nMisses;
+
+    CCountingCache(leveldb::Cache* baseIn) : base(baseIn), nHits(0), nMisses(0) {}
+    ~CCountingCache() { delete base; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge,
+                   void (*deleter)(const leveldb::Slice& key, void* value))
+    {
+        return base->Insert(key, value, charge, deleter);
+    }
+    Handle* Lookup(const leveldb::Slice& key)
+    {
+        Handle* handle = base->Lookup(key);
+        if (handle)
+            nHits++;
+        else
+            nMisses++;
+        return handle;
+    }
+    void Release(Handle* handle) { base->Release(handle); }
+    void* Value(Handle* handle) { return base->Value(handle); }
+    void Erase(const leveldb::Slice& key) { base->Erase(key); }
+    uint64_t NewId() { return base->NewId(); }
+};
+
+// Options of the open instance; they own the cache and filter policy
+static leveldb::Options txdbOptions;
+static boost::atomic<const CTxDBProfile*> ptxdbProfile(&txdbProfiles[0]);
+static bool fTxDBAutoProfile = false;
+static bool fTxDBSync = false;
+static CCountingCache* ptxdbCache = NULL;
+static boost::thread* ptxdbCompactThread = NULL;
+
+static boost::atomic<uint64_t> nTxDBCommits(0);
+static boost::atomic<uint64_t> nTxDBSyncCommits(0);
+static boost::atomic<uint64_t> nTxDBStalls(0);
+static boost::atomic<int64_t> nTxDBStallTimeMs(0);
+static boost::atomic<bool> fTxDBCompacting(false);
+static boost::atomic<int64_t> nTxDBLastCompaction(0);
+
+static const CTxDBProfile* SelectProfile(bool fNewDatabase)
+{
+    string strProfile = GetArg("-dbprofile", "auto");
+    fTxDBAutoProfile = (strProfile == "auto");
+    if (fTxDBAutoProfile)
+        // A new database is about to take the whole chain
+        strProfile = fNewDatabase ? "ibd" : "default";
+    for (unsigned int i = 0; i < sizeof(txdbProfiles) / sizeof(txdbProfiles[0]); i++)
+        if (strProfile == txdbProfiles[i].pszName)
+            return &txdbProfiles[i];
+    LogPrintf("Unknown -dbprofile=%s, using default\n", strProfile);
+    return &txdbProfiles[0];
+}
+
+// -dbcache, in megabytes: the size of the LevelDB block cache and, apart,
+// of the unspent output cache
+static int64_t GetCacheSizeMB(const CTxDBProfile* pprofile)
+{
+    return std::max(GetArg("-dbcache", strcmp(pprofile->pszName, "lowmem") == 0 ? 2 : 10), (int64_t)1);
+}
+
+static leveldb::Options GetOptions(const CTxDBProfile* pprofile) {
     leveldb::Options options;
-    int nCacheSizeMB = GetArg("-dbcache", 10);
-    options.block_cache = leveldb::NewLRUCache(nCacheSizeMB * 1048576);
+    ptxdbCache = new CCountingCache(leveldb::NewLRUCache(GetCacheSizeMB(pprofile) * 1048576));
+    options.block_cache = ptxdbCache;
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.write_buffer_size = pprofile->nWriteBufferSize;
+    options.max_open_files = pprofile->nMaxOpenFiles;
+    options.block_size = pprofile->nBlockSize;
+    options.compression = pprofile->fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
     return options;
 }
 
@@ -79,11 +171,13 @@ CTxDB::CTxDB(const char* pszMode)
 
     bool fCreate = strchr(pszMode, 'c');
 
-    options = GetOptions();
-    options.create_if_missing = true;
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    ptxdbProfile = SelectProfile(!filesystem::exists(GetDataDir() / "txleveldb"));
+    fTxDBSync = GetBoolArg("-dbsync", false);
+    txdbOptions = GetOptions(ptxdbProfile);
+    txdbOptions.create_if_missing = true;
+    LogPrintf("Using LevelDB profile %s%s\n", ptxdbProfile.load()->pszName, fTxDBSync ? ", synced chain commits" : "");
 
-    init_blockindex(options); // Init directory
+    init_blockindex(txdbOptions); // Init directory
     pdb = txdb;
 
     if (Exists(string("version")))
@@ -101,7 +195,7 @@ CTxDB::CTxDB(const char* pszMode)
             delete activeBatch;
             activeBatch = NULL;
 
-            init_blockindex(options, true); // Remove directory and create new database
+            init_blockindex(txdbOptions, true); // Remove directory and create new database
             pdb = txdb;
 
             bool fTmp = fReadOnly;
@@ -123,12 +217,22 @@ CTxDB::CTxDB(const char* pszMode)
 
 void CTxDB::Close()
 {
+    // CompactRange cannot be interrupted; the database must outlive it
+    if (ptxdbCompactThread)
+    {
+        if (fTxDBCompacting)
+            LogPrintf("Waiting for the transaction database compaction to finish\n");
+        ptxdbCompactThread->join();
+        delete ptxdbCompactThread;
+        ptxdbCompactThread = NULL;
+    }
     delete txdb;
     txdb = pdb = NULL;
-    delete options.filter_policy;
-    options.filter_policy = NULL;
-    delete options.block_cache;
-    options.block_cache = NULL;
+    delete txdbOptions.filter_policy;
+    txdbOptions.filter_policy = NULL;
+    delete txdbOptions.block_cache;
+    txdbOptions.block_cache = NULL;
+    ptxdbCache = NULL;
     delete activeBatch;
     activeBatch = NULL;
 }
@@ -140,12 +244,27 @@ bool CTxDB::TxnBegin()
     return true;
 }
 
-bool CTxDB::TxnCommit()
+bool CTxDB::TxnCommit(bool fSync)
 {
     assert(activeBatch);
-    leveldb::Status status = pdb->Write(leveldb::WriteOptions(), activeBatch);
+    leveldb::WriteOptions writeOptions;
+    writeOptions.sync = fSync && fTxDBSync && ptxdbProfile.load()->fSyncWrites;
+    int64_t nStart = GetTimeMillis();
+    leveldb::Status status = pdb->Write(writeOptions, activeBatch);
+    int64_t nElapsed = GetTimeMillis() - nStart;
     delete activeBatch;
     activeBatch = NULL;
+
+    nTxDBCommits++;
+    if (writeOptions.sync)
+        nTxDBSyncCommits++;
+    if (nElapsed > TXDB_STALL_MS)
+    {
+        nTxDBStalls++;
+        nTxDBStallTimeMs += nElapsed;
+        LogPrint("db", "LevelDB batch commit took %dms\n", nElapsed);
+    }
+
     if (!status.ok()) {
         LogPrintf("LevelDB batch commit failure: %s\n", status.ToString());
         return false;
@@ -153,6 +272,91 @@ bool CTxDB::TxnCommit()
     return true;
 }
 
+static void ThreadCompactTxDB(leveldb::DB* pdb)
+{
+    RenameThread("advantage-dbcompact");
+    int64_t nStart = GetTimeMillis();
+    LogPrintf("Compacting transaction database\n");
+    pdb->CompactRange(NULL, NULL);
+    LogPrintf("Compacted transaction database in %dms\n", GetTimeMillis() - nStart);
+    nTxDBLastCompaction = GetTime();
+    fTxDBCompacting = false;
+}
+
+void CTxDB::CompactAsync()
+{
+    if (!pdb || fTxDBCompacting.exchange(true))
+        return;
+    // The previous compaction is over
+    if (ptxdbCompactThread)
+    {
+        ptxdbCompactThread->join();
+        delete ptxdbCompactThread;
+    }
+    ptxdbCompactThread = new boost::thread(boost::bind(&ThreadCompactTxDB, pdb));
+}
+
+void CTxDB::EndInitialDownload()
+{
+    if (fTxDBAutoProfile && ptxdbProfile.load() != &txdbProfiles[0])
+    {
+        // Buffer sizes and open files only change when the database is
+        // opened again; syncing follows the profile from now on
+        LogPrintf("Initial download done, switching LevelDB profile from %s to %s\n", ptxdbProfile.load()->pszName, txdbProfiles[0].pszName);
+        ptxdbProfile = &txdbProfiles[0];
+    }
+    CompactAsync();
+}
+
+size_t CTxDB::GetCoinsCacheSize()
+{
+    return (size_t)GetCacheSizeMB(ptxdbProfile) << 20;
+}
+
+void CTxDB::GetStats(CTxDBStats& stats)
+{
+    stats.strProfile = ptxdbProfile.load()->pszName;
+    stats.nCommits = nTxDBCommits;
+    stats.nSyncCommits = nTxDBSyncCommits;
+    stats.nStalls = nTxDBStalls;
+    stats.nStallTimeMs = nTxDBStallTimeMs;
+    stats.nCacheHits = ptxdbCache ? (uint64_t)ptxdbCache->nHits : 0;
+    stats.nCacheMisses = ptxdbCache ? (uint64_t)ptxdbCache->nMisses : 0;
+    stats.fCompacting = fTxDBCompacting;
+    stats.nLastCompaction = nTxDBLastCompaction;
+    stats.nCompactionReadMB = stats.nCompactionWriteMB = 0;
+    stats.vFilesAtLevel.clear();
+    if (!pdb)
+        return;
+
+    for (int nLevel = 0; ; nLevel++)
+    {
+        string strValue;
+        if (!pdb->GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), &strValue))
+            break;
+        stats.vFilesAtLevel.push_back(atoi(strValue));
+    }
+
+    // Compaction totals only come as the "stats" table:
+    // Level  Files Size(MB) Time(sec) Read(MB) Write(MB)
+    string strStats;
+    if (pdb->GetProperty("leveldb.stats", &strStats))
+    {
+        std::istringstream ss(strStats);
+        string strLine;
+        while (std::getline(ss, strLine))
+        {
+            int nLevel, nFiles;
+            double dSize, dTime, dRead, dWrite;
+            if (sscanf(strLine.c_str(), "%d %d %lf %lf %lf %lf", &nLevel, &nFiles, &dSize, &dTime, &dRead, &dWrite) == 6)
+            {
+                stats.nCompactionReadMB += dRead;
+                stats.nCompactionWriteMB += dWrite;
+            }
+        }
+    }
+}
+
 class CBatchScanner : public leveldb::WriteBatch::Handler {
 public:
     std::string needle;
@@ -224,6 +428,21 @@ bool CTxDB::ReadAddrIndex(uint160 addrHash, std::vector<uint256>& txHashes)
     return Read(make_pair(string("adr"), addrHash), txHashes);
 }
 
+bool CTxDB::HaveBlockFilter(uint256 hashBlock)
+{
+    return Exists(make_pair(string("bfilter"), hashBlock));
+}
+
+bool CTxDB::ReadBlockFilter(uint256 hashBlock, CBlockFilter& filter)
+{
+    return Read(make_pair(string("bfilter"), hashBlock), filter);
+}
+
+bool CTxDB::WriteBlockFilter(const CBlockFilter& filter)
+{
+    return Write(make_pair(string("bfilter"), filter.GetBlockHash()), filter);
+}
+
 bool CTxDB::ReadTxIndex(uint256 hash, CTxIndex& txindex)
 {
     txindex.SetNull();
@@ -239,7 +458,7 @@ bool CTxDB::AddTxIndex(const CTransaction& tx, const CDiskTxPos& pos, int nHeigh
 {
     // Add to tx index
     uint256 hash = tx.GetHash();
-    CTxIndex txindex(pos, tx.vout.size());
+    CTxIndex txindex(pos);
     return Write(make_pair(string("tx"), hash), txindex);
 }
 
@@ -305,6 +524,84 @@ bool CTxDB::WriteBestInvalidTrust(CBigNum bnBestInvalidTrust)
     return Write(string("bnBestInvalidTrust"), bnBestInvalidTrust);
 }
 
+bool CTxDB::ReadCoin(const COutPoint& outpoint, CCoin& coin)
+{
+    return Read(make_pair(string("utxo"), outpoint), coin);
+}
+
+bool CTxDB::WriteCoin(const COutPoint& outpoint, const CCoin& coin)
+{
+    return Write(make_pair(string("utxo"), outpoint), coin);
+}
+
+bool CTxDB::EraseCoin(const COutPoint& outpoint)
+{
+    return Erase(make_pair(string("utxo"), outpoint));
+}
+
+bool CTxDB::ReadBestCoinsBlock(uint256& hashBlock)
+{
+    return Read(string("hashBestCoins"), hashBlock);
+}
+
+bool CTxDB::WriteBestCoinsBlock(uint256 hashBlock)
+{
+    return Write(string("hashBestCoins"), hashBlock);
+}
+
+bool CTxDB::EraseBestCoinsBlock()
+{
+    return Erase(string("hashBestCoins"));
+}
+
+bool CTxDB::ReadCoinsVersion(int& nVersion)
+{
+    return Read(string("coinsVersion"), nVersion);
+}
+
+bool CTxDB::WriteCoinsVersion(int nVersion)
+{
+    return Write(string("coinsVersion"), nVersion);
+}
+
+// Drop the stored unspent output set, before it is rebuilt by replaying the
+// best chain
+bool CTxDB::EraseCoins()
+{
+    assert(!activeBatch);
+    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << make_pair(string("utxo"), COutPoint(0, 0));
+    iterator->Seek(ssStartKey.str());
+    TxnBegin();
+    EraseBestCoinsBlock();
+    unsigned int nErased = 0;
+    while (iterator->Valid())
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.write(iterator->key().data(), iterator->key().size());
+        string strType;
+        ssKey >> strType;
+        if (strType != "utxo")
+            break;
+        activeBatch->Delete(iterator->key());
+        if (++nErased % 50000 == 0)
+        {
+            if (!TxnCommit())
+            {
+                delete iterator;
+                return error("EraseCoins() : erasing old set failed");
+            }
+            TxnBegin();
+        }
+        iterator->Next();
+    }
+    delete iterator;
+    if (!TxnCommit())
+        return error("EraseCoins() : erasing old set failed");
+    return true;
+}
+
 static CBlockIndex *InsertBlockIndex(uint256 hash)
 {
     if (hash == 0)
@@ -430,6 +727,7 @@ bool CTxDB::LoadBlockIndex()
     pindexBest = mapBlockIndex[hashBestChain];
     nBestHeight = pindexBest->nHeight;
     nBestChainTrust = pindexBest->nChainTrust;
+    UpdateChainTip(pindexBest);
 
     LogPrintf("LoadBlockIndex(): hashBestChain=%s  height=%d  trust=%s  date=%s\n",
       hashBestChain.ToString(), nBestHeight, CBigNum(nBestChainTrust).ToString(),
@@ -440,6 +738,13 @@ bool CTxDB::LoadBlockIndex()
     ReadBestInvalidTrust(bnBestInvalidTrust);
     nBestInvalidTrust = bnBestInvalidTrust.getuint256();
 
+    // Bring the unspent output set up to the best chain; moving the chain
+    // back to a bad block found below goes through it
+    if (!pcoinsTip)
+        pcoinsTip = new CCoinsCache(GetCoinsCacheSize());
+    if (!pcoinsTip->Load(*this))
+        return error("CTxDB::LoadBlockIndex() : loading the unspent output set failed");
+
     // Verify blocks in the best chain
     int nCheckLevel = GetArg("-checklevel", 1);
     int nCheckDepth = GetArg( "-checkblocks", 500);
@@ -449,7 +754,6 @@ bool CTxDB::LoadBlockIndex()
         nCheckDepth = nBestHeight;
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
     CBlockIndex* pindexFork = NULL;
-    map<pair<unsigned int, unsigned int>, CBlockIndex*> mapBlockPos;
     for (CBlockIndex* pindex = pindexBest; pindex && pindex->pprev; pindex = pindex->pprev)
     {
         boost::this_thread::interruption_point();
@@ -468,8 +772,6 @@ bool CTxDB::LoadBlockIndex()
         // check level 2: verify transaction index validity
         if (nCheckLevel>1)
         {
-            pair<unsigned int, unsigned int> pos = make_pair(pindex->nFile, pindex->nBlockPos);
-            mapBlockPos[pos] = pindex;
             BOOST_FOREACH(const CTransaction &tx, block.vtx)
             {
                 uint256 hashTx = tx.GetHash();
@@ -493,64 +795,33 @@ bool CTxDB::LoadBlockIndex()
                                 pindexFork = pindex->pprev;
                             }
                     }
-                    // check level 4: check whether spent txouts were spent within the main chain
-                    unsigned int nOutput = 0;
+                    // check level 4: check the unspent outputs of the transaction against it
                     if (nCheckLevel>3)
                     {
-                        BOOST_FOREACH(const CDiskTxPos &txpos, txindex.vSpent)
+                        for (unsigned int n = 0; n < tx.vout.size(); n++)
                         {
-                            if (!txpos.IsNull())
+                            CCoin coin;
+                            if (!pcoinsTip->GetCoin(COutPoint(hashTx, n), coin, pindexBest))
+                                continue;
+                            if (coin.nHeight != pindex->nHeight || coin.txout != tx.vout[n])
                             {
-                                pair<unsigned int, unsigned int> posFind = make_pair(txpos.nFile, txpos.nBlockPos);
-                                if (!mapBlockPos.count(posFind))
-                                {
-                                    LogPrintf("LoadBlockIndex(): *** found bad spend at %d, hashBlock=%s, hashTx=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString(), hashTx.ToString());
-                                    pindexFork = pindex->pprev;
-                                }
-                                // check level 6: check whether spent txouts were spent by a valid transaction that consume them
-                                if (nCheckLevel>5)
-                                {
-                                    CTransaction txSpend;
-                                    if (!txSpend.ReadFromDisk(txpos))
-                                    {
-                                        LogPrintf("LoadBlockIndex(): *** cannot read spending transaction of %s:%i from disk\n", hashTx.ToString(), nOutput);
-                                        pindexFork = pindex->pprev;
-                                    }
-                                    else if (!txSpend.CheckTransaction())
-                                    {
-                                        LogPrintf("LoadBlockIndex(): *** spending transaction of %s:%i is invalid\n", hashTx.ToString(), nOutput);
-                                        pindexFork = pindex->pprev;
-                                    }
-                                    else
-                                    {
-                                        bool fFound = false;
-                                        BOOST_FOREACH(const CTxIn &txin, txSpend.vin)
-                                            if (txin.prevout.hash == hashTx && txin.prevout.n == nOutput)
-                                                fFound = true;
-                                        if (!fFound)
-                                        {
-                                            LogPrintf("LoadBlockIndex(): *** spending transaction of %s:%i does not spend it\n", hashTx.ToString(), nOutput);
-                                            pindexFork = pindex->pprev;
-                                        }
-                                    }
-                                }
+                                LogPrintf("LoadBlockIndex(): *** unspent output %s:%i does not match block %d\n", hashTx.ToString(), n, pindex->nHeight);
+                                pindexFork = pindex->pprev;
                             }
-                            nOutput++;
                         }
                     }
                 }
-                // check level 5: check whether all prevouts are marked spent
-                if (nCheckLevel>4)
+                // check level 5: check that no prevout is still unspent
+                if (nCheckLevel>4 && !tx.IsCoinBase())
                 {
                      BOOST_FOREACH(const CTxIn &txin, tx.vin)
                      {
-                          CTxIndex txindex;
-                          if (ReadTxIndex(txin.prevout.hash, txindex))
-                              if (txindex.vSpent.size()-1 < txin.prevout.n || txindex.vSpent[txin.prevout.n].IsNull())
-                              {
-                                  LogPrintf("LoadBlockIndex(): *** found unspent prevout %s:%i in %s\n", txin.prevout.hash.ToString(), txin.prevout.n, hashTx.ToString());
-                                  pindexFork = pindex->pprev;
-                              }
+                          CCoin coin;
+                          if (pcoinsTip->GetCoin(txin.prevout, coin, pindexBest))
+                          {
+                              LogPrintf("LoadBlockIndex(): *** found unspent prevout %s:%i in %s\n", txin.prevout.hash.ToString(), txin.prevout.n, hashTx.ToString());
+                              pindexFork = pindex->pprev;
+                          }
                      }
                 }
             }
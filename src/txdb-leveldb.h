@@ -7,6 +7,8 @@
 #define BITCREDIT_LEVELDB_H
 
 #include "mainfunctions.h"
+#include "blockfilter.h"
+#include "coins.h"
 
 #include <map>
 #include <string>
@@ -15,6 +17,34 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+/** LevelDB settings for one kind of workload (-dbprofile) */
+struct CTxDBProfile
+{
+    const char* pszName;
+    size_t nWriteBufferSize;
+    int nMaxOpenFiles;
+    size_t nBlockSize;
+    bool fCompression;
+    bool fSyncWrites; // with -dbsync, sync commits that move the best chain
+};
+
+/** Runtime statistics of the transaction database */
+struct CTxDBStats
+{
+    std::string strProfile;
+    uint64_t nCommits;
+    uint64_t nSyncCommits;
+    uint64_t nStalls;        // batch commits slower than TXDB_STALL_MS
+    int64_t nStallTimeMs;
+    uint64_t nCacheHits;     // block cache
+    uint64_t nCacheMisses;
+    std::vector<int> vFilesAtLevel;
+    double nCompactionReadMB;
+    double nCompactionWriteMB;
+    bool fCompacting;
+    int64_t nLastCompaction;
+};
+
 // Class that provides access to a LevelDB. Note that this class is frequently
 // instantiated on the stack and then destroyed again, so instantiation has to
 // be very cheap. Unfortunately that means, a CTxDB instance is actually just a
@@ -46,7 +76,6 @@ private:
     // A batch stores up writes and deletes for atomic application. When this
     // field is non-NULL, writes/deletes go there instead of directly to disk.
     leveldb::WriteBatch *activeBatch;
-    leveldb::Options options;
     bool fReadOnly;
     int nVersion;
 
@@ -164,7 +193,9 @@ protected:
 
 public:
     bool TxnBegin();
-    bool TxnCommit();
+    // fSync: the batch moves the best chain; with -dbsync, and unless the
+    // -dbprofile says otherwise, the commit waits for the disk
+    bool TxnCommit(bool fSync=false);
     bool TxnAbort()
     {
         delete activeBatch;
@@ -199,7 +230,27 @@ public:
     bool WriteHashBestChain(uint256 hashBestChain);
     bool ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust);
     bool WriteBestInvalidTrust(CBigNum bnBestInvalidTrust);
+    bool ReadCoin(const COutPoint& outpoint, CCoin& coin);
+    bool WriteCoin(const COutPoint& outpoint, const CCoin& coin);
+    bool EraseCoin(const COutPoint& outpoint);
+    bool ReadBestCoinsBlock(uint256& hashBlock);
+    bool WriteBestCoinsBlock(uint256 hashBlock);
+    bool EraseBestCoinsBlock();
+    bool ReadCoinsVersion(int& nVersion);
+    bool WriteCoinsVersion(int nVersion);
+    bool EraseCoins();
+    bool HaveBlockFilter(uint256 hashBlock);
+    bool ReadBlockFilter(uint256 hashBlock, CBlockFilter& filter);
+    bool WriteBlockFilter(const CBlockFilter& filter);
     bool LoadBlockIndex();
+
+    // Compact the whole database in a background thread, which Close() waits for
+    void CompactAsync();
+    // Leave the ibd profile picked by -dbprofile=auto and compact once
+    void EndInitialDownload();
+    // Size of the unspent output cache for the profile, from -dbcache
+    size_t GetCoinsCacheSize();
+    void GetStats(CTxDBStats& stats);
 private:
     bool LoadBlockIndexGuts();
 };
@@ -25,16 +25,18 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
-bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx)
+bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx, const CMempoolInputs& inputs)
 {
     // Add to memory pool without checking anything.
     // Used by mainfuctions.cpp AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = tx;
-        for (unsigned int i = 0; i < tx.vin.size(); i++)
-            mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
+        CTransactionRef ptx = MakeTransactionRef(tx);
+        mapTx[hash] = ptx;
+        mapTxInputs[hash] = inputs;
+        for (unsigned int i = 0; i < ptx->vin.size(); i++)
+            mapNextTx[ptx->vin[i].prevout] = CInPoint(ptx.get(), i);
         nTransactionsUpdated++;
     }
     return true;
@@ -58,6 +60,7 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive)
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
             mapTx.erase(hash);
+            mapTxInputs.erase(hash);
             nTransactionsUpdated++;
         }
     }
@@ -83,6 +86,7 @@ void CTxMemPool::clear()
 {
     LOCK(cs);
     mapTx.clear();
+    mapTxInputs.clear();
     mapNextTx.clear();
     ++nTransactionsUpdated;
 }
@@ -93,15 +97,38 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+    for (map<uint256, CTransactionRef>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
         vtxid.push_back((*mi).first);
 }
 
+void CTxMemPool::UpdateInputHeights(const CTransaction &tx, int nHeight)
+{
+    LOCK(cs);
+    uint256 hash = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
+        if (it == mapNextTx.end())
+            continue;
+        std::map<uint256, CMempoolInputs>::iterator mi = mapTxInputs.find(it->second.ptx->GetHash());
+        if (mi != mapTxInputs.end() && it->second.n < mi->second.vPrevOut.size())
+            mi->second.vPrevOut[it->second.n].nHeight = nHeight;
+    }
+}
+
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
 {
     LOCK(cs);
-    std::map<uint256, CTransaction>::const_iterator i = mapTx.find(hash);
+    std::map<uint256, CTransactionRef>::const_iterator i = mapTx.find(hash);
     if (i == mapTx.end()) return false;
-    result = i->second;
+    result = *i->second;
     return true;
 }
+
+CTransactionRef CTxMemPool::get(const uint256& hash) const
+{
+    LOCK(cs);
+    std::map<uint256, CTransactionRef>::const_iterator i = mapTx.find(hash);
+    if (i == mapTx.end()) return CTransactionRef();
+    return i->second;
+}
@@ -7,6 +7,36 @@
 
 #include "core.h"
 
+/** Height recorded for an input whose parent is still in the memory pool */
+static const int MEMPOOL_HEIGHT = 0x7FFFFFFF;
+
+/** An output spent by a pool transaction, as resolved when the spender was accepted */
+class CMempoolPrevOut
+{
+public:
+    CTxOut txout;
+    int nHeight;     // height of the block holding the parent, or MEMPOOL_HEIGHT
+    bool fCoinBase;  // parent is a coinbase or coinstake (subject to maturity)
+
+    CMempoolPrevOut() : nHeight(MEMPOOL_HEIGHT), fCoinBase(false) {}
+};
+
+/*
+ * What block assembly needs to know about a pool transaction's inputs,
+ * so CreateNewBlock can rank and fill a block without touching the disk.
+ * Filled by AcceptToMemoryPool and kept current as blocks connect.
+ */
+class CMempoolInputs
+{
+public:
+    std::vector<CMempoolPrevOut> vPrevOut; // one per vin, same order
+    int64_t nValueIn;
+    unsigned int nTxSize;
+    unsigned int nSigOps; // legacy + P2SH
+
+    CMempoolInputs() : nValueIn(0), nTxSize(0), nSigOps(0) {}
+};
+
 /*
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -24,16 +54,20 @@ private:
 
 public:
     mutable CCriticalSection cs;
-    std::map<uint256, CTransaction> mapTx;
+    std::map<uint256, CTransactionRef> mapTx; // shared, immutable (hash computed once)
+    std::map<uint256, CMempoolInputs> mapTxInputs;
     std::map<COutPoint, CInPoint> mapNextTx;
 
     CTxMemPool();
 
-    bool addUnchecked(const uint256& hash, CTransaction &tx);
+    bool addUnchecked(const uint256& hash, CTransaction &tx, const CMempoolInputs& inputs);
     bool remove(const CTransaction &tx, bool fRecursive = false);
     bool removeConflicts(const CTransaction &tx);
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
+    /** Record that tx's outputs are now confirmed at nHeight (or back in the pool
+     *  with MEMPOOL_HEIGHT) in the cached inputs of the transactions spending them */
+    void UpdateInputHeights(const CTransaction& tx, int nHeight);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
 
@@ -50,6 +84,8 @@ public:
     }
 
     bool lookup(uint256 hash, CTransaction& result) const;
+    /** The pool's own shared copy of a transaction, or an empty pointer */
+    CTransactionRef get(const uint256& hash) const;
 };
 
 #endif /* BITCREDIT_TXMEMPOOL_H */
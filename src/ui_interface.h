@@ -100,6 +100,12 @@ public:
     /** Banlist did change. */
     boost::signals2::signal<void (void)> BannedListChanged;
 
+    /**
+     * New best block.
+     * @note called with lock cs_main held.
+     */
+    boost::signals2::signal<void (int nHeight)> NotifyBlockTip;
+
 };
 
 extern CClientUIInterface uiInterface;
@@ -35,6 +35,8 @@ namespace boost {
 #include <boost/program_options/parsers.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/atomic.hpp>
+#include <boost/exception_ptr.hpp>
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 #include <openssl/crypto.h>
@@ -67,6 +69,11 @@ namespace boost {
 # include <sys/prctl.h>
 #endif
 
+#ifndef WIN32
+#include <signal.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 
 //Dark  features
@@ -224,12 +231,131 @@ uint256 GetRandHash()
 // destroyed, and then some later destructor calls OutputDebugStringF,
 // maybe indirectly, and you get a core dump at shutdown trying to lock
 // the mutex).
+//
+// For the same reason the queue feeding the background writer below is
+// allocated once and never freed. While the writer is running LogPrintStr
+// only formats and enqueues; for ERROR lines, before StartLogWriter(), after
+// StopLogWriter() or when the queue is full it drains the queue and writes
+// synchronously.
+
+/** Bounded multi-producer queue of pending debug.log lines. Each slot carries
+ *  a sequence number so producers claim slots with a single CAS and the
+ *  consumer needs no lock (D. Vyukov's bounded MPMC queue, used here with
+ *  one consumer at a time: whoever holds mutexDebugLog). */
+class CLogQueue
+{
+private:
+    struct Slot
+    {
+        boost::atomic<size_t> nSeq;
+        int64_t nTime;
+        std::string str;
+    };
+
+    Slot* pslots;
+    size_t nMask;
+    boost::atomic<size_t> nEnqueuePos;
+    char padding[64]; // keep producers and the consumer off one cache line
+    boost::atomic<size_t> nDequeuePos;
+
+public:
+    explicit CLogQueue(size_t nSize) : pslots(new Slot[nSize]), nMask(nSize - 1), nEnqueuePos(0), nDequeuePos(0)
+    {
+        assert(nSize >= 2 && (nSize & (nSize - 1)) == 0);
+        for (size_t i = 0; i < nSize; i++)
+            pslots[i].nSeq.store(i, boost::memory_order_relaxed);
+    }
+
+    size_t Capacity() const { return nMask + 1; }
+
+    size_t ApproxSize() const
+    {
+        return nEnqueuePos.load(boost::memory_order_relaxed) - nDequeuePos.load(boost::memory_order_relaxed);
+    }
+
+    /** Move str into the queue; returns false (leaving str alone) if full */
+    bool Push(std::string& str, int64_t nTime)
+    {
+        size_t nPos = nEnqueuePos.load(boost::memory_order_relaxed);
+        Slot* pslot;
+        while (true)
+        {
+            pslot = &pslots[nPos & nMask];
+            size_t nSeq = pslot->nSeq.load(boost::memory_order_acquire);
+            intptr_t nDiff = (intptr_t)nSeq - (intptr_t)nPos;
+            if (nDiff == 0)
+            {
+                if (nEnqueuePos.compare_exchange_weak(nPos, nPos + 1, boost::memory_order_relaxed))
+                    break;
+            }
+            else if (nDiff < 0)
+                return false;
+            else
+                nPos = nEnqueuePos.load(boost::memory_order_relaxed);
+        }
+        pslot->str.swap(str);
+        pslot->nTime = nTime;
+        pslot->nSeq.store(nPos + 1, boost::memory_order_release);
+        return true;
+    }
+
+    /** Take the oldest line; only one thread may pop at a time */
+    bool Pop(std::string& str, int64_t& nTime)
+    {
+        size_t nPos = nDequeuePos.load(boost::memory_order_relaxed);
+        Slot* pslot = &pslots[nPos & nMask];
+        if (pslot->nSeq.load(boost::memory_order_acquire) != nPos + 1)
+            return false;
+        str.swap(pslot->str);
+        pslot->str.clear();
+        nTime = pslot->nTime;
+        nDequeuePos.store(nPos + 1, boost::memory_order_relaxed);
+        pslot->nSeq.store(nPos + nMask + 1, boost::memory_order_release);
+        return true;
+    }
+
+#ifndef WIN32
+    /** Write every queued line to fd with write() alone, leaving the
+     *  strings' memory where it is, so a signal handler may call it */
+    void WriteOut(int fd)
+    {
+        while (true)
+        {
+            size_t nPos = nDequeuePos.load(boost::memory_order_relaxed);
+            Slot* pslot = &pslots[nPos & nMask];
+            if (pslot->nSeq.load(boost::memory_order_acquire) != nPos + 1)
+                return;
+            const char* pch = pslot->str.data();
+            size_t nLeft = pslot->str.size();
+            while (nLeft > 0)
+            {
+                ssize_t nWritten = write(fd, pch, nLeft);
+                if (nWritten <= 0)
+                    return;
+                pch += nWritten;
+                nLeft -= nWritten;
+            }
+            nDequeuePos.store(nPos + 1, boost::memory_order_relaxed);
+            pslot->nSeq.store(nPos + nMask + 1, boost::memory_order_release);
+        }
+    }
+#endif
+};
+
+static const size_t LOG_QUEUE_SIZE = 8192;
 
 static boost::once_flag debugPrintInitFlag = BOOST_ONCE_INIT;
 // We use boost::call_once() to make sure these are initialized in
 // in a thread-safe manner the first time it is called:
 static FILE* fileout = NULL;
 static boost::mutex* mutexDebugLog = NULL;
+static CLogQueue* plogQueue = NULL;
+static boost::mutex* mutexLogWake = NULL;
+static boost::condition_variable* condLogWake = NULL;
+
+static boost::atomic<bool> fLogWriterRunning(false);
+static volatile bool fLogWriterStop = false;
+static boost::thread* pthreadLogWriter = NULL;
 
 static void DebugPrintInit()
 {
@@ -238,37 +364,243 @@ static void DebugPrintInit()
 
     boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
     fileout = fopen(pathDebug.string().c_str(), "a");
-    if (fileout) setbuf(fileout, NULL); // unbuffered
+    if (fileout) setvbuf(fileout, NULL, _IOFBF, 1 << 16); // flushed explicitly after each write
 
     mutexDebugLog = new boost::mutex();
+    plogQueue = new CLogQueue(LOG_QUEUE_SIZE);
+    mutexLogWake = new boost::mutex();
+    condLogWake = new boost::condition_variable();
 }
 
-bool LogAcceptCategory(const char* category)
+// Everything below this point runs with mutexDebugLog held.
+
+static bool fStartedNewLine = true;
+static int64_t nLastStampTime = -1;
+static std::string strLastStamp;
+
+static void WriteLogLine(const std::string& str, int64_t nTime, std::string& strBatch)
 {
-    if (category != NULL)
+    // Debug print useful for profiling
+    if (fLogTimestamps && fStartedNewLine)
     {
-        if (!fDebug)
-            return false;
+        // Lines come in bursts, format each second once
+        if (nTime != nLastStampTime)
+        {
+            strLastStamp = DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTime) + " ";
+            nLastStampTime = nTime;
+        }
+        strBatch += strLastStamp;
+    }
+    fStartedNewLine = !str.empty() && str[str.size()-1] == '\n';
+    strBatch += str;
+}
 
-        // Give each thread quick access to -debug settings.
-        // This helps prevent issues debugging global destructors,
-        // where mapMultiArgs might be deleted before another
-        // global destructor calls LogPrint()
-        static boost::thread_specific_ptr<set<string> > ptrCategory;
-        if (ptrCategory.get() == NULL)
+static void DrainLogQueue(std::string& strBatch)
+{
+    // reopen the log file, if requested
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+        if (freopen(pathDebug.string().c_str(),"a",fileout) != NULL)
+            setvbuf(fileout, NULL, _IOFBF, 1 << 16);
+    }
+
+    std::string str;
+    int64_t nTime;
+    while (plogQueue->Pop(str, nTime))
+        WriteLogLine(str, nTime, strBatch);
+}
+
+static void CommitLogBatch(std::string& strBatch)
+{
+    if (!strBatch.empty())
+    {
+        fwrite(strBatch.data(), 1, strBatch.size(), fileout);
+        strBatch.clear();
+    }
+    fflush(fileout);
+}
+
+static void ThreadLogWriter()
+{
+    RenameThread("advantage-logwriter");
+    std::string strBatch;
+    while (true)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(*mutexLogWake);
+            if (!fLogWriterStop && plogQueue->ApproxSize() < plogQueue->Capacity() / 4)
+                condLogWake->timed_wait(lock, boost::posix_time::milliseconds(100));
+        }
         {
-            const vector<string>& categories = mapMultiArgs["-debug"];
-            ptrCategory.reset(new set<string>(categories.begin(), categories.end()));
-            // thread_specific_ptr automatically deletes the set when the thread ends.
+            boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+            DrainLogQueue(strBatch);
+            CommitLogBatch(strBatch);
         }
-        const set<string>& setCategories = *ptrCategory.get();
+        if (fLogWriterStop)
+            break;
+    }
+}
 
-        // if not debugging everything and not debugging specific category, LogPrint does nothing.
-        if (setCategories.count(string("")) == 0 &&
-            setCategories.count(string(category)) == 0)
-            return false;
+#ifndef WIN32
+// An assert, abort or crash would otherwise take the queued lines, the ones
+// most likely to say what went wrong, down with the process. Write them out
+// raw (no timestamps: formatting one is not async-signal-safe) and let the
+// signal's default action run. If the crash hit while mutexDebugLog was held
+// the lines stay queued rather than risk writing them twice.
+static void HandleFatalSignal(int nSig)
+{
+    if (mutexDebugLog->try_lock())
+    {
+        int fd = fileno(fileout);
+        if (plogQueue->ApproxSize() > 0)
+        {
+            static const char pszMarker[] = "--- lines queued at a fatal signal follow ---\n";
+            if (write(fd, pszMarker, sizeof(pszMarker) - 1) > 0)
+                plogQueue->WriteOut(fd);
+        }
+        mutexDebugLog->unlock();
     }
-    return true;
+    raise(nSig);
+}
+
+static void InstallFatalSignalHandlers()
+{
+    struct sigaction sa;
+    sa.sa_handler = HandleFatalSignal;
+    sigemptyset(&sa.sa_mask);
+    // Reset to the default action on entry, so the raise() above ends the
+    // process (and dumps core) just as the signal would have
+    sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+    sigaction(SIGABRT, &sa, NULL);
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL);
+    sigaction(SIGFPE, &sa, NULL);
+}
+#endif
+
+void StartLogWriter()
+{
+    if (fPrintToConsole || !fPrintToDebugLog || !GetBoolArg("-logasync", true))
+        return;
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    if (fileout == NULL || pthreadLogWriter != NULL)
+        return;
+
+    fLogWriterStop = false;
+    pthreadLogWriter = new boost::thread(&ThreadLogWriter);
+    fLogWriterRunning.store(true, boost::memory_order_release);
+    atexit(FlushDebugLog);
+#ifndef WIN32
+    InstallFatalSignalHandlers();
+#endif
+}
+
+void StopLogWriter()
+{
+    if (pthreadLogWriter == NULL)
+        return;
+
+    fLogWriterRunning.store(false, boost::memory_order_release);
+    fLogWriterStop = true;
+    condLogWake->notify_one();
+    pthreadLogWriter->join();
+    delete pthreadLogWriter;
+    pthreadLogWriter = NULL;
+
+    FlushDebugLog();
+}
+
+void FlushDebugLog()
+{
+    if (fileout == NULL)
+        return;
+
+    boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+    std::string strBatch;
+    DrainLogQueue(strBatch);
+    CommitLogBatch(strBatch);
+    FileCommit(fileout);
+}
+
+// Categories passed to LogPrint() in this tree; -debug=<category> sets the
+// matching bit in nLogCategoryMask. Anything else given to -debug is kept
+// in vLogExtraCategories and matched by name.
+static const char* const pszLogCategories[] = {
+    "addrman", "alert", "coinage", "coindb", "coinstake", "creation", "darksend", "db", "instantx",
+    "lock", "masternode", "mempool", "net", "qt", "rand", "rpc", "selectcoins",
+    "smessage", "stakemodifier",
+};
+static const int LOG_CATEGORY_COUNT = sizeof(pszLogCategories) / sizeof(pszLogCategories[0]);
+
+static boost::once_flag logCategoriesInitFlag = BOOST_ONCE_INIT;
+static bool fLogAllCategories = false;
+static uint32_t nLogCategoryMask = 0;
+static std::vector<std::string>* pvLogExtraCategories = NULL;
+
+static int LogCategoryIndex(const char* category)
+{
+    for (int i = 0; i < LOG_CATEGORY_COUNT; i++)
+        if (category[0] == pszLogCategories[i][0] && strcmp(category, pszLogCategories[i]) == 0)
+            return i;
+    return -1;
+}
+
+static void LogCategoriesInit()
+{
+    pvLogExtraCategories = new std::vector<std::string>();
+    const vector<string>& categories = mapMultiArgs["-debug"];
+    BOOST_FOREACH(const string& strCategory, categories)
+    {
+        if (strCategory.empty() || strCategory == "1")
+        {
+            fLogAllCategories = true;
+            continue;
+        }
+        int n = LogCategoryIndex(strCategory.c_str());
+        if (n >= 0)
+            nLogCategoryMask |= 1U << n;
+        else
+            pvLogExtraCategories->push_back(strCategory);
+    }
+}
+
+void InitLogCategories()
+{
+    boost::call_once(&LogCategoriesInit, logCategoriesInitFlag);
+}
+
+static bool LogCategoryResolve(const char* category)
+{
+    int n = LogCategoryIndex(category);
+    if (n >= 0)
+        return (nLogCategoryMask >> n) & 1;
+    BOOST_FOREACH(const string& strCategory, *pvLogExtraCategories)
+        if (strCategory == category)
+            return true;
+    return false;
+}
+
+// LogPrint() categories are string literals, so once -debug is parsed each
+// one resolves a single time and is then recognised by its address alone.
+static const int LOG_CATEGORY_CACHE_SIZE = 64;
+static boost::atomic<const char*> apszLogCategoryAccepted[LOG_CATEGORY_CACHE_SIZE];
+static boost::atomic<const char*> apszLogCategoryRejected[LOG_CATEGORY_CACHE_SIZE];
+
+bool LogAcceptCategoryMask(const char* category)
+{
+    InitLogCategories();
+    if (fLogAllCategories)
+        return true;
+    uintptr_t n = (uintptr_t)category;
+    unsigned int nSlot = (n ^ (n >> 6)) % LOG_CATEGORY_CACHE_SIZE;
+    if (apszLogCategoryAccepted[nSlot].load(boost::memory_order_relaxed) == category)
+        return true;
+    if (apszLogCategoryRejected[nSlot].load(boost::memory_order_relaxed) == category)
+        return false;
+    bool fAccept = LogCategoryResolve(category);
+    (fAccept ? apszLogCategoryAccepted : apszLogCategoryRejected)[nSlot].store(category, boost::memory_order_relaxed);
+    return fAccept;
 }
 
 int LogPrintStr(const std::string &str)
@@ -281,31 +613,33 @@ int LogPrintStr(const std::string &str)
     }
     else if (fPrintToDebugLog)
     {
-        static bool fStartedNewLine = true;
         boost::call_once(&DebugPrintInit, debugPrintInitFlag);
 
         if (fileout == NULL)
             return ret;
 
-        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
-
-        // reopen the log file, if requested
-        if (fReopenDebugLog) {
-            fReopenDebugLog = false;
-            boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
-            if (freopen(pathDebug.string().c_str(),"a",fileout) != NULL)
-                setbuf(fileout, NULL); // unbuffered
+        ret = str.size();
+        // Errors are rare and are what a crash report needs, so they never
+        // wait in the queue
+        bool fError = str.compare(0, 5, "ERROR") == 0;
+        if (!fError && fLogWriterRunning.load(boost::memory_order_acquire))
+        {
+            std::string strLine(str);
+            if (plogQueue->Push(strLine, GetTime()))
+            {
+                if (plogQueue->ApproxSize() >= plogQueue->Capacity() / 4)
+                    condLogWake->notify_one();
+                return ret;
+            }
         }
 
-        // Debug print useful for profiling
-        if (fLogTimestamps && fStartedNewLine)
-            ret += fprintf(fileout, "%s ", DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()).c_str());
-        if (!str.empty() && str[str.size()-1] == '\n')
-            fStartedNewLine = true;
-        else
-            fStartedNewLine = false;
-
-        ret = fwrite(str.data(), 1, str.size(), fileout);
+        // An error, no writer thread, or the queue is full: write in this
+        // thread, after whatever is still queued so lines stay in order
+        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+        std::string strBatch;
+        DrainLogQueue(strBatch);
+        WriteLogLine(str, GetTime(), strBatch);
+        CommitLogBatch(strBatch);
     }
 
     return ret;
@@ -1056,6 +1390,7 @@ void PrintException(std::exception* pex, const char* pszThread)
 {
     std::string message = FormatException(pex, pszThread);
     LogPrintf("\n\n************************\n%s\n", message);
+    FlushDebugLog();
     fprintf(stderr, "\n\n************************\n%s\n", message.c_str());
     strMiscWarning = message;
     throw;
@@ -1065,6 +1400,7 @@ void PrintExceptionContinue(std::exception* pex, const char* pszThread)
 {
     std::string message = FormatException(pex, pszThread);
     LogPrintf("\n\n************************\n%s\n", message);
+    FlushDebugLog();
     fprintf(stderr, "\n\n************************\n%s\n", message.c_str());
     strMiscWarning = message;
 }
@@ -1461,6 +1797,161 @@ void RenameThread(const char* name)
 #endif
 }
 
+unsigned int GetParallelThreads()
+{
+    return std::max(std::min(boost::thread::hardware_concurrency(), 8u), 1u);
+}
+
+unsigned int CreateThreads(boost::thread_group& threadGroup, unsigned int n, const boost::function<void()>& func)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        try {
+            threadGroup.create_thread(func);
+        } catch (boost::thread_resource_error& e) {
+            LogPrintf("CreateThreads : started %u of %u threads: %s\n", i, n, e.what());
+            return i;
+        }
+    }
+    return n;
+}
+
+/** One ParallelFor call, shared by its caller and the pool threads that help */
+struct CParallelJob
+{
+    size_t n;
+    const boost::function<bool (size_t)>& fn;
+    boost::atomic<size_t> nNext;
+    boost::atomic<bool> fStop;
+    // guarded by mutexParallel:
+    bool fListed;               // in listParallelJobs, where idle pool threads find it
+    unsigned int nHelpers;      // pool threads working on it
+    boost::exception_ptr error; // first exception fn threw
+
+    CParallelJob(size_t nIn, const boost::function<bool (size_t)>& fnIn)
+        : n(nIn), fn(fnIn), nNext(0), fStop(false), fListed(false), nHelpers(0)
+    {
+    }
+};
+
+static boost::mutex mutexParallel;
+static boost::condition_variable condParallelJob;  // a job was listed, or the pool stops
+static boost::condition_variable condParallelDone; // a pool thread left a job
+static std::list<CParallelJob*> listParallelJobs;
+static boost::thread_group* pParallelWorkers = NULL;
+static unsigned int nParallelWorkers = 0;
+static bool fParallelStop = false;
+
+// Take indexes of job until they run out or one fails. An exception fn
+// throws is kept for the caller and stops the job like a failure does.
+static void RunParallelJob(CParallelJob& job)
+{
+    try {
+        while (!job.fStop)
+        {
+            size_t i = job.nNext++;
+            if (i >= job.n)
+                return;
+            if (!job.fn(i))
+                job.fStop = true;
+        }
+    } catch (...) {
+        boost::mutex::scoped_lock lock(mutexParallel);
+        if (!job.error)
+            job.error = boost::current_exception();
+        job.fStop = true;
+    }
+}
+
+// Caller holds mutexParallel
+static void UnlistParallelJob(CParallelJob& job)
+{
+    if (job.fListed)
+    {
+        listParallelJobs.remove(&job);
+        job.fListed = false;
+    }
+}
+
+static void ThreadParallelWorker()
+{
+    RenameThread("advantage-par");
+    boost::mutex::scoped_lock lock(mutexParallel);
+    while (true)
+    {
+        while (!fParallelStop && listParallelJobs.empty())
+            condParallelJob.wait(lock);
+        if (fParallelStop)
+            return;
+
+        // Rotate the list so concurrent callers share the threads
+        CParallelJob* pjob = listParallelJobs.front();
+        listParallelJobs.splice(listParallelJobs.end(), listParallelJobs, listParallelJobs.begin());
+        pjob->nHelpers++;
+        lock.unlock();
+        RunParallelJob(*pjob);
+        lock.lock();
+        // Nothing left to hand out; the caller may return once all helpers are out
+        UnlistParallelJob(*pjob);
+        if (--pjob->nHelpers == 0)
+            condParallelDone.notify_all();
+    }
+}
+
+void StartParallelWorkers()
+{
+    boost::mutex::scoped_lock lock(mutexParallel);
+    if (pParallelWorkers != NULL)
+        return;
+    fParallelStop = false;
+    pParallelWorkers = new boost::thread_group();
+    nParallelWorkers = CreateThreads(*pParallelWorkers, GetParallelThreads() - 1, &ThreadParallelWorker);
+}
+
+void StopParallelWorkers()
+{
+    boost::thread_group* pWorkers;
+    {
+        boost::mutex::scoped_lock lock(mutexParallel);
+        if (pParallelWorkers == NULL)
+            return;
+        pWorkers = pParallelWorkers;
+        pParallelWorkers = NULL;
+        nParallelWorkers = 0;
+        fParallelStop = true;
+        condParallelJob.notify_all();
+    }
+    // Jobs still running are finished by their callers
+    pWorkers->join_all();
+    delete pWorkers;
+}
+
+void ParallelFor(size_t n, size_t nMinParallel, const boost::function<bool (size_t)>& fn)
+{
+    CParallelJob job(n, fn);
+    if (n > 1 && n >= nMinParallel)
+    {
+        boost::mutex::scoped_lock lock(mutexParallel);
+        if (nParallelWorkers > 0)
+        {
+            listParallelJobs.push_back(&job);
+            job.fListed = true;
+            condParallelJob.notify_all();
+        }
+    }
+
+    // Whatever the pool threads do not take, the calling thread does
+    RunParallelJob(job);
+    {
+        boost::mutex::scoped_lock lock(mutexParallel);
+        UnlistParallelJob(job);
+        while (job.nHelpers > 0)
+            condParallelDone.wait(lock);
+    }
+    if (job.error)
+        boost::rethrow_exception(job.error);
+}
+
 std::string DateTimeStrFormat(const char* pszFormat, int64_t nTime)
 {
     // std::locale takes ownership of the pointer
@@ -21,6 +21,7 @@
 #include <vector>
 #include <string>
 
+#include <boost/function.hpp>
 #include <boost/thread.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/path.hpp>
@@ -151,10 +152,28 @@ void RandAddSeedPerfmon();
 
 
 
+/* Parse -debug into the category mask used by LogAcceptCategory */
+void InitLogCategories();
+/* Slow path of LogAcceptCategory, only reached when -debug is on */
+bool LogAcceptCategoryMask(const char* category);
 /* Return true if log accepts specified category */
-bool LogAcceptCategory(const char* category);
+static inline bool LogAcceptCategory(const char* category)
+{
+    if (category == NULL)
+        return true;
+    // Without -debug a disabled LogPrint costs this branch and nothing more
+    if (!fDebug)
+        return false;
+    return LogAcceptCategoryMask(category);
+}
 /* Send a string to the log output */
 int LogPrintStr(const std::string &str);
+/* Hand debug.log writes to a background thread (-logasync, default on) */
+void StartLogWriter();
+/* Stop the background writer; later lines are written synchronously again */
+void StopLogWriter();
+/* Write out all queued lines and sync debug.log to disk */
+void FlushDebugLog();
 
 #define LogPrintf(...) LogPrint(NULL, __VA_ARGS__)
 
@@ -583,6 +602,28 @@ inline void SetThreadPriority(int nPriority)
 
 void RenameThread(const char* name);
 
+/** Threads CPU-bound work is spread over, the calling one included: one per core, 8 at most */
+unsigned int GetParallelThreads();
+
+/** Start n threads running func in threadGroup; returns how many the system let start */
+unsigned int CreateThreads(boost::thread_group& threadGroup, unsigned int n, const boost::function<void()>& func);
+
+/** Start the GetParallelThreads() - 1 long-lived threads ParallelFor shares
+ *  its work with; until then (and after StopParallelWorkers()) it runs on
+ *  the calling thread alone */
+void StartParallelWorkers();
+void StopParallelWorkers();
+
+/**
+ * Call fn for the indexes 0 to n-1, handed out in order to the calling
+ * thread and, from nMinParallel on, to the parallel workers. Once a call
+ * returns false no further index is handed out: every index below it has
+ * been done, the ones above may not. If fn throws, no further index is
+ * handed out either and the exception is rethrown in the calling thread.
+ * fn may call ParallelFor itself.
+ */
+void ParallelFor(size_t n, size_t nMinParallel, const boost::function<bool (size_t)>& fn);
+
 inline uint32_t ByteReverse(uint32_t value)
 {
     value = ((value & 0xFF00FF00) >> 8) | ((value & 0x00FF00FF) << 8);
@@ -31,7 +31,7 @@ static const int DATABASE_VERSION = 70509;
 // network protocol versioning
 //
 
-static const int PROTOCOL_VERSION = 10001;
+static const int PROTOCOL_VERSION = 10002;
 
 // intial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -44,6 +44,9 @@ static const int MIN_POOL_PEER_PROTO_VERSION = 10001;
 
 static const int MIN_INSTANTX_PROTO_VERSION = 10001;
 
+// masternode list sync by digest and batched diffs ("mnget"/"mnlist")
+static const int MIN_MNLIST_SYNC_PROTO_VERSION = 10002;
+
 //! minimum peer version that can receive masternode payments
 // V1 - Last protocol version before update
 // V2 - Newest protocol version
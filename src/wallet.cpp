@@ -7,11 +7,15 @@
 #include "wallet.h"
 
 #include "base58.h"
+#include "blockfilter.h"
+#include "boundedmap.h"
 #include "coincontrol.h"
+#include "coins.h"
 #include "kernel.h"
 #include "net.h"
 #include "util.h"
 #include "txdb.h"
+#include "init.h"
 #include "ui_interface.h"
 #include "walletdb.h"
 #include "crypter.h"
@@ -25,6 +29,7 @@
 #include "smessage.h"
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 
@@ -597,9 +602,11 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
     uint256 hash = wtxIn.GetHash();
     if (fFromLoadWallet)
     {
-        mapWallet[hash] = wtxIn;
         CWalletTx& wtx = mapWallet[hash];
+        if (&wtx != &wtxIn) // LoadWallet decodes straight into mapWallet
+            wtx = wtxIn;
         wtx.BindWallet(this);
+        wtx.MakeImmutable();
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
     }
@@ -610,6 +617,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         pair<map<uint256, CWalletTx>::iterator, bool> ret = mapWallet.insert(make_pair(hash, wtxIn));
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
+        wtx.MakeImmutable(); // the wallet's copy never changes; cache its hash
         bool fInsertedNew = ret.second;
         if (fInsertedNew)
         {
@@ -767,12 +775,24 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock, bool
             if (IsFromMe(tx))
                 DisableTransaction(tx);
         }
+        // Its block left the chain: the GUI only counts confirmations up for
+        // transactions it has seen confirmed, so say so whether or not the
+        // wallet entry itself changed
+        NotifyTransactionChanged(this, tx.GetHash(), CT_UPDATED);
         return;
     }
 
     AddToWalletIfInvolvingMe(tx, pblock, true);
 }
 
+void CWallet::SyncBlock(const CBlock& block, bool fConnect)
+{
+    LOCK2(cs_main, cs_wallet);
+    CDBBatch batch(fFileBacked ? strWalletFile : "");
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        SyncTransaction(tx, &block, fConnect);
+}
+
 void CWallet::EraseFromWallet(const uint256 &hash)
 {
     if (!fFileBacked)
@@ -816,11 +836,30 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
     return 0;
 }
 
+// Rounds of the wallet transactions GetRealInputDarksendRounds walked, least
+// recently used first out
+static boundedmap<uint256, CTransaction> mDenomWtxes(20000);
+
+// The cached copy of wtx, made again if it was evicted meanwhile
+static CTransaction& GetDenomWtx(const uint256& hash, const CWalletTx& wtx)
+{
+    boundedmap<uint256, CTransaction>::iterator mdwi = mDenomWtxes.find(hash);
+    if(mdwi == mDenomWtxes.end())
+    {
+        LogPrint("darksend", "GetInputDarksendRounds INSERTING %s\n", hash.ToString());
+        mdwi = mDenomWtxes.insert(make_pair(hash, CTransaction(wtx))).first;
+    }
+    return mdwi->second;
+}
+
+CCacheInfo GetDarksendRoundsCacheInfo()
+{
+    return mDenomWtxes.GetInfo("darksendrounds");
+}
+
 // Recursively determine the rounds of a given input (How deep is the Darksend chain for a given input)
 int CWallet::GetRealInputDarksendRounds(CTxIn in, int rounds) const
 {
-    static std::map<uint256, CTransaction> mDenomWtxes;
-
     if(rounds >= 16) return 15; // 16 rounds max
 
     uint256 hash = in.prevout.hash;
@@ -829,17 +868,18 @@ int CWallet::GetRealInputDarksendRounds(CTxIn in, int rounds) const
     const CWalletTx* wtx = GetWalletTx(hash);
     if(wtx != NULL)
     {
-        std::map<uint256, CTransaction>::const_iterator mdwi = mDenomWtxes.find(hash);
+        boundedmap<uint256, CTransaction>::iterator mdwi = mDenomWtxes.find(hash);
         // not known yet, let's add it
         if(mdwi == mDenomWtxes.end())
         {
-            LogPrint("darksend", "GetInputDarksendRounds INSERTING %s\n", hash.ToString());
-            mDenomWtxes[hash] = CTransaction(*wtx);
+            GetDenomWtx(hash, *wtx);
         }
         // found and it's not an initial value, just return it
-        else if(mDenomWtxes[hash].vout[nout].nRounds != -10)
+        else
         {
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            mDenomWtxes.touch(mdwi);
+            if(nout < mdwi->second.vout.size() && mdwi->second.vout[nout].nRounds != -10)
+                return mdwi->second.vout[nout].nRounds;
         }
 
 
@@ -853,17 +893,17 @@ int CWallet::GetRealInputDarksendRounds(CTxIn in, int rounds) const
 
         if(pwalletMain->IsCollateralAmount(wtx->vout[nout].nValue))
         {
-            mDenomWtxes[hash].vout[nout].nRounds = -3;
-            LogPrint("darksend", "GetInputDarksendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            GetDenomWtx(hash, *wtx).vout[nout].nRounds = -3;
+            LogPrint("darksend", "GetInputDarksendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, -3);
+            return -3;
         }
 
         //make sure the final output is non-denominate
         if(/*rounds == 0 && */!IsDenominatedAmount(wtx->vout[nout].nValue)) //NOT DENOM
         {
-            mDenomWtxes[hash].vout[nout].nRounds = -2;
-            LogPrint("darksend", "GetInputDarksendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            GetDenomWtx(hash, *wtx).vout[nout].nRounds = -2;
+            LogPrint("darksend", "GetInputDarksendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, -2);
+            return -2;
         }
 
         bool fAllDenoms = true;
@@ -874,9 +914,9 @@ int CWallet::GetRealInputDarksendRounds(CTxIn in, int rounds) const
         // this one is denominated but there is another non-denominated output found in the same tx
         if(!fAllDenoms)
         {
-            mDenomWtxes[hash].vout[nout].nRounds = 0;
-            LogPrint("darksend", "GetInputDarksendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            GetDenomWtx(hash, *wtx).vout[nout].nRounds = 0;
+            LogPrint("darksend", "GetInputDarksendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, 0);
+            return 0;
         }
 
         int nShortest = -10; // an initial value, should be no way to get this by calculations
@@ -895,11 +935,13 @@ int CWallet::GetRealInputDarksendRounds(CTxIn in, int rounds) const
                 }
             }
         }
-        mDenomWtxes[hash].vout[nout].nRounds = fDenomFound
+        // the recursion may have evicted our entry, so look it up again
+        int nRounds = fDenomFound
                 ? (nShortest >= 15 ? 16 : nShortest + 1) // good, we a +1 to the shortest one but only 16 rounds max allowed
                 : 0;            // too bad, we are the fist one in that chain
-        LogPrint("darksend", "GetInputDarksendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-        return mDenomWtxes[hash].vout[nout].nRounds;
+        GetDenomWtx(hash, *wtx).vout[nout].nRounds = nRounds;
+        LogPrint("darksend", "GetInputDarksendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nRounds);
+        return nRounds;
     }
 
     return rounds-1;
@@ -1161,6 +1203,149 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+// The keys of a wallet as they were when a rescan started, so the rescan
+// threads can match outputs without taking cs_KeyStore for each of them.
+// Keys added while the rescan runs are not seen; the stealth payments that
+// add them are matched by their OP_RETURN output instead.
+class CRescanKeyStore : public CKeyStore
+{
+private:
+    const CWallet& wallet;
+    std::set<CKeyID> setKeys;
+    bool fHaveWatchOnly;
+
+public:
+    // The scripts paying the wallet, to look up in block filters
+    BlockFilterElements setFilterElements;
+
+    CRescanKeyStore(const CWallet& walletIn) : wallet(walletIn)
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.GetKeys(setKeys);
+        fHaveWatchOnly = wallet.HaveWatchOnly();
+
+        if (!fBlockFilterIndex)
+            return;
+        BOOST_FOREACH(const CKeyID& keyid, setKeys)
+        {
+            CPubKey pubkey;
+            AddFilterElement(GetScriptForDestination(keyid));
+            if (wallet.GetPubKey(keyid, pubkey))
+            {
+                AddFilterElement(CScript() << pubkey << OP_CHECKSIG);
+                // bare multisig outputs, which IsMine accepts when all the keys are here
+                setFilterElements.insert(BlockFilterElement(pubkey.begin(), pubkey.end()));
+            }
+        }
+        std::vector<CScript> vRedeemScripts;
+        wallet.GetCScripts(vRedeemScripts);
+        BOOST_FOREACH(const CScript& redeemScript, vRedeemScripts)
+        {
+            AddFilterElement(redeemScript);
+            AddFilterElement(GetScriptForDestination(redeemScript.GetID()));
+        }
+        WatchOnlySet setWatchOnly;
+        wallet.GetWatchOnly(setWatchOnly);
+        BOOST_FOREACH(const CScript& script, setWatchOnly)
+            AddFilterElement(script);
+        if (!wallet.stealthAddresses.empty())
+            setFilterElements.insert(BlockFilterStealthElement());
+    }
+
+    void AddFilterElement(const CScript& script)
+    {
+        setFilterElements.insert(BlockFilterElement(script.begin(), script.end()));
+    }
+
+    bool AddKeyPubKey(const CKey& key, const CPubKey& pubkey) { return false; }
+    bool HaveKey(const CKeyID& address) const { return setKeys.count(address) > 0; }
+    bool GetKey(const CKeyID& address, CKey& keyOut) const { return false; }
+    void GetKeys(std::set<CKeyID>& setAddress) const { setAddress = setKeys; }
+    bool AddCScript(const CScript& redeemScript) { return false; }
+    bool HaveCScript(const CScriptID& hash) const { return wallet.HaveCScript(hash); }
+    bool GetCScript(const CScriptID& hash, CScript& redeemScriptOut) const { return wallet.GetCScript(hash, redeemScriptOut); }
+    bool AddWatchOnly(const CScript& dest) { return false; }
+    bool RemoveWatchOnly(const CScript& dest) { return false; }
+    bool HaveWatchOnly(const CScript& dest) const { return fHaveWatchOnly && wallet.HaveWatchOnly(dest); }
+    bool HaveWatchOnly() const { return fHaveWatchOnly; }
+};
+
+// Blocks a rescan reads ahead of the one it commits
+static const unsigned int RESCAN_WINDOW = 64;
+
+// A block read and matched by the rescan threads, to be committed in chain order
+struct CRescanBlock
+{
+    CBlock block;
+    std::vector<char> vRelevant; // per transaction: pays the wallet or may be a stealth payment
+    bool fDone;
+
+    CRescanBlock() : fDone(false) {}
+};
+
+struct CRescanState
+{
+    const std::vector<CBlockIndex*>& vBlocks;
+    const CRescanKeyStore& keystore;
+    std::vector<CRescanBlock> vWindow; // block i is in slot i % RESCAN_WINDOW
+    boost::mutex mutex;
+    boost::condition_variable condDone;
+    boost::condition_variable condFree;
+    size_t nNext;
+    size_t nCommitted;
+    size_t nFiltered; // blocks not read, their filter matching none of the wallet's scripts
+    bool fStop;
+
+    CRescanState(const std::vector<CBlockIndex*>& vBlocksIn, const CRescanKeyStore& keystoreIn) :
+        vBlocks(vBlocksIn), keystore(keystoreIn), vWindow(RESCAN_WINDOW), nNext(0), nCommitted(0), nFiltered(0), fStop(false) {}
+};
+
+static void ReadRescanBlocks(CRescanState& state)
+{
+    while (true)
+    {
+        size_t i;
+        {
+            boost::unique_lock<boost::mutex> lock(state.mutex);
+            while (!state.fStop && state.nNext < state.vBlocks.size() && state.nNext >= state.nCommitted + RESCAN_WINDOW)
+                state.condFree.wait(lock);
+            if (state.fStop || state.nNext >= state.vBlocks.size())
+                return;
+            i = state.nNext++;
+        }
+
+        // The slot is ours until it is marked done. A block left empty
+        // commits nothing: neither its outputs nor the ones it spends pay
+        // the wallet
+        CRescanBlock& slot = state.vWindow[i % RESCAN_WINDOW];
+        CBlockFilter filter;
+        bool fFiltered = GetBlockFilter(state.vBlocks[i], filter) && !filter.MatchAny(state.keystore.setFilterElements);
+        if (!fFiltered)
+            slot.block.ReadFromDisk(state.vBlocks[i], true);
+        slot.vRelevant.assign(slot.block.vtx.size(), 0);
+        for (unsigned int n = 0; n < slot.block.vtx.size(); n++)
+        {
+            BOOST_FOREACH(const CTxOut& txout, slot.block.vtx[n].vout)
+            {
+                if ((!txout.scriptPubKey.empty() && txout.scriptPubKey[0] == OP_RETURN) ||
+                    IsMine(state.keystore, txout.scriptPubKey) != ISMINE_NO)
+                {
+                    slot.vRelevant[n] = 1;
+                    break;
+                }
+            }
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(state.mutex);
+            slot.fDone = true;
+            if (fFiltered)
+                state.nFiltered++;
+        }
+        state.condDone.notify_all();
+    }
+}
+
 // Scan the block chain (starting in pindexStart) for transactions
 // from or to us. If fUpdate is true, found transactions that already
 // exist in the wallet will be updated.
@@ -1168,28 +1353,121 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
 
-    CBlockIndex* pindex = pindexStart;
+    std::vector<CBlockIndex*> vBlocks;
     {
-        LOCK2(cs_main, cs_wallet);
-        while (pindex)
+        LOCK(cs_main);
+        for (CBlockIndex* pindex = pindexStart; pindex; pindex = pindex->pnext)
         {
             // no need to read and scan block, if block was created before
             // our wallet birthday (as adjusted for block time variability)
-            if (nTimeFirstKey && (pindex->nTime < (nTimeFirstKey - 7200))) {
-                pindex = pindex->pnext;
+            if (nTimeFirstKey && (pindex->nTime < (nTimeFirstKey - 7200)))
                 continue;
-            }
+            vBlocks.push_back(pindex);
+        }
+    }
+    if (vBlocks.empty())
+        return 0;
+
+    // One rescan at a time: a second one would commit the same blocks again
+    // and share the progress and abort flags
+    bool fIdle = false;
+    if (!fScanningWallet.compare_exchange_strong(fIdle, true))
+    {
+        LogPrintf("ScanForWalletTransactions : a rescan is already running\n");
+        return -1;
+    }
+    fAbortRescan = false;
+    nScanStartHeight = vBlocks.front()->nHeight;
+    nScanHeight = vBlocks.front()->nHeight;
+    nScanEndHeight = vBlocks.back()->nHeight;
+    nScanStartTime = GetTimeMillis();
+    int64_t nLastProgress = GetTimeMillis();
+    int nLastPercent = -1;
+
+    // Outputs are matched against the keys on the rescan threads; whether a
+    // transaction spends from the wallet depends on what was committed
+    // before it, so inputs are matched when the block is committed
+    CRescanKeyStore keystore(*this);
+    CRescanState state(vBlocks, keystore);
+    boost::thread_group readers;
+    if (!CreateThreads(readers, GetParallelThreads(), boost::bind(&ReadRescanBlocks, boost::ref(state))))
+    {
+        LogPrintf("ScanForWalletTransactions : cannot start the rescan threads\n");
+        fScanningWallet = false;
+        return -1;
+    }
+
+    for (size_t i = 0; i < vBlocks.size(); i++)
+    {
+        CRescanBlock& slot = state.vWindow[i % RESCAN_WINDOW];
+        {
+            boost::unique_lock<boost::mutex> lock(state.mutex);
+            while (!slot.fDone)
+                state.condDone.wait(lock);
+        }
+        if (fAbortRescan || ShutdownRequested())
+        {
+            LogPrintf("Rescan aborted at block %d\n", vBlocks[i]->nHeight);
+            break;
+        }
 
-            CBlock block;
-            block.ReadFromDisk(pindex, true);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+        {
+            LOCK2(cs_main, cs_wallet);
+            // The blocks were listed before the scan; past a reorganization
+            // they are no longer in the chain, and the blocks that replaced
+            // them were synced with the wallet as they were connected
+            if (!vBlocks[i]->pnext && vBlocks[i] != pindexBest)
+            {
+                LogPrintf("Rescan stopped at block %d, no longer in the main chain\n", vBlocks[i]->nHeight);
+                break;
+            }
+            CDBBatch batch(fFileBacked ? strWalletFile : "");
+            for (unsigned int n = 0; n < slot.block.vtx.size(); n++)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                const CTransaction& tx = slot.block.vtx[n];
+                bool fRelevant = slot.vRelevant[n] || mapWallet.count(tx.GetHash());
+                for (unsigned int j = 0; !fRelevant && j < tx.vin.size(); j++)
+                    fRelevant = mapWallet.count(tx.vin[j].prevout.hash);
+                if (fRelevant && AddToWalletIfInvolvingMe(tx, &slot.block, fUpdate))
                     ret++;
             }
-            pindex = pindex->pnext;
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(state.mutex);
+            slot.fDone = false;
+            slot.block.SetNull();
+            state.nCommitted = i + 1;
+        }
+        state.condFree.notify_all();
+
+        nScanHeight = vBlocks[i]->nHeight;
+        int nPercent = (int)((i + 1) * 100 / vBlocks.size());
+        if (nPercent != nLastPercent)
+        {
+            ShowProgress(_("Rescanning..."), std::min(nPercent, 99));
+            nLastPercent = nPercent;
+        }
+        if (GetTimeMillis() - nLastProgress > 10000)
+        {
+            int64_t nElapsed = GetTimeMillis() - nScanStartTime;
+            LogPrintf("Rescan at block %d of %d, %d%%, about %ds left\n", vBlocks[i]->nHeight, vBlocks.back()->nHeight,
+                nPercent, (int)(nElapsed * (vBlocks.size() - i - 1) / (i + 1) / 1000));
+            nLastProgress = GetTimeMillis();
         }
     }
+
+    {
+        boost::unique_lock<boost::mutex> lock(state.mutex);
+        state.fStop = true;
+    }
+    state.condFree.notify_all();
+    readers.join_all();
+
+    LogPrintf("Rescanned %u blocks in %dms, %u skipped by their filters\n", state.nCommitted,
+        GetTimeMillis() - nScanStartTime, state.nFiltered);
+    ShowProgress("", 100); // hide progress dialog in GUI
+    fScanningWallet = false;
     return ret;
 }
 
@@ -1201,7 +1479,8 @@ void CWallet::ReacceptWalletTransactions()
     {
         LOCK2(cs_main, cs_wallet);
         fRepeat = false;
-        vector<CDiskTxPos> vMissingTx;
+        bool fMissingTx = false;
+        bool fCoinsAtTip = pcoinsTip && pcoinsTip->GetBestBlock() == hashBestChain;
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
         {
             const uint256& wtxid = item.first;
@@ -1225,21 +1504,19 @@ void CWallet::ReacceptWalletTransactions()
             bool fUpdated = false;
             if (txdb.ReadTxIndex(wtx.GetHash(), txindex))
             {
-                // Update fSpent if a tx got spent somewhere else by a copy of wallet.dat
-                if (txindex.vSpent.size() != wtx.vout.size())
-                {
-                    LogPrintf("ERROR: ReacceptWalletTransactions() : txindex.vSpent.size() %u != wtx.vout.size() %u\n", txindex.vSpent.size(), wtx.vout.size());
-                    continue;
-                }
-                for (unsigned int i = 0; i < txindex.vSpent.size(); i++)
+                // Update fSpent if a tx got spent somewhere else by a copy of wallet.dat:
+                // an output of a transaction in the chain is spent once it has left the
+                // unspent output set
+                for (unsigned int i = 0; fCoinsAtTip && i < wtx.vout.size(); i++)
                 {
                     if (wtx.IsSpent(i))
                         continue;
-                    if (!txindex.vSpent[i].IsNull() && IsMine(wtx.vout[i]))
+                    CCoin coin;
+                    if (!pcoinsTip->GetCoin(COutPoint(wtx.GetHash(), i), coin, pindexBest) && IsMine(wtx.vout[i]))
                     {
                         wtx.MarkSpent(i);
                         fUpdated = true;
-                        vMissingTx.push_back(txindex.vSpent[i]);
+                        fMissingTx = true;
                     }
                 }
                 if (fUpdated)
@@ -1256,10 +1533,10 @@ void CWallet::ReacceptWalletTransactions()
                     wtx.AcceptWalletTransaction(txdb);
             }
         }
-        if (!vMissingTx.empty())
+        if (fMissingTx)
         {
             // TODO: optimize this to scan just part of the block chain?
-            if (ScanForWalletTransactions(pindexGenesisBlock))
+            if (ScanForWalletTransactions(pindexGenesisBlock) > 0)
                 fRepeat = true;  // Found missing transactions: re-do re-accept.
         }
     }
@@ -1273,7 +1550,10 @@ void CWalletTx::RelayWalletTransaction(CTxDB& txdb, std::string strCommand)
             uint256 hash = GetHash();
             if(strCommand == "txlreq"){
                 LogPrintf("Relaying txlreq %s\n", hash.ToString());
-                mapTxLockReq.insert(make_pair(hash, ((CTransaction)*this)));
+                {
+                    LOCK(cs_instantx);
+                    mapTxLockReq.insert(make_pair(hash, ((CTransaction)*this))).first->second.MakeImmutable();
+                }
                 CreateNewLock(((CTransaction)*this));
                 RelayTransactionLockReq((CTransaction)*this, true);
             } else {
@@ -1439,6 +1719,23 @@ CAmount CWallet::GetAnonymizedBalance() const
     return nTotal;
 }
 
+CWalletBalances CWallet::GetBalancesSnapshot() const
+{
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain)
+    {
+        LOCK(cs_wallet);
+        return cachedBalances;
+    }
+
+    LOCK(cs_wallet);
+    cachedBalances.nBalance = GetBalance();
+    cachedBalances.nAnonymized = GetAnonymizedBalance();
+    cachedBalances.nNewMint = GetNewMint();
+    cachedBalances.nStake = GetStake();
+    return cachedBalances;
+}
+
 // Note: calculated including unconfirmed,
 // that's ok as long as we use it for informational purposes only
 double CWallet::GetAverageAnonymizedRounds() const
@@ -2519,8 +2816,9 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, int64_t> >& vecSend,
 
                 // Sign
                 int nIn = 0;
+                CSignatureHasher sighasher(wtxNew);
                 BOOST_FOREACH(const PAIRTYPE(const CWalletTx*,unsigned int)& coin, setCoins)
-                    if (!SignSignature(*this, *coin.first, wtxNew, nIn++))
+                    if (!SignSignature(*this, *coin.first, wtxNew, nIn++, SIGHASH_ALL, &sighasher))
                     {
                         strFailReason = _(" Signing transaction failed");
                         return false;
@@ -3329,13 +3627,13 @@ uint64_t CWallet::GetStakeWeight() const
     uint64_t nWeight = 0;
 
     int64_t nCurrentTime = GetTime();
-    CTxDB txdb("r");
 
     LOCK2(cs_main, cs_wallet);
     BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
     {
-        CTxIndex txindex;
-        if (!txdb.ReadTxIndex(pcoin.first->GetHash(), txindex))
+        // Only outputs of the main chain count
+        CCoin coin;
+        if (!GetStakeCoin(pindexBest, COutPoint(pcoin.first->GetHash(), pcoin.second), coin))
             continue;
 
         if (nCurrentTime - pcoin.first->nTime > nStakeMinAge)
@@ -3379,9 +3677,15 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
     int64_t nCredit = 0;
     CScript scriptPubKeyKernel;
-    CTxDB txdb("r");
+    int64_t nSearchStart = GetTimeMicros();
     BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
     {
+        // Look the output up once for all the timestamps searched
+        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+        CCoin coinStake;
+        if (!GetStakeCoin(pindexPrev, prevoutStake, coinStake))
+            continue;
+
         static int nMaxStakeSearchInterval = 60;
         bool fKernelFound = false;
         for (unsigned int n=0; n<min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound && pindexPrev == pindexBest; n++)
@@ -3389,9 +3693,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             boost::this_thread::interruption_point();
             // Search backward in time from the given txNew timestamp
             // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-            int64_t nBlockTime;
-            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, &nBlockTime))
+            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, coinStake))
             {
                 // Found a kernel
                 LogPrint("coinstake", "CreateCoinStake : kernel found\n");
@@ -3455,6 +3757,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
         if (fKernelFound)
             break; // if kernel is found stop searching
     }
+    LogPrint("coinstake", "CreateCoinStake : searched %u coins in %.3fms\n", setCoins.size(), (GetTimeMicros() - nSearchStart) * 0.001);
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
@@ -3641,9 +3944,10 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
     // Sign
     int nIn = 0;
+    CSignatureHasher sighasher(txNew);
     BOOST_FOREACH(const CWalletTx* pcoin, vwtxPrev)
     {
-        if (!SignSignature(*this, *pcoin, txNew, nIn++))
+        if (!SignSignature(*this, *pcoin, txNew, nIn++, SIGHASH_ALL, &sighasher))
             return error("CreateCoinStake : failed to sign coinstake");
     }
 
@@ -3673,6 +3977,9 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, std:
         LOCK2(cs_main, cs_wallet);
         LogPrintf("CommitTransaction:\n%s", wtxNew.ToString());
         {
+            // One database transaction for the new tx, the key and every spent coin
+            CDBBatch batch(fFileBacked ? strWalletFile : "");
+
             // This is only to keep the database open to defeat the auto-flush for the
             // duration of this scope.  This is the only place where this optimization
             // maybe makes sense; please don't do it anywhere else.
@@ -4053,6 +4360,8 @@ bool CWallet::TopUpKeyPool(unsigned int nSize)
         if (IsLocked())
             return false;
 
+        // Write the whole refill (keys, metadata, pool entries) in one go
+        CDBBatch batch(fFileBacked ? strWalletFile : "");
         CWalletDB walletdb(strWalletFile);
 
         // Top up key pool
@@ -4313,29 +4622,32 @@ set< set<CTxDestination> > CWallet::GetAddressGroupings()
     return ret;
 }
 
-// ppcoin: check 'spent' consistency between wallet and txindex
-// ppcoin: fix wallet spent state according to txindex
+// ppcoin: check 'spent' consistency between wallet and the unspent output set
+// ppcoin: fix wallet spent state according to the unspent output set
 void CWallet::FixSpentCoins(int& nMismatchFound, int64_t& nBalanceInQuestion, bool fCheckOnly)
 {
     nMismatchFound = 0;
     nBalanceInQuestion = 0;
 
-    LOCK(cs_wallet);
+    LOCK2(cs_main, cs_wallet);
     vector<CWalletTx*> vCoins;
     vCoins.reserve(mapWallet.size());
     for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         vCoins.push_back(&(*it).second);
 
+    if (!pcoinsTip || pcoinsTip->GetBestBlock() != hashBestChain)
+        return;
     CTxDB txdb("r");
     BOOST_FOREACH(CWalletTx* pcoin, vCoins)
     {
-        // Find the corresponding transaction index
-        CTxIndex txindex;
-        if (!txdb.ReadTxIndex(pcoin->GetHash(), txindex))
+        // Only transactions of the chain have their outputs in the set
+        if (!txdb.ContainsTx(pcoin->GetHash()))
             continue;
         for (unsigned int n=0; n < pcoin->vout.size(); n++)
         {
-            if (IsMine(pcoin->vout[n]) && pcoin->IsSpent(n) && (txindex.vSpent.size() <= n || txindex.vSpent[n].IsNull()))
+            CCoin coin;
+            bool fChainSpent = !pcoinsTip->GetCoin(COutPoint(pcoin->GetHash(), n), coin, pindexBest);
+            if (IsMine(pcoin->vout[n]) && pcoin->IsSpent(n) && !fChainSpent)
             {
                 LogPrintf("FixSpentCoins found lost coin %s A %s[%d], %s\n",
                     FormatMoney(pcoin->vout[n].nValue), pcoin->GetHash().ToString(), n, fCheckOnly? "repair not attempted" : "repairing");
@@ -4347,7 +4659,7 @@ void CWallet::FixSpentCoins(int& nMismatchFound, int64_t& nBalanceInQuestion, bo
                     pcoin->WriteToDisk();
                 }
             }
-            else if (IsMine(pcoin->vout[n]) && !pcoin->IsSpent(n) && (txindex.vSpent.size() > n && !txindex.vSpent[n].IsNull()))
+            else if (IsMine(pcoin->vout[n]) && !pcoin->IsSpent(n) && fChainSpent)
             {
                 LogPrintf("FixSpentCoins found spent coin %s A %s[%d], %s\n",
                     FormatMoney(pcoin->vout[n].nValue), pcoin->GetHash().ToString(), n, fCheckOnly? "repair not attempted" : "repairing");
@@ -12,6 +12,8 @@
 
 #include <stdlib.h>
 
+#include <boost/atomic.hpp>
+
 #include "crypter.h"
 #include "mainfunctions.h"
 #include "key.h"
@@ -57,6 +59,11 @@ enum AvailableCoinsType
     ONLY_NONDENOMINATED_NOT10000IFMN = 4
 };
 
+struct CCacheInfo;
+
+/** Size of the cache of darksend rounds per wallet transaction; call with cs_wallet held */
+CCacheInfo GetDarksendRoundsCacheInfo();
+
 /** A key pool entry */
 class CKeyPool
 {
@@ -84,6 +91,17 @@ public:
     )
 };
 
+/** The balances getinfo reports, as of the last time they were computed */
+struct CWalletBalances
+{
+    CAmount nBalance;
+    CAmount nAnonymized;
+    CAmount nNewMint;
+    CAmount nStake;
+
+    CWalletBalances() : nBalance(0), nAnonymized(0), nNewMint(0), nStake(0) {}
+};
+
 /** A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
  */
@@ -111,6 +129,9 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    // Last result of GetBalancesSnapshot, guarded by cs_wallet
+    mutable CWalletBalances cachedBalances;
+
 public:
     /// Main wallet lock.
     /// This lock protects all the fields added by CWallet
@@ -140,10 +161,21 @@ public:
     std::set<CStealthAddress> stealthAddresses;
     StealthKeyMetaMap mapStealthKeyMeta;
 
+    // transactions loaded in an old format, written back by ThreadWalletPostLoad
+    std::vector<uint256> vWalletUpgrade;
+
     int nLastFilteredHeight;
 
     uint32_t nStealth, nFoundStealth; // for reporting, zero before use
 
+    // Progress of the rescan running, if any, for getrescaninfo and abortrescan
+    boost::atomic<bool> fScanningWallet;
+    boost::atomic<bool> fAbortRescan;
+    boost::atomic<int> nScanStartHeight;
+    boost::atomic<int> nScanHeight;
+    boost::atomic<int> nScanEndHeight;
+    boost::atomic<int64_t> nScanStartTime;
+
 
     typedef std::map<unsigned int, CMasterKey> MasterKeyMap;
     MasterKeyMap mapMasterKeys;
@@ -172,6 +204,12 @@ public:
         nTimeFirstKey = 0;
         nLastFilteredHeight = 0;
         fWalletUnlockAnonymizeOnly = false;
+        fScanningWallet = false;
+        fAbortRescan = false;
+        nScanStartHeight = 0;
+        nScanHeight = 0;
+        nScanEndHeight = 0;
+        nScanStartTime = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -252,9 +290,19 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet=false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock, bool fConnect = true);
+    /** SyncTransaction for every transaction of pblock, writing wallet.dat in one batch */
+    void SyncBlock(const CBlock& block, bool fConnect = true);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256 &hash);
+    /** Add the transactions of the blocks from pindexStart on that involve the
+     *  wallet. Blocks are read and matched on several threads and committed in
+     *  chain order, taking cs_main and cs_wallet for one block at a time, so
+     *  call it without them held to keep the node serving while it runs.
+     *  Returns -1 without scanning if another rescan is running. Stops at
+     *  the first block a reorganization took off the main chain.
+     */
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    void AbortRescan() { fAbortRescan = true; }
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(bool fForce = false);
 
@@ -272,6 +320,11 @@ public:
     double GetAverageAnonymizedRounds() const;
     CAmount GetNormalizedAnonymizedBalance() const;
     CAmount GetDenominatedBalance(bool unconfirmed=false) const;
+    /** Balance, anonymized balance, new mint and stake, computed afresh when
+     *  cs_main is free and otherwise the last ones computed, so callers off
+     *  the global locks never wait behind block processing for them.
+     */
+    CWalletBalances GetBalancesSnapshot() const;
 
     bool CreateTransaction(const std::vector<std::pair<CScript, int64_t> >& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, int64_t& nFeeRet, int32_t& nChangePos, std::string& strFailReason, const CCoinControl *coinControl=NULL, AvailableCoinsType coin_type=ALL_CREDITS, bool useIX=false);
     bool CreateTransaction(CScript scriptPubKey, int64_t nValue, std::string& sNarr, CWalletTx& wtxNew, CReserveKey& reservekey, int64_t& nFeeRet, const CCoinControl *coinControl=NULL);
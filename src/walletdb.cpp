@@ -356,6 +356,98 @@ public:
     }
 };
 
+// Decode and check a "tx" record. fUpgrade is set if the record was written
+// in the 0.3.16-0.3.17 format and should be rewritten.
+static bool DecodeTxRecord(const uint256& hash, CDataStream& ssValue, CWalletTx& wtx,
+                           bool& fUpgrade, string& strErr)
+{
+    fUpgrade = false;
+    ssValue >> wtx;
+    wtx.MakeImmutable();
+    if (!(wtx.CheckTransaction() && (wtx.GetHash() == hash)))
+        return false;
+
+    // Undo serialize changes in 31600
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgrade = true;
+    }
+    return true;
+}
+
+// Decode and check a "key" or "wkey" record (key type already read from ssKey)
+static bool DecodeKeyRecord(const string& strType, CDataStream& ssKey, CDataStream& ssValue,
+                            CPubKey& vchPubKey, CKey& key, string& strErr)
+{
+    ssKey >> vchPubKey;
+    if (!vchPubKey.IsValid())
+    {
+        strErr = "Error reading wallet database: CPubKey corrupt";
+        return false;
+    }
+    CPrivKey pkey;
+    uint256 hash = 0;
+
+    if (strType == "key")
+        ssValue >> pkey;
+    else {
+        CWalletKey wkey;
+        ssValue >> wkey;
+        pkey = wkey.vchPrivKey;
+    }
+
+    // Old wallets store keys as "key" [pubkey] => [privkey]
+    // ... which was slow for wallets with lots of keys, because the public key is re-derived from the private key
+    // using EC operations as a checksum.
+    // Newer wallets store keys as "key"[pubkey] => [privkey][hash(pubkey,privkey)], which is much faster while
+    // remaining backwards-compatible.
+    try
+    {
+        ssValue >> hash;
+    }
+    catch(...){}
+
+    bool fSkipCheck = false;
+
+    if (hash != 0)
+    {
+        // hash pubkey/privkey to accelerate wallet load
+        std::vector<unsigned char> vchKey;
+        vchKey.reserve(vchPubKey.size() + pkey.size());
+        vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
+        vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
+
+        if (Hash(vchKey.begin(), vchKey.end()) != hash)
+        {
+            strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
+            return false;
+        }
+
+        fSkipCheck = true;
+    }
+
+    if (!key.Load(pkey, vchPubKey, fSkipCheck))
+    {
+        strErr = "Error reading wallet database: CPrivKey corrupt";
+        return false;
+    }
+    return true;
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, string& strType, string& strErr)
@@ -376,29 +468,11 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             uint256 hash;
             ssKey >> hash;
             CWalletTx& wtx = pwallet->mapWallet[hash];
-            ssValue >> wtx;
-            if (!(wtx.CheckTransaction() && (wtx.GetHash() == hash)))
+            bool fUpgrade;
+            if (!DecodeTxRecord(hash, ssValue, wtx, fUpgrade, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
+            if (fUpgrade)
                 wss.vWalletUpgrade.push_back(hash);
-            }
 
             if (wtx.nOrderPos == -1)
                 wss.fAnyUnordered = true;
@@ -455,62 +529,12 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "key" || strType == "wkey")
         {
-            CPubKey vchPubKey;
-            ssKey >> vchPubKey;
-            if (!vchPubKey.IsValid())
-            {
-                strErr = "Error reading wallet database: CPubKey corrupt";
-                return false;
-            }
-            CKey key;
-            CPrivKey pkey;
-            uint256 hash = 0;
-
             if (strType == "key")
-            {
                 wss.nKeys++;
-                ssValue >> pkey;
-            } else {
-                CWalletKey wkey;
-                ssValue >> wkey;
-                pkey = wkey.vchPrivKey;
-            }
-
-            // Old wallets store keys as "key" [pubkey] => [privkey]
-            // ... which was slow for wallets with lots of keys, because the public key is re-derived from the private key
-            // using EC operations as a checksum.
-            // Newer wallets store keys as "key"[pubkey] => [privkey][hash(pubkey,privkey)], which is much faster while
-            // remaining backwards-compatible.
-            try
-            {
-                ssValue >> hash;
-            }
-            catch(...){}
-
-            bool fSkipCheck = false;
-
-            if (hash != 0)
-            {
-                // hash pubkey/privkey to accelerate wallet load
-                std::vector<unsigned char> vchKey;
-                vchKey.reserve(vchPubKey.size() + pkey.size());
-                vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
-                vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
-
-                if (Hash(vchKey.begin(), vchKey.end()) != hash)
-                {
-                    strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
-                    return false;
-                }
-
-                fSkipCheck = true;
-            }
-
-            if (!key.Load(pkey, vchPubKey, fSkipCheck))
-            {
-                strErr = "Error reading wallet database: CPrivKey corrupt";
+            CPubKey vchPubKey;
+            CKey key;
+            if (!DecodeKeyRecord(strType, ssKey, ssValue, vchPubKey, key, strErr))
                 return false;
-            }
             if (!pwallet->LoadKey(key, vchPubKey))
             {
                 strErr = "Error reading wallet database: LoadKey failed";
@@ -628,6 +652,109 @@ static bool IsKeyType(string strType)
             strType == "mkey" || strType == "ckey");
 }
 
+// How many transaction and key records are gathered before they are decoded
+static const unsigned int WALLET_LOAD_BATCH = 8192;
+
+/** A "tx", "key" or "wkey" record, read by the cursor and decoded on a worker thread */
+class CWalletLoadRecord
+{
+public:
+    CDataStream ssKey;
+    CDataStream ssValue;
+    string strType;
+
+    // tx: the mapWallet entry the record is decoded into
+    uint256 hash;
+    CWalletTx* pwtx;
+    bool fUpgrade;
+
+    // key, wkey
+    CPubKey vchPubKey;
+    CKey key;
+
+    bool fOK;
+    string strErr;
+
+    CWalletLoadRecord() : ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION),
+                          pwtx(NULL), fUpgrade(false), fOK(false)
+    {
+    }
+};
+
+static bool DecodeLoadRecord(vector<CWalletLoadRecord>& vRecords, size_t i)
+{
+    CWalletLoadRecord& rec = vRecords[i];
+    try {
+        if (rec.strType == "tx")
+            rec.fOK = DecodeTxRecord(rec.hash, rec.ssValue, *rec.pwtx, rec.fUpgrade, rec.strErr);
+        else
+            rec.fOK = DecodeKeyRecord(rec.strType, rec.ssKey, rec.ssValue, rec.vchPubKey, rec.key, rec.strErr);
+    } catch (...) {
+        rec.fOK = false;
+    }
+    return true;
+}
+
+static void NoteLoadFailure(const string& strType, DBErrors& result, bool& fNoncriticalErrors)
+{
+    // losing keys is considered a catastrophic error, anything else
+    // we assume the user can live with:
+    if (IsKeyType(strType))
+        result = DB_CORRUPT;
+    else
+    {
+        // Leave other errors alone, if we try to fix them we might make things worse.
+        fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
+        if (strType == "tx")
+            // Rescan if there is a bad transaction record:
+            SoftSetBoolArg("-rescan", true);
+    }
+}
+
+// Decode a batch of records on all cores, then add them to the wallet in
+// the order they were read
+static void LoadRecords(CWallet* pwallet, vector<CWalletLoadRecord>& vRecords, size_t nRecords,
+                        CWalletScanState& wss, DBErrors& result, bool& fNoncriticalErrors)
+{
+    ParallelFor(nRecords, 256, boost::bind(&DecodeLoadRecord, boost::ref(vRecords), _1));
+
+    for (size_t i = 0; i < nRecords; i++)
+    {
+        CWalletLoadRecord& rec = vRecords[i];
+        if (rec.fOK && rec.strType == "tx")
+        {
+            if (rec.fUpgrade)
+                wss.vWalletUpgrade.push_back(rec.hash);
+            if (rec.pwtx->nOrderPos == -1)
+                wss.fAnyUnordered = true;
+            pwallet->AddToWallet(*rec.pwtx, true);
+        }
+        else if (rec.fOK)
+        {
+            if (rec.strType == "key")
+                wss.nKeys++;
+            if (!pwallet->LoadKey(rec.key, rec.vchPubKey))
+            {
+                rec.strErr = "Error reading wallet database: LoadKey failed";
+                rec.fOK = false;
+            }
+        }
+        else if (rec.strType == "tx")
+            pwallet->mapWallet.erase(rec.hash);
+
+        if (!rec.fOK)
+            NoteLoadFailure(rec.strType, result, fNoncriticalErrors);
+        if (!rec.strErr.empty())
+            LogPrintf("%s\n", rec.strErr);
+
+        // Ready the slot for the next batch
+        rec.pwtx = NULL;
+        rec.fUpgrade = rec.fOK = false;
+        rec.key = CKey();
+        rec.strErr.clear();
+    }
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
@@ -653,11 +780,20 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
+        // Transactions and keys make up nearly all of a big wallet and are
+        // expensive to decode (hashing, signature checks on old keys): the
+        // cursor only gathers them, LoadRecords decodes them in parallel.
+        // Everything else is cheap and handled as it is read.
+        vector<CWalletLoadRecord> vRecords;
+        size_t nRecords = 0;
         while (true)
         {
             // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            if (nRecords == vRecords.size())
+                vRecords.push_back(CWalletLoadRecord());
+            CWalletLoadRecord& rec = vRecords[nRecords];
+            CDataStream& ssKey = rec.ssKey;
+            CDataStream& ssValue = rec.ssValue;
             int ret = ReadAtCursor(pcursor, ssKey, ssValue);
             if (ret == DB_NOTFOUND)
                 break;
@@ -667,27 +803,41 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
-            // Try to be tolerant of single corrupt records:
-            string strType, strErr;
-            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
+            string strType;
+            try {
+                CDataStream ssType(ssKey);
+                ssType >> strType;
+            } catch (...) {}
+            if (strType == "tx" || strType == "key" || strType == "wkey")
             {
-                // losing keys is considered a catastrophic error, anything else
-                // we assume the user can live with:
-                if (IsKeyType(strType))
-                    result = DB_CORRUPT;
-                else
-                {
-                    // Leave other errors alone, if we try to fix them we might make things worse.
-                    fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
+                try {
+                    ssKey >> rec.strType;
                     if (strType == "tx")
-                        // Rescan if there is a bad transaction record:
-                        SoftSetBoolArg("-rescan", true);
+                    {
+                        ssKey >> rec.hash;
+                        rec.pwtx = &pwallet->mapWallet[rec.hash];
+                    }
+                } catch (...) {
+                    NoteLoadFailure(strType, result, fNoncriticalErrors);
+                    continue;
+                }
+                if (++nRecords == WALLET_LOAD_BATCH)
+                {
+                    LoadRecords(pwallet, vRecords, nRecords, wss, result, fNoncriticalErrors);
+                    nRecords = 0;
                 }
+                continue;
             }
+
+            // Try to be tolerant of single corrupt records:
+            string strErr;
+            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
+                NoteLoadFailure(strType, result, fNoncriticalErrors);
             if (!strErr.empty())
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+        LoadRecords(pwallet, vRecords, nRecords, wss, result, fNoncriticalErrors);
     }
     catch (boost::thread_interrupted) {
         throw;
@@ -714,8 +864,11 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         pwallet->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
 
-    BOOST_FOREACH(uint256 hash, wss.vWalletUpgrade)
-        WriteTx(hash, pwallet->mapWallet[hash]);
+    // Records in an old format are rewritten by ThreadWalletPostLoad
+    {
+        LOCK(pwallet->cs_wallet);
+        pwallet->vWalletUpgrade.insert(pwallet->vWalletUpgrade.end(), wss.vWalletUpgrade.begin(), wss.vWalletUpgrade.end());
+    }
 
     // Rewrite encrypted wallets of versions 0.4.0 and 0.5.0rc:
     if (wss.fIsEncrypted && (wss.nFileVersion == 40000 || wss.nFileVersion == 50000))
@@ -736,6 +889,56 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     return result;
 }
 
+void ThreadWalletPostLoad(CWallet* pwallet)
+{
+    // Make this thread recognisable as the wallet post-load thread
+    RenameThread("Advantage-walletload");
+
+    int64_t nStart = GetTimeMillis();
+
+    // Write back transactions that were read in an old format
+    vector<uint256> vUpgrade;
+    {
+        LOCK(pwallet->cs_wallet);
+        vUpgrade.swap(pwallet->vWalletUpgrade);
+    }
+    if (!vUpgrade.empty())
+    {
+        CWalletDB walletdb(pwallet->strWalletFile);
+        BOOST_FOREACH(const uint256& hash, vUpgrade)
+        {
+            LOCK(pwallet->cs_wallet);
+            map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.find(hash);
+            if (mi != pwallet->mapWallet.end())
+                walletdb.WriteTx(hash, (*mi).second);
+        }
+    }
+
+    // Check the merkle branches of confirmed transactions now, a slice at a
+    // time, rather than all at once on the first balance query
+    vector<uint256> vHash;
+    {
+        LOCK(pwallet->cs_wallet);
+        vHash.reserve(pwallet->mapWallet.size());
+        for (map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.begin(); mi != pwallet->mapWallet.end(); ++mi)
+            vHash.push_back((*mi).first);
+    }
+    for (size_t i = 0; i < vHash.size(); i += 1000)
+    {
+        boost::this_thread::interruption_point();
+        LOCK2(cs_main, pwallet->cs_wallet);
+        for (size_t j = i; j < vHash.size() && j < i + 1000; j++)
+        {
+            map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.find(vHash[j]);
+            if (mi != pwallet->mapWallet.end())
+                (*mi).second.IsInMainChain();
+        }
+    }
+
+    LogPrint("db", "ThreadWalletPostLoad : %u records upgraded, %u transactions verified in %dms\n",
+        vUpgrade.size(), vHash.size(), GetTimeMillis() - nStart);
+}
+
 void ThreadFlushWalletDB(const string& strFile)
 {
     // Make this thread recognisable as the wallet flushing thread
@@ -157,4 +157,7 @@ public:
 
 bool BackupWallet(const CWallet& wallet, const std::string& strDest);
 
+/** Work LoadWallet leaves for after startup: rewriting upgraded records and merkle branch checks */
+void ThreadWalletPostLoad(CWallet* pwallet);
+
 #endif // BITCREDIT_WALLETDB_H